@@ -0,0 +1,206 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <cerrno>
+#include <sys/stat.h>
+
+#include "counter.hpp"
+#include "counter-file.hpp"
+
+/*
+ * Reader contention on Counter::snapshot().
+ *
+ * One writer plays the tap path (issuer increments and the SN) on emoney and
+ * rewrites every field of brizzi to the same value through Issuer::load(),
+ * while several readers take snapshots. A snapshot whose brizzi fields differ
+ * saw a write half done and is counted as torn; any torn snapshot fails the run.
+ * The same load runs against one mutex over a copy of the fields for reference.
+ * The writer also records its slowest write, the delay a tap can see.
+ */
+
+#define COUNTER_BENCH_SECONDS 2
+
+typedef std::chrono::duration<double> Seconds;
+
+/* the same fields behind a single mutex */
+class LockedCounter
+{
+private:
+    Counter::Snapshot values;
+    mutable std::mutex mutex;
+
+public:
+    LockedCounter() : values(), mutex() {}
+
+    void count(unsigned int amount)
+    {
+        std::lock_guard<std::mutex> guard(this->mutex);
+        this->values.emoney.tapInRegular++;
+        this->values.emoney.amount += amount;
+        this->values.emoney.pending++;
+        this->values.sn++;
+    }
+
+    void load(unsigned int value)
+    {
+        std::lock_guard<std::mutex> guard(this->mutex);
+        Counter::Snapshot::Issuer &issuer = this->values.brizzi;
+        issuer.tapInRegular = issuer.tapInEconomy = issuer.tapInFreeService = issuer.tapOut = issuer.sent = issuer.pending = value;
+        issuer.amount = value;
+    }
+
+    Counter::Snapshot snapshot() const
+    {
+        std::lock_guard<std::mutex> guard(this->mutex);
+        return this->values;
+    }
+};
+
+class Result
+{
+public:
+    double writes;
+    double snapshots;
+    double maxWriteUs;
+    unsigned long long torn;
+};
+
+static bool isTorn(const Counter::Snapshot::Issuer &issuer)
+{
+    return (issuer.tapInEconomy != issuer.tapInRegular ||
+            issuer.tapInFreeService != issuer.tapInRegular ||
+            issuer.tapOut != issuer.tapInRegular ||
+            issuer.sent != issuer.tapInRegular ||
+            issuer.pending != issuer.tapInRegular ||
+            issuer.amount != issuer.tapInRegular);
+}
+
+template <typename Write, typename Read>
+static Result run(std::size_t readers, Write write, Read read)
+{
+    std::atomic<bool> isRun(true);
+    std::atomic<unsigned long long> snapshots(0ULL);
+    std::atomic<unsigned long long> torn(0ULL);
+    unsigned long long writes = 0ULL;
+    double maxWriteUs = 0.0;
+
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < readers; i++)
+    {
+        threads.emplace_back(
+            [&]()
+            {
+                unsigned long long total = 0ULL;
+                unsigned long long broken = 0ULL;
+                while (isRun.load(std::memory_order_relaxed))
+                {
+                    Counter::Snapshot snapshot = read();
+                    if (isTorn(snapshot.brizzi))
+                        broken++;
+                    total++;
+                }
+                snapshots.fetch_add(total);
+                torn.fetch_add(broken);
+            });
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point end = start + std::chrono::seconds(COUNTER_BENCH_SECONDS);
+    while (std::chrono::steady_clock::now() < end)
+    {
+        for (int i = 0; i < 1000; i++)
+        {
+            std::chrono::steady_clock::time_point before = std::chrono::steady_clock::now();
+            write(static_cast<unsigned int>(++writes));
+            double writeUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - before).count();
+            if (writeUs > maxWriteUs)
+                maxWriteUs = writeUs;
+        }
+    }
+    Seconds elapsed = std::chrono::steady_clock::now() - start;
+    isRun = false;
+    for (std::thread &th : threads)
+    {
+        th.join();
+    }
+
+    Result result;
+    result.writes = static_cast<double>(writes) / elapsed.count();
+    result.snapshots = static_cast<double>(snapshots.load()) / elapsed.count();
+    result.maxWriteUs = maxWriteUs;
+    result.torn = torn.load();
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string path = (argc > 1) ? argv[1] : "ftv-counter-bench";
+    std::size_t maxReaders = (argc > 2) ? std::strtoul(argv[2], nullptr, 10) : 4;
+    if (mkdir(path.c_str(), 0777) != 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "command: %s [directory] [max readers]\n", argv[0]);
+        return 1;
+    }
+
+    Counter counter(path, Counter::createSNFile(path), path);
+    LockedCounter locked;
+    CounterFile::IssuerRecord record{};
+
+    printf("%-10s %8s %14s %14s %14s %8s\n", "counter", "readers", "writes/s", "snapshots/s", "max write us", "torn");
+    unsigned long long torn = 0ULL;
+    for (std::size_t readers = 0; readers <= maxReaders; readers = (readers == 0 ? 1 : readers * 2))
+    {
+        Result atomic = run(
+            readers,
+            [&counter, &record](unsigned int value)
+            {
+                if (value & 1U)
+                {
+                    Counter::Issuer &emoney = counter.getEmoney();
+                    emoney.incTapInRegular();
+                    emoney.incAmount(3500);
+                    emoney.incPending();
+                    counter.incSN();
+                }
+                else
+                {
+                    record.tapInRegular = record.tapInEconomy = record.tapInFreeService = record.tapOut = record.sent = record.pending = value;
+                    record.amount = value;
+                    counter.getBrizzi().load(record);
+                }
+            },
+            [&counter]()
+            {
+                return counter.snapshot();
+            });
+        printf("%-10s %8zu %14.0f %14.0f %14.1f %8llu\n", "seqlock", readers, atomic.writes, atomic.snapshots, atomic.maxWriteUs, atomic.torn);
+        torn += atomic.torn;
+
+        Result mutex = run(
+            readers,
+            [&locked](unsigned int value)
+            {
+                if (value & 1U)
+                    locked.count(3500);
+                else
+                    locked.load(value);
+            },
+            [&locked]()
+            {
+                return locked.snapshot();
+            });
+        printf("%-10s %8zu %14.0f %14.0f %14.1f %8llu\n", "mutex", readers, mutex.writes, mutex.snapshots, mutex.maxWriteUs, mutex.torn);
+    }
+
+    if (torn > 0ULL)
+    {
+        fprintf(stderr, "\n%llu torn snapshot(s)\n", torn);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,295 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <algorithm>
+#include <ctime>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "intent-journal.hpp"
+#include "transaction-store.hpp"
+#include "transaction-shards.hpp"
+#include "tscdata/include/transaction-data.hpp"
+
+/*
+ * Cost and crash behaviour of IntentJournal, under the given directory.
+ *
+ * The first part times what a deduct pays: begin(), which returns with its
+ * entry synced before the card is debited, deducted() and complete(). The
+ * check then lets a child process append intents in every state and kill
+ * itself; the parent must recover exactly the open ones, ignore an entry
+ * torn afterwards and find a record committed for an intent through
+ * TransactionStore::isApplied(). The ring is then filled past an open intent,
+ * which must survive, and filled with open intents only, where begin() must
+ * refuse and complete() still close one.
+ * Any failure fails the run.
+ */
+
+#define JOURNAL_BENCH_CRASH_INTENTS 64
+
+typedef std::chrono::duration<double, std::micro> Micros;
+
+static void printTimes(const char *caption, std::vector<double> &times)
+{
+    std::sort(times.begin(), times.end());
+    double total = 0.0;
+    for (double time : times)
+    {
+        total += time;
+    }
+    printf("%-24s %8zu %10.1f %10.1f %10.1f\n",
+           caption,
+           times.size(),
+           total / static_cast<double>(times.size()),
+           times[times.size() / 2],
+           times[std::min(times.size() - 1, times.size() * 99 / 100)]);
+}
+
+static IntentJournal::Intent makeIntent(int i)
+{
+    IntentJournal::Intent intent{};
+    intent.cardNumber = 6032984000000000ULL + static_cast<uint64_t>(i);
+    intent.time = static_cast<int64_t>(std::time(nullptr));
+    intent.amount = 3500U;
+    intent.isTapIn = 1;
+    IntentJournal::copy(intent.uuid, sizeof(intent.uuid), "journal-bench-" + std::to_string(i));
+    IntentJournal::copy(intent.transcode, sizeof(intent.transcode), std::string(128, 'A'));
+    return intent;
+}
+
+/* the state every intent of the crash check is left in, absent once closed */
+static std::map<std::string, IntentJournal::State> expectedStates(int count)
+{
+    std::map<std::string, IntentJournal::State> result;
+    for (int i = 0; i < count; i++)
+    {
+        if (i % 3 == 0)
+            result["journal-bench-" + std::to_string(i)] = IntentJournal::State::PENDING;
+        else if (i % 3 == 1)
+            result["journal-bench-" + std::to_string(i)] = IntentJournal::State::DEDUCTED;
+    }
+    return result;
+}
+
+static std::map<std::string, IntentJournal::State> recoverStates(const std::string &path)
+{
+    std::map<std::string, IntentJournal::State> result;
+    IntentJournal journal(path);
+    if (journal.open() == false)
+        return result;
+    journal.recover(
+        [&result](IntentJournal::State state, const IntentJournal::Intent &intent)
+        {
+            result[intent.uuid] = state;
+            /* left open, the file is read again after the tear */
+            return false;
+        });
+    journal.close();
+    return result;
+}
+
+static bool timing(const std::string &path, int rounds)
+{
+    unlink(path.c_str());
+    IntentJournal journal(path);
+    if (journal.open() == false)
+        return false;
+
+    std::vector<double> beginTimes;
+    std::vector<double> deductedTimes;
+    std::vector<double> completeTimes;
+    bool result = true;
+    for (int i = 0; i < rounds; i++)
+    {
+        IntentJournal::Intent intent = makeIntent(i);
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        uint64_t id = journal.begin(intent);
+        std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+        result = journal.deducted(id, intent) && result;
+        std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+        result = journal.complete(id) && result;
+        std::chrono::steady_clock::time_point t3 = std::chrono::steady_clock::now();
+        beginTimes.push_back(Micros(t1 - t0).count());
+        deductedTimes.push_back(Micros(t2 - t1).count());
+        completeTimes.push_back(Micros(t3 - t2).count());
+    }
+    journal.close();
+
+    printf("%-24s %8s %10s %10s %10s\n", "journal", "runs", "mean us", "p50 us", "p99 us");
+    printTimes("begin, entry synced", beginTimes);
+    printTimes("deducted", deductedTimes);
+    printTimes("complete", completeTimes);
+    if (result == false)
+        fprintf(stderr, "an intent was not journaled\n");
+    return result;
+}
+
+static bool crash(const std::string &path)
+{
+    unlink(path.c_str());
+    pid_t child = fork();
+    if (child < 0)
+        return false;
+    if (child == 0)
+    {
+        IntentJournal journal(path);
+        if (journal.open() == false)
+            _exit(1);
+        for (int i = 0; i < JOURNAL_BENCH_CRASH_INTENTS; i++)
+        {
+            IntentJournal::Intent intent = makeIntent(i);
+            uint64_t id = journal.begin(intent);
+            if (i % 3 != 0)
+                journal.deducted(id, intent);
+            if (i % 3 == 2)
+                journal.complete(id);
+        }
+        /* no close, no flush: the process dies with the appends in the mapping */
+        kill(getpid(), SIGKILL);
+        _exit(1);
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    if (WIFSIGNALED(status) == false || WTERMSIG(status) != SIGKILL)
+    {
+        fprintf(stderr, "journal writer did not run\n");
+        return false;
+    }
+
+    std::map<std::string, IntentJournal::State> expected = expectedStates(JOURNAL_BENCH_CRASH_INTENTS);
+    std::map<std::string, IntentJournal::State> recovered = recoverStates(path);
+    printf("\nkilled writer  : %zu open intent(s) expected, %zu recovered\n", expected.size(), recovered.size());
+    if (recovered != expected)
+        return false;
+
+    /* the last append is the PENDING entry of the last intent, tear its payload */
+    struct stat st{};
+    if (stat(path.c_str(), &st) != 0)
+        return false;
+    const std::size_t entrySize = static_cast<std::size_t>(st.st_size) / IntentJournal::CAPACITY;
+    uint64_t appends = 0;
+    for (int i = 0; i < JOURNAL_BENCH_CRASH_INTENTS; i++)
+    {
+        appends += static_cast<uint64_t>(1 + (i % 3));
+    }
+    const off_t offset = static_cast<off_t>((appends % IntentJournal::CAPACITY) * entrySize + entrySize / 2);
+    int fd = open(path.c_str(), O_RDWR);
+    unsigned char byte = 0;
+    bool isTorn = (fd >= 0 && pread(fd, &byte, 1, offset) == 1);
+    byte ^= 0xFF;
+    isTorn = isTorn && pwrite(fd, &byte, 1, offset) == 1;
+    if (fd >= 0)
+        close(fd);
+    if (isTorn == false)
+        return false;
+
+    expected.erase("journal-bench-" + std::to_string(JOURNAL_BENCH_CRASH_INTENTS - 1));
+    recovered = recoverStates(path);
+    printf("torn entry     : %zu open intent(s) expected, %zu recovered\n", expected.size(), recovered.size());
+    return (recovered == expected);
+}
+
+static bool wrap(const std::string &path)
+{
+    unlink(path.c_str());
+    IntentJournal journal(path);
+    if (journal.open() == false)
+        return false;
+
+    /* one tap left open, then the ring goes around twice */
+    IntentJournal::Intent open = makeIntent(0);
+    bool result = (journal.begin(open) != 0ULL);
+    for (std::size_t i = 1; i <= 2 * IntentJournal::CAPACITY + 1; i++)
+    {
+        IntentJournal::Intent intent = makeIntent(static_cast<int>(i));
+        uint64_t id = journal.begin(intent);
+        result = id && journal.deducted(id, intent) && journal.complete(id) && result;
+    }
+    journal.close();
+
+    std::map<std::string, IntentJournal::State> expected;
+    expected["journal-bench-0"] = IntentJournal::State::PENDING;
+    std::map<std::string, IntentJournal::State> recovered = recoverStates(path);
+    printf("wrapped ring   : %zu open intent(s) expected, %zu recovered\n", expected.size(), recovered.size());
+    result = (recovered == expected) && result;
+
+    /* every slot open: no more intents, a commit still closes one and frees its slot */
+    unlink(path.c_str());
+    if (journal.open() == false)
+        return false;
+    std::vector<uint64_t> ids;
+    for (std::size_t i = 0; i < IntentJournal::CAPACITY; i++)
+    {
+        ids.push_back(journal.begin(makeIntent(static_cast<int>(i))));
+    }
+    const bool isFilled = (std::count(ids.begin(), ids.end(), 0ULL) == 0);
+    const bool isRefused = (journal.begin(makeIntent(-1)) == 0ULL);
+    const bool isClosed = journal.complete(ids.front());
+    const bool isReused = (journal.begin(makeIntent(-2)) != 0ULL);
+    journal.close();
+
+    recovered = recoverStates(path);
+    const bool isRecovered = (recovered.size() == IntentJournal::CAPACITY &&
+                              recovered.count("journal-bench-0") == 0 &&
+                              recovered.count("journal-bench--2") == 1);
+    printf("full ring      : filled %d, refused %d, closed %d, reused %d, %zu open intent(s) recovered\n", isFilled, isRefused, isClosed, isReused, recovered.size());
+    return (result && isFilled && isRefused && isClosed && isReused && isRecovered);
+}
+
+static bool applied(const std::string &directory)
+{
+    TransactionShards shards(directory);
+    TransactionStore store(shards);
+    if (store.open() == false)
+        return false;
+
+    const std::time_t now = std::time(nullptr);
+    const std::string uuid = "journal-bench-applied-" + std::to_string(static_cast<long long>(now));
+    TransactionData tsc(true);
+    tsc.setUUID(uuid);
+    tsc.setTransactionTime(now);
+    tsc.setTransactionStoredTime(now);
+    tsc.setStatus("S");
+    TransactionStore::UploadTag tag;
+    tag.intent = uuid;
+    bool isInserted = store.insert(tsc, tag);
+    bool isDurable = store.isDurable();
+    store.close();
+
+    bool isFound = store.isApplied(uuid, now);
+    bool isOtherFound = store.isApplied(uuid + "-missing", now);
+    printf("applied intent : inserted %d, durable %d, found %d, unknown found %d\n", isInserted, isDurable, isFound, isOtherFound);
+    return (isInserted && isDurable && isFound && isOtherFound == false);
+}
+
+int main(int argc, char *argv[])
+{
+    std::string directory = (argc > 1) ? argv[1] : "ftv-journal-bench";
+    int rounds = (argc > 2) ? std::atoi(argv[2]) : 2000;
+    if (rounds <= 0)
+    {
+        fprintf(stderr, "command: %s [directory] [rounds]\n", argv[0]);
+        return 1;
+    }
+    struct stat st{};
+    if (stat(directory.c_str(), &st) != 0 && mkdir(directory.c_str(), 0777) != 0)
+    {
+        fprintf(stderr, "create %s failed\n", directory.c_str());
+        return 1;
+    }
+
+    const std::string path = directory + "/intent.journal";
+    bool result = timing(path, rounds);
+    result = crash(path) && result;
+    result = wrap(path) && result;
+    result = applied(directory + "/transaction") && result;
+    printf("\n%s\n", result ? "ok" : "FAILED");
+    return result ? 0 : 1;
+}
@@ -0,0 +1,472 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <array>
+#include <thread>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <algorithm>
+#include <random>
+#include <fstream>
+#include <sstream>
+#include <atomic>
+#include <new>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+#include "controller.hpp"
+#include "simulated-card-reader.hpp"
+#include "poll-scheduler.hpp"
+#include "latency-stats.hpp"
+#include "async-log.hpp"
+#include "gui-state.hpp"
+#include "gui/include/gui.hpp"
+#include "workflow/include/workflow-manager.hpp"
+
+#include "utils/include/debug.hpp"
+
+/*
+ * Replays a tap trace through Controller with the simulated card reader.
+ *
+ * trace line: <card number> <issuer> <balance> <inter-arrival ms> <user data, 128 hex chars>
+ * issuer    : mandiri | bri | bni | bca | dki
+ * empty lines and lines starting with '#' are ignored
+ */
+
+/*
+ * Heap allocations of every thread but the driver, the driver only feeds the
+ * simulated reader and must not show up in the per tap numbers.
+ */
+static std::atomic<unsigned long long> allocations(0ULL);
+static thread_local bool isAllocationIgnored = false;
+
+static void *allocate(std::size_t size)
+{
+    if (isAllocationIgnored == false)
+        allocations.fetch_add(1ULL, std::memory_order_relaxed);
+    void *ptr = std::malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void *operator new(std::size_t size)
+{
+    return allocate(size);
+}
+
+void *operator new[](std::size_t size)
+{
+    return allocate(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+class TraceEntry
+{
+public:
+    unsigned long long cardNumber;
+    Card::cardType_t type;
+    int balance;
+    unsigned int interArrivalMs;
+    std::array<unsigned char, 64> userData;
+
+    TraceEntry() : cardNumber(0ULL),
+                   type(Card::CARD_TYPE_MANDIRI),
+                   balance(0),
+                   interArrivalMs(0U),
+                   userData()
+    {
+    }
+};
+
+static bool parseIssuer(const std::string &name, Card::cardType_t &type)
+{
+    static const std::pair<const char *, Card::cardType_t> issuers[] = {
+        {"mandiri", Card::CARD_TYPE_MANDIRI},
+        {"bri", Card::CARD_TYPE_BRI},
+        {"bni", Card::CARD_TYPE_BNI},
+        {"bca", Card::CARD_TYPE_BCA},
+        {"dki", Card::CARD_TYPE_DKI}};
+    for (const std::pair<const char *, Card::cardType_t> &issuer : issuers)
+    {
+        if (name == issuer.first)
+        {
+            type = issuer.second;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parseHex(const std::string &hex, std::array<unsigned char, 64> &out)
+{
+    if (hex.length() != out.size() * 2)
+        return false;
+    for (std::size_t i = 0; i < out.size(); i++)
+    {
+        unsigned int value = 0;
+        if (sscanf(hex.c_str() + i * 2, "%2x", &value) != 1)
+            return false;
+        out[i] = static_cast<unsigned char>(value);
+    }
+    return true;
+}
+
+static bool loadTrace(const std::string &path, std::vector<TraceEntry> &trace)
+{
+    std::ifstream file(path);
+    if (!file.is_open())
+    {
+        Debug::error(__FILE__, __LINE__, __func__, "failed to open \"%s\"\n", path.c_str());
+        return false;
+    }
+
+    std::string line;
+    std::size_t lineNumber = 0;
+    while (std::getline(file, line))
+    {
+        lineNumber++;
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        std::istringstream iss(line);
+        std::string issuer;
+        std::string hex;
+        TraceEntry entry;
+        if (!(iss >> entry.cardNumber >> issuer >> entry.balance >> entry.interArrivalMs >> hex) ||
+            parseIssuer(issuer, entry.type) == false ||
+            parseHex(hex, entry.userData) == false)
+        {
+            Debug::error(__FILE__, __LINE__, __func__, "%s:%zu: invalid trace entry\n", path.c_str(), lineNumber);
+            return false;
+        }
+        trace.push_back(entry);
+    }
+    return true;
+}
+
+static void synthesize(std::size_t count, std::size_t cards, unsigned int interArrivalMs, std::vector<TraceEntry> &trace)
+{
+    static const Card::cardType_t types[] = {Card::CARD_TYPE_MANDIRI, Card::CARD_TYPE_BRI, Card::CARD_TYPE_BNI, Card::CARD_TYPE_BCA, Card::CARD_TYPE_DKI};
+    std::mt19937 rng(5489U);
+    std::uniform_int_distribution<std::size_t> pick(0, (cards > 0 ? cards : 1) - 1);
+    for (std::size_t i = 0; i < count; i++)
+    {
+        TraceEntry entry;
+        std::size_t card = pick(rng);
+        entry.cardNumber = 6032000000000000ULL + card;
+        entry.type = types[card % (sizeof(types) / sizeof(types[0]))];
+        entry.balance = 100000;
+        entry.interArrivalMs = interArrivalMs;
+        /* blank user data, the workflow sees a card without trip history */
+        trace.push_back(entry);
+    }
+}
+
+static unsigned long long directorySize(const std::string &path)
+{
+    DIR *dir = opendir(path.c_str());
+    if (dir == nullptr)
+        return 0ULL;
+
+    unsigned long long total = 0ULL;
+    struct dirent *entry = nullptr;
+    while ((entry = readdir(dir)) != nullptr)
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        std::string child = path + "/" + entry->d_name;
+        struct stat st;
+        if (stat(child.c_str(), &st) != 0)
+            continue;
+        if (S_ISDIR(st.st_mode))
+            total += directorySize(child);
+        else
+            total += static_cast<unsigned long long>(st.st_size);
+    }
+    closedir(dir);
+    return total;
+}
+
+/* user plus system time of every thread of the process, log formatting included */
+static double processCpuSeconds()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0.0;
+    return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+           static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000000.0;
+}
+
+/* bytes this process pushed to the storage layer, includes log files */
+static unsigned long long processWriteBytes()
+{
+    std::ifstream file("/proc/self/io");
+    std::string key;
+    unsigned long long value = 0ULL;
+    while (file >> key >> value)
+    {
+        if (key == "write_bytes:")
+            return value;
+    }
+    return 0ULL;
+}
+
+static unsigned long long completedTaps(const LatencyStats &stats)
+{
+    return stats.summary(LatencyStats::stageIndex(Duration::Stage::TOTAL), LatencyStats::ISSUER_ALL).count;
+}
+
+class StorageUsage
+{
+public:
+    unsigned long long database;
+    unsigned long long counter;
+    unsigned long long process;
+
+    StorageUsage() : database(directorySize(TRANSACTION_DATA_DIRECTORY)),
+                     counter(directorySize(COUNTER_DATA_DIRECTORY)),
+                     process(processWriteBytes())
+    {
+    }
+};
+
+static long long delta(unsigned long long after, unsigned long long before)
+{
+    return static_cast<long long>(after) - static_cast<long long>(before);
+}
+
+static void usage(const char *name)
+{
+    Debug::error(__FILE__, __LINE__, __func__,
+                 "command: %s <provision.json> (--trace <file> | --synthetic <taps>) [--cards <n>] [--gap <ms>] [--time-scale <x>] [--group-window <ms>] [--group-max <n>]\n",
+                 name);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 4)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::string provisionPath = argv[1];
+    std::string tracePath;
+    std::size_t syntheticTaps = 0;
+    std::size_t syntheticCards = 500;
+    unsigned int gapMs = 0U;
+    double timeScale = 1.0;
+    long long groupWindowMs = -1;
+    long long groupMax = -1;
+    for (int i = 2; i + 1 < argc; i += 2)
+    {
+        std::string key = argv[i];
+        if (key == "--trace")
+            tracePath = argv[i + 1];
+        else if (key == "--synthetic")
+            syntheticTaps = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (key == "--cards")
+            syntheticCards = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (key == "--gap")
+            gapMs = static_cast<unsigned int>(std::strtoul(argv[i + 1], nullptr, 10));
+        else if (key == "--time-scale")
+            timeScale = std::strtod(argv[i + 1], nullptr);
+        else if (key == "--group-window")
+            groupWindowMs = std::strtoll(argv[i + 1], nullptr, 10);
+        else if (key == "--group-max")
+            groupMax = std::strtoll(argv[i + 1], nullptr, 10);
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<TraceEntry> trace;
+    if (tracePath.length() > 0)
+    {
+        if (loadTrace(tracePath, trace) == false)
+            return 1;
+    }
+    else
+    {
+        synthesize(syntheticTaps, syntheticCards, gapMs, trace);
+    }
+    if (trace.empty())
+    {
+        Debug::error(__FILE__, __LINE__, __func__, "nothing to replay\n");
+        return 1;
+    }
+
+    AsyncLog::begin();
+
+    Gui gui;
+    WorkflowManager workflow;
+    if (workflow.loadProvision(provisionPath.c_str()) == false)
+    {
+        Debug::critical(__FILE__, __LINE__, __func__, "invalid provision data: %s\n", provisionPath.c_str());
+        return 1;
+    }
+
+    SimulatedCardReader reader;
+    reader.setTimeScale(timeScale);
+
+    Controller controller(reader, workflow, gui);
+    controller.setPollScheduler(std::unique_ptr<PollScheduler>(new FixedPollScheduler(std::chrono::milliseconds(1))));
+    controller.setDisplayHold(std::chrono::milliseconds(0), std::chrono::milliseconds(0));
+    /* --group-max 1 is the one insert per transaction path */
+    if (groupWindowMs >= 0 || groupMax >= 0)
+        controller.setGroupCommit(std::chrono::milliseconds(groupWindowMs >= 0 ? groupWindowMs : TRANSACTION_GROUP_COMMIT_WINDOW_MS),
+                                  static_cast<std::size_t>(groupMax >= 0 ? groupMax : TRANSACTION_GROUP_COMMIT_MAX_RECORDS));
+
+    std::shared_ptr<std::promise<void>> ready(new std::promise<void>());
+    std::future<void> isReady = ready->get_future();
+
+    controller.begin(
+        [&controller, ready](CardReader &reader, WorkflowManager &workflow, GuiState &view)
+        {
+            static const Card::cardType_t types[] = {Card::CARD_TYPE_MANDIRI, Card::CARD_TYPE_BRI, Card::CARD_TYPE_BNI, Card::CARD_TYPE_BCA, Card::CARD_TYPE_DKI};
+            for (const Card::cardType_t type : types)
+            {
+                controller.initIssuer(
+                    type, LatencyStats::issuerName(LatencyStats::issuerIndex(type)),
+                    []()
+                    { return true; });
+            }
+            while (controller.getPendingIssuers() > 0)
+                controller.waitAnyIssuerReady();
+            view.setTariff(1, "Tarif", true);
+            ready->set_value();
+        });
+
+    std::thread driver(
+        [&]()
+        {
+            isAllocationIgnored = true;
+            isReady.wait();
+
+            StorageUsage before;
+            std::size_t dropped = 0;
+            /* the first taps fill the pools and caches, steady state is counted after them */
+            const std::size_t warmup = std::min<std::size_t>(trace.size() / 10, 100);
+            unsigned long long allocationsStart = allocations.load(std::memory_order_relaxed);
+            unsigned long long allocationsSteady = allocationsStart;
+            unsigned long long completedWarmup = 0ULL;
+            std::size_t replayed = 0;
+            double cpuStart = processCpuSeconds();
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            for (const TraceEntry &entry : trace)
+            {
+                if (replayed++ == warmup)
+                {
+                    allocationsSteady = allocations.load(std::memory_order_relaxed);
+                    completedWarmup = completedTaps(controller.getLatencyStats());
+                }
+
+                SimulatedCardReader::SimulatedCard card;
+                card.cardNumber = entry.cardNumber;
+                card.type = entry.type;
+                card.balance = entry.balance;
+                card.userData = entry.userData;
+                reader.addCard(card);
+
+                unsigned long long done = completedTaps(controller.getLatencyStats());
+                reader.present(entry.cardNumber);
+                std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+                while (completedTaps(controller.getLatencyStats()) == done)
+                {
+                    if (std::chrono::steady_clock::now() >= deadline)
+                    {
+                        dropped++;
+                        break;
+                    }
+                    std::this_thread::sleep_for(std::chrono::microseconds(200));
+                }
+                reader.remove();
+
+                /* give the controller a few polls to see the card leave */
+                std::chrono::milliseconds gap(static_cast<long long>(entry.interArrivalMs * timeScale));
+                std::this_thread::sleep_for(std::max(gap, std::chrono::milliseconds(5)));
+            }
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            unsigned long long allocationsEnd = allocations.load(std::memory_order_relaxed);
+
+            /* stop drains the persistence queue, storage numbers include every record */
+            controller.stop();
+            AsyncLog::stop();
+            double cpu = processCpuSeconds() - cpuStart;
+            StorageUsage after;
+
+            const LatencyStats &stats = controller.getLatencyStats();
+            unsigned long long completed = completedTaps(stats);
+
+            printf("\n== replay summary ==\n");
+            printf("taps       : %zu replayed, %llu completed, %zu dropped\n", trace.size(), completed, dropped);
+            printf("elapsed    : %.3f s\n", elapsed.count());
+            printf("throughput : %.1f taps/min\n", elapsed.count() > 0.0 ? static_cast<double>(completed) * 60.0 / elapsed.count() : 0.0);
+            printf("\n%-48s %8s %9s %9s %9s %9s\n", "stage (all issuers)", "count", "p50 ms", "p95 ms", "p99 ms", "max ms");
+            for (std::size_t i = 0; i < stats.getStageCount(); i++)
+            {
+                LatencyHistogram::Summary s = stats.summary(i, LatencyStats::ISSUER_ALL);
+                if (s.count == 0ULL)
+                    continue;
+                printf("%-48s %8llu %9.3f %9.3f %9.3f %9.3f\n", stats.getStage(i).c_str(), s.count, s.p50Ms, s.p95Ms, s.p99Ms, s.maxMs);
+            }
+            printf("\nstorage growth\n");
+            printf("transaction shards : %lld bytes\n", delta(after.database, before.database));
+            printf("counter files      : %lld bytes\n", delta(after.counter, before.counter));
+            printf("process write_bytes: %lld bytes\n", delta(after.process, before.process));
+            if (completed > 0ULL)
+                printf("per tap            : %.1f bytes\n", static_cast<double>(delta(after.process, before.process)) / static_cast<double>(completed));
+            PersistenceWorker::Stats persistence = controller.getPersistenceStats();
+            printf("\npersistence (push to commit)\n");
+            printf("commits            : %llu for %llu record(s), max group %zu\n", persistence.commits, persistence.records, persistence.maxGroup);
+            if (elapsed.count() > 0.0)
+                printf("commits/s          : %.1f\n", static_cast<double>(persistence.commits) / elapsed.count());
+            if (persistence.records > 0ULL)
+                printf("record latency     : %.3f ms mean, %.3f ms max\n", persistence.totalLatencyMs / static_cast<double>(persistence.records), persistence.maxLatencyMs);
+            printf("\nprocess cpu (all threads, log formatting included)\n");
+            printf("total              : %.3f s\n", cpu);
+            if (completed > 0ULL)
+                printf("per tap            : %.1f us\n", cpu * 1000000.0 / static_cast<double>(completed));
+            printf("\nheap allocations (all threads but the driver)\n");
+            printf("total              : %llu\n", allocationsEnd - allocationsStart);
+            if (completed > 0ULL)
+                printf("per tap            : %.2f\n", static_cast<double>(allocationsEnd - allocationsStart) / static_cast<double>(completed));
+            if (completed > completedWarmup)
+                printf("per tap, steady    : %.2f (after %llu warm-up taps)\n",
+                       static_cast<double>(allocationsEnd - allocationsSteady) / static_cast<double>(completed - completedWarmup),
+                       completedWarmup);
+            fflush(stdout);
+
+            std::exit(dropped > 0 ? 2 : 0);
+        });
+    driver.detach();
+
+    gui.begin(argc, argv);
+    return 0;
+}
@@ -0,0 +1,405 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <memory>
+#include <ctime>
+#include <sys/stat.h>
+
+#include "transaction-store.hpp"
+#include "transaction-shards.hpp"
+#include "counter.hpp"
+#include "sqlite3.h"
+#include "tscdata/include/transaction-data.hpp"
+#include "tscdata/include/sqlite3-transaction.hpp"
+
+/*
+ * Measures the upload queries of TransactionStore on a large transaction.db.
+ *
+ * The database is built once at the given path (5M records by default, spread
+ * over half a year of cycles) and reused by later runs. The first part prints
+ * the query plans and fails when one of them scans a table; the second part
+ * times the queries the uploader and the counter reconciliation run, against a
+ * full scan of the outbox for reference.
+ *
+ * The last part times TransactionStore::insert() on the shard of today under
+ * <database>.shards, grown to 1M records by default, next to the connection
+ * per tap the controller used before the store kept it open.
+ *
+ * Timings quoted for this bench were taken off target, on an x86_64 host
+ * (g++ 12, -O3, system SQLite 3.40.1, ext4), built without CMake since the
+ * vendor libraries only exist for the board:
+ *   g++ -std=gnu++14 -O3 -Iinclude -I<stand-ins> -D__TRANSJAKARTA \
+ *       bench/store-bench.cpp <SOURCE_FILES> -lsqlite3 -llzma -lcurl -lpthread
+ * where <stand-ins> holds header-only replacements of utils/ and tscdata/; the
+ * Sqlite3Transaction one inserts a row as wide as the real log table with one
+ * prepared autocommit INSERT. The query part runs on SQLite alone and should
+ * carry over, the insert part depends on that replacement and does not.
+ */
+
+#define STORE_BENCH_DAYS 180
+#define STORE_BENCH_BATCH 50
+#define STORE_BENCH_ROUNDS 400
+#define STORE_BENCH_CYCLE_0 1735664400 /* 2025-01-01 00:00 WIB */
+#define STORE_BENCH_INSERTS 2000
+#define STORE_BENCH_REOPENS 200
+
+static const char *SOURCE_SQL = "SELECT * FROM bench_log WHERE rowid = ?;";
+
+typedef std::chrono::duration<double, std::micro> Micros;
+
+static bool exec(sqlite3 *db, const char *sql)
+{
+    char *err = nullptr;
+    if (sqlite3_exec(db, sql, nullptr, nullptr, &err) != SQLITE_OK)
+    {
+        fprintf(stderr, "%s: %s\n", sql, err ? err : "unknown error");
+        sqlite3_free(err);
+        return false;
+    }
+    return true;
+}
+
+static long long scalar(sqlite3 *db, const char *sql)
+{
+    sqlite3_stmt *stmt = nullptr;
+    long long value = -1;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW)
+        value = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    return value;
+}
+
+static bool populate(sqlite3 *db, long long rows)
+{
+    if (exec(db, "CREATE TABLE IF NOT EXISTS bench_log (uuid TEXT, time INTEGER, fare INTEGER, balance INTEGER, card TEXT);") == false ||
+        TransactionStore::createOutbox(db) == false)
+        return false;
+
+    long long existing = scalar(db, "SELECT COUNT(*) FROM upload_outbox;");
+    if (existing >= rows)
+        return true;
+
+    sqlite3_stmt *log = nullptr;
+    sqlite3_stmt *outbox = nullptr;
+    sqlite3_prepare_v2(db, "INSERT INTO bench_log VALUES (?, ?, ?, ?, ?);", -1, &log, nullptr);
+    sqlite3_prepare_v2(db, "INSERT INTO upload_outbox (source, source_rowid, counted, ctype, cycle) VALUES ('bench_log', ?, 1, ?, ?);", -1, &outbox, nullptr);
+
+    const long long perDay = rows / STORE_BENCH_DAYS + 1;
+    char uuid[40];
+    printf("populating %lld record(s)...\n", rows - existing);
+    exec(db, "BEGIN;");
+    for (long long i = existing; i < rows; i++)
+    {
+        const long long day = i / perDay;
+        const long long time = STORE_BENCH_CYCLE_0 + day * 86400 + (i % perDay) * 86400 / perDay;
+        snprintf(uuid, sizeof(uuid), "0190a3b2-0000-7000-8000-%012llx", i);
+        sqlite3_bind_text(log, 1, uuid, -1, SQLITE_STATIC);
+        sqlite3_bind_int64(log, 2, time);
+        sqlite3_bind_int(log, 3, 3500);
+        sqlite3_bind_int(log, 4, 100000 - static_cast<int>(i % 90000));
+        sqlite3_bind_text(log, 5, "6032984000000000", -1, SQLITE_STATIC);
+        sqlite3_step(log);
+        sqlite3_reset(log);
+
+        sqlite3_bind_int64(outbox, 1, sqlite3_last_insert_rowid(db));
+        sqlite3_bind_int(outbox, 2, static_cast<int>(i % 5));
+        sqlite3_bind_int64(outbox, 3, STORE_BENCH_CYCLE_0 + day * 86400);
+        sqlite3_step(outbox);
+        sqlite3_reset(outbox);
+
+        if ((i + 1) % 100000 == 0)
+        {
+            exec(db, "COMMIT; BEGIN;");
+            printf("\r%lld", i + 1);
+            fflush(stdout);
+        }
+    }
+    exec(db, "COMMIT;");
+    printf("\n");
+    sqlite3_finalize(log);
+    sqlite3_finalize(outbox);
+    return exec(db, "ANALYZE;");
+}
+
+static bool explain(sqlite3 *db, const char *name, const char *sql)
+{
+    std::string query = std::string("EXPLAIN QUERY PLAN ") + sql;
+    sqlite3_stmt *stmt = nullptr;
+    if (sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+    {
+        fprintf(stderr, "%s: %s\n", name, sqlite3_errmsg(db));
+        return false;
+    }
+    bool isIndexed = true;
+    printf("%s\n", name);
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        const char *detail = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 3));
+        printf("  %s\n", detail);
+        if (strncmp(detail, "SCAN", 4) == 0)
+            isIndexed = false;
+    }
+    sqlite3_finalize(stmt);
+    return isIndexed;
+}
+
+static void report(const char *name, std::vector<double> &samples)
+{
+    if (samples.empty())
+        return;
+    std::sort(samples.begin(), samples.end());
+    double total = 0.0;
+    for (double sample : samples)
+    {
+        total += sample;
+    }
+    printf("%-28s %8zu %10.1f %10.1f %10.1f\n",
+           name,
+           samples.size(),
+           total / static_cast<double>(samples.size()),
+           samples[samples.size() / 2],
+           samples[std::min(samples.size() - 1, samples.size() * 99 / 100)]);
+}
+
+static void fill(TransactionData &tsc, long long i)
+{
+    char uuid[40];
+    snprintf(uuid, sizeof(uuid), "0190a3b2-0000-7000-8000-%012llx", i);
+    const std::time_t now = std::time(nullptr);
+    tsc.setIntegratorId(1);
+    tsc.setMinimumBalance(3500);
+    tsc.setBalanceBeforeTransaction(100000 - static_cast<int>(i % 90000));
+    tsc.setNormalFare(3500);
+    tsc.setFare(3500);
+    tsc.setBalanceAfterTransaction(96500 - static_cast<int>(i % 90000));
+    tsc.setProcessingTimeMs(300);
+    tsc.setCoordinates(0.0, 0.0);
+    tsc.setTransactionTime(now);
+    tsc.setTransactionStoredTime(now);
+    tsc.setUUID(uuid);
+    tsc.setMID("0000000000000000");
+    tsc.setTID("00000000");
+    tsc.setTranscode(std::string(128, 'A'));
+    tsc.setStatus("S");
+    tsc.setDescription("S");
+}
+
+static bool insertLatency(const std::string &directory, long long rows)
+{
+    struct stat st{};
+    if (stat(directory.c_str(), &st) != 0 && mkdir(directory.c_str(), 0777) != 0)
+    {
+        fprintf(stderr, "create %s failed\n", directory.c_str());
+        return false;
+    }
+
+    TransactionShards shards(directory);
+    TransactionStore store(shards);
+    if (store.open() == false)
+        return false;
+
+    /* the shard of today, a later run on the same day reuses it */
+    const std::time_t cycle = Counter::Cycle(std::time(nullptr)).getCycleTime();
+    const std::string path = shards.determinePath(cycle);
+    sqlite3 *db = nullptr;
+    sqlite3_open(path.c_str(), &db);
+    long long existing = scalar(db, "SELECT COUNT(*) FROM upload_outbox;");
+    sqlite3_close(db);
+
+    const TransactionStore::UploadTag tag(0U, cycle);
+    if (existing < rows)
+    {
+        std::vector<std::unique_ptr<TransactionData>> owned;
+        std::vector<const TransactionData *> records;
+        for (int i = 0; i < 1000; i++)
+        {
+            owned.emplace_back(new TransactionData(true));
+            records.push_back(owned.back().get());
+        }
+        std::vector<TransactionStore::UploadTag> tags(records.size(), tag);
+        std::vector<bool> committed;
+        printf("\npopulating %lld transaction(s)...\n", rows - existing);
+        long long i = existing;
+        for (; i < rows; i += static_cast<long long>(records.size()))
+        {
+            for (std::size_t j = 0; j < records.size(); j++)
+            {
+                fill(*owned[j], i + static_cast<long long>(j));
+            }
+            if (store.insert(records, tags, committed) != records.size())
+            {
+                fprintf(stderr, "populate %s failed\n", path.c_str());
+                return false;
+            }
+            if ((i / 1000) % 100 == 99)
+            {
+                printf("\r%lld", i + 1000);
+                fflush(stdout);
+            }
+        }
+        printf("\n");
+        existing = i;
+    }
+
+    TransactionData tsc(true);
+    std::vector<double> insertTimes;
+    for (int round = 0; round < STORE_BENCH_INSERTS; round++)
+    {
+        fill(tsc, existing + round);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        store.insert(tsc, tag);
+        insertTimes.push_back(Micros(std::chrono::steady_clock::now() - start).count());
+    }
+    store.close();
+
+    /* what every tap paid before: open, schema check, insert, close */
+    std::vector<double> reopenTimes;
+    for (int round = 0; round < STORE_BENCH_REOPENS; round++)
+    {
+        fill(tsc, existing + STORE_BENCH_INSERTS + round);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        {
+            Sqlite3Transaction transaction(path);
+            transaction.createLog();
+            transaction.insertLog(tsc);
+        }
+        reopenTimes.push_back(Micros(std::chrono::steady_clock::now() - start).count());
+    }
+
+    stat(path.c_str(), &st);
+    printf("\nshard      : %s, %lld records, %lld bytes\n", path.c_str(), existing, static_cast<long long>(st.st_size));
+    printf("\n%-28s %8s %10s %10s %10s\n", "insert", "runs", "mean us", "p50 us", "p99 us");
+    report("store insert", insertTimes);
+    report("connection per tap", reopenTimes);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string path = (argc > 1) ? argv[1] : "ftv-store-bench.db";
+    long long rows = (argc > 2) ? std::strtoll(argv[2], nullptr, 10) : 5000000LL;
+    long long pending = (argc > 3) ? std::strtoll(argv[3], nullptr, 10) : 20000LL;
+    long long inserted = (argc > 4) ? std::strtoll(argv[4], nullptr, 10) : 1000000LL;
+    if (rows <= 0 || pending < 0 || pending > rows || inserted < 0)
+    {
+        fprintf(stderr, "command: %s [database] [records] [pending] [shard records]\n", argv[0]);
+        return 1;
+    }
+
+    sqlite3 *db = nullptr;
+    if (sqlite3_open(path.c_str(), &db) != SQLITE_OK)
+    {
+        fprintf(stderr, "open %s failed\n", path.c_str());
+        return 1;
+    }
+    exec(db, "PRAGMA journal_mode=WAL;");
+    exec(db, "PRAGMA synchronous=NORMAL;");
+    if (populate(db, rows) == false)
+    {
+        sqlite3_close(db);
+        return 1;
+    }
+
+    /* the pending records are the newest ones, like on a validator that lost its link */
+    long long last = scalar(db, "SELECT MAX(id) FROM upload_outbox;");
+    std::string reset = "UPDATE upload_cursor SET last_id = " + std::to_string(last - pending) + " WHERE id = 0;";
+    exec(db, reset.c_str());
+    struct stat st{};
+    stat(path.c_str(), &st);
+    printf("records    : %lld, pending %lld, %lld bytes\n\n", last, pending, static_cast<long long>(st.st_size));
+
+    bool isIndexed = explain(db, "next batch", TransactionStore::NEXT_BATCH_SQL);
+    isIndexed = explain(db, "source record", SOURCE_SQL) && isIndexed;
+    isIndexed = explain(db, "advance cursor", TransactionStore::ADVANCE_CURSOR_SQL) && isIndexed;
+    isIndexed = explain(db, "read cursor", TransactionStore::READ_CURSOR_SQL) && isIndexed;
+    isIndexed = explain(db, "cycle totals", TransactionStore::COUNT_CYCLE_SQL) && isIndexed;
+
+    sqlite3_stmt *next = nullptr;
+    sqlite3_stmt *source = nullptr;
+    sqlite3_stmt *advance = nullptr;
+    sqlite3_stmt *totals = nullptr;
+    sqlite3_stmt *scan = nullptr;
+    sqlite3_prepare_v2(db, TransactionStore::NEXT_BATCH_SQL, -1, &next, nullptr);
+    sqlite3_prepare_v2(db, SOURCE_SQL, -1, &source, nullptr);
+    sqlite3_prepare_v2(db, TransactionStore::ADVANCE_CURSOR_SQL, -1, &advance, nullptr);
+    sqlite3_prepare_v2(db, TransactionStore::COUNT_CYCLE_SQL, -1, &totals, nullptr);
+    sqlite3_prepare_v2(db, "SELECT ctype, COUNT(*) FROM upload_outbox NOT INDEXED WHERE cycle = ? AND counted = 1 GROUP BY ctype;", -1, &scan, nullptr);
+
+    std::vector<double> batchTimes;
+    std::vector<double> advanceTimes;
+    std::vector<double> totalsTimes;
+    std::vector<double> scanTimes;
+    long long uploaded = 0;
+    for (int round = 0; round < STORE_BENCH_ROUNDS && uploaded < pending; round++)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        long long lastId = 0;
+        sqlite3_bind_int(next, 1, STORE_BENCH_BATCH);
+        while (sqlite3_step(next) == SQLITE_ROW)
+        {
+            lastId = sqlite3_column_int64(next, 0);
+            sqlite3_bind_int64(source, 1, sqlite3_column_int64(next, 2));
+            sqlite3_step(source);
+            sqlite3_reset(source);
+            uploaded++;
+        }
+        sqlite3_reset(next);
+        batchTimes.push_back(Micros(std::chrono::steady_clock::now() - start).count());
+
+        start = std::chrono::steady_clock::now();
+        sqlite3_bind_int64(advance, 1, lastId);
+        sqlite3_step(advance);
+        sqlite3_reset(advance);
+        advanceTimes.push_back(Micros(std::chrono::steady_clock::now() - start).count());
+    }
+
+    const long long cycle = scalar(db, "SELECT cycle FROM upload_outbox ORDER BY id DESC LIMIT 1;");
+    for (int round = 0; round < 20; round++)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        sqlite3_bind_int64(totals, 1, cycle);
+        sqlite3_bind_int64(totals, 2, scalar(db, TransactionStore::READ_CURSOR_SQL));
+        while (sqlite3_step(totals) == SQLITE_ROW)
+        {
+        }
+        sqlite3_reset(totals);
+        totalsTimes.push_back(Micros(std::chrono::steady_clock::now() - start).count());
+    }
+    for (int round = 0; round < 3; round++)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        sqlite3_bind_int64(scan, 1, cycle);
+        while (sqlite3_step(scan) == SQLITE_ROW)
+        {
+        }
+        sqlite3_reset(scan);
+        scanTimes.push_back(Micros(std::chrono::steady_clock::now() - start).count());
+    }
+
+    printf("\n%-28s %8s %10s %10s %10s\n", "query", "runs", "mean us", "p50 us", "p99 us");
+    report("next batch + source rows", batchTimes);
+    report("advance cursor", advanceTimes);
+    report("cycle totals", totalsTimes);
+    report("cycle totals, full scan", scanTimes);
+
+    sqlite3_finalize(next);
+    sqlite3_finalize(source);
+    sqlite3_finalize(advance);
+    sqlite3_finalize(totals);
+    sqlite3_finalize(scan);
+    sqlite3_close(db);
+
+    if (inserted > 0 && insertLatency(path + ".shards", inserted) == false)
+        return 1;
+
+    if (isIndexed == false)
+    {
+        fprintf(stderr, "\na query plan scans a table\n");
+        return 1;
+    }
+    return 0;
+}
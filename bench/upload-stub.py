@@ -0,0 +1,107 @@
+#!/usr/bin/env python3
+"""
+Local stand-in for the back office endpoint of the Uploader.
+
+Accepts the POSTs of the uploader, unpacks the xz body, checks that it is a
+JSON array and answers 200. Every batch is printed with its size and the
+running totals, so a run can be compared with the outbox of the shards.
+A share of the requests can be refused to exercise the backoff.
+
+    bench/upload-stub.py [--port 8080] [--fail 0.2] [--delay-ms 0]
+
+with config/uploader.json pointing at it:
+
+    {"url": "http://127.0.0.1:8080/transactions"}
+"""
+
+import argparse
+import json
+import lzma
+import random
+import sys
+import time
+from http.server import BaseHTTPRequestHandler, HTTPServer
+
+
+class Totals:
+    batches = 0
+    records = 0
+    refused = 0
+    uuids = set()
+    duplicates = 0
+
+
+def make_handler(args):
+    class Handler(BaseHTTPRequestHandler):
+        protocol_version = "HTTP/1.1"
+
+        def answer(self, code, text):
+            body = text.encode()
+            self.send_response(code)
+            self.send_header("Content-Type", "text/plain")
+            self.send_header("Content-Length", str(len(body)))
+            self.end_headers()
+            self.wfile.write(body)
+
+        def do_POST(self):
+            length = int(self.headers.get("Content-Length", "0"))
+            raw = self.rfile.read(length)
+            if args.delay_ms > 0:
+                time.sleep(args.delay_ms / 1000.0)
+            if random.random() < args.fail:
+                Totals.refused += 1
+                print("refused batch of %d bytes" % len(raw), flush=True)
+                self.answer(503, "refused")
+                return
+
+            try:
+                if self.headers.get("Content-Encoding", "") == "xz":
+                    raw = lzma.decompress(raw)
+                records = json.loads(raw)
+                if not isinstance(records, list):
+                    raise ValueError("not a JSON array")
+            except (lzma.LZMAError, ValueError) as e:
+                print("bad batch: %s" % e, flush=True)
+                self.answer(400, str(e))
+                return
+
+            Totals.batches += 1
+            Totals.records += len(records)
+            for record in records:
+                uuid = record.get("uuid") if isinstance(record, dict) else None
+                if uuid is None:
+                    continue
+                if uuid in Totals.uuids:
+                    Totals.duplicates += 1
+                Totals.uuids.add(uuid)
+            print("batch %d: %d record(s), %d bytes xz, %d bytes json | total %d record(s), %d duplicate(s), %d refused"
+                  % (Totals.batches, len(records), length, len(raw), Totals.records, Totals.duplicates, Totals.refused),
+                  flush=True)
+            self.answer(200, "ok")
+
+        def log_message(self, format, *args):
+            pass
+
+    return Handler
+
+
+def main():
+    parser = argparse.ArgumentParser(description="local HTTP stub for the transaction uploader")
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--fail", type=float, default=0.0, help="share of requests answered with 503")
+    parser.add_argument("--delay-ms", type=int, default=0, help="delay before every answer")
+    args = parser.parse_args()
+
+    server = HTTPServer(("127.0.0.1", args.port), make_handler(args))
+    print("listening on http://127.0.0.1:%d/transactions" % args.port, flush=True)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    print("%d batch(es), %d record(s), %d duplicate(s), %d refused"
+          % (Totals.batches, Totals.records, Totals.duplicates, Totals.refused))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
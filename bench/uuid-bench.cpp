@@ -0,0 +1,156 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <array>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+#include "uuid.hpp"
+
+/*
+ * Cost and correctness of UUIDv7::generate().
+ *
+ * The microbenchmark times the generator against the stringstream one it
+ * replaced, on one thread. The check then lets several threads generate
+ * millions of identifiers at once: every thread must see its own identifiers
+ * strictly increasing (as text, which is how the back office sorts them) and
+ * no identifier may appear twice. Any failure fails the run.
+ */
+
+#define UUID_BENCH_ROUNDS 1000000
+
+typedef std::array<char, UUIDv7::STRING_LENGTH + 1> Text;
+
+/* the generator before UUIDv7, kept for reference */
+static std::string baselineUUID(std::time_t timeValue)
+{
+    unsigned long long timestampMs = static_cast<unsigned long long>(timeValue) * 1000ULL;
+
+    static std::mt19937 gen(static_cast<unsigned>(
+        std::chrono::high_resolution_clock::now()
+            .time_since_epoch()
+            .count()));
+
+    std::uniform_int_distribution<unsigned long long> dist(0, UINT64_MAX);
+
+    unsigned long long randA = dist(gen);
+    unsigned long long randB = dist(gen);
+
+    std::stringstream ss;
+    ss << std::hex << std::setfill('0');
+    ss << std::setw(12) << (timestampMs & 0xFFFFFFFFFFFFULL);
+    ss << "-";
+    ss << std::setw(4) << ((randA & 0x0FFFULL) | 0x7000);
+    ss << "-";
+    ss << std::setw(4) << ((randA >> 12 & 0x3FFFULL) | 0x8000);
+    ss << "-";
+    ss << std::setw(4) << (randB & 0xFFFFULL);
+    ss << "-";
+    ss << std::setw(12) << ((randB >> 16) & 0xFFFFFFFFFFFFULL);
+    return ss.str();
+}
+
+template <typename Generate>
+static double nanosPerId(Generate generate)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < UUID_BENCH_ROUNDS; i++)
+        generate();
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / UUID_BENCH_ROUNDS;
+}
+
+int main(int argc, char *argv[])
+{
+    std::size_t total = (argc > 1) ? std::strtoul(argv[1], nullptr, 10) : 4000000;
+    std::size_t threads = (argc > 2) ? std::strtoul(argv[2], nullptr, 10) : 4;
+    if (total == 0 || threads == 0)
+    {
+        fprintf(stderr, "command: %s [identifiers] [threads]\n", argv[0]);
+        return 1;
+    }
+
+    volatile char sink = 0;
+    std::time_t now = std::time(nullptr);
+    double baselineNs = nanosPerId(
+        [&sink, now]()
+        {
+            sink = baselineUUID(now)[0];
+        });
+    double stringNs = nanosPerId(
+        [&sink]()
+        {
+            sink = UUIDv7::generate()[0];
+        });
+    double bufferNs = nanosPerId(
+        [&sink]()
+        {
+            char text[UUIDv7::STRING_LENGTH + 1];
+            UUIDv7::generate(text);
+            sink = text[0];
+        });
+    printf("%-28s %10s\n", "generator", "ns/id");
+    printf("%-28s %10.1f\n", "stringstream (baseline)", baselineNs);
+    printf("%-28s %10.1f\n", "UUIDv7 std::string", stringNs);
+    printf("%-28s %10.1f\n", "UUIDv7 buffer", bufferNs);
+
+    std::size_t perThread = total / threads;
+    std::vector<std::vector<Text>> texts(threads, std::vector<Text>(perThread));
+    std::vector<std::size_t> disorders(threads, 0);
+    std::vector<std::thread> workers;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (std::size_t t = 0; t < threads; t++)
+    {
+        workers.emplace_back(
+            [&texts, &disorders, t, perThread]()
+            {
+                std::vector<Text> &own = texts[t];
+                for (std::size_t i = 0; i < perThread; i++)
+                {
+                    char text[UUIDv7::STRING_LENGTH + 1];
+                    UUIDv7::generate(text);
+                    memcpy(own[i].data(), text, sizeof(text));
+                    if (i > 0 && strcmp(own[i - 1].data(), own[i].data()) >= 0)
+                        disorders[t]++;
+                }
+            });
+    }
+    for (std::thread &th : workers)
+    {
+        th.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::vector<Text> all;
+    all.reserve(perThread * threads);
+    std::size_t disorder = 0;
+    for (std::size_t t = 0; t < threads; t++)
+    {
+        all.insert(all.end(), texts[t].begin(), texts[t].end());
+        std::vector<Text>().swap(texts[t]);
+        disorder += disorders[t];
+    }
+    std::sort(all.begin(), all.end(),
+              [](const Text &a, const Text &b)
+              {
+                  return strcmp(a.data(), b.data()) < 0;
+              });
+    std::size_t duplicates = 0;
+    for (std::size_t i = 1; i < all.size(); i++)
+    {
+        if (strcmp(all[i - 1].data(), all[i].data()) == 0)
+            duplicates++;
+    }
+
+    printf("\n%zu identifiers on %zu thread(s) in %.3f s (%.1f ns/id)\n", all.size(), threads, elapsed.count(), elapsed.count() * 1e9 / static_cast<double>(all.size()));
+    printf("first %s\nlast  %s\n", all.front().data(), all.back().data());
+    printf("out of order: %zu\nduplicates  : %zu\n", disorder, duplicates);
+    return (disorder > 0 || duplicates > 0) ? 1 : 0;
+}
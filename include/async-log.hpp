@@ -0,0 +1,241 @@
+#ifndef __ASYNC_LOG_HPP__
+#define __ASYNC_LOG_HPP__
+
+#include <atomic>
+#include <string>
+#include <cstddef>
+#include <type_traits>
+
+/*
+ * Asynchronous front end of Debug. A log call stores the format pointer and
+ * its arguments in a fixed-size record of a bounded lock-free ring; a low
+ * priority thread formats the records, hands them to Debug and moves the
+ * Debug history to file. When the ring is full the record is dropped and
+ * counted, a log burst never blocks the caller.
+ *
+ * Format strings and __FILE__/__func__ must be literals, string arguments are
+ * copied into the record (truncated to TEXT_SIZE in total).
+ */
+class AsyncLog
+{
+public:
+    enum class Level : unsigned char
+    {
+        INFO,
+        WARNING,
+        ERROR,
+        CRITICAL
+    };
+
+    static const std::size_t CAPACITY = 512; /* power of two */
+    static const std::size_t MAX_ARGS = 8;
+    static const std::size_t TEXT_SIZE = 128;
+
+    class Arg
+    {
+    public:
+        enum class Type : unsigned char
+        {
+            SIGNED,
+            UNSIGNED,
+            DOUBLE,
+            STRING,
+            POINTER
+        };
+
+        Type type;
+        union
+        {
+            long long i;
+            unsigned long long u;
+            double d;
+            const void *p;
+            std::size_t offset;
+        };
+    };
+
+    class Record
+    {
+    public:
+        Level level;
+        unsigned char argCount;
+        unsigned short textUsed;
+        int line;
+        const char *file;
+        const char *func;
+        const char *format;
+        Arg args[MAX_ARGS];
+        char text[TEXT_SIZE];
+
+        void reset(Level level, const char *file, int line, const char *func, const char *format);
+
+        void addSigned(long long value);
+        void addUnsigned(unsigned long long value);
+        void addDouble(double value);
+        void addString(const char *value);
+        void addPointer(const void *value);
+
+        template <typename T>
+        typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type add(const T &value)
+        {
+            this->addSigned(static_cast<long long>(value));
+        }
+
+        template <typename T>
+        typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type add(const T &value)
+        {
+            this->addUnsigned(static_cast<unsigned long long>(value));
+        }
+
+        template <typename T>
+        typename std::enable_if<std::is_enum<T>::value>::type add(const T &value)
+        {
+            this->addSigned(static_cast<long long>(value));
+        }
+
+        template <typename T>
+        typename std::enable_if<std::is_floating_point<T>::value>::type add(const T &value)
+        {
+            this->addDouble(static_cast<double>(value));
+        }
+
+        void add(const char *value);
+        void add(char *value);
+        void add(const std::string &value);
+        void add(const void *value);
+    };
+
+private:
+    class Cell
+    {
+    public:
+        std::atomic<std::size_t> sequence;
+        std::size_t position;
+        Record record;
+    };
+
+    static Cell cells[CAPACITY];
+    static std::atomic<std::size_t> enqueuePos;
+    static std::size_t dequeuePos;
+    static std::atomic<bool> isRunning;
+    static std::atomic<unsigned long long> dropped;
+
+    static Cell *reserve();
+    static void commit(Cell *cell);
+    static void write(const Record &record);
+    static void routine();
+
+    static void capture(Record &/* record */)
+    {
+    }
+
+    template <typename T, typename... Rest>
+    static void capture(Record &record, const T &value, const Rest &...rest)
+    {
+        record.add(value);
+        AsyncLog::capture(record, rest...);
+    }
+
+public:
+    static void begin();
+    static void stop();
+    static unsigned long long getDropped();
+    static std::size_t format(const Record &record, char *out, std::size_t size);
+
+    template <typename... Args>
+    static void log(Level level, const char *file, int line, const char *func, const char *format, const Args &...args)
+    {
+        if (AsyncLog::isRunning.load(std::memory_order_acquire) == false)
+        {
+            /* before begin and after stop the record is written in place */
+            Record record;
+            record.reset(level, file, line, func, format);
+            AsyncLog::capture(record, args...);
+            AsyncLog::write(record);
+            return;
+        }
+
+        Cell *cell = AsyncLog::reserve();
+        if (cell == nullptr)
+        {
+            AsyncLog::dropped.fetch_add(1ULL, std::memory_order_relaxed);
+            return;
+        }
+        cell->record.reset(level, file, line, func, format);
+        AsyncLog::capture(cell->record, args...);
+        AsyncLog::commit(cell);
+    }
+
+    template <typename... Args>
+    static void info(const char *file, int line, const char *func, const char *format, const Args &...args)
+    {
+        AsyncLog::log(Level::INFO, file, line, func, format, args...);
+    }
+
+    template <typename... Args>
+    static void warning(const char *file, int line, const char *func, const char *format, const Args &...args)
+    {
+        AsyncLog::log(Level::WARNING, file, line, func, format, args...);
+    }
+
+    template <typename... Args>
+    static void error(const char *file, int line, const char *func, const char *format, const Args &...args)
+    {
+        AsyncLog::log(Level::ERROR, file, line, func, format, args...);
+    }
+
+    template <typename... Args>
+    static void critical(const char *file, int line, const char *func, const char *format, const Args &...args)
+    {
+        AsyncLog::log(Level::CRITICAL, file, line, func, format, args...);
+    }
+};
+
+/*
+ * Compile-time filtered front end. Call sites below FTV_LOG_LEVEL compile to
+ * nothing, their arguments only appear in an unevaluated sizeof so values kept
+ * for the log alone do not turn into unused variables; the others go through
+ * AsyncLog and are formatted on the log thread. Code outside AsyncLog logs
+ * through these macros only.
+ */
+#define FTV_LOG_LEVEL_INFO 0
+#define FTV_LOG_LEVEL_WARNING 1
+#define FTV_LOG_LEVEL_ERROR 2
+#define FTV_LOG_LEVEL_CRITICAL 3
+#define FTV_LOG_LEVEL_NONE 4
+
+#ifndef FTV_LOG_LEVEL
+#define FTV_LOG_LEVEL FTV_LOG_LEVEL_INFO
+#endif
+
+#define FTV_LOG_DISCARD(...)                                                          \
+    do                                                                                \
+    {                                                                                 \
+        (void)sizeof((AsyncLog::info(__FILE__, __LINE__, __func__, __VA_ARGS__), 0)); \
+    } while (0)
+
+#if FTV_LOG_LEVEL <= FTV_LOG_LEVEL_INFO
+#define FTV_LOG_INFO(...) AsyncLog::info(__FILE__, __LINE__, __func__, __VA_ARGS__)
+#else
+#define FTV_LOG_INFO(...) FTV_LOG_DISCARD(__VA_ARGS__)
+#endif
+
+#if FTV_LOG_LEVEL <= FTV_LOG_LEVEL_WARNING
+#define FTV_LOG_WARNING(...) AsyncLog::warning(__FILE__, __LINE__, __func__, __VA_ARGS__)
+#else
+#define FTV_LOG_WARNING(...) FTV_LOG_DISCARD(__VA_ARGS__)
+#endif
+
+#if FTV_LOG_LEVEL <= FTV_LOG_LEVEL_ERROR
+#define FTV_LOG_ERROR(...) AsyncLog::error(__FILE__, __LINE__, __func__, __VA_ARGS__)
+#else
+#define FTV_LOG_ERROR(...) FTV_LOG_DISCARD(__VA_ARGS__)
+#endif
+
+#if FTV_LOG_LEVEL <= FTV_LOG_LEVEL_CRITICAL
+#define FTV_LOG_CRITICAL(...) AsyncLog::critical(__FILE__, __LINE__, __func__, __VA_ARGS__)
+#else
+#define FTV_LOG_CRITICAL(...) FTV_LOG_DISCARD(__VA_ARGS__)
+#endif
+
+#endif
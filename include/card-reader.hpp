@@ -0,0 +1,84 @@
+#ifndef __CARD_READER_HPP__
+#define __CARD_READER_HPP__
+
+#include <array>
+#include <string>
+#include <ctime>
+
+#include "epayment/include/card-access.hpp"
+
+class Epayment;
+
+/*
+ * Card access used by the tap pipeline. EpaymentCardReader forwards to the
+ * reader hardware, SimulatedCardReader lets the Controller run without it.
+ */
+class CardReader
+{
+public:
+    virtual ~CardReader();
+
+    virtual std::string getVersion() = 0;
+
+    virtual bool selectAttachedCard() = 0;
+    virtual unsigned long long getCardNumber() = 0;
+    virtual bool readUserData(std::array<unsigned char, 64> &userData) = 0;
+    virtual bool writeUserData(const std::array<unsigned char, 64> &toWrite, const std::array<unsigned char, 64> &userData) = 0;
+    virtual void getFreeServiceParam(unsigned short &interop, std::time_t &expireOn) = 0;
+
+    virtual std::string getBank() = 0;
+    virtual std::string getIssuer() = 0;
+    virtual Card::cardType_t getType() = 0;
+
+    virtual void setAmount(unsigned int amount) = 0;
+    virtual bool deduct() = 0;
+    virtual int getLastBalance() = 0;
+    virtual int getBalance() = 0;
+    virtual bool purchaseCommit() = 0;
+
+    virtual int getLastStatus() = 0;
+    virtual bool isInsufficientValue() = 0;
+    virtual std::string getTranscode() = 0;
+    virtual std::string getTranscodeUTF8() = 0;
+    virtual std::string getActiveMID() = 0;
+    virtual std::string getActiveTID() = 0;
+};
+
+class EpaymentCardReader : public CardReader
+{
+private:
+    Epayment &epayment;
+
+public:
+    EpaymentCardReader(Epayment &epayment);
+    ~EpaymentCardReader();
+
+    Epayment &getEpayment();
+
+    std::string getVersion() override;
+
+    bool selectAttachedCard() override;
+    unsigned long long getCardNumber() override;
+    bool readUserData(std::array<unsigned char, 64> &userData) override;
+    bool writeUserData(const std::array<unsigned char, 64> &toWrite, const std::array<unsigned char, 64> &userData) override;
+    void getFreeServiceParam(unsigned short &interop, std::time_t &expireOn) override;
+
+    std::string getBank() override;
+    std::string getIssuer() override;
+    Card::cardType_t getType() override;
+
+    void setAmount(unsigned int amount) override;
+    bool deduct() override;
+    int getLastBalance() override;
+    int getBalance() override;
+    bool purchaseCommit() override;
+
+    int getLastStatus() override;
+    bool isInsufficientValue() override;
+    std::string getTranscode() override;
+    std::string getTranscodeUTF8() override;
+    std::string getActiveMID() override;
+    std::string getActiveTID() override;
+};
+
+#endif
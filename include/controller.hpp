@@ -3,10 +3,19 @@
 
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <vector>
+#include <deque>
+#include <array>
+#include <string>
+#include <condition_variable>
 #include <functional>
 #include <memory>
+#include <chrono>
 
 #include "error-code.hpp"
+#include "intent-journal.hpp"
+#include "persistence-worker.hpp"
 
 #ifndef FTV_WORKING_DIRECTORY
 #define FTV_WORKING_DIRECTORY "."
@@ -20,30 +29,132 @@
 #define MAIN_APP_LOG_DIRECTORY LOG_DIRECTORY "/main"
 #define EPAYMENT_MODULE_LOG_DIRECTORY LOG_DIRECTORY "/epayment"
 
-#define TRANSACTION_DATABASE DATA_DIRECTORY "/transaction.db"
+#define TRANSACTION_DATA_DIRECTORY DATA_DIRECTORY "/transaction"
+/* single database written before the transactions were sharded per day */
+#define TRANSACTION_LEGACY_DATABASE DATA_DIRECTORY "/transaction.db"
 #define MAIN_APP_LOG_FILE "main_app"
 #define PROVISION_CONFIG_FILE CONFIG_DIRECTORY "/provision.json"
+#define LATENCY_STATS_FILE DATA_DIRECTORY "/latency.json"
+#define UPLOADER_CONFIG_FILE CONFIG_DIRECTORY "/uploader.json"
+#define POLL_SCHEDULER_CONFIG_FILE CONFIG_DIRECTORY "/poll-scheduler.json"
+#define INTENT_JOURNAL_FILE DATA_DIRECTORY "/intent.journal"
+
+#ifndef LATENCY_STATS_DUMP_INTERVAL_S
+#define LATENCY_STATS_DUMP_INTERVAL_S 300
+#endif
+
+#ifndef COUNTER_PREPARE_LEAD_S
+#define COUNTER_PREPARE_LEAD_S 300
+#endif
+
+/* a card left on the reader after a failed read is tried again, this many times at this pace */
+#ifndef HELD_CARD_RETRIES
+#define HELD_CARD_RETRIES 2
+#endif
+
+#ifndef HELD_CARD_RETRY_DELAY_MS
+#define HELD_CARD_RETRY_DELAY_MS 300
+#endif
+
+/* once a SAM is ready taps come first: the next SAM handshake waits for the reader to be
+ * free of cards this long, and at most the second value for a card left on it */
+#ifndef ISSUER_INIT_QUIET_MS
+#define ISSUER_INIT_QUIET_MS 500
+#endif
+
+#ifndef ISSUER_INIT_MAX_DEFER_MS
+#define ISSUER_INIT_MAX_DEFER_MS 10000
+#endif
+
+#ifndef TRANSACTION_GROUP_COMMIT_WINDOW_MS
+#define TRANSACTION_GROUP_COMMIT_WINDOW_MS 0
+#endif
+
+#ifndef TRANSACTION_GROUP_COMMIT_MAX_RECORDS
+#define TRANSACTION_GROUP_COMMIT_MAX_RECORDS 32
+#endif
 
 class Gui;
-class Epayment;
+class GuiState;
+class CardReader;
 class WorkflowManager;
 class TransactionRules;
 class CardData;
 class Duration;
 class Counter;
+class CounterFile;
+class CounterRotation;
+class TransactionShards;
+class TransactionStore;
+class Uploader;
+class PollScheduler;
+class LatencyStats;
+class TapContext;
 
 class Controller
 {
 private:
+    class IssuerInit
+    {
+    public:
+        unsigned int ctype;
+        std::string name;
+        std::function<bool()> init;
+        std::function<void(bool ready)> onDone;
+    };
+
     bool isRun;
-    Epayment &epayment;
+    CardReader &reader;
     WorkflowManager &workflow;
     Gui &gui;
+    std::unique_ptr<GuiState> view;
     std::unique_ptr<std::thread> th;
-    std::unique_ptr<Counter> counter;
+    std::shared_ptr<CounterFile> snFile;
+    std::shared_ptr<Counter> counter;
+    std::unique_ptr<CounterRotation> rotation;
+    std::unique_ptr<TransactionShards> shards;
+    std::unique_ptr<TransactionStore> tscdb;
+    std::unique_ptr<PersistenceWorker> persistence;
+    std::unique_ptr<Uploader> uploader;
+    std::unique_ptr<IntentJournal> journal;
+    std::unique_ptr<TapContext> tap;
+    std::unique_ptr<PollScheduler> scheduler;
+    std::unique_ptr<LatencyStats> latency;
+    std::chrono::steady_clock::time_point lastStatsDump;
+    std::chrono::milliseconds holdSuccess;
+    std::chrono::milliseconds holdFailed;
+    std::chrono::steady_clock::time_point holdUntil;
+    bool isHolding;
+    unsigned long long lastCardNumber;
+    bool isLastCardPresent;
+    bool isTransientFailure;
+    unsigned int heldRetries;
+    std::chrono::steady_clock::time_point retryAt;
+    std::chrono::steady_clock::time_point bootRef;
+    bool isFirstTapLogged;
+    std::atomic<unsigned int> readyIssuers;
+    std::size_t pendingIssuers;
+    std::deque<IssuerInit> issuerInits;
+    std::unique_ptr<std::thread> issuerThread;
+    bool isIssuerThreadRunning;
+    std::string runningIssuer;
+    bool isIssuerStop;
+    bool isCardOnReader;
+    std::chrono::steady_clock::time_point lastCardSeen;
+    std::chrono::steady_clock::time_point readerBlockedSince;
+    std::mutex issuerMtx;
+    std::condition_variable issuerChanged;
+    std::mutex readerMtx;
     mutable std::mutex mtx;
 
-    bool processAttachedCard(Duration &duration);
+    bool processAttachedCard(unsigned long long cardNumber, Duration &duration);
+    bool deduct(bool isTapIn,
+                const unsigned int amount,
+                const std::array<unsigned char, 64> &userData,
+                const CardData &refUserData,
+                const TransactionRules &rules,
+                bool isPinalty = false);
+
     bool storeTransaction(bool isTapIn,
                           bool isDeduct,
                           const std::time_t time,
@@ -52,63 +163,59 @@ private:
                           const TransactionRules &rules,
                           Duration &duration);
 
-    bool storeErrorTransactionOnReadFailed(const std::time_t time, Duration &duration, const ErrorCode::Code &desc);
-
-    bool storeErrorTransactionOnReadSuccess(bool isTapIn,
-                                            bool isDeduct,
-                                            const std::time_t time,
-                                            const int lastBalance,
-                                            const CardData &refUserData,
-                                            const TransactionRules &rules,
-                                            Duration &duration,
-                                            const ErrorCode::Code &desc);
-
-    bool storeErrorInsufficientBalance(bool isTapIn,
-                                       bool isDeduct,
-                                       const int lastBalance,
-                                       const CardData &refUserData,
-                                       const TransactionRules &rules,
-                                       Duration &duration);
-
-    bool storeErrorGetBalance(bool isTapIn,
-                              bool isDeduct,
-                              const CardData &refUserData,
-                              const TransactionRules &rules,
-                              Duration &duration);
-
-    bool storeErrorPurchaseBalance(bool isTapIn,
-                                   bool isDeduct,
-                                   const CardData &refUserData,
-                                   const TransactionRules &rules,
-                                   Duration &duration);
-
-    bool storeErrorWriteUserData(bool isTapIn,
-                                 bool isDeduct,
-                                 const int lastBalance,
-                                 const CardData &refUserData,
-                                 const TransactionRules &rules,
-                                 Duration &duration);
-
-    bool storeErrorBlockingTime(const CardData &refUserData,
-                                const TransactionRules &rules,
-                                Duration &duration);
-
-    bool storeErrorFreeServiceExpired(const CardData &refUserData,
-                                      const TransactionRules &rules,
-                                      Duration &duration);
-
+    bool recordError(bool isTapIn,
+                     const ErrorCode::Code &code,
+                     const int lastBalance,
+                     const unsigned int minimumBalance,
+                     const unsigned int normalFare,
+                     const unsigned int fare,
+                     Duration &duration);
+
+    bool storeErrorTransactionOnReadFailed(Duration &duration, const ErrorCode::Code &desc);
+
+    bool storeError(ErrorCode::Class errorClass,
+                    bool isTapIn,
+                    bool isDeduct,
+                    const int lastBalance,
+                    const CardData &refUserData,
+                    const TransactionRules &rules,
+                    Duration &duration);
+
+    static unsigned int issuerBit(unsigned int ctype);
+
+    void runIssuerInits();
+    void waitReaderIdle();
+    void markReader(bool isCardPresent);
     void routine();
     void reloadCounter();
+    void rollCounter(const std::time_t time);
+    void reconcileCounter();
+    void recoverIntents();
+    bool replayIntent(IntentJournal::State state, const IntentJournal::Intent &intent);
+    void onUploaded(unsigned int ctype, std::time_t cycle, unsigned int count);
 
 public:
-    Controller(Epayment &epayment, WorkflowManager &workflow, Gui &gui);
+    Controller(CardReader &reader, WorkflowManager &workflow, Gui &gui);
     ~Controller();
 
-    void setup(std::function<void(Epayment &epayment, WorkflowManager &workflow, Gui &gui)> handler);
+    void setup(std::function<void(CardReader &reader, WorkflowManager &workflow, GuiState &view)> handler);
+    void setPollScheduler(std::unique_ptr<PollScheduler> scheduler);
+    void setDisplayHold(std::chrono::milliseconds onSuccess, std::chrono::milliseconds onFailed);
+    void setGroupCommit(std::chrono::milliseconds window, std::size_t maxRecords);
+
+    void initIssuer(unsigned int ctype,
+                    const std::string &name,
+                    std::function<bool()> init,
+                    std::function<void(bool ready)> onDone = nullptr);
+    bool isIssuerReady(unsigned int ctype) const;
+    bool waitAnyIssuerReady(std::vector<std::string> *pending = nullptr);
+    std::size_t getPendingIssuers();
 
     bool isRuning();
+    const LatencyStats &getLatencyStats() const;
+    PersistenceWorker::Stats getPersistenceStats() const;
 
-    void begin(std::function<void(Epayment &epayment, WorkflowManager &workflow, Gui &gui)> preSetup);
+    void begin(std::function<void(CardReader &reader, WorkflowManager &workflow, GuiState &view)> preSetup);
     void stop();
 };
 
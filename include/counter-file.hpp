@@ -0,0 +1,86 @@
+#ifndef __COUNTER_FILE_HPP__
+#define __COUNTER_FILE_HPP__
+
+#include <string>
+#include <mutex>
+#include <functional>
+#include <cstdint>
+
+/*
+ * Fixed-layout, checksummed, memory-mapped counter record.
+ *
+ * The file holds two copies (slots) of the record. store() always writes the
+ * older slot and stamps it with a higher sequence number and a CRC32 last, so
+ * an interrupted update leaves the other slot intact. load() picks the newest
+ * slot whose checksum matches and recovers from a damaged file instead of
+ * failing.
+ *
+ * One file is mapped by one CounterFile: the sequence of the newest slot is
+ * cached, a second instance on the same file would overwrite the newest copy.
+ */
+class CounterFile
+{
+public:
+    static const std::size_t ISSUER_COUNT = 5;
+
+    struct IssuerRecord
+    {
+        uint32_t tapInRegular;
+        uint32_t tapInEconomy;
+        uint32_t tapInFreeService;
+        uint32_t tapOut;
+        uint32_t sent;
+        uint32_t pending;
+        uint64_t amount;
+    };
+
+    struct Record
+    {
+        uint32_t sn;
+        uint32_t reserved;
+        IssuerRecord issuer[ISSUER_COUNT];
+    };
+
+private:
+    struct Slot
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t sequence;
+        Record record;
+        uint32_t crc;
+        uint32_t reserved;
+    };
+
+    struct Layout
+    {
+        Slot slot[2];
+    };
+
+    std::string filePath;
+    int fd;
+    Layout *layout;
+    uint64_t sequence;
+    mutable std::mutex mutex;
+
+    static uint32_t checksum(const Slot &slot);
+    static bool isValid(const Slot &slot);
+
+    bool loadSlot(Record &record);
+    bool storeSlot(const Record &record);
+
+public:
+    CounterFile(const std::string &filePath);
+    ~CounterFile();
+
+    bool open(bool &isCreated);
+    void close();
+
+    bool load(Record &record);
+    bool store(const Record &record);
+
+    /* read, modify and write under one lock; modify returns false to keep the file as is */
+    bool update(const std::function<bool(Record &record)> &modify);
+};
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef __COUNTER_ROTATION_HPP__
+#define __COUNTER_ROTATION_HPP__
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <string>
+#include <map>
+#include <chrono>
+#include <ctime>
+
+class Counter;
+class CounterFile;
+
+/*
+ * Builds the counter of the next day in the background, a little before the
+ * boundary given to schedule(): the YYYY/MMM/date directory, counter.bin and
+ * the mapped Counter object. The first tap after midnight only has to take()
+ * it. A prepared counter that does not cover the tap time (clock jump) is
+ * thrown away and the caller falls back to building one inline.
+ *
+ * It is also the one place a Counter is built: acquire() returns the counter
+ * already mapping the counter.bin of a cycle (the current day, the prepared
+ * next day, or a past day still held by a pending callback) and only builds a
+ * new one when none is alive. A counter being destroyed finishes its last
+ * store() before the next one of its cycle is built, so two Counter objects
+ * never map the same file.
+ */
+class CounterRotation
+{
+private:
+    class Registry
+    {
+    public:
+        std::map<std::time_t, std::weak_ptr<Counter>> counters;
+        std::mutex mutex;
+        std::condition_variable released;
+    };
+
+    bool isRun;
+    std::string snPath;
+    std::shared_ptr<CounterFile> snFile;
+    std::string basePath;
+    std::chrono::seconds lead;
+    std::time_t target;
+    bool isPreparing;
+    std::shared_ptr<Counter> prepared;
+    std::shared_ptr<Registry> registry;
+    std::unique_ptr<std::thread> th;
+    std::mutex mutex;
+    std::condition_variable changed;
+
+    void routine();
+
+public:
+    CounterRotation(const std::string &snPath, std::shared_ptr<CounterFile> snFile, const std::string &basePath, std::chrono::seconds lead = std::chrono::seconds(300));
+    ~CounterRotation();
+
+    void begin();
+    void stop();
+
+    void schedule(const std::time_t boundary);
+    std::shared_ptr<Counter> take(const std::time_t time);
+    std::shared_ptr<Counter> acquire(const std::time_t time);
+};
+
+#endif
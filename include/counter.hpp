@@ -2,7 +2,11 @@
 #define __COUNTER_HPP__
 
 #include <string>
+#include <ctime>
 #include <mutex>
+#include <atomic>
+#include <memory>
+#include "counter-file.hpp"
 #include "utils/include/nlohmann/json_fwd.hpp"
 
 class Counter
@@ -11,18 +15,17 @@ public:
     class Issuer
     {
     private:
-        unsigned int tapInRegular;
-        unsigned int tapInEconomy;
-        unsigned int tapInFreeService;
-        unsigned int tapOut;
-        unsigned int sent;
-        unsigned int pending;
-        unsigned long long int amount;
-        std::string filePath;
-        mutable std::mutex mutex;
+        std::atomic<unsigned int> tapInRegular;
+        std::atomic<unsigned int> tapInEconomy;
+        std::atomic<unsigned int> tapInFreeService;
+        std::atomic<unsigned int> tapOut;
+        std::atomic<unsigned int> sent;
+        std::atomic<unsigned int> pending;
+        std::atomic<unsigned long long int> amount;
+        std::atomic<unsigned int> *generation;
 
     public:
-        Issuer(const std::string &filePath);
+        Issuer(std::atomic<unsigned int> *generation = nullptr);
         ~Issuer();
 
         void incTapInRegular();
@@ -41,45 +44,88 @@ public:
         unsigned int getSent() const;
         unsigned long long int getAmount() const;
 
-        void load();
-        bool store();
+        void load(const CounterFile::IssuerRecord &record);
+        void save(CounterFile::IssuerRecord &record) const;
+        bool importJSON(const std::string &filePath);
         bool reset();
     };
 
+    class Snapshot
+    {
+    public:
+        class Issuer
+        {
+        public:
+            unsigned int tapInRegular;
+            unsigned int tapInEconomy;
+            unsigned int tapInFreeService;
+            unsigned int tapOut;
+            unsigned int sent;
+            unsigned int pending;
+            unsigned long long int amount;
+        };
+
+        unsigned int sn;
+        Issuer emoney;
+        Issuer brizzi;
+        Issuer tapcash;
+        Issuer flazz;
+        Issuer jakcard;
+        Issuer total;
+    };
+
+    /*
+     * One local day, kept as [start, next) epochs so the rollover check on the
+     * tap path is two integer compares.
+     */
     class Cycle
     {
     private:
-        unsigned char day;
-        unsigned char month;
-        unsigned short year;
+        std::time_t start;
+        std::time_t next;
+
+        static std::time_t midnight(const std::time_t time);
 
     public:
-        Cycle();
+        Cycle(const std::time_t time = std::time(nullptr));
         ~Cycle();
 
         std::time_t getCycleTime() const;
+        std::time_t getNextCycleTime() const;
         bool isSameCycle(const std::time_t time) const;
     };
 
 private:
-    unsigned int sn;
+    std::atomic<unsigned int> sn;
+    std::atomic<unsigned int> storedSN;
+    std::atomic<unsigned int> generation;
     Cycle cycle;
     Issuer emoney;
     Issuer brizzi;
     Issuer tapcash;
     Issuer flazz;
     Issuer jakcard;
-    std::string filePath;
+    std::string counterPath;
+    CounterFile counterFile;
+    std::shared_ptr<CounterFile> snFile;
+    std::string snPath;
     mutable std::mutex mutex;
 
+    static void beginWrite(std::atomic<unsigned int> *generation);
+    static void endWrite(std::atomic<unsigned int> *generation);
+    static void read(const Issuer &issuer, Snapshot::Issuer &target);
+    static void accumulate(const Snapshot::Issuer &issuer, Snapshot::Issuer &target);
+
     template <typename T>
     static void readUnsignedSafe(const nlohmann::json &j, const char *key, T &target);
 
 public:
-    Counter(const std::string &snPath, const std::string &counterPath);
+    /* sn.bin is shared by every day, all counters get the same snFile */
+    Counter(const std::string &snPath, std::shared_ptr<CounterFile> snFile, const std::string &counterPath, const std::time_t time = std::time(nullptr));
     ~Counter();
 
     void incSN();
+    void continueSN(const Counter &previous);
 
     const Cycle &getCycle() const;
     Issuer &getEmoney();
@@ -98,10 +144,16 @@ public:
     unsigned int getTotalSent() const;
     unsigned long long int getTotalAmount() const;
 
+    Snapshot snapshot() const;
+
+    void load();
+    bool store();
+
     void loadSN();
     bool storeSN();
     bool resetSN();
 
+    static std::shared_ptr<CounterFile> createSNFile(const std::string &snPath);
     static std::string determineConfigPath(const std::string &basePath, const std::time_t time);
 };
 
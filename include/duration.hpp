@@ -2,41 +2,84 @@
 #define __DURATION_HPP__
 
 #include <chrono>
+#include <array>
 #include <vector>
 #include <string>
+#include <atomic>
+#include <functional>
 
 class Duration
 {
+public:
+    enum class Stage : unsigned char
+    {
+        GET_CARD_NUMBER,
+        READ_USER_DATA,
+        READ_USER_DATA_FAILED,
+        DEDUCT_PINALTY_SUCCESS,
+        DEDUCT_PINALTY_FAILED,
+        DEDUCT_TAP_IN_SUCCESS,
+        DEDUCT_TAP_IN_FAILED,
+        DEDUCT_TAP_OUT_SUCCESS,
+        DEDUCT_TAP_OUT_FAILED,
+        GET_BALANCE,
+        GET_BALANCE_TAP_IN_WITHOUT_DEDUCT,
+        GET_BALANCE_TAP_OUT_WITHOUT_DEDUCT,
+        GET_BALANCE_FAILED,
+        WRITE_USER_DATA_SUCCESS,
+        WRITE_USER_DATA_FAILED,
+        TOTAL,
+        CUSTOM
+    };
+
+    static const std::size_t MAX_CHECK_POINTS = 16;
+
 private:
     class PointRefs
     {
     private:
         std::chrono::steady_clock::time_point timePoint;
-        std::string caption;
+        Stage stage;
+        unsigned char customIndex;
 
     public:
-        PointRefs(const std::string &caption = "");
+        PointRefs();
+        PointRefs(Stage stage, unsigned char customIndex = 0);
         ~PointRefs();
 
         const std::chrono::steady_clock::time_point &getTime() const;
-        const std::string &getCaption() const;
+        Stage getStage() const;
+        unsigned char getCustomIndex() const;
 
         double diff(const std::chrono::steady_clock::time_point &ref) const;
     };
 
+    static std::atomic<bool> isReportEnabled;
+
     std::chrono::steady_clock::time_point startRef;
-    std::vector<PointRefs> pointRefs;
+    std::array<PointRefs, MAX_CHECK_POINTS> pointRefs;
+    std::size_t pointCount;
+    std::size_t droppedCount;
+    std::vector<std::string> customCaptions;
     std::string caption;
 
+    const char *getCaption(const PointRefs &pref) const;
     void printDiffTime(const PointRefs &pref, const std::chrono::steady_clock::time_point &sref) const;
 
 public:
     Duration(const std::string &caption = "");
     ~Duration();
 
+    static const char *toString(Stage stage);
+    static void setReportEnabled(bool enable);
+
+    void checkPoint(Stage stage);
     void checkPoint(const std::string &caption = "");
     double getTotalDurationInSeconds() const;
     int getTotalDurationInMs() const;
+
+    /* every check point, then Stage::TOTAL; the caption is only meaningful for Stage::CUSTOM */
+    void visit(const std::function<void(Stage stage, const char *caption, double seconds)> &visitor) const;
 };
 
-#endif
\ No newline at end of file
+#endif
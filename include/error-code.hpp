@@ -1,7 +1,8 @@
 #ifndef __ERROR_CODE_HPP__
 #define __ERROR_CODE_HPP__
 
-#include <string>
+#include <cstddef>
+
 class ErrorCode
 {
 public:
@@ -78,7 +79,24 @@ public:
         GENERAL_F6_DEBIT_DEVICE_LOST_CONTACT
     };
 
-    static std::string toString(const Code &errorCode);
+    /* what went wrong, independent of the issuer */
+    enum class Class
+    {
+        SAM_NOT_READY,
+        BALANCE_CHECK,
+        INSUFFICIENT_BALANCE,
+        WRITE_BLOCK,
+        TAP_BELOW_ONE_MINUTE,
+        DEBIT_LOST_CONTACT,
+        FREE_SERVICE_EXPIRED
+    };
+
+    static const std::size_t CODE_COUNT = static_cast<std::size_t>(Code::GENERAL_F6_DEBIT_DEVICE_LOST_CONTACT) + 1;
+    static const std::size_t CLASS_COUNT = static_cast<std::size_t>(Class::FREE_SERVICE_EXPIRED) + 1;
+    static const std::size_t ISSUER_COUNT = 5;
+
+    static Code classify(unsigned int ctype, Class errorClass);
+    static const char *toString(const Code &errorCode);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,155 @@
+#ifndef __GUI_STATE_HPP__
+#define __GUI_STATE_HPP__
+
+#include <array>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <string>
+#include <chrono>
+#include <condition_variable>
+
+#include "screen-template.hpp"
+
+class Gui;
+
+/*
+ * What the screen should show. Writers only update this model and mark it
+ * dirty, a frame thread applies the latest state to the Gui widgets at most
+ * once per frame. Repeated writes between two frames collapse into one widget
+ * call. A message screen or counter equal to what is already on screen is not
+ * sent again; any other message repaints the whole five-line block, the Gui
+ * Message widget has no per-line setter.
+ */
+class GuiState
+{
+public:
+    static const std::chrono::milliseconds FRAME_INTERVAL;
+
+private:
+    /* latest set and/or hide of one widget since the last frame, in the order they happened */
+    template <typename T>
+    class Slot
+    {
+    public:
+        T value;
+        bool isShow;
+        bool hasSet;
+        bool hasHide;
+        bool isHideFirst;
+
+        Slot();
+
+        void set(const T &value, bool show);
+        void hide();
+        bool isDirty() const;
+        void clear();
+    };
+
+    class Rupiah
+    {
+    public:
+        unsigned int amount;
+        std::string caption;
+
+        Rupiah(unsigned int amount = 0U, const std::string &caption = "");
+        bool operator==(const Rupiah &other) const;
+    };
+
+    class Pan
+    {
+    public:
+        unsigned long long pan;
+        std::string caption;
+
+        Pan(unsigned long long pan = 0ULL, const std::string &caption = "");
+        bool operator==(const Pan &other) const;
+    };
+
+    enum Counter : unsigned char
+    {
+        COUNTER_TAP_IN_REGULAR,
+        COUNTER_TAP_IN_ECONOMY,
+        COUNTER_TAP_IN_FREE,
+        COUNTER_TAP_OUT,
+        COUNTER_PENDING,
+        COUNTER_SENT,
+        COUNTER_COUNT
+    };
+
+    class Pending
+    {
+    public:
+        Slot<Rupiah> tariff;
+        Slot<std::string> status;
+        Slot<Pan> cardNumber;
+        Slot<bool> balance;
+        Slot<ScreenTemplate::Frame> message;
+        Slot<std::string> fletCode;
+        Slot<std::string> terminalId;
+        Slot<std::string> version;
+        std::array<unsigned int, COUNTER_COUNT> counters;
+        unsigned int counterDirty;
+
+        Pending();
+
+        bool isDirty() const;
+        void clear();
+    };
+
+    /* what the widgets currently show, only touched by the frame thread */
+    class Applied
+    {
+    public:
+        ScreenTemplate::Frame message;
+        bool isMessageShown;
+        std::array<unsigned int, COUNTER_COUNT> counters;
+        unsigned int counterKnown;
+
+        Applied();
+    };
+
+    Gui &gui;
+    Pending pending;
+    Applied applied;
+    bool isRun;
+    std::unique_ptr<std::thread> th;
+    std::mutex mtx;
+    std::condition_variable changed;
+
+    void setCounter(Counter counter, unsigned int value);
+    void notify();
+    void apply(const Pending &frame);
+    void routine();
+
+public:
+    GuiState(Gui &gui);
+    ~GuiState();
+
+    void begin();
+    void stop();
+    void flush();
+
+    void setTariff(unsigned int amount, const std::string &caption, bool show = false);
+    void hideTariff();
+    void setStatus(const std::string &text, bool show = false);
+    void hideStatus();
+    void setCardNumber(unsigned long long pan, const std::string &caption, bool show = false);
+    void hideCardNumber();
+    void hideBalance();
+    void showMessage(const ScreenTemplate::Frame &frame);
+    void showMessage(const std::array<std::string, ScreenTemplate::LINE_COUNT> &lines);
+    void hideMessage();
+    void setFletCode(const std::string &text);
+    void setTerminalId(const std::string &text);
+    void setVersion(const std::string &text);
+
+    void setCounters(unsigned int tapInRegular,
+                     unsigned int tapInEconomy,
+                     unsigned int tapInFree,
+                     unsigned int tapOut,
+                     unsigned int pending,
+                     unsigned int sent);
+};
+
+#endif
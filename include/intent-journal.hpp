@@ -0,0 +1,122 @@
+#ifndef __INTENT_JOURNAL_HPP__
+#define __INTENT_JOURNAL_HPP__
+
+#include <string>
+#include <array>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <cstdint>
+
+/*
+ * Fixed-size, checksummed, memory-mapped ring of deduct intents.
+ *
+ * begin() appends an intent before the card is debited, deducted() appends its
+ * balance and transcode once the debit succeeded and complete() closes it when
+ * the record is committed to the transaction database. Entries are appended,
+ * never rewritten in place, and stamped with a CRC32 last, so an interrupted
+ * append only loses that entry. begin() returns once the pages of its entry
+ * are on flash, the debit is never ahead of its intent; the other appends are
+ * a copy into the mapping that the flusher thread syncs later. That sync is what
+ * a deduct waits on; journal-bench times it, on the target eMMC it is unmeasured.
+ *
+ * The ring goes around the newest entry of every open intent instead of
+ * overwriting it. With all slots held by open intents begin() and deducted()
+ * refuse to append and return 0/false; complete() then replaces the intent's
+ * own entry.
+ *
+ * complete() is meant for records behind a durable commit only: a DONE entry
+ * for a record that can still be lost would drop its intent for good.
+ *
+ * open() walks the ring once; recover() hands the newest state of every intent
+ * without a closing entry to the caller, oldest intent first.
+ */
+class IntentJournal
+{
+public:
+    static const std::size_t CAPACITY = 256;
+
+    enum class State : uint32_t
+    {
+        PENDING = 1,
+        DEDUCTED = 2,
+        DONE = 3
+    };
+
+    struct Intent
+    {
+        uint64_t cardNumber;
+        int64_t time;
+        uint32_t ctype;
+        uint32_t amount;
+        uint32_t normalFare;
+        uint32_t minimumBalance;
+        int32_t balance;
+        uint8_t isTapIn;
+        uint8_t isEconomy;
+        uint8_t isFreeService;
+        uint8_t isPinalty;
+        char uuid[48];
+        char mid[24];
+        char tid[24];
+        char issuer[16];
+        char bank[16];
+        char transcode[320];
+        std::array<unsigned char, 64> userData;
+    };
+
+    /* returns true once the intent is settled, it is closed then */
+    typedef std::function<bool(State state, const Intent &intent)> Replay;
+
+private:
+    struct Entry
+    {
+        uint32_t magic;
+        uint32_t state;
+        uint64_t sequence;
+        uint64_t id;
+        Intent intent;
+        uint32_t crc;
+        uint32_t reserved;
+    };
+
+    std::string filePath;
+    int fd;
+    Entry *entries;
+    uint64_t sequence;
+    /* id of the open intent whose newest entry sits in the slot, 0 when the slot is free */
+    std::array<uint64_t, CAPACITY> live;
+    std::size_t head;
+    bool isRun;
+    bool isDirty;
+    std::unique_ptr<std::thread> th;
+    std::mutex mutex;
+    std::condition_variable dirty;
+
+    static uint32_t checksum(const Entry &entry);
+    static bool isValid(const Entry &entry);
+
+    std::size_t findLive(uint64_t id) const;
+    uint64_t append(State state, uint64_t id, const Intent *intent);
+    bool syncEntry(const Entry &entry);
+    void flush();
+
+public:
+    IntentJournal(const std::string &filePath);
+    ~IntentJournal();
+
+    bool open();
+    void close();
+
+    static void copy(char *target, std::size_t size, const std::string &source);
+
+    uint64_t begin(const Intent &intent);
+    bool deducted(uint64_t id, const Intent &intent);
+    bool complete(uint64_t id);
+
+    std::size_t recover(Replay replay);
+};
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef __LATENCY_STATS_HPP__
+#define __LATENCY_STATS_HPP__
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <cstdint>
+
+#include "duration.hpp"
+
+/*
+ * Log-linear latency histogram in microseconds. Values below 8 us get one
+ * bucket each; every power of two above is split into 8 equal buckets, so a
+ * bucket is at most 1/8 of its value wide. Recording is a couple of relaxed
+ * atomic operations and never allocates. Percentiles are interpolated inside
+ * the bucket they fall in and never exceed the recorded maximum.
+ */
+class LatencyHistogram
+{
+public:
+    static const std::size_t SUB_BUCKET_BITS = 3;
+    static const std::size_t SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+    static const std::size_t BUCKET_COUNT = (32 - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+    class Summary
+    {
+    public:
+        unsigned long long count;
+        double p50Ms;
+        double p95Ms;
+        double p99Ms;
+        double maxMs;
+    };
+
+private:
+    std::atomic<uint32_t> buckets[BUCKET_COUNT];
+    std::atomic<uint64_t> count;
+    std::atomic<uint32_t> maxUs;
+
+    static std::size_t bucketOf(uint32_t us);
+    static void bucketRange(std::size_t bucket, double &lowerUs, double &widthUs);
+
+    double percentile(const uint32_t *snapshot, uint64_t total, double ratio, double maxUs) const;
+
+public:
+    LatencyHistogram();
+    ~LatencyHistogram();
+
+    void record(double seconds);
+    Summary summary() const;
+    void reset();
+};
+
+/*
+ * Latency histograms per Duration stage and per issuer. Every Duration::Stage
+ * has its own slot, indexed by the enum; only custom captions are looked up
+ * by name, registered on first use (rare, under a mutex) in the slots after
+ * them. Lookups and recording are lock-free.
+ */
+class LatencyStats
+{
+public:
+    static const std::size_t FIXED_STAGE_COUNT = static_cast<std::size_t>(Duration::Stage::CUSTOM);
+    static const std::size_t STAGE_COUNT = 32;
+    static const std::size_t ISSUER_COUNT = 6; /* five issuers + all issuers */
+    static const std::size_t ISSUER_ALL = ISSUER_COUNT - 1;
+
+private:
+    std::string stages[STAGE_COUNT];
+    std::atomic<std::size_t> stageCount;
+    LatencyHistogram histograms[STAGE_COUNT][ISSUER_COUNT];
+    std::mutex mutex;
+
+    std::size_t findStage(const char *caption);
+    void record(std::size_t stage, unsigned int ctype, double seconds);
+
+public:
+    LatencyStats();
+    ~LatencyStats();
+
+    static std::size_t issuerIndex(unsigned int ctype);
+    static const char *issuerName(std::size_t issuer);
+    static std::size_t stageIndex(Duration::Stage stage);
+
+    void record(Duration::Stage stage, unsigned int ctype, double seconds);
+    void record(const char *stage, unsigned int ctype, double seconds);
+    void record(const Duration &duration, unsigned int ctype);
+
+    std::size_t getStageCount() const;
+    const std::string &getStage(std::size_t stage) const;
+    LatencyHistogram::Summary summary(std::size_t stage, std::size_t issuer) const;
+
+    bool dump(const std::string &filePath) const;
+};
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef __PERSISTENCE_WORKER_HPP__
+#define __PERSISTENCE_WORKER_HPP__
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <deque>
+#include <vector>
+#include <chrono>
+
+#include "transaction-store.hpp"
+
+class TransactionData;
+
+/*
+ * Write-behind queue between the card thread and the transaction database.
+ *
+ * Durability contract: the callback given to push() is invoked with `true` only
+ * after the record has been committed by TransactionStore, and with `false` when
+ * the insert failed, whichever way the record went. stop() drains everything
+ * already queued before returning; a record pushed while the worker is not
+ * running is committed on the caller's thread, push() then returns the outcome
+ * of that commit instead of whether the record was queued.
+ *
+ * Records that queued up while the previous commit was syncing go to the store
+ * as one batch, up to the maximum batch size; their outbox rows share one
+ * SQLite transaction, the records commit one by one. A group commit window
+ * additionally holds the first record until the window expires or the batch
+ * is full. Each record is still acknowledged individually once that
+ * transaction has committed.
+ *
+ * Records are handed to the recycler, when one is set, after their callback
+ * instead of being freed.
+ */
+class PersistenceWorker
+{
+public:
+    typedef std::function<void(bool committed)> Callback;
+    typedef std::function<void(std::unique_ptr<TransactionData> data)> Recycler;
+
+    /* commits and the time from push() until a record's commit returned */
+    class Stats
+    {
+    public:
+        unsigned long long commits;
+        unsigned long long records;
+        std::size_t maxGroup;
+        double totalLatencyMs;
+        double maxLatencyMs;
+
+        Stats();
+    };
+
+private:
+    class Entry
+    {
+    public:
+        std::unique_ptr<TransactionData> data;
+        Callback onCommitted;
+        TransactionStore::UploadTag tag;
+        std::chrono::steady_clock::time_point enqueuedAt;
+
+        Entry(std::unique_ptr<TransactionData> data, Callback onCommitted, const TransactionStore::UploadTag &tag);
+    };
+
+    bool isRun;
+    TransactionStore &store;
+    std::size_t capacity;
+    std::size_t maxBacklog;
+    std::chrono::milliseconds stallThreshold;
+    std::chrono::milliseconds groupWindow;
+    std::size_t groupSize;
+    std::deque<Entry> queue;
+    Stats stats;
+    Recycler recycler;
+    std::unique_ptr<std::thread> th;
+    mutable std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+
+    void routine();
+    void commit(std::vector<Entry> &batch,
+                std::vector<bool> &committed,
+                std::vector<const TransactionData *> &records,
+                std::vector<TransactionStore::UploadTag> &tags);
+    void release(std::unique_ptr<TransactionData> data);
+    bool commitInline(std::unique_ptr<TransactionData> data, Callback onCommitted, const TransactionStore::UploadTag &tag);
+
+public:
+    PersistenceWorker(TransactionStore &store, std::size_t capacity = 64, std::chrono::milliseconds stallThreshold = std::chrono::milliseconds(2000));
+    ~PersistenceWorker();
+
+    void setGroupCommit(std::chrono::milliseconds window, std::size_t maxRecords);
+    void setRecycler(Recycler recycler);
+
+    void begin();
+    void stop();
+
+    bool push(std::unique_ptr<TransactionData> data, Callback onCommitted, const TransactionStore::UploadTag &tag = TransactionStore::UploadTag());
+
+    std::size_t getBacklog() const;
+    std::size_t getMaxBacklog() const;
+    Stats getStats() const;
+};
+
+#endif
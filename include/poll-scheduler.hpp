@@ -0,0 +1,106 @@
+#ifndef __POLL_SCHEDULER_HPP__
+#define __POLL_SCHEDULER_HPP__
+
+#include <chrono>
+#include <vector>
+#include <string>
+#include <utility>
+
+/*
+ * Decides how long the controller sleeps between two card polls.
+ *
+ * next() is called after every selectAttachedCard() with the poll result and
+ * returns the delay before the following poll. It also records the
+ * poll-to-detect latency: the time between the last empty poll and the poll
+ * that found the card, an upper bound of how long the passenger waited before
+ * the reader looked at the card. held() is called instead while the card
+ * just processed stays on the reader, which is neither a new card nor an
+ * idle poll.
+ */
+class PollScheduler
+{
+public:
+    class Stats
+    {
+    public:
+        unsigned long long samples;
+        double totalMs;
+        double lastMs;
+        double maxMs;
+
+        Stats();
+        double getAverageMs() const;
+    };
+
+private:
+    std::chrono::steady_clock::time_point lastMiss;
+    bool hasLastMiss;
+    Stats stats;
+
+protected:
+    virtual std::chrono::milliseconds interval(bool isDetected, const std::chrono::steady_clock::time_point &now) = 0;
+
+public:
+    PollScheduler();
+    virtual ~PollScheduler();
+
+    std::chrono::milliseconds next(bool isDetected);
+    std::chrono::milliseconds held();
+
+    const Stats &getStats() const;
+    void resetStats();
+};
+
+/*
+ * Legacy behaviour: a constant delay whatever the bus is doing.
+ */
+class FixedPollScheduler : public PollScheduler
+{
+private:
+    std::chrono::milliseconds delay;
+
+protected:
+    std::chrono::milliseconds interval(bool isDetected, const std::chrono::steady_clock::time_point &now) override;
+
+public:
+    FixedPollScheduler(std::chrono::milliseconds delay = std::chrono::milliseconds(175));
+    ~FixedPollScheduler();
+};
+
+/*
+ * Polls every `fast` ms while a card was seen within `hold` or while the local
+ * time is inside a configured peak window, then doubles the delay on each
+ * empty poll up to `slow` to save CPU when the bus is idle.
+ *
+ * load() reads the route's settings, every key is optional:
+ * {"fast_ms": 10, "slow_ms": 160, "hold_s": 30,
+ *  "peak_windows": [{"start": "06:00", "end": "09:00"}, {"start": "22:30", "end": "01:00"}]}
+ */
+class AdaptivePollScheduler : public PollScheduler
+{
+private:
+    std::chrono::milliseconds fast;
+    std::chrono::milliseconds slow;
+    std::chrono::milliseconds hold;
+    std::chrono::milliseconds current;
+    std::chrono::steady_clock::time_point lastActivity;
+    std::vector<std::pair<int, int>> peakWindows;
+
+    bool isPeakTime() const;
+
+protected:
+    std::chrono::milliseconds interval(bool isDetected, const std::chrono::steady_clock::time_point &now) override;
+
+public:
+    AdaptivePollScheduler(std::chrono::milliseconds fast = std::chrono::milliseconds(10),
+                          std::chrono::milliseconds slow = std::chrono::milliseconds(160),
+                          std::chrono::milliseconds hold = std::chrono::milliseconds(30000));
+    ~AdaptivePollScheduler();
+
+    bool load(const std::string &filePath);
+
+    void addPeakWindow(int startMinuteOfDay, int endMinuteOfDay);
+    void clearPeakWindows();
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef __SCREEN_TEMPLATE_HPP__
+#define __SCREEN_TEMPLATE_HPP__
+
+#include <array>
+#include <ctime>
+#include <cstddef>
+
+/*
+ * Five line message screen. The layout (static text, or a prefix followed by
+ * a formatted value) is built once; rendering formats amounts and dates into
+ * a fixed frame without touching the heap, so two frames can be compared to
+ * skip repainting an identical screen. formatRupiah() is the only rupiah
+ * formatter of the validator, the UI helper renders through it.
+ */
+class ScreenTemplate
+{
+public:
+    static const std::size_t LINE_COUNT = 5;
+    static const std::size_t LINE_SIZE = 48;
+
+    enum class Field : unsigned char
+    {
+        TEXT,
+        AMOUNT,
+        BASE_AMOUNT,
+        BALANCE,
+        EXPIRE_DATE,
+        ERROR
+    };
+
+    class Line
+    {
+    public:
+        const char *text;
+        Field field;
+
+        Line(const char *text, Field field = Field::TEXT);
+    };
+
+    class Values
+    {
+    public:
+        unsigned int amount;
+        unsigned int baseAmount;
+        unsigned int balance;
+        std::time_t expire;
+        const char *error;
+
+        Values();
+    };
+
+    class Frame
+    {
+    public:
+        char lines[LINE_COUNT][LINE_SIZE];
+
+        Frame();
+
+        void clear();
+        bool operator==(const Frame &other) const;
+        bool operator!=(const Frame &other) const;
+    };
+
+private:
+    std::array<Line, LINE_COUNT> lines;
+
+public:
+    ScreenTemplate(const Line &first, const Line &second, const Line &third, const Line &fourth, const Line &fifth);
+    ~ScreenTemplate();
+
+    void render(const Values &values, Frame &frame) const;
+
+    static std::size_t formatRupiah(char *out, std::size_t size, unsigned int value, const char *pre = "");
+    static std::size_t formatDate(char *out, std::size_t size, std::time_t time, const char *pre = "");
+};
+
+#endif
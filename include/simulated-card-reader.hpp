@@ -0,0 +1,141 @@
+#ifndef __SIMULATED_CARD_READER_HPP__
+#define __SIMULATED_CARD_READER_HPP__
+
+#include <map>
+#include <array>
+#include <mutex>
+#include <random>
+#include <string>
+#include <cstddef>
+
+#include "card-reader.hpp"
+
+/*
+ * Card reader without hardware. Cards are registered up front and presented
+ * with present()/remove(). Every operation sleeps for a latency drawn from the
+ * profile of the card's issuer and can be made to fail with a given rate.
+ */
+class SimulatedCardReader : public CardReader
+{
+public:
+    enum class Operation : unsigned char
+    {
+        SELECT,
+        READ_USER_DATA,
+        WRITE_USER_DATA,
+        DEDUCT,
+        GET_BALANCE,
+        PURCHASE_COMMIT,
+        COUNT
+    };
+
+    static const std::size_t OPERATION_COUNT = static_cast<std::size_t>(Operation::COUNT);
+
+    enum Status
+    {
+        STATUS_SUCCESS = 0,
+        STATUS_INSUFFICIENT_VALUE = 1,
+        STATUS_FAILED = 2,
+        STATUS_NO_CARD = 3
+    };
+
+    /* normal distribution clipped at zero */
+    class Latency
+    {
+    public:
+        double meanMs;
+        double stddevMs;
+
+        Latency(double meanMs = 0.0, double stddevMs = 0.0);
+    };
+
+    class IssuerProfile
+    {
+    public:
+        std::string bank;
+        std::string issuer;
+        std::string mid;
+        std::string tid;
+        std::array<Latency, OPERATION_COUNT> latency;
+        std::array<double, OPERATION_COUNT> failureRate;
+
+        IssuerProfile();
+        IssuerProfile(const std::string &bank, const std::string &issuer);
+
+        IssuerProfile &setLatency(Operation op, double meanMs, double stddevMs = 0.0);
+        IssuerProfile &setFailureRate(Operation op, double rate);
+    };
+
+    class SimulatedCard
+    {
+    public:
+        unsigned long long cardNumber;
+        Card::cardType_t type;
+        int balance;
+        std::array<unsigned char, 64> userData;
+        unsigned short interop;
+        std::time_t expireOn;
+
+        SimulatedCard();
+    };
+
+private:
+    std::map<Card::cardType_t, IssuerProfile> profiles;
+    std::map<unsigned long long, SimulatedCard> cards;
+    SimulatedCard *presented;
+    SimulatedCard *selected;
+    unsigned int amount;
+    int lastBalance;
+    int lastStatus;
+    unsigned long long transcodeSeq;
+    std::string transcode;
+    double timeScale;
+    std::mt19937 rng;
+    std::mutex mtx;
+
+    const IssuerProfile &findProfile(Card::cardType_t type) const;
+    bool simulate(Operation op);
+
+public:
+    SimulatedCardReader(unsigned int seed = 5489U);
+    ~SimulatedCardReader();
+
+    void setProfile(Card::cardType_t type, const IssuerProfile &profile);
+    IssuerProfile getProfile(Card::cardType_t type);
+    void setTimeScale(double scale);
+
+    void addCard(unsigned long long cardNumber, Card::cardType_t type, int balance);
+    void addCard(const SimulatedCard &card);
+    bool getCard(unsigned long long cardNumber, SimulatedCard &card);
+    std::size_t getCardCount();
+
+    bool present(unsigned long long cardNumber);
+    void remove();
+
+    std::string getVersion() override;
+
+    bool selectAttachedCard() override;
+    unsigned long long getCardNumber() override;
+    bool readUserData(std::array<unsigned char, 64> &userData) override;
+    bool writeUserData(const std::array<unsigned char, 64> &toWrite, const std::array<unsigned char, 64> &userData) override;
+    void getFreeServiceParam(unsigned short &interop, std::time_t &expireOn) override;
+
+    std::string getBank() override;
+    std::string getIssuer() override;
+    Card::cardType_t getType() override;
+
+    void setAmount(unsigned int amount) override;
+    bool deduct() override;
+    int getLastBalance() override;
+    int getBalance() override;
+    bool purchaseCommit() override;
+
+    int getLastStatus() override;
+    bool isInsufficientValue() override;
+    std::string getTranscode() override;
+    std::string getTranscodeUTF8() override;
+    std::string getActiveMID() override;
+    std::string getActiveTID() override;
+};
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef __TAP_CONTEXT_HPP__
+#define __TAP_CONTEXT_HPP__
+
+#include <string>
+#include <vector>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <ctime>
+#include <cstdint>
+
+#include "uuid.hpp"
+#include "workflow/include/workflow-manager.hpp"
+
+class CardReader;
+class TransactionData;
+
+/*
+ * State shared by every transaction of one tap. reset() takes the clock once
+ * and reads the reader values the transactions repeat; the terminal identity
+ * is copied from the workflow on the first tap only and just restamped, until
+ * invalidate() reports a provision change. The card copy and the origin
+ * identity are built once per tap by bind(), or by bindUnread() when the card
+ * could not be read.
+ *
+ * The strings and objects are kept between taps and only reassigned, so their
+ * storage is reused. A journaled deduct leaves its intent here; the next
+ * record of the tap takes it, together with the UUID the intent was written
+ * with. TransactionData objects come from a small pool: the
+ * persistence worker hands them back through recycle() once committed, where
+ * they are reset to a freshly constructed record.
+ */
+class TapContext
+{
+public:
+    static const std::size_t POOL_SIZE = 16;
+
+private:
+    std::time_t time;
+    std::string issuer;
+    std::string bank;
+    std::string mid;
+    std::string tid;
+    std::string uuid;
+    uint64_t intent;
+    TransactionIdentity identity;
+    bool isIdentityLoaded;
+    std::atomic<bool> isProvisionChanged;
+    TransactionIdentity origin;
+    CardData card;
+    CardData unread;
+    bool isUnreadParsed;
+    const CardData *boundCard;
+    std::array<TransactionData *, POOL_SIZE> owned[2];
+    std::size_t ownedCount[2];
+    std::vector<std::unique_ptr<TransactionData>> pool[2];
+    std::unique_ptr<TransactionData> blank[2];
+    std::mutex poolMtx;
+
+    int findOwner(const TransactionData *tsc) const;
+
+public:
+    TapContext();
+    ~TapContext();
+
+    void invalidate();
+    void reset(CardReader &reader, WorkflowManager &workflow);
+    void bind(const CardData &refUserData);
+    void bindUnread(const Provision &provision);
+
+    std::time_t getTime() const;
+    const std::string &getIssuer() const;
+    const std::string &getBank() const;
+    const std::string &getMID() const;
+    const std::string &getTID() const;
+    const TransactionIdentity &getIdentity() const;
+    const TransactionIdentity &getOrigin() const;
+    const CardData &getCard() const;
+    const std::string &nextUUID();
+    const std::string &getUUID() const;
+
+    void setIntent(uint64_t intent);
+    uint64_t takeIntent();
+
+    std::unique_ptr<TransactionData> acquire(bool isTapIn);
+    void recycle(std::unique_ptr<TransactionData> tsc);
+};
+
+#endif
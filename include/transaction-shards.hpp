@@ -0,0 +1,77 @@
+#ifndef __TRANSACTION_SHARDS_HPP__
+#define __TRANSACTION_SHARDS_HPP__
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <mutex>
+#include <ctime>
+#include <sys/types.h>
+
+struct sqlite3;
+
+/*
+ * Layout of the day-sharded transaction databases.
+ *
+ * Every cycle writes its own basePath/YYYY/MMM/date/transaction.db, the same
+ * directory scheme as the counters, so the database a tap inserts into stays
+ * one day small. A shard whose upload cursor has reached its last outbox row
+ * can be rolled into transaction.db.xz next to it; query() opens live and
+ * archived shards alike, the latter through a scratch copy next to the
+ * archive. The last scratch copies are kept while their archive is unchanged,
+ * so repeated queries of the same days decompress them once.
+ *
+ * The single transaction.db written before the shards, when given and still
+ * present, is listed first with cycle 0: the uploader drains it like any
+ * other shard (its outbox is created and backfilled on the way) and it is
+ * archived once uploaded. Queries by cycle never reach it.
+ */
+class TransactionShards
+{
+public:
+    class Shard
+    {
+    public:
+        std::time_t cycle;
+        std::string path;
+        bool isArchived;
+    };
+
+    static const char *FILE_NAME;
+    static const char *ARCHIVE_SUFFIX;
+
+private:
+    class Scratch
+    {
+    public:
+        std::string path;
+        std::time_t mtime;
+        off_t size;
+    };
+
+    std::string basePath;
+    std::string legacyPath;
+    mutable std::vector<Scratch> scratches;
+    mutable std::mutex scratchMtx;
+
+    bool openScratch(const Shard &shard, std::string &path) const;
+    static bool compress(const std::string &source, const std::string &target);
+    static bool decompress(const std::string &source, const std::string &target);
+
+public:
+    TransactionShards(const std::string &basePath, const std::string &legacyPath = "");
+    ~TransactionShards();
+
+    std::string determinePath(const std::time_t time) const;
+    std::vector<Shard> list() const;
+
+    static bool isUploaded(const std::string &path);
+    bool archive(const Shard &shard) const;
+    std::size_t archiveUploaded(const std::time_t before, const std::string &busyPath) const;
+
+    bool query(const std::time_t from,
+               const std::time_t to,
+               std::function<bool(sqlite3 *db, const Shard &shard)> visitor) const;
+};
+
+#endif
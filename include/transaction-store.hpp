@@ -0,0 +1,154 @@
+#ifndef __TRANSACTION_STORE_HPP__
+#define __TRANSACTION_STORE_HPP__
+
+#include <string>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <ctime>
+
+struct sqlite3;
+struct sqlite3_stmt;
+class Sqlite3Transaction;
+class TransactionData;
+class TransactionShards;
+
+/*
+ * Long-lived owner of the transaction database connections.
+ *
+ * The shard of the current cycle is opened once (schema is created at the
+ * same time) and kept until the first insert of the next cycle switches to the
+ * next shard, so a tap only pays for the insert itself. Two connections are
+ * kept on the shard: the one inside Sqlite3Transaction, which insertLog()
+ * writes through and which the library does not expose, and the store's own,
+ * opened first and tuned for the validator workload (WAL journaling, which
+ * the file keeps for the library's connection too, synchronous FULL).
+ * isDurable() tells whether a commit on both has reached flash once insert()
+ * returns: the library's connection never sets synchronous, so it runs at the
+ * WAL default of the linked SQLite, read from a fresh connection at open.
+ *
+ * insertLog() commits every record on its own. The store then finds the row
+ * the record got (the next rowid of one of the library's tables) and writes
+ * its upload_outbox row, and the intent_applied row of a journaled deduct, on
+ * its own connection; a batch of records shares that one transaction. Every
+ * write to a shard, including the uploader's, holds writeMutex(), so the
+ * library's connection never meets a locked database.
+ *
+ * The outbox is append-only: upload_cursor holds the id of the last row the
+ * back office acknowledged and only moves forward. The next batch is a rowid
+ * range after the cursor and the per-cycle totals are read from a covering
+ * index, so neither query depends on how many months the database holds.
+ * Opening a shard queues every row of the library's tables past the last one
+ * in the outbox, uncounted since their card type is not known: a database
+ * written before the outbox, or a record whose outbox row was lost with a
+ * power cut right after the library's commit.
+ *
+ * isApplied() looks for the intent in intent_applied, then for a record with
+ * the intent UUID in the library's tables that have a uuid column, which
+ * covers the same power cut.
+ */
+class TransactionStore
+{
+public:
+    /* how the uploader accounts a record once the back office has it */
+    class UploadTag
+    {
+    public:
+        bool isCounted;
+        unsigned int ctype;
+        std::time_t cycle;
+        std::string intent;
+
+        UploadTag();
+        UploadTag(unsigned int ctype, std::time_t cycle);
+    };
+
+    /* uploaded and waiting records of one card type in one counter cycle */
+    class UploadCount
+    {
+    public:
+        unsigned int ctype;
+        unsigned int pending;
+        unsigned int sent;
+    };
+
+    static const char *OUTBOX_TABLE;
+    static const char *NEXT_BATCH_SQL;
+    static const char *ADVANCE_CURSOR_SQL;
+    static const char *READ_CURSOR_SQL;
+    static const char *COUNT_CYCLE_SQL;
+
+private:
+    /* a table insertLog() writes to, and the last of its rows queued for upload */
+    class Source
+    {
+    public:
+        std::string table;
+        long long lastRowId;
+        sqlite3_stmt *lastStmt;
+        sqlite3_stmt *queueStmt;
+    };
+
+    /* rows of one inserted record, still to be queued */
+    class Queued
+    {
+    public:
+        std::size_t source;
+        long long from;
+        long long to;
+        const UploadTag *tag;
+    };
+
+    const TransactionShards &shards;
+    std::string filePath;
+    std::time_t shardEnd;
+    std::unique_ptr<Sqlite3Transaction> db;
+    sqlite3 *handle;
+    bool isSynchronous;
+    bool hasOutbox;
+    std::vector<Source> sources;
+    std::vector<Queued> queued;
+    sqlite3_stmt *appliedStmt;
+    mutable std::mutex mutex;
+
+    static bool tune(sqlite3 *db, const std::string &path);
+    static bool exec(sqlite3 *db, const char *sql);
+    static bool hasColumn(sqlite3 *db, const std::string &table, const char *column);
+    static bool isFullSync(sqlite3 *db);
+    static std::vector<std::string> listSources(sqlite3 *db);
+    static bool catchUpOutbox(sqlite3 *db);
+
+    static bool countShard(sqlite3 *db, const std::time_t cycle, std::vector<UploadCount> &counts);
+    static bool findIntent(sqlite3 *db, const std::string &uuid);
+
+    bool openShard(const std::time_t time);
+    void closeShard();
+    bool rotate();
+    bool prepareOutbox();
+    bool loadSources();
+    void closeSources();
+    bool locate(Queued &entry);
+    bool insertLocked(const TransactionData &tsc, const UploadTag &tag);
+    bool queue();
+
+public:
+    TransactionStore(const TransactionShards &shards);
+    ~TransactionStore();
+
+    bool open();
+    void close();
+    bool isOpen() const;
+    bool isDurable() const;
+
+    static std::mutex &writeMutex();
+    static bool createOutbox(sqlite3 *db);
+    bool countUploads(const std::time_t cycle, std::vector<UploadCount> &counts) const;
+    bool isApplied(const std::string &intent, const std::time_t since) const;
+
+    bool insert(const TransactionData &tsc, const UploadTag &tag = UploadTag());
+    std::size_t insert(const std::vector<const TransactionData *> &records,
+                       const std::vector<UploadTag> &tags,
+                       std::vector<bool> &committed);
+};
+
+#endif
@@ -2,16 +2,30 @@
 #define __UI_HELPER__
 
 #include <string>
+#include <memory>
+#include <thread>
 #include <mutex>
+#include <atomic>
+#include <condition_variable>
 
-class Gui;
+#include "screen-template.hpp"
+
+class GuiState;
 class Counter;
 
 class UIHelper
 {
 private:
-    static bool isStateProcessing;
+    static std::atomic<bool> isStateProcessing;
+    static std::atomic<unsigned int> processingSeq;
     static std::mutex mtx;
+    static std::mutex animationMtx;
+    static std::condition_variable animationChanged;
+    static std::unique_ptr<std::thread> animationThread;
+    static bool isAnimationRun;
+
+    static void animationRoutine(GuiState &view);
+    static void show(GuiState &view, const ScreenTemplate &screen, const ScreenTemplate::Values &values);
 
 public:
     enum class TariffType : unsigned char
@@ -22,25 +36,28 @@ public:
         FREE = 0x03
     };
 
-    static void reset(Gui &gui, unsigned int amount);
-    static void updateCounter(Gui &gui, const Counter *counter);
-    static void processingCard(Gui &gui);
-
-    static void successTapInWithDeduct(Gui &gui, unsigned int amount, unsigned int baseAmount, unsigned int balance, TariffType type, std::time_t exp = 0);
-    static void successTapOutWithoutDeduct(Gui &gui, unsigned int balance, UIHelper::TariffType type, std::time_t exp = 0);
-
-    static void successTapOutWithDeduct(Gui &gui, unsigned int amount, unsigned int baseAmount, unsigned int balance, TariffType type, std::time_t exp = 0);
-    static void successTapInWithoutDeduct(Gui &gui, unsigned int balance, UIHelper::TariffType type, std::time_t exp = 0);
-    static void successResetTapIn(Gui &gui, unsigned int amount, unsigned int baseAmount, unsigned int balance, TariffType type, std::time_t exp = 0);
-
-    static void failedToReadCard(Gui &gui, const std::string &err);
-    static void failedToWriteCard(Gui &gui, const std::string &err);
-    static void failedToDeductCard(Gui &gui, const std::string &err);
-    static void insufficientBalance(Gui &gui, unsigned int balance);
-    static void blockingTime(Gui &gui);
-    static void freeServiceExpired(Gui &gui, std::time_t exp);
-    static void fareNotFound(Gui &gui);
-    static void insufficientMinimumBalance(Gui &gui, unsigned int balance);
+    static void beginAnimation(GuiState &view);
+    static void stopAnimation();
+
+    static void reset(GuiState &view, unsigned int amount);
+    static void updateCounter(GuiState &view, const Counter *counter);
+    static void processingCard(GuiState &view);
+
+    static void successTapInWithDeduct(GuiState &view, unsigned int amount, unsigned int baseAmount, unsigned int balance, TariffType type, std::time_t exp = 0);
+    static void successTapOutWithoutDeduct(GuiState &view, unsigned int balance, UIHelper::TariffType type, std::time_t exp = 0);
+
+    static void successTapOutWithDeduct(GuiState &view, unsigned int amount, unsigned int baseAmount, unsigned int balance, TariffType type, std::time_t exp = 0);
+    static void successTapInWithoutDeduct(GuiState &view, unsigned int balance, UIHelper::TariffType type, std::time_t exp = 0);
+    static void successResetTapIn(GuiState &view, unsigned int amount, unsigned int baseAmount, unsigned int balance, TariffType type, std::time_t exp = 0);
+
+    static void failedToReadCard(GuiState &view, const char *err);
+    static void failedToWriteCard(GuiState &view, const char *err);
+    static void failedToDeductCard(GuiState &view, const char *err);
+    static void insufficientBalance(GuiState &view, unsigned int balance);
+    static void blockingTime(GuiState &view);
+    static void freeServiceExpired(GuiState &view, std::time_t exp);
+    static void fareNotFound(GuiState &view);
+    static void insufficientMinimumBalance(GuiState &view, unsigned int balance);
 };
 
 #endif
\ No newline at end of file
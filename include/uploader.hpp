@@ -0,0 +1,119 @@
+#ifndef __UPLOADER_HPP__
+#define __UPLOADER_HPP__
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <ctime>
+#include <cstdint>
+
+struct sqlite3;
+struct sqlite3_stmt;
+struct curl_slist;
+class TransactionShards;
+
+/*
+ * Drains the upload_outbox of the transaction shards to the back office.
+ *
+ * The oldest shard with rows after its upload cursor is drained first, then
+ * the next one, up to the shard of the current cycle. A batch of outbox rows
+ * is read through a connection of its own, the source
+ * records are serialized as a JSON array, compressed to xz and POSTed on one
+ * kept-alive HTTP connection at a capped send rate. On a 2xx answer the upload
+ * cursor moves past the batch and the counted records are reported through the sent
+ * callback; any other outcome is retried with exponential backoff. While idle
+ * it rolls uploaded shards older than archive_after_days into xz archives.
+ * The thread runs at the lowest scheduling priority.
+ *
+ * The body is sent with "Content-Encoding: xz". xz is not a registered HTTP
+ * content coding, so proxies and stock servers will not decode it: the back
+ * office endpoint has to accept this header and unpack the body itself, as
+ * bench/upload-stub.py does.
+ *
+ * The endpoint comes from the configuration file; bench/upload-stub.py is a
+ * local HTTP stub for testing, it unpacks and counts every batch:
+ *   {"url": "http://127.0.0.1:8080/transactions", "batch_size": 50,
+ *    "interval_ms": 5000, "max_bytes_per_s": 16384, "timeout_s": 15,
+ *    "backoff_max_s": 300, "archive_after_days": 7}
+ */
+class Uploader
+{
+public:
+    class Config
+    {
+    public:
+        std::string url;
+        std::size_t batchSize;
+        std::chrono::milliseconds interval;
+        std::chrono::seconds timeout;
+        std::chrono::seconds backoffMax;
+        unsigned long maxBytesPerSecond;
+        unsigned int archiveAfterDays;
+
+        Config();
+
+        bool load(const std::string &filePath);
+    };
+
+    /* count records of one card type and counter cycle reached the back office */
+    typedef std::function<void(unsigned int ctype, std::time_t cycle, unsigned int count)> SentCallback;
+
+private:
+    class Pending
+    {
+    public:
+        long long id;
+        bool isCounted;
+        unsigned int ctype;
+        std::time_t cycle;
+    };
+
+    std::atomic<bool> isRun;
+    const TransactionShards &shards;
+    Config config;
+    SentCallback onSent;
+    sqlite3 *db;
+    std::string shardPath;
+    std::time_t shardCycle;
+    sqlite3_stmt *outboxStmt;
+    sqlite3_stmt *sourceStmt;
+    std::string sourceTable;
+    void *curl;
+    curl_slist *headers;
+    std::chrono::steady_clock::time_point lastArchive;
+    std::unique_ptr<std::thread> th;
+    std::mutex mutex;
+    std::condition_variable wake;
+
+    bool openShard(const std::string &path, const std::time_t cycle);
+    bool hasPending();
+    bool openDatabase();
+    void closeDatabase();
+    bool openConnection();
+    void closeConnection();
+
+    bool readBatch(std::vector<Pending> &batch, std::string &payload);
+    bool appendRecord(const std::string &table, long long rowid, std::string &payload);
+    bool compress(const std::string &payload, std::vector<uint8_t> &body);
+    bool post(const std::vector<uint8_t> &body);
+    bool markSent(long long lastId);
+    void report(const std::vector<Pending> &batch);
+    void archive();
+
+    void routine();
+
+public:
+    Uploader(const TransactionShards &shards, const Config &config, SentCallback onSent);
+    ~Uploader();
+
+    void begin();
+    void stop();
+};
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef __UUID_HPP__
+#define __UUID_HPP__
+
+#include <string>
+#include <cstdint>
+
+/*
+ * UUIDv7 (RFC 9562) style generator.
+ *
+ * 48-bit Unix time in milliseconds, version 7 with a 12-bit counter so
+ * identifiers created within the same millisecond still sort in creation
+ * order, then the RFC variant and 78 random bits from a per-thread generator.
+ * The shared state is a single atomic word, the text form is hex encoded
+ * straight into the caller's buffer.
+ *
+ * The text keeps the layout the validator always sent to the back office,
+ * 12-4-4-4-12 hex digits (40 characters), not the 8-4-4-4-12 of RFC 9562; the
+ * timestamp is the whole first group, so the text still sorts by time.
+ */
+class UUIDv7
+{
+public:
+    static const std::size_t STRING_LENGTH = 40;
+
+    static void generate(char (&out)[STRING_LENGTH + 1]);
+    static std::string generate();
+
+    static void format(char (&out)[STRING_LENGTH + 1], uint64_t timestamp, uint64_t random, uint64_t tail);
+
+private:
+    static uint64_t nextTimestamp();
+    static uint64_t random();
+};
+
+#endif
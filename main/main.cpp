@@ -4,12 +4,17 @@
 #include <functional>
 #include <thread>
 #include <algorithm>
+#include <memory>
+#include <array>
+#include <string>
 
 #include "controller.hpp"
+#include "card-reader.hpp"
+#include "gui-state.hpp"
+#include "async-log.hpp"
 #include "epayment/include/epayment.hpp"
 #include "workflow/include/workflow-manager.hpp"
 #include "gui/include/gui.hpp"
-#include "tscdata/include/sqlite3-transaction.hpp"
 #include "communication/include/fetch-api.hpp"
 
 #include "utils/include/debug.hpp"
@@ -41,6 +46,72 @@ std::string toTerminal(const std::array<unsigned char, 8> &tid)
     return result.data();
 }
 
+/* boot screen for the SAM initialization, updated from the initializer threads */
+class SamProgress
+{
+private:
+    GuiState &view;
+    std::array<std::string, 5> status;
+    bool isVisible;
+    std::mutex mtx;
+
+    void render()
+    {
+        this->view.showMessage(
+            {"Initialize SAM MDR  " + this->status[0],
+             "Initialize SAM BNI  " + this->status[1],
+             "Initialize SAM BRI  " + this->status[2],
+             "Initialize SAM BCA  " + this->status[3],
+             "Initialize SAM DKI  " + this->status[4]});
+    }
+
+public:
+    SamProgress(GuiState &view) : view(view),
+                                  status({"...", "...", "...", "...", "..."}),
+                                  isVisible(false),
+                                  mtx()
+    {
+    }
+
+    void show()
+    {
+        std::lock_guard<std::mutex> guard(this->mtx);
+        this->isVisible = true;
+        this->render();
+    }
+
+    void update(std::size_t index, bool ready)
+    {
+        std::lock_guard<std::mutex> guard(this->mtx);
+        this->status[index] = ready ? " OK" : "ERR";
+        /* late SAMs only get logged, the screen belongs to transactions by then */
+        if (this->isVisible)
+            this->render();
+    }
+
+    void hide()
+    {
+        std::lock_guard<std::mutex> guard(this->mtx);
+        this->isVisible = false;
+        this->view.hideMessage();
+    }
+};
+
+/* stops the log when it goes out of scope, declared before the controller so it outlives it */
+class AsyncLogScope
+{
+public:
+    AsyncLogScope()
+    {
+        AsyncLog::begin();
+    }
+
+    ~AsyncLogScope()
+    {
+        AsyncLog::stop();
+    }
+};
+
 int main(int argc, char *argv[])
 {
     if (argc > 1)
@@ -73,9 +144,7 @@ int main(int argc, char *argv[])
 
     Debug::setMaxLinesLogCache(1024);
     Debug::setupTXTLogFile(MAIN_APP_LOG_DIRECTORY, MAIN_APP_LOG_FILE, 20971520UL, 5, 5);
-
-    Sqlite3Transaction tscdb(TRANSACTION_DATABASE);
-    tscdb.createLog();
+    AsyncLogScope log;
 
     Gui gui;
     Epayment epayment;
@@ -83,13 +152,15 @@ int main(int argc, char *argv[])
 
     if (workflow.loadProvision(PROVISION_CONFIG_FILE) == false)
     {
-        Debug::critical(__FILE__, __LINE__, __func__, "invalid provision data: %s\n", PROVISION_CONFIG_FILE);
-        exit(0);
+        FTV_LOG_CRITICAL("invalid provision data: %s\n", PROVISION_CONFIG_FILE);
+        /* returns instead of exit() so the log scope drains the message */
+        return 0;
     }
 
-    Controller controller(epayment, workflow, gui);
+    EpaymentCardReader reader(epayment);
+    Controller controller(reader, workflow, gui);
 
-    Debug::info(__FILE__, __LINE__, __func__, "epayment library version: %s\n", epayment.getVersion().c_str());
+    FTV_LOG_INFO("epayment library version: %s\n", epayment.getVersion().c_str());
 
     const PaymentAcceptance &p = workflow.getProvision().getData().getPaymentAcceptance();
 
@@ -159,79 +230,68 @@ int main(int argc, char *argv[])
     }
 
     controller.begin(
-        [](Epayment &ep, WorkflowManager &workflow, Gui &ui)
+        [&controller, &epayment](CardReader &reader, WorkflowManager &workflow, GuiState &view)
         {
-            bool samMandiri = false;
-            bool samBni = false;
-            bool samBri = false;
-            bool samBca = false;
-            bool samDki = false;
-
-            ui.labelFletCode.setText(toFletCode(workflow.getIdentity().getFletCode()));
-            ui.labelTerminalId.setText(toTerminal(workflow.getIdentity().getTerminalId()));
-
-            ui.labelTariff.hide();
-            ui.labelVersion.setText(ep.getVersion());
-
-            ui.message.show(
-                {"Initialize SAM MDR  ...",
-                 "Initialize SAM BNI   - ",
-                 "Initialize SAM BRI   - ",
-                 "Initialize SAM BCA   - ",
-                 "Initialize SAM DKI   - "});
-
-            samMandiri = ep.initMandiriSAM(230400);
-
-            ui.message.show(
-                {"Initialize SAM MDR  " + std::string(samMandiri ? " OK" : "ERR"),
-                 "Initialize SAM BNI  ...",
-                 "Initialize SAM BRI   - ",
-                 "Initialize SAM BCA   - ",
-                 "Initialize SAM DKI   - "});
-
-            samBni = ep.initBNISAM(115200);
-
-            ui.message.show(
-                {"Initialize SAM MDR  " + std::string(samMandiri ? " OK" : "ERR"),
-                 "Initialize SAM BNI  " + std::string(samBni ? " OK" : "ERR"),
-                 "Initialize SAM BRI  ...",
-                 "Initialize SAM BCA   - ",
-                 "Initialize SAM DKI   - "});
-
-            samBri = ep.initBRISAM(115200);
-
-            ui.message.show(
-                {"Initialize SAM MDR  " + std::string(samMandiri ? " OK" : "ERR"),
-                 "Initialize SAM BNI  " + std::string(samBni ? " OK" : "ERR"),
-                 "Initialize SAM BRI  " + std::string(samBri ? " OK" : "ERR"),
-                 "Initialize SAM BCA  ...",
-                 "Initialize SAM DKI   - "});
-
-            samBca = ep.initBCASAM(115200);
-
-            ui.message.show(
-                {"Initialize SAM MDR  " + std::string(samMandiri ? " OK" : "ERR"),
-                 "Initialize SAM BNI  " + std::string(samBni ? " OK" : "ERR"),
-                 "Initialize SAM BRI  " + std::string(samBri ? " OK" : "ERR"),
-                 "Initialize SAM BCA  " + std::string(samBca ? " OK" : "ERR"),
-                 "Initialize SAM DKI  ..."});
-
-            samDki = ep.initDKISAM(115200);
-
-            ui.message.show(
-                {"Initialize SAM MDR  " + std::string(samMandiri ? " OK" : "ERR"),
-                 "Initialize SAM BNI  " + std::string(samBni ? " OK" : "ERR"),
-                 "Initialize SAM BRI  " + std::string(samBri ? " OK" : "ERR"),
-                 "Initialize SAM BCA  " + std::string(samBca ? " OK" : "ERR"),
-                 "Initialize SAM DKI  " + std::string(samDki ? " OK" : "ERR")});
-
-            std::this_thread::sleep_for(std::chrono::seconds(1));
-
-            ui.labelTariff.setRupiah(1, "Tarif", true);
-            ui.labelStatus.hide();
-            ui.message.hide();
-
-            Debug::moveLogHistoryToFile();
+            view.setFletCode(toFletCode(workflow.getIdentity().getFletCode()));
+            view.setTerminalId(toTerminal(workflow.getIdentity().getTerminalId()));
+
+            view.hideTariff();
+            view.setVersion(reader.getVersion());
+
+            std::shared_ptr<SamProgress> progress(new SamProgress(view));
+            progress->show();
+
+            /* the SAMs initialize one after the other in the background, the first ready one opens the validator */
+            controller.initIssuer(
+                Card::CARD_TYPE_MANDIRI, "MDR",
+                [&epayment]()
+                { return epayment.initMandiriSAM(230400); },
+                [progress](bool ready)
+                { progress->update(0, ready); });
+            controller.initIssuer(
+                Card::CARD_TYPE_BNI, "BNI",
+                [&epayment]()
+                { return epayment.initBNISAM(115200); },
+                [progress](bool ready)
+                { progress->update(1, ready); });
+            controller.initIssuer(
+                Card::CARD_TYPE_BRI, "BRI",
+                [&epayment]()
+                { return epayment.initBRISAM(115200); },
+                [progress](bool ready)
+                { progress->update(2, ready); });
+            controller.initIssuer(
+                Card::CARD_TYPE_BCA, "BCA",
+                [&epayment]()
+                { return epayment.initBCASAM(115200); },
+                [progress](bool ready)
+                { progress->update(3, ready); });
+            controller.initIssuer(
+                Card::CARD_TYPE_DKI, "DKI",
+                [&epayment]()
+                { return epayment.initDKISAM(115200); },
+                [progress](bool ready)
+                { progress->update(4, ready); });
+
+            std::vector<std::string> pending;
+            if (controller.waitAnyIssuerReady(&pending) == false)
+            {
+                FTV_LOG_CRITICAL("no SAM is ready\n");
+            }
+            for (const std::string &name : pending)
+            {
+                FTV_LOG_INFO("SAM %s still initializing\n", name.c_str());
+            }
+
+            if (controller.getPendingIssuers() == 0)
+            {
+                /* everything finished at once, leave the summary on screen for a moment */
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+            }
+            progress->hide();
+
+            view.setTariff(1, "Tarif", true);
+            view.hideStatus();
         });
 
     gui.begin(argc, argv);
@@ -0,0 +1,371 @@
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include "async-log.hpp"
+
+#include "utils/include/debug.hpp"
+
+/* one history move per second at most, or earlier when the Debug line cache fills up */
+#define ASYNC_LOG_FLUSH_INTERVAL_MS 1000
+#define ASYNC_LOG_FLUSH_LINES 256
+#define ASYNC_LOG_STOP_DRAIN_MS 100
+
+std::atomic<bool> AsyncLog::isRunning(false);
+std::atomic<unsigned long long> AsyncLog::dropped(0ULL);
+
+AsyncLog::Cell AsyncLog::cells[AsyncLog::CAPACITY];
+std::atomic<std::size_t> AsyncLog::enqueuePos(0);
+std::size_t AsyncLog::dequeuePos = 0;
+static std::unique_ptr<std::thread> th;
+
+void AsyncLog::Record::reset(Level level, const char *file, int line, const char *func, const char *format)
+{
+    this->level = level;
+    this->argCount = 0;
+    this->textUsed = 0;
+    this->line = line;
+    this->file = file;
+    this->func = func;
+    this->format = format;
+}
+
+void AsyncLog::Record::addSigned(long long value)
+{
+    if (this->argCount >= MAX_ARGS)
+        return;
+    Arg &arg = this->args[this->argCount++];
+    arg.type = Arg::Type::SIGNED;
+    arg.i = value;
+}
+
+void AsyncLog::Record::addUnsigned(unsigned long long value)
+{
+    if (this->argCount >= MAX_ARGS)
+        return;
+    Arg &arg = this->args[this->argCount++];
+    arg.type = Arg::Type::UNSIGNED;
+    arg.u = value;
+}
+
+void AsyncLog::Record::addDouble(double value)
+{
+    if (this->argCount >= MAX_ARGS)
+        return;
+    Arg &arg = this->args[this->argCount++];
+    arg.type = Arg::Type::DOUBLE;
+    arg.d = value;
+}
+
+void AsyncLog::Record::addString(const char *value)
+{
+    if (this->argCount >= MAX_ARGS)
+        return;
+    Arg &arg = this->args[this->argCount++];
+    arg.type = Arg::Type::STRING;
+    arg.offset = this->textUsed;
+
+    /* strings share the inline text area, the last one gets truncated */
+    std::size_t room = TEXT_SIZE - this->textUsed - 1;
+    std::size_t length = value ? strnlen(value, room) : 0;
+    if (length > 0)
+        memcpy(this->text + this->textUsed, value, length);
+    this->text[this->textUsed + length] = 0x00;
+    this->textUsed = static_cast<unsigned short>(this->textUsed + length + ((this->textUsed + length + 1 < TEXT_SIZE) ? 1 : 0));
+}
+
+void AsyncLog::Record::addPointer(const void *value)
+{
+    if (this->argCount >= MAX_ARGS)
+        return;
+    Arg &arg = this->args[this->argCount++];
+    arg.type = Arg::Type::POINTER;
+    arg.p = value;
+}
+
+void AsyncLog::Record::add(const char *value)
+{
+    this->addString(value);
+}
+
+void AsyncLog::Record::add(char *value)
+{
+    this->addString(value);
+}
+
+void AsyncLog::Record::add(const std::string &value)
+{
+    this->addString(value.c_str());
+}
+
+void AsyncLog::Record::add(const void *value)
+{
+    this->addPointer(value);
+}
+
+AsyncLog::Cell *AsyncLog::reserve()
+{
+    /* bounded MPMC ring (Vyukov), every cell carries the position it expects next */
+    std::size_t pos = AsyncLog::enqueuePos.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        Cell *cell = &AsyncLog::cells[pos & (CAPACITY - 1)];
+        std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+        long long diff = static_cast<long long>(seq) - static_cast<long long>(pos);
+        if (diff == 0)
+        {
+            if (AsyncLog::enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                cell->position = pos;
+                return cell;
+            }
+        }
+        else if (diff < 0)
+        {
+            return nullptr;
+        }
+        else
+        {
+            pos = AsyncLog::enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void AsyncLog::commit(Cell *cell)
+{
+    cell->sequence.store(cell->position + 1, std::memory_order_release);
+}
+
+std::size_t AsyncLog::format(const Record &record, char *out, std::size_t size)
+{
+    std::size_t used = 0;
+    std::size_t argIndex = 0;
+    const char *p = record.format;
+
+    if (size == 0)
+        return 0;
+    out[0] = 0x00;
+
+    while (*p != 0x00 && used + 1 < size)
+    {
+        if (*p != '%')
+        {
+            out[used++] = *p++;
+            continue;
+        }
+        if (p[1] == '%')
+        {
+            out[used++] = '%';
+            p += 2;
+            continue;
+        }
+
+        /* copy flags, width and precision, drop the length modifier, keep the conversion */
+        char spec[32];
+        std::size_t specLength = 0;
+        spec[specLength++] = *p++;
+        while (*p != 0x00 && strchr("-+ #0123456789.", *p) != nullptr && specLength < sizeof(spec) - 4)
+            spec[specLength++] = *p++;
+        while (*p != 0x00 && strchr("hlLqjzt", *p) != nullptr)
+            p++;
+        char conversion = *p;
+        if (conversion == 0x00)
+            break;
+        p++;
+
+        int written = 0;
+        if (argIndex >= record.argCount)
+        {
+            written = snprintf(out + used, size - used, "(missing)");
+        }
+        else
+        {
+            const Arg &arg = record.args[argIndex++];
+            switch (conversion)
+            {
+            case 'd':
+            case 'i':
+                spec[specLength++] = 'l';
+                spec[specLength++] = 'l';
+                spec[specLength++] = 'd';
+                spec[specLength] = 0x00;
+                written = snprintf(out + used, size - used, spec, arg.type == Arg::Type::UNSIGNED ? static_cast<long long>(arg.u) : arg.i);
+                break;
+            case 'c':
+                spec[specLength++] = 'c';
+                spec[specLength] = 0x00;
+                written = snprintf(out + used, size - used, spec, static_cast<int>(arg.type == Arg::Type::UNSIGNED ? arg.u : static_cast<unsigned long long>(arg.i)));
+                break;
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X':
+                spec[specLength++] = 'l';
+                spec[specLength++] = 'l';
+                spec[specLength++] = conversion;
+                spec[specLength] = 0x00;
+                written = snprintf(out + used, size - used, spec, arg.type == Arg::Type::SIGNED ? static_cast<unsigned long long>(arg.i) : arg.u);
+                break;
+            case 'f':
+            case 'F':
+            case 'e':
+            case 'E':
+            case 'g':
+            case 'G':
+                spec[specLength++] = conversion;
+                spec[specLength] = 0x00;
+                written = snprintf(out + used, size - used, spec, arg.type == Arg::Type::DOUBLE ? arg.d : static_cast<double>(arg.i));
+                break;
+            case 's':
+                spec[specLength++] = 's';
+                spec[specLength] = 0x00;
+                written = snprintf(out + used, size - used, spec, arg.type == Arg::Type::STRING ? record.text + arg.offset : "(invalid)");
+                break;
+            case 'p':
+                written = snprintf(out + used, size - used, "%p", arg.p);
+                break;
+            default:
+                written = snprintf(out + used, size - used, "(?)");
+                break;
+            }
+        }
+        if (written < 0)
+            break;
+        used += static_cast<std::size_t>(written);
+        if (used >= size)
+        {
+            used = size - 1;
+            break;
+        }
+    }
+    out[used] = 0x00;
+    return used;
+}
+
+void AsyncLog::write(const Record &record)
+{
+    char line[512];
+    AsyncLog::format(record, line, sizeof(line));
+    switch (record.level)
+    {
+    case Level::WARNING:
+        Debug::warning(record.file, record.line, record.func, "%s", line);
+        break;
+    case Level::ERROR:
+        Debug::error(record.file, record.line, record.func, "%s", line);
+        break;
+    case Level::CRITICAL:
+        Debug::critical(record.file, record.line, record.func, "%s", line);
+        break;
+    default:
+        Debug::info(record.file, record.line, record.func, "%s", line);
+        break;
+    }
+}
+
+void AsyncLog::routine()
+{
+    /* formatting and file I/O must not compete with the tap and persistence threads */
+    setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19);
+
+    unsigned long long reportedDrops = 0ULL;
+    std::size_t pendingLines = 0;
+    std::chrono::steady_clock::time_point lastFlush = std::chrono::steady_clock::now();
+
+    for (;;)
+    {
+        bool isStopping = (AsyncLog::isRunning.load(std::memory_order_acquire) == false);
+        std::size_t count = 0;
+        for (;;)
+        {
+            Cell *cell = &AsyncLog::cells[AsyncLog::dequeuePos & (CAPACITY - 1)];
+            if (cell->sequence.load(std::memory_order_acquire) != AsyncLog::dequeuePos + 1)
+                break;
+            AsyncLog::write(cell->record);
+            cell->sequence.store(AsyncLog::dequeuePos + CAPACITY, std::memory_order_release);
+            AsyncLog::dequeuePos++;
+            count++;
+            if (++pendingLines >= ASYNC_LOG_FLUSH_LINES)
+            {
+                Debug::moveLogHistoryToFile();
+                pendingLines = 0;
+                lastFlush = std::chrono::steady_clock::now();
+            }
+        }
+
+        unsigned long long drops = AsyncLog::dropped.load(std::memory_order_relaxed);
+        if (drops != reportedDrops)
+        {
+            Debug::warning(__FILE__, __LINE__, __func__, "%llu log record(s) dropped (total %llu)\n", drops - reportedDrops, drops);
+            reportedDrops = drops;
+            pendingLines++;
+        }
+
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (pendingLines > 0 && (isStopping || now - lastFlush >= std::chrono::milliseconds(ASYNC_LOG_FLUSH_INTERVAL_MS)))
+        {
+            Debug::moveLogHistoryToFile();
+            pendingLines = 0;
+            lastFlush = now;
+        }
+
+        if (isStopping)
+            break;
+        if (count == 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+}
+
+void AsyncLog::begin()
+{
+    if (th.get())
+        return;
+    for (std::size_t i = 0; i < CAPACITY; i++)
+        AsyncLog::cells[i].sequence.store(i, std::memory_order_relaxed);
+    AsyncLog::enqueuePos.store(0, std::memory_order_relaxed);
+    AsyncLog::dequeuePos = 0;
+    AsyncLog::isRunning.store(true, std::memory_order_release);
+    th.reset(new std::thread(&AsyncLog::routine));
+}
+
+void AsyncLog::stop()
+{
+    AsyncLog::isRunning.store(false, std::memory_order_release);
+    if (th.get())
+    {
+        th->join();
+        th.reset();
+    }
+
+    /* a caller that still saw the log running may commit after the last drain of the thread,
+     * wait a moment for a reserved record rather than leave it in the ring */
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(ASYNC_LOG_STOP_DRAIN_MS);
+    bool isWritten = false;
+    while (AsyncLog::dequeuePos != AsyncLog::enqueuePos.load(std::memory_order_acquire))
+    {
+        Cell *cell = &AsyncLog::cells[AsyncLog::dequeuePos & (CAPACITY - 1)];
+        if (cell->sequence.load(std::memory_order_acquire) != AsyncLog::dequeuePos + 1)
+        {
+            if (std::chrono::steady_clock::now() >= deadline)
+                break;
+            std::this_thread::yield();
+            continue;
+        }
+        AsyncLog::write(cell->record);
+        cell->sequence.store(AsyncLog::dequeuePos + CAPACITY, std::memory_order_release);
+        AsyncLog::dequeuePos++;
+        isWritten = true;
+    }
+    if (isWritten)
+        Debug::moveLogHistoryToFile();
+}
+
+unsigned long long AsyncLog::getDropped()
+{
+    return AsyncLog::dropped.load(std::memory_order_relaxed);
+}
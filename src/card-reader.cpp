@@ -0,0 +1,116 @@
+#include "card-reader.hpp"
+#include "epayment/include/epayment.hpp"
+
+CardReader::~CardReader() {}
+
+EpaymentCardReader::EpaymentCardReader(Epayment &epayment) : epayment(epayment)
+{
+}
+
+EpaymentCardReader::~EpaymentCardReader() {}
+
+Epayment &EpaymentCardReader::getEpayment()
+{
+    return this->epayment;
+}
+
+std::string EpaymentCardReader::getVersion()
+{
+    return this->epayment.getVersion();
+}
+
+bool EpaymentCardReader::selectAttachedCard()
+{
+    return this->epayment.selectAttachedCard();
+}
+
+unsigned long long EpaymentCardReader::getCardNumber()
+{
+    return this->epayment.getCardNumber();
+}
+
+bool EpaymentCardReader::readUserData(std::array<unsigned char, 64> &userData)
+{
+    return this->epayment.readUserData<64>(userData);
+}
+
+bool EpaymentCardReader::writeUserData(const std::array<unsigned char, 64> &toWrite, const std::array<unsigned char, 64> &userData)
+{
+    return this->epayment.writeUserData<64>(toWrite, userData);
+}
+
+void EpaymentCardReader::getFreeServiceParam(unsigned short &interop, std::time_t &expireOn)
+{
+    this->epayment.getFreeServiceParam(interop, expireOn);
+}
+
+std::string EpaymentCardReader::getBank()
+{
+    return this->epayment.getBank();
+}
+
+std::string EpaymentCardReader::getIssuer()
+{
+    return this->epayment.getIssuer();
+}
+
+Card::cardType_t EpaymentCardReader::getType()
+{
+    return this->epayment.getType();
+}
+
+void EpaymentCardReader::setAmount(unsigned int amount)
+{
+    this->epayment.setAmount(amount);
+}
+
+bool EpaymentCardReader::deduct()
+{
+    return this->epayment.deduct();
+}
+
+int EpaymentCardReader::getLastBalance()
+{
+    return this->epayment.getLastBalance();
+}
+
+int EpaymentCardReader::getBalance()
+{
+    return this->epayment.getBalance();
+}
+
+bool EpaymentCardReader::purchaseCommit()
+{
+    return this->epayment.purchaseCommit();
+}
+
+int EpaymentCardReader::getLastStatus()
+{
+    return static_cast<int>(this->epayment.getLastStatus());
+}
+
+bool EpaymentCardReader::isInsufficientValue()
+{
+    return this->epayment.getLastStatus() == Epayment::CARD_OP_INSUFFICIENT_VALUE;
+}
+
+std::string EpaymentCardReader::getTranscode()
+{
+    return this->epayment.getTranscode();
+}
+
+std::string EpaymentCardReader::getTranscodeUTF8()
+{
+    const char *transcode = this->epayment.getTranscodeUTF8();
+    return transcode ? std::string(transcode) : std::string();
+}
+
+std::string EpaymentCardReader::getActiveMID()
+{
+    return this->epayment.getActiveMID();
+}
+
+std::string EpaymentCardReader::getActiveTID()
+{
+    return this->epayment.getActiveTID();
+}
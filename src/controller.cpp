@@ -1,78 +1,139 @@
 #include <cstring>
 #include <cstdlib>
+#include <algorithm>
 #include <chrono>
-#include <random>
-#include <sstream>
-#include <iomanip>
 #include "counter.hpp"
+#include "counter-rotation.hpp"
 #include "controller.hpp"
 #include "ui-helper.hpp"
 #include "duration.hpp"
+#include "transaction-shards.hpp"
+#include "transaction-store.hpp"
+#include "persistence-worker.hpp"
+#include "uploader.hpp"
+#include "poll-scheduler.hpp"
+#include "latency-stats.hpp"
+#include "uuid.hpp"
+#include "card-reader.hpp"
+#include "tap-context.hpp"
+#include "gui-state.hpp"
 #include "gui/include/gui.hpp"
-#include "epayment/include/epayment.hpp"
 #include "workflow/include/workflow-manager.hpp"
 #include "tscdata/include/transaction-data.hpp"
-#include "tscdata/include/sqlite3-transaction.hpp"
 
-#include "utils/include/debug.hpp"
+#include "async-log.hpp"
 
-static std::string generateTimeBasedUUID(std::time_t timeValue)
+/* adds a committed record to the issuer totals of its counter */
+static void countTransaction(Counter &counter,
+                             unsigned int ctype,
+                             bool isTapIn,
+                             bool isDeduct,
+                             bool isFreeService,
+                             bool isEconomy,
+                             unsigned int amount)
 {
-    unsigned long long timestampMs = static_cast<unsigned long long>(timeValue) * 1000ULL;
-
-    static std::mt19937 gen(static_cast<unsigned>(
-        std::chrono::high_resolution_clock::now()
-            .time_since_epoch()
-            .count()));
-
-    std::uniform_int_distribution<unsigned long long> dist(0, UINT64_MAX);
-
-    unsigned long long randA = dist(gen);
-    unsigned long long randB = dist(gen);
-
-    std::stringstream ss;
-    ss << std::hex << std::setfill('0');
-
-    // 48-bit timestamp
-    ss << std::setw(12) << (timestampMs & 0xFFFFFFFFFFFFULL);
-    ss << "-";
-
-    // version 7
-    ss << std::setw(4) << ((randA & 0x0FFFULL) | 0x7000);
-    ss << "-";
+    Counter::Issuer &cissuer = counter.getIssuerByEpaymentCardType(ctype);
+    if (isTapIn)
+    {
+        if (isFreeService)
+        {
+            cissuer.incTapInFreeService();
+        }
+        else if (isEconomy)
+        {
+            cissuer.incTapInEconomy();
+        }
+        else
+        {
+            cissuer.incTapInRegular();
+        }
+    }
+    else
+    {
+        cissuer.incTapOut();
+    }
 
-    // variant RFC 4122
-    ss << std::setw(4) << ((randA >> 12 & 0x3FFFULL) | 0x8000);
-    ss << "-";
+    if (isDeduct && amount > 0)
+    {
+        cissuer.incAmount(amount);
+    }
 
-    ss << std::setw(4) << (randB & 0xFFFFULL);
-    ss << "-";
-    ss << std::setw(12) << ((randB >> 16) & 0xFFFFFFFFFFFFULL);
+    cissuer.incPending();
+}
 
-    return ss.str();
+/* status of a replayed intent whose debit may or may not have reached the card */
+static const char *const STATUS_UNKNOWN = "U";
+
+/* the field list shared by the success and the error records */
+static void fillRecord(TransactionData &tsc,
+                       const TapContext &tap,
+                       const std::string &uuid,
+                       const std::time_t time,
+                       const unsigned int minimumBalance,
+                       const int balanceBefore,
+                       const unsigned int normalFare,
+                       const unsigned int fare,
+                       const int balanceAfter,
+                       const int processingTimeMs,
+                       const std::string &transcode,
+                       const std::string &status,
+                       const std::string &description)
+{
+    tsc.setIntegratorId(1);
+    tsc.setMinimumBalance(minimumBalance);
+    tsc.setBalanceBeforeTransaction(balanceBefore);
+    tsc.setNormalFare(normalFare);
+    tsc.setFare(fare);
+    tsc.setBalanceAfterTransaction(balanceAfter);
+    tsc.setProcessingTimeMs(processingTimeMs);
+    tsc.setCoordinates(0.0, 0.0);
+    tsc.setTransactionTime(time);
+    tsc.setTransactionStoredTime(time);
+    tsc.setUUID(uuid);
+    tsc.setMID(tap.getMID());
+    tsc.setTID(tap.getTID());
+    tsc.setTranscode(transcode);
+    tsc.setStatus(status);
+    tsc.setDescription(description);
+    tsc.setTransactionInInfo(tap.getIdentity());
+    tsc.setTransactionOutInfo(tap.getOrigin());
+    tsc.setCardData(tap.getCard());
 }
 
-bool Controller::processAttachedCard(Duration &duration)
+bool Controller::processAttachedCard(unsigned long long cardNumber, Duration &duration)
 {
     std::array<unsigned char, 64> userData;
     unsigned short interop = 0;
     std::time_t expireOn = 0;
 
-    UIHelper::processingCard(this->gui);
+    UIHelper::processingCard(*this->view);
+    this->tap->reset(this->reader, this->workflow);
+
+    this->view->setCardNumber(cardNumber, "", true);
+    FTV_LOG_INFO("card number: %016llu\n", cardNumber);
 
-    unsigned long long cardNumber = epayment.getCardNumber();
-    duration.checkPoint("get card number");
-    this->gui.labelCardNumber.setPAN(cardNumber, "", true);
-    Debug::info(__FILE__, __LINE__, __func__, "card number: %016llu\n", cardNumber);
+    unsigned int ctype = static_cast<unsigned int>(this->reader.getType());
+    if (this->isIssuerReady(ctype) == false)
+    {
+        /* the SAM of this issuer is still initializing (or failed), other issuers keep working;
+         * a handshake outlasts the retry window, so the card is held and recorded once */
+        FTV_LOG_WARNING("SAM %s is not ready\n", this->reader.getIssuer().c_str());
+        ErrorCode::Code ecode = ErrorCode::classify(ctype, ErrorCode::Class::SAM_NOT_READY);
+        UIHelper::failedToReadCard(*this->view, ErrorCode::toString(ecode));
+        this->storeErrorTransactionOnReadFailed(duration, ecode);
+        return false;
+    }
 
-    if (epayment.readUserData<64>(userData) == false)
+    if (this->reader.readUserData(userData) == false)
     {
-        duration.checkPoint("read user data failed");
-        UIHelper::failedToReadCard(this->gui, "1004");
+        duration.checkPoint(Duration::Stage::READ_USER_DATA_FAILED);
+        UIHelper::failedToReadCard(*this->view, "1004");
+        /* nothing was written to the card yet */
+        this->isTransientFailure = true;
         return false;
     }
-    duration.checkPoint("read user data");
-    epayment.getFreeServiceParam(interop, expireOn);
+    duration.checkPoint(Duration::Stage::READ_USER_DATA);
+    this->reader.getFreeServiceParam(interop, expireOn);
 
 #ifdef __HARDCODE_EXPIRED_ON
     expireOn = __HARDCODE_EXPIRED_ON;
@@ -82,8 +143,8 @@ bool Controller::processAttachedCard(Duration &duration)
     bool result = false;
 
     work.validate(
-            this->epayment.getBank(),
-            (this->epayment.getIssuer().compare("jakcard") ? this->epayment.getIssuer() : "jakcard2"),
+            this->tap->getBank(),
+            (this->tap->getIssuer().compare("jakcard") ? this->tap->getIssuer() : "jakcard2"),
             cardNumber,
             999999,
             userData,
@@ -94,27 +155,27 @@ bool Controller::processAttachedCard(Duration &duration)
             {
                 int cardBalance = 0;
                 const unsigned int amountDeduct = rules.getFinalFare(refUserData.isCardFreeServices(), refUserData.isCardOKOTrip(), refUserData.getSubsidyAccumulation());
-                this->epayment.setAmount(amountDeduct);
+                this->reader.setAmount(amountDeduct);
                 if (amountDeduct > 0)
                 {
-                    result = this->epayment.deduct();
+                    result = this->deduct(false, amountDeduct, userData, refUserData, rules, true);
                     if (result)
                     {
-                        cardBalance = this->epayment.getLastBalance();
+                        cardBalance = this->reader.getLastBalance();
                     }
                 }
                 else
                 {
-                    cardBalance = this->epayment.getBalance();
+                    cardBalance = this->reader.getBalance();
                     result = (cardBalance >= 0);
                 }
                 if (result)
                 {
-                    duration.checkPoint("deduct pinalty success");
-                    result = this->epayment.writeUserData<64>(toWrite, userData);
+                    duration.checkPoint(Duration::Stage::DEDUCT_PINALTY_SUCCESS);
+                    result = this->reader.writeUserData(toWrite, userData);
                     if (result)
                     {
-                        duration.checkPoint("write user data success");
+                        duration.checkPoint(Duration::Stage::WRITE_USER_DATA_SUCCESS);
 
                         UIHelper::TariffType type = UIHelper::TariffType::REGULER;
 
@@ -123,21 +184,21 @@ bool Controller::processAttachedCard(Duration &duration)
                         else if (refUserData.isCardFreeServices())
                             type = UIHelper::TariffType::FREE;
 
-                        UIHelper::successResetTapIn(this->gui,
+                        UIHelper::successResetTapIn(*this->view,
                                                     amountDeduct,
                                                     amountDeduct,
                                                     cardBalance,
                                                     type,
                                                     refUserData.freeService.expireOn);
 
-                        Debug::info(__FILE__, __LINE__, __func__, "last balance: %u\n", cardBalance);
-                        Debug::info(__FILE__, __LINE__, __func__, "transcode   : %s\n", amountDeduct > 0 ? this->epayment.getTranscodeUTF8() : "custom");
+                        FTV_LOG_INFO("last balance: %u\n", cardBalance);
+                        FTV_LOG_INFO("transcode   : %s\n", amountDeduct > 0 ? this->reader.getTranscodeUTF8().c_str() : "custom");
 
                         /* generate reset data */
                         this->storeTransaction(
                             false,
                             true,
-                            std::time(nullptr),
+                            this->tap->getTime(),
                             cardBalance,
                             refUserData,
                             rules,
@@ -147,45 +208,45 @@ bool Controller::processAttachedCard(Duration &duration)
                         this->storeTransaction(
                             true,
                             false,
-                            std::time(nullptr),
+                            this->tap->getTime(),
                             cardBalance,
                             refUserData,
                             rules,
                             duration);
 
                         if (amountDeduct > 0)
-                            this->epayment.purchaseCommit();
+                            this->reader.purchaseCommit();
                     }
                     else
                     {
-                        duration.checkPoint("write user data failed");
-                        UIHelper::failedToWriteCard(this->gui, "1004");
-                        this->storeErrorWriteUserData(true, false, cardBalance, refUserData, rules, duration);
+                        duration.checkPoint(Duration::Stage::WRITE_USER_DATA_FAILED);
+                        UIHelper::failedToWriteCard(*this->view, "1004");
+                        this->storeError(ErrorCode::Class::WRITE_BLOCK, true, false, cardBalance, refUserData, rules, duration);
                     }
                 }
                 else
                 {
-                    duration.checkPoint("deduct pinalty failed");
-                    if (this->epayment.getLastStatus() == Epayment::CARD_OP_INSUFFICIENT_VALUE)
+                    duration.checkPoint(Duration::Stage::DEDUCT_PINALTY_FAILED);
+                    if (this->reader.isInsufficientValue())
                     {
-                        int cardBalance = this->epayment.getBalance();
-                        duration.checkPoint("get balance operation");
+                        int cardBalance = this->reader.getBalance();
+                        duration.checkPoint(Duration::Stage::GET_BALANCE);
                         if (cardBalance >= 0)
                         {
-                            UIHelper::insufficientBalance(this->gui, cardBalance);
-                            this->storeErrorInsufficientBalance(false, true, cardBalance, refUserData, rules, duration);
+                            UIHelper::insufficientBalance(*this->view, cardBalance);
+                            this->storeError(ErrorCode::Class::INSUFFICIENT_BALANCE, false, true, cardBalance, refUserData, rules, duration);
                             return;
                         }
                         else
                         {
-                            this->storeErrorGetBalance(false, true, refUserData, rules, duration);
+                            this->storeError(ErrorCode::Class::BALANCE_CHECK, false, true, 0, refUserData, rules, duration);
                         }
                     }
-                    UIHelper::failedToDeductCard(this->gui, std::to_string(static_cast<int>(this->epayment.getLastStatus())));
+                    UIHelper::failedToDeductCard(*this->view, std::to_string(static_cast<int>(this->reader.getLastStatus())).c_str());
                     if (amountDeduct > 0)
-                        this->storeErrorPurchaseBalance(false, true, refUserData, rules, duration);
+                        this->storeError(ErrorCode::Class::DEBIT_LOST_CONTACT, false, true, 0, refUserData, rules, duration);
                     else
-                        this->storeErrorGetBalance(false, true, refUserData, rules, duration);
+                        this->storeError(ErrorCode::Class::BALANCE_CHECK, false, true, 0, refUserData, rules, duration);
                 }
             })
         .onTapInWithDeduct(
@@ -193,27 +254,27 @@ bool Controller::processAttachedCard(Duration &duration)
             {
                 int cardBalance = 0;
                 const unsigned int amountDeduct = rules.getFinalFare(refUserData.isCardFreeServices(), refUserData.isCardOKOTrip(), refUserData.getSubsidyAccumulation());
-                this->epayment.setAmount(amountDeduct);
+                this->reader.setAmount(amountDeduct);
                 if (amountDeduct > 0)
                 {
-                    result = this->epayment.deduct();
+                    result = this->deduct(true, amountDeduct, userData, refUserData, rules);
                     if (result)
                     {
-                        cardBalance = this->epayment.getLastBalance();
+                        cardBalance = this->reader.getLastBalance();
                     }
                 }
                 else
                 {
-                    cardBalance = this->epayment.getBalance();
+                    cardBalance = this->reader.getBalance();
                     result = (cardBalance >= 0);
                 }
                 if (result)
                 {
-                    duration.checkPoint("deduct on tap in success");
-                    result = this->epayment.writeUserData<64>(toWrite, userData);
+                    duration.checkPoint(Duration::Stage::DEDUCT_TAP_IN_SUCCESS);
+                    result = this->reader.writeUserData(toWrite, userData);
                     if (result)
                     {
-                        duration.checkPoint("write user data success");
+                        duration.checkPoint(Duration::Stage::WRITE_USER_DATA_SUCCESS);
                         UIHelper::TariffType type = UIHelper::TariffType::REGULER;
 
                         if (refUserData.isCardOKOTrip())
@@ -221,72 +282,72 @@ bool Controller::processAttachedCard(Duration &duration)
                         else if (refUserData.isCardFreeServices())
                             type = UIHelper::TariffType::FREE;
 
-                        UIHelper::successTapInWithDeduct(this->gui,
+                        UIHelper::successTapInWithDeduct(*this->view,
                                                          amountDeduct,
                                                          amountDeduct,
                                                          cardBalance,
                                                          type,
                                                          refUserData.freeService.expireOn);
 
-                        Debug::info(__FILE__, __LINE__, __func__, "last balance: %u\n", cardBalance);
-                        Debug::info(__FILE__, __LINE__, __func__, "transcode   : %s\n", amountDeduct > 0 ? this->epayment.getTranscodeUTF8() : "custom");
+                        FTV_LOG_INFO("last balance: %u\n", cardBalance);
+                        FTV_LOG_INFO("transcode   : %s\n", amountDeduct > 0 ? this->reader.getTranscodeUTF8().c_str() : "custom");
 
                         this->storeTransaction(
                             true,
                             true,
-                            std::time(nullptr),
+                            this->tap->getTime(),
                             cardBalance,
                             refUserData,
                             rules,
                             duration);
 
                         if (amountDeduct > 0)
-                            this->epayment.purchaseCommit();
+                            this->reader.purchaseCommit();
                     }
                     else
                     {
-                        duration.checkPoint("write user data failed");
-                        UIHelper::failedToWriteCard(this->gui, "1004");
-                        this->storeErrorWriteUserData(true, true, cardBalance, refUserData, rules, duration);
+                        duration.checkPoint(Duration::Stage::WRITE_USER_DATA_FAILED);
+                        UIHelper::failedToWriteCard(*this->view, "1004");
+                        this->storeError(ErrorCode::Class::WRITE_BLOCK, true, true, cardBalance, refUserData, rules, duration);
                     }
                 }
                 else
                 {
-                    duration.checkPoint("deduct on tap in failed");
-                    if (this->epayment.getLastStatus() == Epayment::CARD_OP_INSUFFICIENT_VALUE)
+                    duration.checkPoint(Duration::Stage::DEDUCT_TAP_IN_FAILED);
+                    if (this->reader.isInsufficientValue())
                     {
-                        int cardBalance = this->epayment.getBalance();
-                        duration.checkPoint("get balance operation");
+                        int cardBalance = this->reader.getBalance();
+                        duration.checkPoint(Duration::Stage::GET_BALANCE);
                         if (cardBalance >= 0)
                         {
-                            UIHelper::insufficientBalance(this->gui, cardBalance);
-                            this->storeErrorInsufficientBalance(true, true, cardBalance, refUserData, rules, duration);
+                            UIHelper::insufficientBalance(*this->view, cardBalance);
+                            this->storeError(ErrorCode::Class::INSUFFICIENT_BALANCE, true, true, cardBalance, refUserData, rules, duration);
                             return;
                         }
                         else
                         {
-                            this->storeErrorGetBalance(true, true, refUserData, rules, duration);
+                            this->storeError(ErrorCode::Class::BALANCE_CHECK, true, true, 0, refUserData, rules, duration);
                         }
                     }
-                    UIHelper::failedToDeductCard(this->gui, std::to_string(static_cast<int>(this->epayment.getLastStatus())));
+                    UIHelper::failedToDeductCard(*this->view, std::to_string(static_cast<int>(this->reader.getLastStatus())).c_str());
                     if (amountDeduct > 0)
-                        this->storeErrorPurchaseBalance(true, true, refUserData, rules, duration);
+                        this->storeError(ErrorCode::Class::DEBIT_LOST_CONTACT, true, true, 0, refUserData, rules, duration);
                     else
-                        this->storeErrorGetBalance(true, true, refUserData, rules, duration);
+                        this->storeError(ErrorCode::Class::BALANCE_CHECK, true, true, 0, refUserData, rules, duration);
                 }
             })
         .onTapOutWithoutDeduct(
             [this, &result, &userData, &duration](const CardData &refUserData, const std::array<unsigned char, 64> &toWrite, const TransactionRules &rules)
             {
                 int cardBalance = 0;
-                result = this->epayment.writeUserData<64>(toWrite, userData);
+                result = this->reader.writeUserData(toWrite, userData);
                 if (result)
                 {
-                    duration.checkPoint("write user data success");
-                    cardBalance = this->epayment.getBalance();
-                    duration.checkPoint("get balance operation on tap out without deduct");
+                    duration.checkPoint(Duration::Stage::WRITE_USER_DATA_SUCCESS);
+                    cardBalance = this->reader.getBalance();
+                    duration.checkPoint(Duration::Stage::GET_BALANCE_TAP_OUT_WITHOUT_DEDUCT);
                     result = (cardBalance >= 0);
-                    Debug::info(__FILE__, __LINE__, __func__, "balance: %u\n", cardBalance);
+                    FTV_LOG_INFO("balance: %u\n", cardBalance);
 
                     UIHelper::TariffType type = UIHelper::TariffType::REGULER;
 
@@ -295,12 +356,12 @@ bool Controller::processAttachedCard(Duration &duration)
                     else if (refUserData.isCardFreeServices())
                         type = UIHelper::TariffType::FREE;
 
-                    UIHelper::successTapOutWithoutDeduct(this->gui, cardBalance, type, refUserData.freeService.expireOn);
+                    UIHelper::successTapOutWithoutDeduct(*this->view, cardBalance, type, refUserData.freeService.expireOn);
 
                     this->storeTransaction(
                         false,
                         false,
-                        std::time(nullptr),
+                        this->tap->getTime(),
                         cardBalance,
                         refUserData,
                         rules,
@@ -308,48 +369,48 @@ bool Controller::processAttachedCard(Duration &duration)
                 }
                 else
                 {
-                    duration.checkPoint("write user data failed");
-                    UIHelper::failedToWriteCard(this->gui, "1004");
-                    this->storeErrorWriteUserData(false, false, cardBalance, refUserData, rules, duration);
+                    duration.checkPoint(Duration::Stage::WRITE_USER_DATA_FAILED);
+                    UIHelper::failedToWriteCard(*this->view, "1004");
+                    this->storeError(ErrorCode::Class::WRITE_BLOCK, false, false, cardBalance, refUserData, rules, duration);
                 }
             })
         .onTapInWithoutDeduct(
             [this, &result, &userData, &duration](const CardData &refUserData, const std::array<unsigned char, 64> &toWrite, const TransactionRules &rules)
             {
-                int cardBalance = this->epayment.getBalance();
-                duration.checkPoint("get balance operation on tap in without deduct");
+                int cardBalance = this->reader.getBalance();
+                duration.checkPoint(Duration::Stage::GET_BALANCE_TAP_IN_WITHOUT_DEDUCT);
                 result = (cardBalance >= 0);
-                Debug::info(__FILE__, __LINE__, __func__, "balance: %u\n", cardBalance);
+                FTV_LOG_INFO("balance: %u\n", cardBalance);
 
                 if (refUserData.isCardFreeServices() == false)
                 {
                     const TransJakartaFare *calculatedTransJakartaFare = rules.getCalculatedFare();
                     if (calculatedTransJakartaFare)
                     {
-                        Debug::info(__FILE__, __LINE__, __func__, "minimum balance: %u\n", calculatedTransJakartaFare->getTicketRules().getMinimalBalance());
+                        FTV_LOG_INFO("minimum balance: %u\n", calculatedTransJakartaFare->getTicketRules().getMinimalBalance());
                         if (result)
                         {
                             if (cardBalance < calculatedTransJakartaFare->getTicketRules().getMinimalBalance())
                             {
                                 result = false;
-                                Debug::error(__FILE__, __LINE__, __func__, "insufficient minimum balance\n");
-                                UIHelper::insufficientMinimumBalance(this->gui, cardBalance);
-                                this->storeErrorInsufficientBalance(true, false, cardBalance, refUserData, rules, duration);
+                                FTV_LOG_ERROR("insufficient minimum balance\n");
+                                UIHelper::insufficientMinimumBalance(*this->view, cardBalance);
+                                this->storeError(ErrorCode::Class::INSUFFICIENT_BALANCE, true, false, cardBalance, refUserData, rules, duration);
                                 return;
                             }
                         }
                         else
                         {
-                            this->storeErrorGetBalance(true, false, refUserData, rules, duration);
+                            this->storeError(ErrorCode::Class::BALANCE_CHECK, true, false, 0, refUserData, rules, duration);
                         }
                     }
                 }
                 if (result)
                 {
-                    result = this->epayment.writeUserData<64>(toWrite, userData);
+                    result = this->reader.writeUserData(toWrite, userData);
                     if (result)
                     {
-                        duration.checkPoint("write user data success");
+                        duration.checkPoint(Duration::Stage::WRITE_USER_DATA_SUCCESS);
 
                         UIHelper::TariffType type = UIHelper::TariffType::REGULER;
 
@@ -358,12 +419,12 @@ bool Controller::processAttachedCard(Duration &duration)
                         else if (refUserData.isCardFreeServices())
                             type = UIHelper::TariffType::FREE;
 
-                        UIHelper::successTapInWithoutDeduct(this->gui, cardBalance, type, refUserData.freeService.expireOn);
+                        UIHelper::successTapInWithoutDeduct(*this->view, cardBalance, type, refUserData.freeService.expireOn);
 
                         this->storeTransaction(
                             true,
                             false,
-                            std::time(nullptr),
+                            this->tap->getTime(),
                             cardBalance,
                             refUserData,
                             rules,
@@ -371,16 +432,16 @@ bool Controller::processAttachedCard(Duration &duration)
                     }
                     else
                     {
-                        duration.checkPoint("write user data failed");
-                        UIHelper::failedToWriteCard(this->gui, "1004");
-                        this->storeErrorWriteUserData(true, false, cardBalance, refUserData, rules, duration);
+                        duration.checkPoint(Duration::Stage::WRITE_USER_DATA_FAILED);
+                        UIHelper::failedToWriteCard(*this->view, "1004");
+                        this->storeError(ErrorCode::Class::WRITE_BLOCK, true, false, cardBalance, refUserData, rules, duration);
                     }
                 }
                 else
                 {
-                    duration.checkPoint("get balance failed");
-                    UIHelper::failedToWriteCard(this->gui, "1004");
-                    this->storeErrorGetBalance(true, false, refUserData, rules, duration);
+                    duration.checkPoint(Duration::Stage::GET_BALANCE_FAILED);
+                    UIHelper::failedToWriteCard(*this->view, "1004");
+                    this->storeError(ErrorCode::Class::BALANCE_CHECK, true, false, 0, refUserData, rules, duration);
                 }
             })
         .onTapOutWithDeduct(
@@ -388,27 +449,27 @@ bool Controller::processAttachedCard(Duration &duration)
             {
                 int cardBalance = 0;
                 const unsigned int amountDeduct = rules.getFinalFare(refUserData.isCardFreeServices(), refUserData.isCardOKOTrip(), refUserData.getSubsidyAccumulation());
-                this->epayment.setAmount(amountDeduct);
+                this->reader.setAmount(amountDeduct);
                 if (amountDeduct > 0)
                 {
-                    result = this->epayment.deduct();
+                    result = this->deduct(false, amountDeduct, userData, refUserData, rules);
                     if (result)
                     {
-                        cardBalance = this->epayment.getLastBalance();
+                        cardBalance = this->reader.getLastBalance();
                     }
                 }
                 else
                 {
-                    cardBalance = this->epayment.getBalance();
+                    cardBalance = this->reader.getBalance();
                     result = (cardBalance >= 0);
                 }
                 if (result)
                 {
-                    duration.checkPoint("deduct on tap out success");
-                    result = this->epayment.writeUserData<64>(toWrite, userData);
+                    duration.checkPoint(Duration::Stage::DEDUCT_TAP_OUT_SUCCESS);
+                    result = this->reader.writeUserData(toWrite, userData);
                     if (result)
                     {
-                        duration.checkPoint("write user data success");
+                        duration.checkPoint(Duration::Stage::WRITE_USER_DATA_SUCCESS);
                         UIHelper::TariffType type = UIHelper::TariffType::REGULER;
 
                         if (refUserData.isCardOKOTrip())
@@ -416,92 +477,139 @@ bool Controller::processAttachedCard(Duration &duration)
                         else if (refUserData.isCardFreeServices())
                             type = UIHelper::TariffType::FREE;
 
-                        UIHelper::successTapOutWithDeduct(this->gui,
+                        UIHelper::successTapOutWithDeduct(*this->view,
                                                           amountDeduct,
                                                           amountDeduct,
                                                           cardBalance,
                                                           type,
                                                           refUserData.freeService.expireOn);
 
-                        Debug::info(__FILE__, __LINE__, __func__, "last balance: %u\n", cardBalance);
-                        Debug::info(__FILE__, __LINE__, __func__, "transcode   : %s\n", amountDeduct > 0 ? this->epayment.getTranscodeUTF8() : "custom");
+                        FTV_LOG_INFO("last balance: %u\n", cardBalance);
+                        FTV_LOG_INFO("transcode   : %s\n", amountDeduct > 0 ? this->reader.getTranscodeUTF8().c_str() : "custom");
 
                         this->storeTransaction(
                             false,
                             true,
-                            std::time(nullptr),
+                            this->tap->getTime(),
                             cardBalance,
                             refUserData,
                             rules,
                             duration);
 
                         if (amountDeduct > 0)
-                            this->epayment.purchaseCommit();
+                            this->reader.purchaseCommit();
                     }
                     else
                     {
-                        duration.checkPoint("write user data failed");
-                        UIHelper::failedToWriteCard(this->gui, "1004");
-                        this->storeErrorWriteUserData(false, true, cardBalance, refUserData, rules, duration);
+                        duration.checkPoint(Duration::Stage::WRITE_USER_DATA_FAILED);
+                        UIHelper::failedToWriteCard(*this->view, "1004");
+                        this->storeError(ErrorCode::Class::WRITE_BLOCK, false, true, cardBalance, refUserData, rules, duration);
                     }
                 }
                 else
                 {
-                    duration.checkPoint("deduct on tap out failed");
-                    if (this->epayment.getLastStatus() == Epayment::CARD_OP_INSUFFICIENT_VALUE)
+                    duration.checkPoint(Duration::Stage::DEDUCT_TAP_OUT_FAILED);
+                    if (this->reader.isInsufficientValue())
                     {
-                        int cardBalance = this->epayment.getBalance();
-                        duration.checkPoint("get balance operation");
+                        int cardBalance = this->reader.getBalance();
+                        duration.checkPoint(Duration::Stage::GET_BALANCE);
                         if (cardBalance >= 0)
                         {
-                            UIHelper::insufficientBalance(this->gui, cardBalance);
-                            this->storeErrorInsufficientBalance(false, true, cardBalance, refUserData, rules, duration);
+                            UIHelper::insufficientBalance(*this->view, cardBalance);
+                            this->storeError(ErrorCode::Class::INSUFFICIENT_BALANCE, false, true, cardBalance, refUserData, rules, duration);
                             return;
                         }
                         else
                         {
-                            this->storeErrorGetBalance(false, true, refUserData, rules, duration);
+                            this->storeError(ErrorCode::Class::BALANCE_CHECK, false, true, 0, refUserData, rules, duration);
                         }
                     }
-                    UIHelper::failedToDeductCard(this->gui, std::to_string(static_cast<int>(this->epayment.getLastStatus())));
+                    UIHelper::failedToDeductCard(*this->view, std::to_string(static_cast<int>(this->reader.getLastStatus())).c_str());
                     if (amountDeduct > 0)
-                        this->storeErrorPurchaseBalance(false, true, refUserData, rules, duration);
+                        this->storeError(ErrorCode::Class::DEBIT_LOST_CONTACT, false, true, 0, refUserData, rules, duration);
                     else
-                        this->storeErrorGetBalance(false, true, refUserData, rules, duration);
+                        this->storeError(ErrorCode::Class::BALANCE_CHECK, false, true, 0, refUserData, rules, duration);
                 }
             })
         .onFreeServiceExpired(
             [this, &result, &duration](const CardData &refUserData, const std::array<unsigned char, 64> &originData, const TransactionRules &rules)
             {
-                UIHelper::freeServiceExpired(this->gui, refUserData.freeService.expireOn);
-                this->storeErrorFreeServiceExpired(refUserData, rules, duration);
+                UIHelper::freeServiceExpired(*this->view, refUserData.freeService.expireOn);
+                this->storeError(ErrorCode::Class::FREE_SERVICE_EXPIRED, true, false, 0, refUserData, rules, duration);
             })
         .onBlocking(
             [this, &result, &duration](const CardData &refUserData, const std::array<unsigned char, 64> &originData, const TransactionRules &rules)
             {
-                UIHelper::blockingTime(this->gui);
-                this->storeErrorBlockingTime(refUserData, rules, duration);
+                UIHelper::blockingTime(*this->view);
+                this->storeError(ErrorCode::Class::TAP_BELOW_ONE_MINUTE, true, false, 0, refUserData, rules, duration);
             })
         .onInvalid(
             [this](const std::array<unsigned char, 64> &userData)
             {
-                Debug::error(__FILE__, __LINE__, __func__, "invalid user data\n");
+                FTV_LOG_ERROR("invalid user data\n");
             })
         .onFareNotFound(
             [this](const std::array<unsigned char, 64> &userData)
             {
-                Debug::error(__FILE__, __LINE__, __func__, "fare not found\n");
-                UIHelper::fareNotFound(this->gui);
+                FTV_LOG_ERROR("fare not found\n");
+                UIHelper::fareNotFound(*this->view);
             })
         .onInsufficientBalance(
             [this](const std::array<unsigned char, 64> &userData)
             {
-                Debug::error(__FILE__, __LINE__, __func__, "insufficient minimum balance\n");
-                UIHelper::insufficientMinimumBalance(this->gui, 0);
+                FTV_LOG_ERROR("insufficient minimum balance\n");
+                UIHelper::insufficientMinimumBalance(*this->view, 0);
             });
     return result;
 }
 
+bool Controller::deduct(bool isTapIn,
+                        const unsigned int amount,
+                        const std::array<unsigned char, 64> &userData,
+                        const CardData &refUserData,
+                        const TransactionRules &rules,
+                        bool isPinalty)
+{
+    if (this->journal.get() == nullptr)
+        return this->reader.deduct();
+
+    /* written before the card is touched, the record of this tap reuses the UUID */
+    const TransJakartaFare *transjakartaFare = rules.getCalculatedFare();
+    TapContext &tap = *this->tap;
+    IntentJournal::Intent intent{};
+    intent.cardNumber = this->lastCardNumber;
+    intent.time = tap.getTime();
+    intent.ctype = static_cast<unsigned int>(this->reader.getType());
+    intent.amount = amount;
+    intent.normalFare = rules.getNormalFare();
+    intent.minimumBalance = (transjakartaFare == nullptr) ? 0 : transjakartaFare->getTicketRules().getMinimalBalance();
+    intent.isTapIn = isTapIn ? 1 : 0;
+    intent.isEconomy = (transjakartaFare != nullptr && transjakartaFare->getFareType().compare("economy") == 0) ? 1 : 0;
+    intent.isFreeService = refUserData.isCardFreeServices() ? 1 : 0;
+    intent.isPinalty = isPinalty ? 1 : 0;
+    IntentJournal::copy(intent.uuid, sizeof(intent.uuid), tap.nextUUID());
+    IntentJournal::copy(intent.mid, sizeof(intent.mid), tap.getMID());
+    IntentJournal::copy(intent.tid, sizeof(intent.tid), tap.getTID());
+    IntentJournal::copy(intent.issuer, sizeof(intent.issuer), tap.getIssuer());
+    IntentJournal::copy(intent.bank, sizeof(intent.bank), tap.getBank());
+    intent.userData = userData;
+
+    /* begin() returns with the PENDING entry on flash. When the entry cannot be written (id 0)
+     * or its sync fails, the card is still debited as without a journal: a power cut before the
+     * record is committed then loses the tap */
+    const uint64_t id = this->journal->begin(intent);
+    tap.setIntent(id);
+
+    bool result = this->reader.deduct();
+    if (result && id)
+    {
+        intent.balance = this->reader.getLastBalance();
+        IntentJournal::copy(intent.transcode, sizeof(intent.transcode), this->reader.getTranscode());
+        this->journal->deducted(id, intent);
+    }
+    return result;
+}
+
 bool Controller::storeTransaction(bool isTapIn,
                                   bool isDeduct,
                                   const std::time_t time,
@@ -514,469 +622,788 @@ bool Controller::storeTransaction(bool isTapIn,
     {
         if (this->counter.get() == nullptr)
             this->reloadCounter();
-        else if (counter->getCycle().isSameCycle(time) == false)
-            this->reloadCounter();
+        else if (this->counter->getCycle().isSameCycle(time) == false)
+            this->rollCounter(time);
     }
     catch (const std::exception &e)
     {
-        Debug::error(__FILE__, __LINE__, __func__, "failed to load counter: %s\n", e.what());
+        FTV_LOG_ERROR("failed to load counter: %s\n", e.what());
     }
 
     const unsigned int amount = rules.getFinalFare(refUserData.isCardFreeServices(), refUserData.isCardOKOTrip(), refUserData.getSubsidyAccumulation());
     const TransJakartaFare *transjakartaFare = rules.getCalculatedFare();
 
-    std::string transcode = "";
+    std::string transcode;
     if (isDeduct)
     {
         if (amount > 0)
         {
-            transcode = epayment.getTranscode();
+            transcode = this->reader.getTranscode();
         }
         else
         {
-            transcode = this->workflow.generateZeroDeductTranscode(this->epayment.getActiveTID(),
-                                                                   this->epayment.getActiveMID(),
+            transcode = this->workflow.generateZeroDeductTranscode(this->tap->getTID(),
+                                                                   this->tap->getMID(),
                                                                    this->counter.get() ? this->counter->getSN() : 0);
         }
     }
 
-    TransactionIdentity ref;
-    ref.setFletCode(refUserData.getFletCode());
-    ref.setTerminalId(refUserData.getTerminalId());
-    ref.setTransactionTime(refUserData.getEpochTime());
-    ref.setTransportationType(refUserData.getTrasportationCode());
+    TapContext &tap = *this->tap;
+    tap.bind(refUserData);
+    const uint64_t intent = tap.takeIntent();
+
+    std::unique_ptr<TransactionData> tsc = tap.acquire(isTapIn);
+
+    fillRecord(*tsc,
+               tap,
+               intent ? tap.getUUID() : tap.nextUUID(),
+               time,
+               transjakartaFare == nullptr ? 0 : transjakartaFare->getTicketRules().getMinimalBalance(),
+               isDeduct ? (lastBalance + amount) : lastBalance,
+               rules.getNormalFare(),
+               isDeduct ? amount : 0,
+               lastBalance,
+               duration.getTotalDurationInMs(),
+               transcode,
+               "S",
+               "S");
+
+    std::shared_ptr<Counter> counter = this->counter;
+    const unsigned int ctype = static_cast<unsigned int>(this->reader.getType());
+    const bool isFreeService = refUserData.isCardFreeServices();
+    const bool isEconomy = (transjakartaFare != nullptr && transjakartaFare->getFareType().compare("economy") == 0);
+    GuiState &view = *this->view;
+
+    if (counter.get())
+    {
+        /* reserve the serial number now, the next zero deduct transcode must not reuse it */
+        counter->incSN();
+    }
 
-    TransactionIdentity me(this->workflow.getIdentity());
-    me.setTransactionTime(std::time(nullptr));
+    /* the uploader reports the record as sent on the counter of the day it was counted on */
+    TransactionStore::UploadTag tag;
+    if (counter.get())
+        tag = TransactionStore::UploadTag(ctype, counter->getCycle().getCycleTime());
+    if (intent)
+        tag.intent = tap.getUUID();
+    IntentJournal *journal = this->journal.get();
+    const TransactionStore *store = this->tscdb.get();
+
+    return this->persistence->push(
+        std::move(tsc),
+        [counter, ctype, isTapIn, isDeduct, isFreeService, isEconomy, amount, intent, journal, store, &view](bool committed)
+        {
+            if (committed == false)
+                return;
+            /* DONE only behind a commit on flash, otherwise the next start finds the record through intent_applied */
+            if (intent && store->isDurable())
+                journal->complete(intent);
 
-    CardData card = refUserData;
-    card.setIssuer(this->epayment.getIssuer());
-    card.setBank(this->epayment.getBank());
+            if (counter.get() == nullptr)
+            {
+                FTV_LOG_WARNING("success to insert transaction but counter object is null\n");
+                return;
+            }
 
-    TransactionData tsc(isTapIn);
+            FTV_LOG_INFO("success to insert transaction [%d] on cycle %li\n", counter->getSN(), counter->getCycle().getCycleTime());
 
-    tsc.setIntegratorId(1);
-    tsc.setMinimumBalance(transjakartaFare == nullptr ? 0 : transjakartaFare->getTicketRules().getMinimalBalance());
-    tsc.setBalanceBeforeTransaction(isDeduct ? (lastBalance + amount) : lastBalance);
-    tsc.setNormalFare(rules.getNormalFare());
-    tsc.setFare(isDeduct ? amount : 0);
-    tsc.setBalanceAfterTransaction(lastBalance);
-    tsc.setProcessingTimeMs(duration.getTotalDurationInMs());
-    tsc.setCoordinates(0.0, 0.0);
-    tsc.setTransactionTime(std::time(nullptr));
-    tsc.setTransactionStoredTime(std::time(nullptr));
-    tsc.setUUID(generateTimeBasedUUID(tsc.getTransactionTime()));
-    tsc.setMID(this->epayment.getActiveMID());
-    tsc.setTID(this->epayment.getActiveTID());
-    tsc.setTranscode(transcode);
-    tsc.setStatus("S");
-    tsc.setDescription("S");
-    tsc.setTransactionInInfo(me);
-    tsc.setTransactionOutInfo(ref);
-    tsc.setCardData(card);
+            countTransaction(*counter, ctype, isTapIn, isDeduct, isFreeService, isEconomy, amount);
+            counter->store();
+            counter->storeSN();
 
-    Sqlite3Transaction tscdb(TRANSACTION_DATABASE);
+            UIHelper::updateCounter(view, counter.get());
+        },
+        tag);
+}
 
-    if (tscdb.insertLog(tsc) == 0)
-    {
-        if (this->counter.get())
+bool Controller::recordError(bool isTapIn,
+                             const ErrorCode::Code &code,
+                             const int lastBalance,
+                             const unsigned int minimumBalance,
+                             const unsigned int normalFare,
+                             const unsigned int fare,
+                             Duration &duration)
+{
+    /* card data and origin come from the tap context, bound by the caller */
+    TapContext &tap = *this->tap;
+    const uint64_t intent = tap.takeIntent();
+    std::unique_ptr<TransactionData> tsc = tap.acquire(isTapIn);
+
+    fillRecord(*tsc,
+               tap,
+               intent ? tap.getUUID() : tap.nextUUID(),
+               tap.getTime(),
+               minimumBalance,
+               lastBalance,
+               normalFare,
+               fare,
+               lastBalance,
+               duration.getTotalDurationInMs(),
+               "",
+               "F",
+               ErrorCode::toString(code));
+
+    /* a failed deduct closes its intent with the error record */
+    TransactionStore::UploadTag tag;
+    if (intent)
+        tag.intent = tap.getUUID();
+    IntentJournal *journal = this->journal.get();
+    const TransactionStore *store = this->tscdb.get();
+
+    return this->persistence->push(
+        std::move(tsc),
+        [intent, journal, store](bool committed)
         {
-            Debug::info(__FILE__, __LINE__, __func__, "success to insert transaction [%d] on cycle %li\n", this->counter->getSN(), this->counter->getCycle().getCycleTime());
+            if (committed == false)
+                return;
+            if (intent && store->isDurable())
+                journal->complete(intent);
+            FTV_LOG_INFO("success to insert invalid transaction\n");
+        },
+        tag);
+}
+
+bool Controller::storeErrorTransactionOnReadFailed(Duration &duration, const ErrorCode::Code &desc)
+{
+    this->tap->bindUnread(this->workflow.getProvision());
+    return this->recordError(true,
+                             desc,
+                             0,
+                             0,
+                             this->workflow.getProvision().getData().getPriceInformation().getSingleTrip().getPrice(),
+                             0,
+                             duration);
+}
+
+bool Controller::storeError(ErrorCode::Class errorClass,
+                            bool isTapIn,
+                            bool isDeduct,
+                            const int lastBalance,
+                            const CardData &refUserData,
+                            const TransactionRules &rules,
+                            Duration &duration)
+{
+    const unsigned int amount = rules.getFinalFare(refUserData.isCardFreeServices(), refUserData.isCardOKOTrip(), refUserData.getSubsidyAccumulation());
+    const TransJakartaFare *transjakartaFare = rules.getCalculatedFare();
+
+    this->tap->bind(refUserData);
+    return this->recordError(isTapIn,
+                             ErrorCode::classify(static_cast<unsigned int>(this->reader.getType()), errorClass),
+                             lastBalance,
+                             transjakartaFare == nullptr ? 0 : transjakartaFare->getTicketRules().getMinimalBalance(),
+                             rules.getNormalFare(),
+                             isDeduct ? amount : 0,
+                             duration);
+}
+
+void Controller::routine()
+{
+    bool cardAvailable = false;
+    bool isHeld = false;
+    bool isProcessed = false;
+    bool result = false;
 
-            Counter::Issuer &cissuer = this->counter->getIssuerByEpaymentCardType(static_cast<int>(this->epayment.getType()));
-            if (isTapIn)
+    /* a SAM handshake holds the reader, skip this poll rather than wait for it */
+    std::unique_lock<std::mutex> readerLock(this->readerMtx, std::try_to_lock);
+    if (readerLock.owns_lock() == false && this->readerBlockedSince == std::chrono::steady_clock::time_point())
+        this->readerBlockedSince = std::chrono::steady_clock::now();
+    if (readerLock.owns_lock())
+    { /* needed for duration calculation */
+        if (this->readerBlockedSince != std::chrono::steady_clock::time_point())
+        {
+            /* how long a tap could have waited for a handshake, the number to watch on the board */
+            std::chrono::duration<double> blocked = std::chrono::steady_clock::now() - this->readerBlockedSince;
+            this->readerBlockedSince = std::chrono::steady_clock::time_point();
+            FTV_LOG_INFO("polls held off %.3fs by a SAM handshake\n", blocked.count());
+        }
+        Duration duration("transaction");
+        cardAvailable = this->reader.selectAttachedCard();
+        this->markReader(cardAvailable);
+        if (cardAvailable)
+        {
+            unsigned long long cardNumber = this->reader.getCardNumber();
+            duration.checkPoint(Duration::Stage::GET_CARD_NUMBER);
+            bool isRetry = false;
+            if (this->isLastCardPresent && cardNumber == this->lastCardNumber)
+            {
+                /* the card just processed is still on the reader: wait until it is removed,
+                 * unless it failed on something a second attempt can get past */
+                isRetry = (this->heldRetries > 0 && std::chrono::steady_clock::now() >= this->retryAt);
+                isHeld = (isRetry == false);
+            }
+
+            if (isHeld == false)
             {
-                if (refUserData.isCardFreeServices())
+                if (isRetry)
                 {
-                    cissuer.incTapInFreeService();
+                    this->heldRetries--;
+                    FTV_LOG_WARNING("retry card %016llu, %u attempt(s) left\n", cardNumber, this->heldRetries);
                 }
                 else
                 {
-                    if (transjakartaFare)
-                    {
-                        if (transjakartaFare->getFareType().compare("economy") == 0)
-                        {
-                            cissuer.incTapInEconomy();
-                        }
-                        else
-                        {
-                            cissuer.incTapInRegular();
-                        }
-                    }
-                    else
-                    {
-                        cissuer.incTapInRegular();
-                    }
+                    this->heldRetries = HELD_CARD_RETRIES;
+                    this->scheduler->next(true);
                 }
+                isProcessed = true;
+                if (this->isFirstTapLogged == false)
+                {
+                    this->isFirstTapLogged = true;
+                    std::chrono::duration<double> sinceBoot = std::chrono::steady_clock::now() - this->bootRef;
+                    FTV_LOG_INFO("boot-to-first-tap: %.3fs\n", sinceBoot.count());
+                }
+                this->lastCardNumber = cardNumber;
+                this->isLastCardPresent = true;
+                this->isTransientFailure = false;
+                try
+                {
+                    result = this->processAttachedCard(cardNumber, duration);
+                }
+                catch (const std::exception &e)
+                {
+                    FTV_LOG_INFO("catch: %s\n", e.what());
+                }
+                this->latency->record(duration, static_cast<unsigned int>(this->reader.getType()));
+                if (result || this->isTransientFailure == false)
+                    this->heldRetries = 0;
+                else
+                    this->retryAt = std::chrono::steady_clock::now() + std::chrono::milliseconds(HELD_CARD_RETRY_DELAY_MS);
             }
-            else
-            {
-                cissuer.incTapOut();
-            }
-
-            if (isDeduct && amount > 0)
-            {
-                cissuer.incAmount(amount);
-            }
-
-            cissuer.incPending();
-            cissuer.store();
-
-            this->counter->incSN();
-            this->counter->storeSN();
-
-            UIHelper::updateCounter(this->gui, this->counter.get());
         }
         else
         {
-            Debug::warning(__FILE__, __LINE__, __func__, "success to insert transaction but counter object is null\n");
+            this->isLastCardPresent = false;
         }
-
-        return true;
     }
+    if (readerLock.owns_lock())
+        readerLock.unlock();
 
-    Debug::error(__FILE__, __LINE__, __func__, "failed to insert transaction\n");
-    return false;
-}
+    if (isProcessed)
+    {
+        /* keep the result on screen without blocking the reader, a new card takes over early */
+        this->holdUntil = std::chrono::steady_clock::now() + (result ? this->holdSuccess : this->holdFailed);
+        this->isHolding = true;
 
-bool Controller::storeErrorTransactionOnReadFailed(const std::time_t time, Duration &duration, const ErrorCode::Code &desc)
-{
-    TransactionIdentity me(this->workflow.getIdentity());
-    me.setTransactionTime(std::time(nullptr));
+        FTV_LOG_INFO("poll-to-detect: %.1f ms\n", this->scheduler->getStats().lastMs);
+        return;
+    }
 
-    std::array<unsigned char, 64UL> empty{};
-    CardData card;
-    card.parse(empty, this->workflow.getProvision());
-    card.setIssuer(this->epayment.getIssuer());
-    card.setBank(this->epayment.getBank());
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (now - this->lastStatsDump >= std::chrono::seconds(LATENCY_STATS_DUMP_INTERVAL_S))
+    {
+        this->lastStatsDump = now;
+        this->latency->dump(LATENCY_STATS_FILE);
+        FTV_LOG_INFO("persistence backlog: %zu (max %zu)\n", this->persistence->getBacklog(), this->persistence->getMaxBacklog());
+        const PollScheduler::Stats &pollStats = this->scheduler->getStats();
+        FTV_LOG_INFO("poll-to-detect: avg %.1f ms, max %.1f ms, n %llu\n", pollStats.getAverageMs(), pollStats.maxMs, pollStats.samples);
+    }
 
-    TransactionData tsc(true);
+    if (this->isHolding && now >= this->holdUntil)
+    {
+        this->isHolding = false;
+        const SingleTripFare &singleTripFare = this->workflow.getProvision().getData().getPriceInformation().getSingleTrip();
+        UIHelper::reset(*this->view, singleTripFare.getPrice());
+    }
 
-    tsc.setIntegratorId(1);
-    tsc.setMinimumBalance(0);
-    tsc.setBalanceBeforeTransaction(0);
-    tsc.setNormalFare(this->workflow.getProvision().getData().getPriceInformation().getSingleTrip().getPrice());
-    tsc.setFare(0);
-    tsc.setBalanceAfterTransaction(0);
-    tsc.setProcessingTimeMs(duration.getTotalDurationInMs());
-    tsc.setCoordinates(0.0, 0.0);
-    tsc.setTransactionTime(std::time(nullptr));
-    tsc.setTransactionStoredTime(std::time(nullptr));
-    tsc.setUUID(generateTimeBasedUUID(tsc.getTransactionTime()));
-    tsc.setMID(this->epayment.getActiveMID());
-    tsc.setTID(this->epayment.getActiveTID());
-    tsc.setTranscode("");
-    tsc.setStatus("F");
-    tsc.setDescription(ErrorCode::toString(desc));
-    tsc.setTransactionInInfo(me);
-    tsc.setTransactionOutInfo(me);
-    tsc.setCardData(card);
+    std::this_thread::sleep_for(isHeld ? this->scheduler->held() : this->scheduler->next(false));
+}
 
-    Sqlite3Transaction tscdb(TRANSACTION_DATABASE);
+void Controller::reloadCounter()
+{
+    /* the uploader thread reads the pointer, swap it atomically */
+    std::atomic_store(&this->counter, this->rotation->acquire(std::time(nullptr)));
+    this->rotation->schedule(this->counter->getCycle().getNextCycleTime());
+}
 
-    if (tscdb.insertLog(tsc) == 0)
+void Controller::rollCounter(const std::time_t time)
+{
+    std::shared_ptr<Counter> previous = this->counter;
+    std::shared_ptr<Counter> next = this->rotation->take(time);
+    if (next.get())
     {
-        Debug::info(__FILE__, __LINE__, __func__, "success to insert invalid transaction\n");
-        return true;
+        std::atomic_store(&this->counter, next);
+        this->rotation->schedule(this->counter->getCycle().getNextCycleTime());
+    }
+    else
+    {
+        FTV_LOG_WARNING("no counter prepared for %li, build it inline\n", static_cast<long>(time));
+        this->reloadCounter();
     }
+    this->counter->continueSN(*previous);
+}
+
+void Controller::reconcileCounter()
+{
+    std::shared_ptr<Counter> counter = std::atomic_load(&this->counter);
+    std::vector<TransactionStore::UploadCount> counts;
+    if (counter.get() == nullptr || this->tscdb->countUploads(counter->getCycle().getCycleTime(), counts) == false)
+        return;
 
-    Debug::error(__FILE__, __LINE__, __func__, "failed to insert transaction\n");
-    return false;
+    bool isChanged = false;
+    for (const TransactionStore::UploadCount &count : counts)
+    {
+        Counter::Issuer &cissuer = counter->getIssuerByEpaymentCardType(count.ctype);
+        CounterFile::IssuerRecord record{};
+        cissuer.save(record);
+        /* only a crash between the cursor update and incSent() moves records from one side to the other */
+        if (record.pending + record.sent != count.pending + count.sent || record.sent == count.sent)
+            continue;
+
+        FTV_LOG_WARNING("counter of card type %u: sent %u -> %u\n", count.ctype, record.sent, count.sent);
+        record.pending = count.pending;
+        record.sent = count.sent;
+        cissuer.load(record);
+        isChanged = true;
+    }
+    if (isChanged)
+        counter->store();
 }
 
-bool Controller::storeErrorTransactionOnReadSuccess(bool isTapIn,
-                                                    bool isDeduct,
-                                                    const std::time_t time,
-                                                    const int lastBalance,
-                                                    const CardData &refUserData,
-                                                    const TransactionRules &rules,
-                                                    Duration &duration,
-                                                    const ErrorCode::Code &desc)
+void Controller::recoverIntents()
 {
-    const unsigned int amount = rules.getFinalFare(refUserData.isCardFreeServices(), refUserData.isCardOKOTrip(), refUserData.getSubsidyAccumulation());
-    const TransJakartaFare *transjakartaFare = rules.getCalculatedFare();
+    if (this->journal.get() == nullptr)
+        return;
 
-    TransactionIdentity ref;
-    ref.setFletCode(refUserData.getFletCode());
-    ref.setTerminalId(refUserData.getTerminalId());
-    ref.setTransactionTime(refUserData.getEpochTime());
-    ref.setTransportationType(refUserData.getTrasportationCode());
+    std::size_t total = this->journal->recover(
+        [this](IntentJournal::State state, const IntentJournal::Intent &intent)
+        {
+            try
+            {
+                /* the record was committed, only the closing entry is missing */
+                if (this->tscdb->isApplied(intent.uuid, intent.time))
+                    return true;
+                /* left open when the commit may not be on flash yet, intent_applied closes it next time */
+                return (this->replayIntent(state, intent) && this->tscdb->isDurable());
+            }
+            catch (const std::exception &e)
+            {
+                FTV_LOG_ERROR("failed to replay intent %s: %s\n", intent.uuid, e.what());
+                return false;
+            }
+        });
+    if (total > 0)
+        FTV_LOG_WARNING("%zu deduct intent(s) recovered from the journal\n", total);
+}
 
-    TransactionIdentity me(this->workflow.getIdentity());
-    me.setTransactionTime(std::time(nullptr));
+bool Controller::replayIntent(IntentJournal::State state, const IntentJournal::Intent &intent)
+{
+    /* a pending intent may or may not have reached the card: stored as a lost contact with
+     * fare 0 and the unknown status, the back office settles it against the issuer */
+    const bool isDeducted = (state == IntentJournal::State::DEDUCTED);
+    const bool isTapIn = (intent.isTapIn != 0);
+    FTV_LOG_WARNING("replay intent %s of card %016llu: %s\n", intent.uuid, static_cast<unsigned long long>(intent.cardNumber), isDeducted ? "deducted" : "pending");
 
-    CardData card = refUserData;
-    card.setIssuer(this->epayment.getIssuer());
-    card.setBank(this->epayment.getBank());
+    CardData card;
+    card.parse(intent.userData, this->workflow.getProvision());
+    card.setIssuer(intent.issuer);
+    card.setBank(intent.bank);
+
+    TransactionIdentity identity = this->workflow.getIdentity();
+    identity.setTransactionTime(intent.time);
+    TransactionIdentity origin;
+    origin.setFletCode(card.getFletCode());
+    origin.setTerminalId(card.getTerminalId());
+    origin.setTransactionTime(card.getEpochTime());
+    origin.setTransportationType(card.getTrasportationCode());
 
     TransactionData tsc(isTapIn);
-
     tsc.setIntegratorId(1);
-    tsc.setMinimumBalance(transjakartaFare == nullptr ? 0 : transjakartaFare->getTicketRules().getMinimalBalance());
-    tsc.setBalanceBeforeTransaction(lastBalance);
-    tsc.setNormalFare(rules.getNormalFare());
-    tsc.setFare(isDeduct ? amount : 0);
-    tsc.setBalanceAfterTransaction(lastBalance);
-    tsc.setProcessingTimeMs(duration.getTotalDurationInMs());
+    tsc.setMinimumBalance(intent.minimumBalance);
+    tsc.setBalanceBeforeTransaction(isDeducted ? (intent.balance + static_cast<int>(intent.amount)) : 0);
+    tsc.setNormalFare(intent.normalFare);
+    tsc.setFare(isDeducted ? intent.amount : 0);
+    tsc.setBalanceAfterTransaction(isDeducted ? intent.balance : 0);
+    tsc.setProcessingTimeMs(0);
     tsc.setCoordinates(0.0, 0.0);
-    tsc.setTransactionTime(std::time(nullptr));
+    tsc.setTransactionTime(intent.time);
     tsc.setTransactionStoredTime(std::time(nullptr));
-    tsc.setUUID(generateTimeBasedUUID(tsc.getTransactionTime()));
-    tsc.setMID(this->epayment.getActiveMID());
-    tsc.setTID(this->epayment.getActiveTID());
-    tsc.setTranscode("");
-    tsc.setStatus("F");
-    tsc.setDescription(ErrorCode::toString(desc));
-    tsc.setTransactionInInfo(me);
-    tsc.setTransactionOutInfo(ref);
+    tsc.setUUID(intent.uuid);
+    tsc.setMID(intent.mid);
+    tsc.setTID(intent.tid);
+    tsc.setTranscode(isDeducted ? intent.transcode : "");
+    tsc.setStatus(isDeducted ? "S" : STATUS_UNKNOWN);
+    tsc.setDescription(isDeducted ? "S" : ErrorCode::toString(ErrorCode::classify(intent.ctype, ErrorCode::Class::DEBIT_LOST_CONTACT)));
+    tsc.setTransactionInInfo(identity);
+    tsc.setTransactionOutInfo(origin);
     tsc.setCardData(card);
 
-    Sqlite3Transaction tscdb(TRANSACTION_DATABASE);
+    const std::time_t cycle = Counter::Cycle(intent.time).getCycleTime();
+    TransactionStore::UploadTag tag;
+    if (isDeducted)
+        tag = TransactionStore::UploadTag(intent.ctype, cycle);
+    tag.intent = intent.uuid;
+    if (this->tscdb->insert(tsc, tag) == false)
+        return false;
+    if (isDeducted == false)
+        return true;
+
+    /* counted on the day of the tap, like the uploader counts its records, on the one
+     * Counter of that day (the current one when the tap was today) */
+    std::shared_ptr<Counter> counter = this->rotation->acquire(intent.time);
+    countTransaction(*counter, intent.ctype, isTapIn, true, intent.isFreeService != 0, intent.isEconomy != 0, intent.amount);
 
-    if (tscdb.insertLog(tsc) == 0)
+    if (intent.isPinalty)
     {
-        Debug::info(__FILE__, __LINE__, __func__, "success to insert invalid transaction\n");
-        return true;
+        /* a pinalty stores the reset and then a tap-in without deduct. The reset above carries the
+         * intent, so a crash right here loses the tap-in record but never stores the debit twice */
+        TransactionData tapIn(true);
+        tapIn.setIntegratorId(1);
+        tapIn.setMinimumBalance(intent.minimumBalance);
+        tapIn.setBalanceBeforeTransaction(intent.balance);
+        tapIn.setNormalFare(intent.normalFare);
+        tapIn.setFare(0);
+        tapIn.setBalanceAfterTransaction(intent.balance);
+        tapIn.setProcessingTimeMs(0);
+        tapIn.setCoordinates(0.0, 0.0);
+        tapIn.setTransactionTime(intent.time);
+        tapIn.setTransactionStoredTime(std::time(nullptr));
+        tapIn.setUUID(UUIDv7::generate());
+        tapIn.setMID(intent.mid);
+        tapIn.setTID(intent.tid);
+        tapIn.setTranscode("");
+        tapIn.setStatus("S");
+        tapIn.setDescription("S");
+        tapIn.setTransactionInInfo(identity);
+        tapIn.setTransactionOutInfo(origin);
+        tapIn.setCardData(card);
+        if (this->tscdb->insert(tapIn, TransactionStore::UploadTag(intent.ctype, cycle)))
+            countTransaction(*counter, intent.ctype, true, false, intent.isFreeService != 0, intent.isEconomy != 0, 0);
+        else
+            FTV_LOG_ERROR("intent %s: tap-in record of the pinalty not stored\n", intent.uuid);
     }
+    counter->store();
+    return true;
+}
 
-    Debug::error(__FILE__, __LINE__, __func__, "failed to insert transaction\n");
-    return false;
+void Controller::onUploaded(unsigned int ctype, std::time_t cycle, unsigned int count)
+{
+    std::shared_ptr<Counter> counter = std::atomic_load(&this->counter);
+    try
+    {
+        if (counter.get() == nullptr)
+        {
+            FTV_LOG_WARNING("missing counter, %u sent record(s) not counted\n", count);
+            return;
+        }
+        const bool isShown = (counter->getCycle().getCycleTime() == cycle);
+        if (isShown == false)
+        {
+            /* sent after the day rolled over, the record belongs to the counter of its own day,
+             * which may still be alive next to the current one */
+            counter = this->rotation->acquire(cycle);
+        }
+
+        Counter::Issuer &cissuer = counter->getIssuerByEpaymentCardType(ctype);
+        for (unsigned int i = 0; i < count; i++)
+        {
+            cissuer.incSent();
+        }
+        counter->store();
+
+        /* the screen shows the counter of the current day only */
+        if (isShown)
+            UIHelper::updateCounter(*this->view, counter.get());
+    }
+    catch (const std::exception &e)
+    {
+        FTV_LOG_ERROR("failed to count %u sent record(s) of cycle %li: %s\n", count, static_cast<long>(cycle), e.what());
+    }
 }
 
-bool Controller::storeErrorInsufficientBalance(bool isTapIn,
-                                               bool isDeduct,
-                                               const int lastBalance,
-                                               const CardData &refUserData,
-                                               const TransactionRules &rules,
-                                               Duration &duration)
+Controller::Controller(CardReader &reader, WorkflowManager &workflow, Gui &gui) : isRun(false),
+                                                                                  reader(reader),
+                                                                                  workflow(workflow),
+                                                                                  gui(gui),
+                                                                                  view(new GuiState(gui)),
+                                                                                  th(),
+                                                                                  snFile(Counter::createSNFile(COUNTER_DATA_DIRECTORY)),
+                                                                                  counter(),
+                                                                                  rotation(new CounterRotation(COUNTER_DATA_DIRECTORY, this->snFile, COUNTER_DATA_DIRECTORY, std::chrono::seconds(COUNTER_PREPARE_LEAD_S))),
+                                                                                  shards(new TransactionShards(TRANSACTION_DATA_DIRECTORY, TRANSACTION_LEGACY_DATABASE)),
+                                                                                  tscdb(new TransactionStore(*this->shards)),
+                                                                                  persistence(),
+                                                                                  uploader(),
+                                                                                  journal(new IntentJournal(INTENT_JOURNAL_FILE)),
+                                                                                  tap(new TapContext()),
+                                                                                  scheduler(),
+                                                                                  latency(new LatencyStats()),
+                                                                                  lastStatsDump(std::chrono::steady_clock::now()),
+                                                                                  holdSuccess(3000),
+                                                                                  holdFailed(1500),
+                                                                                  holdUntil(),
+                                                                                  isHolding(false),
+                                                                                  lastCardNumber(0ULL),
+                                                                                  isLastCardPresent(false),
+                                                                                  isTransientFailure(false),
+                                                                                  heldRetries(0U),
+                                                                                  retryAt(),
+                                                                                  bootRef(std::chrono::steady_clock::now()),
+                                                                                  isFirstTapLogged(false),
+                                                                                  readyIssuers(0U),
+                                                                                  pendingIssuers(0),
+                                                                                  issuerInits(),
+                                                                                  issuerThread(),
+                                                                                  isIssuerThreadRunning(false),
+                                                                                  runningIssuer(),
+                                                                                  isIssuerStop(false),
+                                                                                  isCardOnReader(false),
+                                                                                  lastCardSeen(),
+                                                                                  readerBlockedSince(),
+                                                                                  issuerMtx(),
+                                                                                  issuerChanged(),
+                                                                                  readerMtx(),
+                                                                                  mtx()
 {
-    ErrorCode::Code ecode = ErrorCode::Code::MANDIRI_D5_INSUFFICIENT_BALANCE;
-    switch (this->epayment.getType())
+    std::unique_ptr<AdaptivePollScheduler> adaptive(new AdaptivePollScheduler());
+    adaptive->load(POLL_SCHEDULER_CONFIG_FILE);
+    this->scheduler = std::move(adaptive);
+
+    this->tscdb->open();
+    if (this->journal->open() == false)
     {
-    case Card::CARD_TYPE_BRI:
-        ecode = ErrorCode::Code::BRI_A3_INSUFFICIENT_BALANCE;
-        break;
-    case Card::CARD_TYPE_BNI:
-        ecode = ErrorCode::Code::BNI_B3_INSUFFICIENT_BALANCE;
-        break;
-    case Card::CARD_TYPE_BCA:
-        ecode = ErrorCode::Code::BCA_E5_INSUFFICIENT_BALANCE;
-        break;
-    case Card::CARD_TYPE_DKI:
-        ecode = ErrorCode::Code::DKI_C6_INSUFFICIENT_BALANCE;
-        break;
-    }
-    this->storeErrorTransactionOnReadSuccess(isTapIn,
-                                             isDeduct,
-                                             std::time(nullptr),
-                                             lastBalance,
-                                             refUserData,
-                                             rules,
-                                             duration,
-                                             ecode);
-}
-
-bool Controller::storeErrorGetBalance(bool isTapIn,
-                                      bool isDeduct,
-                                      const CardData &refUserData,
-                                      const TransactionRules &rules,
-                                      Duration &duration)
-{
-    ErrorCode::Code ecode = ErrorCode::Code::MANDIRI_D3_BALANCE_CHECK_EXCEPTION;
-    switch (this->epayment.getType())
+        FTV_LOG_ERROR("intent journal is not available, deducts are not journaled\n");
+        this->journal.reset();
+    }
+    this->persistence.reset(new PersistenceWorker(*this->tscdb));
+    this->persistence->setGroupCommit(std::chrono::milliseconds(TRANSACTION_GROUP_COMMIT_WINDOW_MS), TRANSACTION_GROUP_COMMIT_MAX_RECORDS);
+    this->persistence->setRecycler(
+        [this](std::unique_ptr<TransactionData> data)
+        {
+            this->tap->recycle(std::move(data));
+        });
+    this->persistence->begin();
+    this->rotation->begin();
+    this->reloadCounter();
+    this->reconcileCounter();
+
+    Uploader::Config config;
+    if (config.load(UPLOADER_CONFIG_FILE))
     {
-    case Card::CARD_TYPE_BRI:
-        ecode = ErrorCode::Code::BRI_AA_BALANCE_CHECK_EXCEPTION;
-        break;
-    case Card::CARD_TYPE_BNI:
-        ecode = ErrorCode::Code::BNI_BA_BALANCE_CHECK_EXCEPTION;
-        break;
-    case Card::CARD_TYPE_BCA:
-        ecode = ErrorCode::Code::BCA_E3_BALANCE_CHECK_EXCEPTION;
-        break;
-    case Card::CARD_TYPE_DKI:
-        ecode = ErrorCode::Code::DKI_C3_BALANCE_CHECK_EXCEPTION;
-        break;
-    }
-    this->storeErrorTransactionOnReadSuccess(isTapIn,
-                                             isDeduct,
-                                             std::time(nullptr),
-                                             0,
-                                             refUserData,
-                                             rules,
-                                             duration,
-                                             ecode);
-}
-
-bool Controller::storeErrorPurchaseBalance(bool isTapIn,
-                                           bool isDeduct,
-                                           const CardData &refUserData,
-                                           const TransactionRules &rules,
-                                           Duration &duration)
-{
-    this->storeErrorTransactionOnReadSuccess(isTapIn,
-                                             isDeduct,
-                                             std::time(nullptr),
-                                             0,
-                                             refUserData,
-                                             rules,
-                                             duration,
-                                             ErrorCode::Code::GENERAL_F6_DEBIT_DEVICE_LOST_CONTACT);
-}
-
-bool Controller::storeErrorWriteUserData(bool isTapIn,
-                                         bool isDeduct,
-                                         const int lastBalance,
-                                         const CardData &refUserData,
-                                         const TransactionRules &rules,
-                                         Duration &duration)
-{
-    ErrorCode::Code ecode = ErrorCode::Code::MANDIRI_D9_WRITE_BLOCK_EXCEPTION;
-    switch (this->epayment.getType())
+        this->uploader.reset(new Uploader(*this->shards,
+                                          config,
+                                          [this](unsigned int ctype, std::time_t cycle, unsigned int count)
+                                          {
+                                              this->onUploaded(ctype, cycle, count);
+                                          }));
+        this->uploader->begin();
+    }
+}
+
+Controller::~Controller()
+{
+    this->stop();
+}
+
+void Controller::setup(std::function<void(CardReader &reader, WorkflowManager &workflow, GuiState &view)> handler)
+{
+    std::lock_guard<std::mutex> guard(this->mtx);
+    handler(this->reader, this->workflow, *this->view);
+    /* the handler may have changed the provision the tap context copied from */
+    this->tap->invalidate();
+}
+
+void Controller::setPollScheduler(std::unique_ptr<PollScheduler> scheduler)
+{
+    std::lock_guard<std::mutex> guard(this->mtx);
+    if (this->isRun)
     {
-    case Card::CARD_TYPE_BRI:
-        ecode = ErrorCode::Code::BRI_A7_WRITE_BLOCK_EXCEPTION;
-        break;
-    case Card::CARD_TYPE_BNI:
-        ecode = ErrorCode::Code::BNI_B8_WRITE_BLOCK_EXCEPTION;
-        break;
-    case Card::CARD_TYPE_BCA:
-        ecode = ErrorCode::Code::BCA_E9_WRITE_BLOCK_EXCEPTION;
-        break;
-    case Card::CARD_TYPE_DKI:
-        ecode = ErrorCode::Code::DKI_CB_WRITE_BLOCK_EXCEPTION;
-        break;
-    }
-    this->storeErrorTransactionOnReadSuccess(isTapIn,
-                                             isDeduct,
-                                             std::time(nullptr),
-                                             lastBalance,
-                                             refUserData,
-                                             rules,
-                                             duration,
-                                             ecode);
-}
-
-bool Controller::storeErrorBlockingTime(const CardData &refUserData,
-                                        const TransactionRules &rules,
-                                        Duration &duration)
-{
-    ErrorCode::Code ecode = ErrorCode::Code::MANDIRI_D4_TAP_BELOW_ONE_MINUTE;
-    switch (this->epayment.getType())
+        FTV_LOG_WARNING("poll scheduler can only be replaced before begin\n");
+        return;
+    }
+    if (scheduler.get())
+        this->scheduler = std::move(scheduler);
+}
+
+void Controller::setDisplayHold(std::chrono::milliseconds onSuccess, std::chrono::milliseconds onFailed)
+{
+    std::lock_guard<std::mutex> guard(this->mtx);
+    if (this->isRun)
     {
-    case Card::CARD_TYPE_BRI:
-        ecode = ErrorCode::Code::BRI_A2_TAP_BELOW_ONE_MINUTE;
-        break;
-    case Card::CARD_TYPE_BNI:
-        ecode = ErrorCode::Code::BNI_B9_TAP_BELOW_ONE_MINUTE;
-        break;
-    case Card::CARD_TYPE_BCA:
-        ecode = ErrorCode::Code::BCA_E4_TAP_BELOW_ONE_MINUTE;
-        break;
-    case Card::CARD_TYPE_DKI:
-        ecode = ErrorCode::Code::DKI_C9_TAP_BELOW_ONE_MINUTE;
-        break;
-    }
-    this->storeErrorTransactionOnReadSuccess(true,
-                                             false,
-                                             std::time(nullptr),
-                                             0,
-                                             refUserData,
-                                             rules,
-                                             duration,
-                                             ecode);
-}
-
-bool Controller::storeErrorFreeServiceExpired(const CardData &refUserData,
-                                              const TransactionRules &rules,
-                                              Duration &duration)
-{
-    this->storeErrorTransactionOnReadSuccess(true,
-                                             false,
-                                             std::time(nullptr),
-                                             0,
-                                             refUserData,
-                                             rules,
-                                             duration,
-                                             ErrorCode::Code::DKI_C5_KLG_EXPIRED);
+        FTV_LOG_WARNING("display hold can only be changed before begin\n");
+        return;
+    }
+    this->holdSuccess = onSuccess;
+    this->holdFailed = onFailed;
 }
 
-void Controller::routine()
+void Controller::setGroupCommit(std::chrono::milliseconds window, std::size_t maxRecords)
 {
-    bool cardAvailable = false;
-    bool result = false;
+    this->persistence->setGroupCommit(window, maxRecords);
+}
 
-    { /* needed for duration calculation */
-        Duration duration("transaction");
-        cardAvailable = this->epayment.selectAttachedCard();
-        if (cardAvailable)
+unsigned int Controller::issuerBit(unsigned int ctype)
+{
+    /* one bit per card type value */
+    return (ctype < 32U) ? (1U << ctype) : 0U;
+}
+
+void Controller::initIssuer(unsigned int ctype,
+                            const std::string &name,
+                            std::function<bool()> init,
+                            std::function<void(bool ready)> onDone)
+{
+    /* every SAM talks through the same Epayment, which takes one handshake at a time: the inits
+     * run one after the other on one thread, a slow or failing issuer delays the ones queued after it */
+    std::lock_guard<std::mutex> guard(this->issuerMtx);
+    this->pendingIssuers++;
+    this->issuerInits.push_back(IssuerInit{ctype, name, init, onDone});
+    this->isIssuerStop = false;
+    if (this->isIssuerThreadRunning)
+        return;
+
+    if (this->issuerThread.get())
+        /* it already left its loop, the join does not wait */
+        this->issuerThread->join();
+    this->isIssuerThreadRunning = true;
+    this->issuerThread.reset(new std::thread(&Controller::runIssuerInits, this));
+}
+
+void Controller::markReader(bool isCardPresent)
+{
+    /* only the poller writes the flag: an empty reader that stays empty costs nothing */
+    if (isCardPresent == false && this->isCardOnReader == false)
+        return;
+    {
+        std::lock_guard<std::mutex> guard(this->issuerMtx);
+        this->isCardOnReader = isCardPresent;
+        this->lastCardSeen = std::chrono::steady_clock::now();
+    }
+    this->issuerChanged.notify_all();
+}
+
+void Controller::waitReaderIdle()
+{
+    /* the inits are vendor calls that hold the reader until done, they cannot be interrupted:
+     * once a card can be served, a handshake only starts on a reader left alone for a while */
+    std::unique_lock<std::mutex> lock(this->issuerMtx);
+    if (this->readyIssuers.load(std::memory_order_acquire) == 0U)
+        return;
+    const std::chrono::steady_clock::time_point limit = std::chrono::steady_clock::now() + std::chrono::milliseconds(ISSUER_INIT_MAX_DEFER_MS);
+    while (this->isIssuerStop == false)
+    {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (now >= limit)
         {
-            duration.checkPoint("card pooling");
-            try
-            {
-                result = this->processAttachedCard(duration);
-            }
-            catch (const std::exception &e)
+            FTV_LOG_WARNING("reader busy for %d ms, SAM %s starts anyway\n", ISSUER_INIT_MAX_DEFER_MS, this->runningIssuer.c_str());
+            return;
+        }
+        std::chrono::steady_clock::time_point quietAt = this->lastCardSeen + std::chrono::milliseconds(ISSUER_INIT_QUIET_MS);
+        if (this->isCardOnReader == false && now >= quietAt)
+            return;
+        this->issuerChanged.wait_until(lock, this->isCardOnReader ? limit : std::min(quietAt, limit));
+    }
+}
+
+void Controller::runIssuerInits()
+{
+    /* boot waits for the sum of the handshakes, not the slowest one: logged so it shows up in the field */
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    std::size_t total = 0;
+    while (true)
+    {
+        IssuerInit item;
+        {
+            std::lock_guard<std::mutex> guard(this->issuerMtx);
+            if (this->issuerInits.empty())
             {
-                Debug::info(__FILE__, __LINE__, __func__, "catch: %s\n", e.what());
+                this->isIssuerThreadRunning = false;
+                this->runningIssuer.clear();
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+                FTV_LOG_INFO("%zu SAM(s) initialized in sequence in %.3fs\n", total, elapsed.count());
+                return;
             }
+            item = std::move(this->issuerInits.front());
+            this->issuerInits.pop_front();
+            this->runningIssuer = item.name;
         }
-        else
+
+        this->waitReaderIdle();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        bool ready = false;
+        try
         {
-            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            /* the controller polls cards on the same Epayment */
+            std::lock_guard<std::mutex> guard(this->readerMtx);
+            ready = item.init();
         }
-    }
-
-    if (cardAvailable)
-    {
-        if (result)
+        catch (const std::exception &e)
         {
-            std::this_thread::sleep_for(std::chrono::milliseconds(3000));
+            FTV_LOG_ERROR("SAM %s: %s\n", item.name.c_str(), e.what());
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (ready)
+        {
+            FTV_LOG_INFO("SAM %s ready in %.3fs\n", item.name.c_str(), elapsed.count());
         }
         else
         {
-            std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+            FTV_LOG_ERROR("SAM %s failed after %.3fs\n", item.name.c_str(), elapsed.count());
         }
-        Debug::moveLogHistoryToFile();
-        const SingleTripFare &singleTripFare = this->workflow.getProvision().getData().getPriceInformation().getSingleTrip();
-        UIHelper::reset(this->gui, singleTripFare.getPrice());
+        total++;
+
+        {
+            std::lock_guard<std::mutex> guard(this->issuerMtx);
+            if (ready)
+                this->readyIssuers.fetch_or(Controller::issuerBit(item.ctype), std::memory_order_release);
+            this->pendingIssuers--;
+            this->runningIssuer.clear();
+        }
+        this->issuerChanged.notify_all();
+        if (item.onDone)
+            item.onDone(ready);
     }
 }
 
-void Controller::reloadCounter()
+bool Controller::isIssuerReady(unsigned int ctype) const
 {
-    std::string counterPath = Counter::determineConfigPath(COUNTER_DATA_DIRECTORY, std::time(nullptr));
-    this->counter.reset(new Counter(COUNTER_DATA_DIRECTORY, counterPath));
+    return (this->readyIssuers.load(std::memory_order_acquire) & Controller::issuerBit(ctype)) != 0U;
 }
 
-Controller::Controller(Epayment &epayment, WorkflowManager &workflow, Gui &gui) : isRun(false),
-                                                                                  epayment(epayment),
-                                                                                  workflow(workflow),
-                                                                                  gui(gui),
-                                                                                  th(),
-                                                                                  mtx()
+bool Controller::waitAnyIssuerReady(std::vector<std::string> *pending)
 {
-    this->reloadCounter();
+    std::unique_lock<std::mutex> lock(this->issuerMtx);
+    this->issuerChanged.wait(
+        lock,
+        [this]()
+        {
+            return this->readyIssuers.load(std::memory_order_acquire) != 0U || this->pendingIssuers == 0;
+        });
+    if (pending)
+    {
+        /* the one in its handshake first, then the queue in the order it runs */
+        pending->clear();
+        if (this->runningIssuer.empty() == false)
+            pending->push_back(this->runningIssuer);
+        for (const IssuerInit &item : this->issuerInits)
+        {
+            pending->push_back(item.name);
+        }
+    }
+    return this->readyIssuers.load(std::memory_order_acquire) != 0U;
 }
 
-Controller::~Controller()
+std::size_t Controller::getPendingIssuers()
 {
-    this->stop();
+    std::lock_guard<std::mutex> guard(this->issuerMtx);
+    return this->pendingIssuers;
 }
 
-void Controller::setup(std::function<void(Epayment &epayment, WorkflowManager &workflow, Gui &gui)> handler)
+bool Controller::isRuning()
 {
     std::lock_guard<std::mutex> guard(this->mtx);
-    handler(this->epayment, this->workflow, this->gui);
+    return this->isRun;
 }
 
-bool Controller::isRuning()
+const LatencyStats &Controller::getLatencyStats() const
 {
-    std::lock_guard<std::mutex> guard(this->mtx);
-    return this->isRun;
+    return *this->latency;
+}
+
+PersistenceWorker::Stats Controller::getPersistenceStats() const
+{
+    return this->persistence->getStats();
 }
 
-void Controller::begin(std::function<void(Epayment &epayment, WorkflowManager &workflow, Gui &gui)> preSetup)
+void Controller::begin(std::function<void(CardReader &reader, WorkflowManager &workflow, GuiState &view)> preSetup)
 {
     {
         std::lock_guard<std::mutex> guard(this->mtx);
@@ -986,21 +1413,25 @@ void Controller::begin(std::function<void(Epayment &epayment, WorkflowManager &w
         [this, preSetup]()
         {
             this->gui.waitObjectReady();
+            this->view->begin();
+            UIHelper::beginAnimation(*this->view);
             {
                 std::lock_guard<std::mutex> guard(this->mtx);
-                preSetup(this->epayment, this->workflow, this->gui);
+                /* the frame thread owns the widgets from here on, the setup writes through the model too */
+                preSetup(this->reader, this->workflow, *this->view);
+                /* needs the provision to rebuild the card data, before the counter goes on screen */
+                this->recoverIntents();
 
                 const SingleTripFare &singleTripFare = this->workflow.getProvision().getData().getPriceInformation().getSingleTrip();
-                UIHelper::reset(this->gui, singleTripFare.getPrice());
+                UIHelper::reset(*this->view, singleTripFare.getPrice());
                 if (this->counter.get())
-                    UIHelper::updateCounter(this->gui, this->counter.get());
+                    UIHelper::updateCounter(*this->view, this->counter.get());
                 else
-                    Debug::warning(__FILE__, __LINE__, __func__, "missing counter\n");
+                    FTV_LOG_WARNING("missing counter\n");
             }
             while (this->isRuning())
             {
                 this->routine();
-                std::this_thread::sleep_for(std::chrono::milliseconds(125));
             }
         }));
 }
@@ -1011,6 +1442,35 @@ void Controller::stop()
         std::lock_guard<std::mutex> guard(this->mtx);
         this->isRun = false;
     }
-    this->th->join();
-    this->th.reset();
+    if (this->th.get())
+    {
+        this->th->join();
+        this->th.reset();
+    }
+    {
+        std::unique_ptr<std::thread> inits;
+        {
+            /* a SAM still queued is not started any more */
+            std::lock_guard<std::mutex> guard(this->issuerMtx);
+            this->pendingIssuers -= this->issuerInits.size();
+            this->issuerInits.clear();
+            this->isIssuerStop = true;
+            inits.swap(this->issuerThread);
+        }
+        this->issuerChanged.notify_all();
+        if (inits.get())
+            inits->join();
+    }
+    if (this->uploader.get())
+        /* it updates the counters, stop it before they go away */
+        this->uploader->stop();
+    this->rotation->stop();
+    /* every queued record must reach the database before shutdown */
+    this->persistence->stop();
+    if (this->journal.get())
+        /* the persistence callbacks close intents, it goes after them */
+        this->journal->close();
+    /* after the persistence callbacks, they still update the counters on screen */
+    UIHelper::stopAnimation();
+    this->view->stop();
 }
\ No newline at end of file
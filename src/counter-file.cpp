@@ -0,0 +1,178 @@
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <cstddef>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "counter-file.hpp"
+#include "lzma.h"
+
+#include "async-log.hpp"
+
+#define COUNTER_FILE_MAGIC 0x43545246U /* "FTRC" */
+#define COUNTER_FILE_VERSION 1U
+
+uint32_t CounterFile::checksum(const Slot &slot)
+{
+    return lzma_crc32(reinterpret_cast<const uint8_t *>(&slot), offsetof(Slot, crc), 0);
+}
+
+bool CounterFile::isValid(const Slot &slot)
+{
+    return (slot.magic == COUNTER_FILE_MAGIC &&
+            slot.version == COUNTER_FILE_VERSION &&
+            slot.crc == CounterFile::checksum(slot));
+}
+
+CounterFile::CounterFile(const std::string &filePath) : filePath(filePath),
+                                                         fd(-1),
+                                                         layout(nullptr),
+                                                         sequence(0ULL),
+                                                         mutex()
+{
+}
+
+CounterFile::~CounterFile()
+{
+    this->close();
+}
+
+bool CounterFile::open(bool &isCreated)
+{
+    std::lock_guard<std::mutex> guard(this->mutex);
+    isCreated = false;
+    if (this->layout)
+        return true;
+
+    this->fd = ::open(this->filePath.c_str(), O_RDWR | O_CREAT, 0644);
+    if (this->fd < 0)
+    {
+        FTV_LOG_ERROR("open \"%s\" failed: %s\n", this->filePath.c_str(), strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(this->fd, &st) != 0)
+    {
+        FTV_LOG_ERROR("stat \"%s\" failed: %s\n", this->filePath.c_str(), strerror(errno));
+        ::close(this->fd);
+        this->fd = -1;
+        return false;
+    }
+
+    if (static_cast<std::size_t>(st.st_size) != sizeof(Layout))
+    {
+        isCreated = (st.st_size == 0);
+        if (isCreated == false)
+            FTV_LOG_WARNING("\"%s\" has unexpected size %li, recreate\n", this->filePath.c_str(), static_cast<long>(st.st_size));
+        if (ftruncate(this->fd, 0) != 0 || ftruncate(this->fd, sizeof(Layout)) != 0)
+        {
+            FTV_LOG_ERROR("resize \"%s\" failed: %s\n", this->filePath.c_str(), strerror(errno));
+            ::close(this->fd);
+            this->fd = -1;
+            return false;
+        }
+    }
+
+    void *addr = mmap(nullptr, sizeof(Layout), PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, 0);
+    if (addr == MAP_FAILED)
+    {
+        FTV_LOG_ERROR("mmap \"%s\" failed: %s\n", this->filePath.c_str(), strerror(errno));
+        ::close(this->fd);
+        this->fd = -1;
+        return false;
+    }
+    this->layout = static_cast<Layout *>(addr);
+    return true;
+}
+
+void CounterFile::close()
+{
+    std::lock_guard<std::mutex> guard(this->mutex);
+    if (this->layout)
+    {
+        msync(this->layout, sizeof(Layout), MS_SYNC);
+        munmap(this->layout, sizeof(Layout));
+        this->layout = nullptr;
+    }
+    if (this->fd >= 0)
+    {
+        ::close(this->fd);
+        this->fd = -1;
+    }
+}
+
+bool CounterFile::load(Record &record)
+{
+    std::lock_guard<std::mutex> guard(this->mutex);
+    return this->loadSlot(record);
+}
+
+bool CounterFile::loadSlot(Record &record)
+{
+    memset(&record, 0x00, sizeof(record));
+    this->sequence = 0ULL;
+    if (this->layout == nullptr)
+        return false;
+
+    const Slot &a = this->layout->slot[0];
+    const Slot &b = this->layout->slot[1];
+    bool isValidA = CounterFile::isValid(a);
+    bool isValidB = CounterFile::isValid(b);
+
+    if (isValidA == false && isValidB == false)
+        return false;
+
+    const Slot &newest = (isValidA && (isValidB == false || a.sequence > b.sequence)) ? a : b;
+    if (isValidA != isValidB && newest.sequence > 1ULL)
+        FTV_LOG_WARNING("\"%s\" has a damaged slot, recovered from sequence %llu\n", this->filePath.c_str(), static_cast<unsigned long long>(newest.sequence));
+
+    record = newest.record;
+    this->sequence = newest.sequence;
+    return true;
+}
+
+bool CounterFile::store(const Record &record)
+{
+    std::lock_guard<std::mutex> guard(this->mutex);
+    return this->storeSlot(record);
+}
+
+bool CounterFile::update(const std::function<bool(Record &record)> &modify)
+{
+    std::lock_guard<std::mutex> guard(this->mutex);
+    if (this->layout == nullptr)
+        return false;
+
+    Record record;
+    this->loadSlot(record);
+    if (modify(record) == false)
+        return true;
+    return this->storeSlot(record);
+}
+
+bool CounterFile::storeSlot(const Record &record)
+{
+    if (this->layout == nullptr)
+        return false;
+
+    /* the newest copy lives in slot (sequence & 1), overwrite the other one */
+    uint64_t next = this->sequence + 1ULL;
+    Slot &slot = this->layout->slot[next & 1ULL];
+
+    slot.crc = 0U;
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.magic = COUNTER_FILE_MAGIC;
+    slot.version = COUNTER_FILE_VERSION;
+    slot.sequence = next;
+    slot.record = record;
+    slot.reserved = 0U;
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.crc = CounterFile::checksum(slot);
+
+    msync(this->layout, sizeof(Layout), MS_ASYNC);
+    this->sequence = next;
+    return true;
+}
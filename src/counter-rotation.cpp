@@ -0,0 +1,171 @@
+#include "counter-rotation.hpp"
+#include "counter.hpp"
+
+#include "async-log.hpp"
+
+#define COUNTER_ROTATION_RETRY_S 60
+
+CounterRotation::CounterRotation(const std::string &snPath, std::shared_ptr<CounterFile> snFile, const std::string &basePath, std::chrono::seconds lead) : isRun(false),
+                                                                                                                                                     snPath(snPath),
+                                                                                                                                                     snFile(snFile),
+                                                                                                                                                     basePath(basePath),
+                                                                                                                                                     lead(lead),
+                                                                                                                                                     target(0),
+                                                                                                                                                     isPreparing(false),
+                                                                                                                                                     prepared(),
+                                                                                                                                                     registry(new Registry()),
+                                                                                                                                                     th(),
+                                                                                                                                                     mutex(),
+                                                                                                                                                     changed()
+{
+}
+
+CounterRotation::~CounterRotation()
+{
+    this->stop();
+}
+
+void CounterRotation::routine()
+{
+    std::unique_lock<std::mutex> lock(this->mutex);
+    while (this->isRun)
+    {
+        if (this->target == 0 || this->prepared.get())
+        {
+            /* nothing scheduled or already waiting to be taken */
+            this->changed.wait(lock);
+            continue;
+        }
+
+        std::chrono::system_clock::time_point at = std::chrono::system_clock::from_time_t(this->target) - this->lead;
+        if (std::chrono::system_clock::now() < at)
+        {
+            /* woken early by schedule() or stop(), the loop checks again */
+            this->changed.wait_until(lock, at);
+            continue;
+        }
+
+        std::time_t boundary = this->target;
+        this->isPreparing = true;
+        lock.unlock();
+        std::shared_ptr<Counter> counter;
+        try
+        {
+            counter = this->acquire(boundary);
+        }
+        catch (const std::exception &e)
+        {
+            FTV_LOG_ERROR("failed to prepare counter: %s\n", e.what());
+        }
+        lock.lock();
+        this->isPreparing = false;
+        this->changed.notify_all();
+
+        if (counter.get() == nullptr)
+        {
+            this->changed.wait_for(lock, std::chrono::seconds(COUNTER_ROTATION_RETRY_S));
+            continue;
+        }
+        if (boundary != this->target)
+        {
+            /* rescheduled meanwhile, drop it outside of the lock */
+            lock.unlock();
+            counter.reset();
+            lock.lock();
+            continue;
+        }
+        this->prepared = counter;
+        FTV_LOG_INFO("counter of cycle %li prepared\n", static_cast<long>(boundary));
+    }
+}
+
+void CounterRotation::begin()
+{
+    std::lock_guard<std::mutex> guard(this->mutex);
+    if (this->th.get())
+        return;
+    this->isRun = true;
+    this->th.reset(new std::thread(&CounterRotation::routine, this));
+}
+
+void CounterRotation::stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(this->mutex);
+        if (this->th.get() == nullptr)
+            return;
+        this->isRun = false;
+    }
+    this->changed.notify_all();
+    this->th->join();
+    this->th.reset();
+    this->prepared.reset();
+}
+
+void CounterRotation::schedule(const std::time_t boundary)
+{
+    std::shared_ptr<Counter> stale;
+    {
+        std::lock_guard<std::mutex> guard(this->mutex);
+        if (this->target == boundary)
+            return;
+        this->target = boundary;
+        stale.swap(this->prepared);
+    }
+    this->changed.notify_all();
+}
+
+std::shared_ptr<Counter> CounterRotation::take(const std::time_t time)
+{
+    std::shared_ptr<Counter> result;
+    {
+        /* never build the same day twice, two counters would write one counter.bin */
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->changed.wait(lock,
+                           [this]()
+                           {
+                               return (this->isPreparing == false);
+                           });
+        result.swap(this->prepared);
+        this->target = 0;
+    }
+    this->changed.notify_all();
+    if (result.get() && result->getCycle().isSameCycle(time) == false)
+        /* the clock jumped past the prepared day */
+        result.reset();
+    return result;
+}
+
+std::shared_ptr<Counter> CounterRotation::acquire(const std::time_t time)
+{
+    const std::time_t cycle = Counter::Cycle(time).getCycleTime();
+    std::unique_lock<std::mutex> lock(this->registry->mutex);
+    for (;;)
+    {
+        std::map<std::time_t, std::weak_ptr<Counter>>::iterator it = this->registry->counters.find(cycle);
+        if (it == this->registry->counters.end())
+            break;
+        std::shared_ptr<Counter> counter = it->second.lock();
+        if (counter.get())
+            return counter;
+        /* the last owner is still storing it, wait until the file is released */
+        this->registry->released.wait(lock);
+    }
+
+    std::shared_ptr<Registry> registry = this->registry;
+    std::string counterPath = Counter::determineConfigPath(this->basePath, cycle);
+    std::shared_ptr<Counter> counter(new Counter(this->snPath, this->snFile, counterPath, time),
+                                     [registry, cycle](Counter *counter)
+                                     {
+                                         delete counter;
+                                         {
+                                             std::lock_guard<std::mutex> guard(registry->mutex);
+                                             std::map<std::time_t, std::weak_ptr<Counter>>::iterator it = registry->counters.find(cycle);
+                                             if (it != registry->counters.end() && it->second.expired())
+                                                 registry->counters.erase(it);
+                                         }
+                                         registry->released.notify_all();
+                                     });
+    this->registry->counters[cycle] = counter;
+    return counter;
+}
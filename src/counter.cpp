@@ -2,238 +2,243 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <cerrno>
+#include <thread>
 #include "counter.hpp"
 #include "epayment/include/card-access.hpp"
 #include "utils/include/nlohmann/json.hpp"
-#include "utils/include/debug.hpp"
+#include "async-log.hpp"
 #include "utils/include/error.hpp"
 #include "utils/include/time.hpp"
 
 static bool createDirectory(const std::string &path)
 {
-    Debug::info(__FILE__, __LINE__, __func__, "create directory \"%s\"...\n", path.c_str());
+    /* called for every counter path, only a directory actually created is worth a line */
     if (mkdir(path.c_str(), 0777) == 0)
     {
-        Debug::info(__FILE__, __LINE__, __func__, "create directory \"%s\" success\n", path.c_str());
+        FTV_LOG_INFO("directory \"%s\" created\n", path.c_str());
         return true;
     }
     else if (errno == EEXIST)
     {
-        Debug::info(__FILE__, __LINE__, __func__, "directory \"%s\" already exist\n", path.c_str());
         return true;
     }
-    Debug::error(__FILE__, __LINE__, __func__, "create directory \"%s\" failed: %s\n", path.c_str(), strerror(errno));
+    FTV_LOG_ERROR("create directory \"%s\" failed: %s\n", path.c_str(), strerror(errno));
     return false;
 }
 
-Counter::Issuer::Issuer(const std::string &filePath) : tapInRegular(0U),
-                                                       tapInEconomy(0U),
-                                                       tapInFreeService(0U),
-                                                       tapOut(0U),
-                                                       sent(0U),
-                                                       pending(0U),
-                                                       amount(0ULL),
-                                                       filePath(filePath),
-                                                       mutex()
+Counter::Issuer::Issuer(std::atomic<unsigned int> *generation) : tapInRegular(0U),
+                                                                 tapInEconomy(0U),
+                                                                 tapInFreeService(0U),
+                                                                 tapOut(0U),
+                                                                 sent(0U),
+                                                                 pending(0U),
+                                                                 amount(0ULL),
+                                                                 generation(generation)
 {
-    this->load();
 }
 
-Counter::Issuer::~Issuer()
-{
-    this->store();
-}
+Counter::Issuer::~Issuer() {}
+
 
 void Counter::Issuer::incTapInRegular()
 {
-    std::lock_guard<std::mutex> guard(this->mutex);
-    this->tapInRegular++;
+    Counter::beginWrite(this->generation);
+    this->tapInRegular.fetch_add(1U, std::memory_order_relaxed);
+    Counter::endWrite(this->generation);
 }
 
 void Counter::Issuer::incTapInEconomy()
 {
-    std::lock_guard<std::mutex> guard(this->mutex);
-    this->tapInEconomy++;
+    Counter::beginWrite(this->generation);
+    this->tapInEconomy.fetch_add(1U, std::memory_order_relaxed);
+    Counter::endWrite(this->generation);
 }
 
 void Counter::Issuer::incTapInFreeService()
 {
-    std::lock_guard<std::mutex> guard(this->mutex);
-    this->tapInFreeService++;
+    Counter::beginWrite(this->generation);
+    this->tapInFreeService.fetch_add(1U, std::memory_order_relaxed);
+    Counter::endWrite(this->generation);
 }
 
 void Counter::Issuer::incTapOut()
 {
-    std::lock_guard<std::mutex> guard(this->mutex);
-    this->tapOut++;
+    Counter::beginWrite(this->generation);
+    this->tapOut.fetch_add(1U, std::memory_order_relaxed);
+    Counter::endWrite(this->generation);
 }
 
 void Counter::Issuer::incAmount(const unsigned int amount)
 {
-    std::lock_guard<std::mutex> guard(this->mutex);
-    this->amount += amount;
+    Counter::beginWrite(this->generation);
+    this->amount.fetch_add(amount, std::memory_order_relaxed);
+    Counter::endWrite(this->generation);
 }
 
 void Counter::Issuer::incPending()
 {
-    std::lock_guard<std::mutex> guard(this->mutex);
-    this->pending++;
+    Counter::beginWrite(this->generation);
+    this->pending.fetch_add(1U, std::memory_order_relaxed);
+    Counter::endWrite(this->generation);
 }
 
 void Counter::Issuer::incSent()
 {
-    std::lock_guard<std::mutex> guard(this->mutex);
-    this->sent++;
-    this->pending--;
+    Counter::beginWrite(this->generation);
+    this->sent.fetch_add(1U, std::memory_order_relaxed);
+    this->pending.fetch_sub(1U, std::memory_order_relaxed);
+    Counter::endWrite(this->generation);
 }
 
 unsigned int Counter::Issuer::getTapInRegular() const
 {
-    std::lock_guard<std::mutex> guard(this->mutex);
-    return this->tapInRegular;
+    return this->tapInRegular.load(std::memory_order_relaxed);
 }
 
 unsigned int Counter::Issuer::getTapInEconomy() const
 {
-    std::lock_guard<std::mutex> guard(this->mutex);
-    return this->tapInEconomy;
+    return this->tapInEconomy.load(std::memory_order_relaxed);
 }
 
 unsigned int Counter::Issuer::getTapinFreeService() const
 {
-    std::lock_guard<std::mutex> guard(this->mutex);
-    return this->tapInFreeService;
+    return this->tapInFreeService.load(std::memory_order_relaxed);
 }
 
 unsigned int Counter::Issuer::getTapOut() const
 {
-    std::lock_guard<std::mutex> guard(this->mutex);
-    return this->tapOut;
+    return this->tapOut.load(std::memory_order_relaxed);
 }
 
 unsigned int Counter::Issuer::getPending() const
 {
-    std::lock_guard<std::mutex> guard(this->mutex);
-    return this->sent;
+    return this->pending.load(std::memory_order_relaxed);
 }
 
 unsigned int Counter::Issuer::getSent() const
 {
-    std::lock_guard<std::mutex> guard(this->mutex);
-    return this->pending;
+    return this->sent.load(std::memory_order_relaxed);
 }
 
 unsigned long long int Counter::Issuer::getAmount() const
 {
-    std::lock_guard<std::mutex> guard(this->mutex);
-    return this->amount;
+    return this->amount.load(std::memory_order_relaxed);
 }
 
-void Counter::Issuer::load()
+void Counter::Issuer::load(const CounterFile::IssuerRecord &record)
 {
-    std::lock_guard<std::mutex> guard(this->mutex);
-    Debug::info(__FILE__, __LINE__, __func__, "load %s configuartion\n", this->filePath.c_str());
-    std::ifstream file(filePath);
-    if (!file.is_open())
-        /* file doesn't exist */
-        return;
-
-    nlohmann::json j;
-    try
-    {
-        file >> j;
-    }
-    catch (...)
-    {
-        throw std::runtime_error(Error::common(__FILE__, __LINE__, __func__, "parse \"" + filePath + "\" failed"));
-    }
-
-    if (!j.is_object())
-        throw std::runtime_error(Error::common(__FILE__, __LINE__, __func__, "configuuration in \"" + filePath + "\" is not JSON object"));
-
-    Counter::readUnsignedSafe(j, "tap_in_regular", tapInRegular);
-    Counter::readUnsignedSafe(j, "tap_in_economy", tapInEconomy);
-    Counter::readUnsignedSafe(j, "tap_in_free_service", tapInFreeService);
-    Counter::readUnsignedSafe(j, "tap_out", tapOut);
-    Counter::readUnsignedSafe(j, "sent", sent);
-    Counter::readUnsignedSafe(j, "pending", pending);
-    Counter::readUnsignedSafe(j, "amount", amount);
-
-    Debug::info(__FILE__, __LINE__, __func__, "load %s configuartion done\n", this->filePath.c_str());
+    Counter::beginWrite(this->generation);
+    this->tapInRegular.store(record.tapInRegular, std::memory_order_relaxed);
+    this->tapInEconomy.store(record.tapInEconomy, std::memory_order_relaxed);
+    this->tapInFreeService.store(record.tapInFreeService, std::memory_order_relaxed);
+    this->tapOut.store(record.tapOut, std::memory_order_relaxed);
+    this->sent.store(record.sent, std::memory_order_relaxed);
+    this->pending.store(record.pending, std::memory_order_relaxed);
+    this->amount.store(record.amount, std::memory_order_relaxed);
+    Counter::endWrite(this->generation);
 }
 
-bool Counter::Issuer::store()
+void Counter::Issuer::save(CounterFile::IssuerRecord &record) const
 {
-    std::lock_guard<std::mutex> guard(this->mutex);
-
-    nlohmann::json j;
-
-    j["tap_in_regular"] = tapInRegular;
-    j["tap_in_economy"] = tapInEconomy;
-    j["tap_in_free_service"] = tapInFreeService;
-    j["tap_out"] = tapOut;
-    j["sent"] = sent;
-    j["pending"] = pending;
-    j["amount"] = amount;
+    record.tapInRegular = this->getTapInRegular();
+    record.tapInEconomy = this->getTapInEconomy();
+    record.tapInFreeService = this->getTapinFreeService();
+    record.tapOut = this->getTapOut();
+    record.sent = this->getSent();
+    record.pending = this->getPending();
+    record.amount = this->getAmount();
+}
 
-    std::ofstream file(filePath, std::ios::trunc);
+bool Counter::Issuer::importJSON(const std::string &filePath)
+{
+    std::ifstream file(filePath);
     if (!file.is_open())
+        /* file doesn't exist */
         return false;
 
+    FTV_LOG_INFO("import %s configuartion\n", filePath.c_str());
+    CounterFile::IssuerRecord record{};
+    unsigned int tapInRegular = 0U;
+    unsigned int tapInEconomy = 0U;
+    unsigned int tapInFreeService = 0U;
+    unsigned int tapOut = 0U;
+    unsigned int sent = 0U;
+    unsigned int pending = 0U;
+    unsigned long long int amount = 0ULL;
     try
     {
-        file << j.dump(4);
+        nlohmann::json j;
+        file >> j;
+
+        if (!j.is_object())
+            throw std::runtime_error(Error::common(__FILE__, __LINE__, __func__, "configuuration in \"" + filePath + "\" is not JSON object"));
+
+        Counter::readUnsignedSafe(j, "tap_in_regular", tapInRegular);
+        Counter::readUnsignedSafe(j, "tap_in_economy", tapInEconomy);
+        Counter::readUnsignedSafe(j, "tap_in_free_service", tapInFreeService);
+        Counter::readUnsignedSafe(j, "tap_out", tapOut);
+        Counter::readUnsignedSafe(j, "sent", sent);
+        Counter::readUnsignedSafe(j, "pending", pending);
+        Counter::readUnsignedSafe(j, "amount", amount);
     }
-    catch (...)
+    catch (const std::exception &e)
     {
+        FTV_LOG_ERROR("import \"%s\" failed: %s\n", filePath.c_str(), e.what());
         return false;
     }
 
+    record.tapInRegular = tapInRegular;
+    record.tapInEconomy = tapInEconomy;
+    record.tapInFreeService = tapInFreeService;
+    record.tapOut = tapOut;
+    record.sent = sent;
+    record.pending = pending;
+    record.amount = amount;
+    this->load(record);
+
+    FTV_LOG_INFO("import %s configuartion done\n", filePath.c_str());
     return true;
 }
 
 bool Counter::Issuer::reset()
 {
-    std::lock_guard<std::mutex> guard(this->mutex);
-    this->tapInRegular = 0U;
-    this->tapInEconomy = 0U;
-    this->tapInFreeService = 0U;
-    this->tapOut = 0U;
-    this->sent = 0U;
-    this->pending = 0U;
-    this->amount = 0ULL;
+    CounterFile::IssuerRecord record{};
+    this->load(record);
+    return true;
 }
 
-Counter::Cycle::Cycle() : day(0x00U),
-                          month(0x00U),
-                          year(0x0000U)
+Counter::Cycle::Cycle(const std::time_t time) : start(Cycle::midnight(time)),
+                                                next(0)
 {
-    std::tm tmp{};
-    TimeUtils::fromEpoch(&tmp, std::time(nullptr));
-    this->year = static_cast<unsigned short>(tmp.tm_year + 1900);
-    this->month = static_cast<unsigned char>(tmp.tm_mon + 1);
-    this->day = static_cast<unsigned char>(tmp.tm_mday);
+    /* 36 hours after midnight always falls on the next day, DST shifts included */
+    this->next = Cycle::midnight(this->start + 36 * 3600);
 }
 
 Counter::Cycle::~Cycle() {}
 
-std::time_t Counter::Cycle::getCycleTime() const
+std::time_t Counter::Cycle::midnight(const std::time_t time)
 {
     std::tm tmp{};
-    memset(&tmp, 0x00, sizeof(tmp));
-    tmp.tm_year = static_cast<int>(this->year - 1900);
-    tmp.tm_mon = static_cast<int>(this->month - 1);
-    tmp.tm_mday = static_cast<int>(this->day);
+    TimeUtils::fromEpoch(&tmp, time);
+    tmp.tm_hour = 0;
+    tmp.tm_min = 0;
+    tmp.tm_sec = 0;
     return TimeUtils::toEpoch(&tmp);
 }
 
+std::time_t Counter::Cycle::getCycleTime() const
+{
+    return this->start;
+}
+
+std::time_t Counter::Cycle::getNextCycleTime() const
+{
+    return this->next;
+}
+
 bool Counter::Cycle::isSameCycle(const std::time_t time) const
 {
-    std::tm tmp{};
-    TimeUtils::fromEpoch(&tmp, std::time(nullptr));
-    return (this->year == static_cast<unsigned short>(tmp.tm_year + 1900) ||
-            this->month == static_cast<unsigned char>(tmp.tm_mon + 1) ||
-            this->day == static_cast<unsigned char>(tmp.tm_mday));
+    return (time >= this->start && time < this->next);
 }
 
 template <typename T>
@@ -256,69 +261,109 @@ void Counter::readUnsignedSafe(const nlohmann::json &j, const char *key, T &targ
 template void Counter::readUnsignedSafe(const nlohmann::json &j, const char *key, unsigned int &target);
 template void Counter::readUnsignedSafe(const nlohmann::json &j, const char *key, unsigned long long int &target);
 
-Counter::Counter(const std::string &snPath, const std::string &counterPath) : sn(0),
-                                                                              cycle(),
-                                                                              emoney(counterPath + "/emoney.json"),
-                                                                              brizzi(counterPath + "/brizzi.json"),
-                                                                              tapcash(counterPath + "/tapcash.json"),
-                                                                              flazz(counterPath + "/flazz.json"),
-                                                                              jakcard(counterPath + "/jakcard.json"),
-                                                                              filePath(snPath + "/sn.json"),
-                                                                              mutex()
+Counter::Counter(const std::string &snPath, std::shared_ptr<CounterFile> snFile, const std::string &counterPath, const std::time_t time) : sn(0U),
+                                                                                                                                           storedSN(0U),
+                                                                                                                                           generation(0U),
+                                                                                                                                           cycle(time),
+                                                                                                                                           emoney(&generation),
+                                                                                                                                           brizzi(&generation),
+                                                                                                                                           tapcash(&generation),
+                                                                                                                                           flazz(&generation),
+                                                                                                                                           jakcard(&generation),
+                                                                                                                                           counterPath(counterPath),
+                                                                                                                                           counterFile(counterPath + "/counter.bin"),
+                                                                                                                                           snFile(snFile),
+                                                                                                                                           snPath(snPath),
+                                                                                                                                           mutex()
 {
+    this->load();
     this->loadSN();
 }
 
 Counter::~Counter()
 {
-    this->storeSN();
+    this->store();
+    /* sn.bin is shared by every day, a counter left behind by a rollover must not write back a stale sn */
+    if (this->getSN() != this->storedSN.load(std::memory_order_relaxed))
+        this->storeSN();
+}
+
+void Counter::beginWrite(std::atomic<unsigned int> *generation)
+{
+    /* seqlock: the generation is odd while a write is in progress, writers take turns on it */
+    if (generation == nullptr)
+        return;
+    unsigned int current = generation->load(std::memory_order_relaxed);
+    for (;;)
+    {
+        if ((current & 1U) == 0U &&
+            generation->compare_exchange_weak(current, current + 1U, std::memory_order_acquire, std::memory_order_relaxed))
+            break;
+        if (current & 1U)
+        {
+            std::this_thread::yield();
+            current = generation->load(std::memory_order_relaxed);
+        }
+    }
+    /* the odd generation is visible before any field changes */
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void Counter::endWrite(std::atomic<unsigned int> *generation)
+{
+    if (generation)
+        generation->fetch_add(1U, std::memory_order_release);
 }
 
 void Counter::incSN()
 {
-    std::lock_guard<std::mutex> guard(this->mutex);
-    this->sn++;
+    Counter::beginWrite(&this->generation);
+    this->sn.fetch_add(1U, std::memory_order_relaxed);
+    Counter::endWrite(&this->generation);
+}
+
+void Counter::continueSN(const Counter &previous)
+{
+    /* the previous day may still have a commit in flight, its memory is ahead of sn.bin */
+    unsigned int value = previous.getSN();
+    Counter::beginWrite(&this->generation);
+    this->sn.store(value, std::memory_order_relaxed);
+    this->storedSN.store(previous.storedSN.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    Counter::endWrite(&this->generation);
 }
 
 const Counter::Cycle &Counter::getCycle() const
 {
-    std::lock_guard<std::mutex> guard(this->mutex);
     return this->cycle;
 }
 
 Counter::Issuer &Counter::getEmoney()
 {
-    std::lock_guard<std::mutex> guard(this->mutex);
     return this->emoney;
 }
 
 Counter::Issuer &Counter::getBrizzi()
 {
-    std::lock_guard<std::mutex> guard(this->mutex);
     return this->brizzi;
 }
 
 Counter::Issuer &Counter::getTapcash()
 {
-    std::lock_guard<std::mutex> guard(this->mutex);
     return this->tapcash;
 }
 
 Counter::Issuer &Counter::getFlazz()
 {
-    std::lock_guard<std::mutex> guard(this->mutex);
     return this->flazz;
 }
 
 Counter::Issuer &Counter::getJakcard()
 {
-    std::lock_guard<std::mutex> guard(this->mutex);
     return this->jakcard;
 }
 
 Counter::Issuer &Counter::getIssuerByEpaymentCardType(const unsigned int ctype)
 {
-    std::lock_guard<std::mutex> guard(this->mutex);
     switch (static_cast<Card::cardType_t>(ctype))
     {
     case Card::CARD_TYPE_BRI:
@@ -339,140 +384,230 @@ Counter::Issuer &Counter::getIssuerByEpaymentCardType(const unsigned int ctype)
 
 unsigned int Counter::getSN() const
 {
-    return this->sn;
+    return this->sn.load(std::memory_order_relaxed);
 }
 
 unsigned int Counter::getTotalTapInRegular() const
 {
-    std::lock_guard<std::mutex> guard(this->mutex);
-    unsigned int result = this->emoney.getTapInRegular() +
-                          this->brizzi.getTapInRegular() +
-                          this->tapcash.getTapInRegular() +
-                          this->flazz.getTapInRegular() +
-                          this->jakcard.getTapInRegular();
-    return result;
+    return this->snapshot().total.tapInRegular;
 }
 
 unsigned int Counter::getTotalTapInEconomy() const
 {
-    std::lock_guard<std::mutex> guard(this->mutex);
-    unsigned int result = this->emoney.getTapInEconomy() +
-                          this->brizzi.getTapInEconomy() +
-                          this->tapcash.getTapInEconomy() +
-                          this->flazz.getTapInEconomy() +
-                          this->jakcard.getTapInEconomy();
-    return result;
+    return this->snapshot().total.tapInEconomy;
 }
 
 unsigned int Counter::getTotalTapInFreeService() const
 {
-    std::lock_guard<std::mutex> guard(this->mutex);
-    unsigned int result = this->emoney.getTapinFreeService() +
-                          this->brizzi.getTapinFreeService() +
-                          this->tapcash.getTapinFreeService() +
-                          this->flazz.getTapinFreeService() +
-                          this->jakcard.getTapinFreeService();
-    return result;
+    return this->snapshot().total.tapInFreeService;
 }
 
 unsigned int Counter::getTotalTapOut() const
 {
-    std::lock_guard<std::mutex> guard(this->mutex);
-    unsigned int result = this->emoney.getTapOut() +
-                          this->brizzi.getTapOut() +
-                          this->tapcash.getTapOut() +
-                          this->flazz.getTapOut() +
-                          this->jakcard.getTapOut();
-    return result;
+    return this->snapshot().total.tapOut;
 }
 
 unsigned int Counter::getTotalPending() const
 {
-    std::lock_guard<std::mutex> guard(this->mutex);
-    unsigned int result = this->emoney.getPending() +
-                          this->brizzi.getPending() +
-                          this->tapcash.getPending() +
-                          this->flazz.getPending() +
-                          this->jakcard.getPending();
-    return result;
+    return this->snapshot().total.pending;
 }
 
 unsigned int Counter::getTotalSent() const
 {
-    std::lock_guard<std::mutex> guard(this->mutex);
-    unsigned int result = this->emoney.getSent() +
-                          this->brizzi.getSent() +
-                          this->tapcash.getSent() +
-                          this->flazz.getSent() +
-                          this->jakcard.getSent();
-    return result;
+    return this->snapshot().total.sent;
 }
 
 unsigned long long int Counter::getTotalAmount() const
 {
-    std::lock_guard<std::mutex> guard(this->mutex);
-    unsigned long long int result = this->emoney.getAmount() +
-                                    this->brizzi.getAmount() +
-                                    this->tapcash.getAmount() +
-                                    this->flazz.getAmount() +
-                                    this->jakcard.getAmount();
+    return this->snapshot().total.amount;
+}
+
+void Counter::read(const Issuer &issuer, Snapshot::Issuer &target)
+{
+    target.tapInRegular = issuer.getTapInRegular();
+    target.tapInEconomy = issuer.getTapInEconomy();
+    target.tapInFreeService = issuer.getTapinFreeService();
+    target.tapOut = issuer.getTapOut();
+    target.sent = issuer.getSent();
+    target.pending = issuer.getPending();
+    target.amount = issuer.getAmount();
+}
+
+void Counter::accumulate(const Snapshot::Issuer &issuer, Snapshot::Issuer &target)
+{
+    target.tapInRegular += issuer.tapInRegular;
+    target.tapInEconomy += issuer.tapInEconomy;
+    target.tapInFreeService += issuer.tapInFreeService;
+    target.tapOut += issuer.tapOut;
+    target.sent += issuer.sent;
+    target.pending += issuer.pending;
+    target.amount += issuer.amount;
+}
+
+Counter::Snapshot Counter::snapshot() const
+{
+    Snapshot result{};
+
+    /* seqlock read: start over until no write was in progress or landed meanwhile */
+    for (;;)
+    {
+        unsigned int before = this->generation.load(std::memory_order_acquire);
+        if (before & 1U)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        result.sn = this->sn.load(std::memory_order_relaxed);
+        Counter::read(this->emoney, result.emoney);
+        Counter::read(this->brizzi, result.brizzi);
+        Counter::read(this->tapcash, result.tapcash);
+        Counter::read(this->flazz, result.flazz);
+        Counter::read(this->jakcard, result.jakcard);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (this->generation.load(std::memory_order_relaxed) == before)
+            break;
+    }
+
+    result.total = Snapshot::Issuer{};
+    Counter::accumulate(result.emoney, result.total);
+    Counter::accumulate(result.brizzi, result.total);
+    Counter::accumulate(result.tapcash, result.total);
+    Counter::accumulate(result.flazz, result.total);
+    Counter::accumulate(result.jakcard, result.total);
     return result;
 }
 
-void Counter::loadSN()
+void Counter::load()
 {
     std::lock_guard<std::mutex> guard(this->mutex);
-    Debug::info(__FILE__, __LINE__, __func__, "load %s configuartion\n", this->filePath.c_str());
-    std::ifstream file(filePath);
-    if (!file.is_open())
-        /* file doesn't exist */
-        return;
+    Issuer *issuers[CounterFile::ISSUER_COUNT] = {&this->emoney, &this->brizzi, &this->tapcash, &this->flazz, &this->jakcard};
+    const char *names[CounterFile::ISSUER_COUNT] = {"emoney", "brizzi", "tapcash", "flazz", "jakcard"};
+    CounterFile::Record record;
+    bool isCreated = false;
 
-    nlohmann::json j;
-    try
+    if (this->counterFile.open(isCreated) == false)
     {
-        file >> j;
+        FTV_LOG_ERROR("counter of %s is kept in memory only\n", this->counterPath.c_str());
+        return;
     }
-    catch (...)
+
+    if (this->counterFile.load(record))
     {
-        throw std::runtime_error(Error::common(__FILE__, __LINE__, __func__, "parse \"" + filePath + "\" failed"));
+        for (std::size_t i = 0; i < CounterFile::ISSUER_COUNT; i++)
+            issuers[i]->load(record.issuer[i]);
+        return;
     }
 
-    if (!j.is_object())
-        throw std::runtime_error(Error::common(__FILE__, __LINE__, __func__, "configuuration in \"" + filePath + "\" is not JSON object"));
-
-    Counter::readUnsignedSafe(j, "sn", this->sn);
+    if (isCreated == false)
+        FTV_LOG_ERROR("counter of %s is corrupted, recover from JSON or restart from zero\n", this->counterPath.c_str());
 
-    Debug::info(__FILE__, __LINE__, __func__, "load %s configuartion done\n", this->filePath.c_str());
+    /* one-shot import of the JSON counters written by previous releases */
+    for (std::size_t i = 0; i < CounterFile::ISSUER_COUNT; i++)
+    {
+        issuers[i]->importJSON(this->counterPath + "/" + names[i] + ".json");
+        issuers[i]->save(record.issuer[i]);
+    }
+    this->counterFile.store(record);
 }
 
-bool Counter::storeSN()
+bool Counter::store()
 {
     std::lock_guard<std::mutex> guard(this->mutex);
+    const Snapshot view = this->snapshot();
+    const Snapshot::Issuer *issuers[CounterFile::ISSUER_COUNT] = {&view.emoney, &view.brizzi, &view.tapcash, &view.flazz, &view.jakcard};
+    CounterFile::Record record{};
+    for (std::size_t i = 0; i < CounterFile::ISSUER_COUNT; i++)
+    {
+        record.issuer[i].tapInRegular = issuers[i]->tapInRegular;
+        record.issuer[i].tapInEconomy = issuers[i]->tapInEconomy;
+        record.issuer[i].tapInFreeService = issuers[i]->tapInFreeService;
+        record.issuer[i].tapOut = issuers[i]->tapOut;
+        record.issuer[i].sent = issuers[i]->sent;
+        record.issuer[i].pending = issuers[i]->pending;
+        record.issuer[i].amount = issuers[i]->amount;
+    }
+    return this->counterFile.store(record);
+}
 
-    nlohmann::json j;
-
-    j["sn"] = this->sn;
+void Counter::loadSN()
+{
+    std::lock_guard<std::mutex> guard(this->mutex);
+    CounterFile::Record record{};
+    bool isCreated = false;
 
-    std::ofstream file(filePath, std::ios::trunc);
-    if (!file.is_open())
-        return false;
+    if (this->snFile->open(isCreated) == false)
+    {
+        FTV_LOG_ERROR("sn is kept in memory only\n");
+        return;
+    }
 
-    try
+    if (this->snFile->load(record))
     {
-        file << j.dump(4);
+        this->sn.store(record.sn, std::memory_order_relaxed);
+        this->storedSN.store(record.sn, std::memory_order_relaxed);
+        return;
     }
-    catch (...)
+
+    if (isCreated == false)
+        FTV_LOG_ERROR("sn of %s is corrupted, recover from JSON or restart from zero\n", this->snPath.c_str());
+
+    /* one-shot import of the JSON serial number written by previous releases */
+    std::string filePath = this->snPath + "/sn.json";
+    std::ifstream file(filePath);
+    if (file.is_open())
     {
-        return false;
+        FTV_LOG_INFO("import %s configuartion\n", filePath.c_str());
+        try
+        {
+            nlohmann::json j;
+            file >> j;
+            if (!j.is_object())
+                throw std::runtime_error(Error::common(__FILE__, __LINE__, __func__, "configuuration in \"" + filePath + "\" is not JSON object"));
+            unsigned int value = 0U;
+            Counter::readUnsignedSafe(j, "sn", value);
+            this->sn.store(value, std::memory_order_relaxed);
+        }
+        catch (const std::exception &e)
+        {
+            FTV_LOG_ERROR("import \"%s\" failed: %s\n", filePath.c_str(), e.what());
+        }
     }
 
+    record.sn = this->getSN();
+    if (this->snFile->store(record))
+        this->storedSN.store(record.sn, std::memory_order_relaxed);
+}
+
+bool Counter::storeSN()
+{
+    std::lock_guard<std::mutex> guard(this->mutex);
+    unsigned int value = this->getSN();
+    /* sn.bin only moves forward, a counter left behind by a rollover may hold an older sn */
+    bool isStored = this->snFile->update(
+        [value](CounterFile::Record &record)
+        {
+            if (record.sn >= value)
+                return false;
+            record = CounterFile::Record{};
+            record.sn = value;
+            return true;
+        });
+    if (isStored == false)
+        return false;
+    this->storedSN.store(value, std::memory_order_relaxed);
     return true;
 }
 
 bool Counter::resetSN()
 {
-    this->sn = 0U;
+    std::lock_guard<std::mutex> guard(this->mutex);
+    this->sn.store(0U, std::memory_order_relaxed);
+    return true;
+}
+
+std::shared_ptr<CounterFile> Counter::createSNFile(const std::string &snPath)
+{
+    return std::shared_ptr<CounterFile>(new CounterFile(snPath + "/sn.bin"));
 }
 
 std::string Counter::determineConfigPath(const std::string &basePath, const std::time_t time)
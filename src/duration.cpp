@@ -1,10 +1,11 @@
 #include "duration.hpp"
-#include "utils/include/debug.hpp"
+#include "async-log.hpp"
 
-std::chrono::steady_clock::time_point timePoint;
-std::string caption;
+std::atomic<bool> Duration::isReportEnabled(true);
 
-Duration::PointRefs::PointRefs(const std::string &caption) : timePoint(std::chrono::steady_clock::now()), caption(caption) {}
+Duration::PointRefs::PointRefs() : timePoint(), stage(Stage::CUSTOM), customIndex(0) {}
+
+Duration::PointRefs::PointRefs(Stage stage, unsigned char customIndex) : timePoint(std::chrono::steady_clock::now()), stage(stage), customIndex(customIndex) {}
 
 Duration::PointRefs::~PointRefs() {}
 
@@ -13,9 +14,14 @@ const std::chrono::steady_clock::time_point &Duration::PointRefs::getTime() cons
     return this->timePoint;
 }
 
-const std::string &Duration::PointRefs::getCaption() const
+Duration::Stage Duration::PointRefs::getStage() const
 {
-    return this->caption;
+    return this->stage;
+}
+
+unsigned char Duration::PointRefs::getCustomIndex() const
+{
+    return this->customIndex;
 }
 
 double Duration::PointRefs::diff(const std::chrono::steady_clock::time_point &ref) const
@@ -24,45 +30,106 @@ double Duration::PointRefs::diff(const std::chrono::steady_clock::time_point &re
     return diff.count();
 }
 
+const char *Duration::toString(Stage stage)
+{
+    static const char *captions[] = {
+        "get card number",
+        "read user data",
+        "read user data failed",
+        "deduct pinalty success",
+        "deduct pinalty failed",
+        "deduct on tap in success",
+        "deduct on tap in failed",
+        "deduct on tap out success",
+        "deduct on tap out failed",
+        "get balance operation",
+        "get balance operation on tap in without deduct",
+        "get balance operation on tap out without deduct",
+        "get balance failed",
+        "write user data success",
+        "write user data failed",
+        "total",
+        "custom"};
+    std::size_t index = static_cast<std::size_t>(stage);
+    return (index < sizeof(captions) / sizeof(captions[0])) ? captions[index] : "unknown";
+}
+
+void Duration::setReportEnabled(bool enable)
+{
+    Duration::isReportEnabled.store(enable, std::memory_order_relaxed);
+}
+
+const char *Duration::getCaption(const PointRefs &pref) const
+{
+    if (pref.getStage() == Stage::CUSTOM && pref.getCustomIndex() < this->customCaptions.size())
+        return this->customCaptions[pref.getCustomIndex()].c_str();
+    return Duration::toString(pref.getStage());
+}
+
 void Duration::printDiffTime(const PointRefs &pref, const std::chrono::steady_clock::time_point &sref) const
 {
-    Debug::info(__FILE__, __LINE__, "elapsed time", "%s: %.03fs\n", pref.getCaption().c_str(), pref.diff(sref));
+    FTV_LOG_INFO("elapsed time, %s: %.03fs\n", this->getCaption(pref), pref.diff(sref));
 }
 
-Duration::Duration(const std::string &caption) : startRef(std::chrono::steady_clock::now()), pointRefs(), caption(caption)
+Duration::Duration(const std::string &caption) : startRef(std::chrono::steady_clock::now()),
+                                                 pointRefs(),
+                                                 pointCount(0),
+                                                 droppedCount(0),
+                                                 customCaptions(),
+                                                 caption(caption)
 {
-    this->pointRefs.reserve(8);
 }
 
 Duration::~Duration()
 {
-    if (this->pointRefs.empty())
+    /* formatting only happens when somebody reads the text report */
+    if (this->pointCount == 0 || Duration::isReportEnabled.load(std::memory_order_relaxed) == false)
         return;
 
     std::chrono::steady_clock::time_point endRef = std::chrono::steady_clock::now();
     std::chrono::duration<double> diff = endRef - this->startRef;
-    std::size_t sz = this->pointRefs.size();
-
     this->printDiffTime(this->pointRefs[0], this->startRef);
 
-    for (std::size_t i = 1; i < sz; i++)
+    for (std::size_t i = 1; i < this->pointCount; i++)
     {
         this->printDiffTime(this->pointRefs[i], this->pointRefs[i - 1].getTime());
     }
 
+    if (this->droppedCount > 0)
+    {
+        FTV_LOG_WARNING("elapsed time, %zu check point(s) dropped\n", this->droppedCount);
+    }
+
     if (this->caption.empty())
     {
-        Debug::info(__FILE__, __LINE__, "elapsed time", "total: %.03fs\n", diff.count());
+        FTV_LOG_INFO("elapsed time, total: %.03fs\n", diff.count());
     }
     else
     {
-        Debug::info(__FILE__, __LINE__, "elapsed time", "total %s: %.03fs\n", this->caption.c_str(), diff.count());
+        FTV_LOG_INFO("elapsed time, total %s: %.03fs\n", this->caption.c_str(), diff.count());
     }
 }
 
+void Duration::checkPoint(Stage stage)
+{
+    if (this->pointCount >= MAX_CHECK_POINTS)
+    {
+        this->droppedCount++;
+        return;
+    }
+    this->pointRefs[this->pointCount++] = PointRefs(stage);
+}
+
 void Duration::checkPoint(const std::string &caption)
 {
-    this->pointRefs.emplace_back(caption);
+    if (this->pointCount >= MAX_CHECK_POINTS)
+    {
+        this->droppedCount++;
+        return;
+    }
+    /* dynamic captions are the only path that allocates */
+    this->customCaptions.push_back(caption);
+    this->pointRefs[this->pointCount++] = PointRefs(Stage::CUSTOM, static_cast<unsigned char>(this->customCaptions.size() - 1));
 }
 
 double Duration::getTotalDurationInSeconds() const
@@ -77,4 +144,17 @@ int Duration::getTotalDurationInMs() const
     std::chrono::steady_clock::time_point endRef = std::chrono::steady_clock::now();
     int ms = std::chrono::duration_cast<std::chrono::milliseconds>(endRef - this->startRef).count();
     return ms;
-}
\ No newline at end of file
+}
+
+void Duration::visit(const std::function<void(Stage stage, const char *caption, double seconds)> &visitor) const
+{
+    if (this->pointCount == 0)
+        return;
+
+    visitor(this->pointRefs[0].getStage(), this->getCaption(this->pointRefs[0]), this->pointRefs[0].diff(this->startRef));
+    for (std::size_t i = 1; i < this->pointCount; i++)
+    {
+        visitor(this->pointRefs[i].getStage(), this->getCaption(this->pointRefs[i]), this->pointRefs[i].diff(this->pointRefs[i - 1].getTime()));
+    }
+    visitor(Stage::TOTAL, Duration::toString(Stage::TOTAL), this->getTotalDurationInSeconds());
+}
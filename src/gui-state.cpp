@@ -0,0 +1,439 @@
+#include <cstdio>
+#include "gui-state.hpp"
+#include "gui/include/gui.hpp"
+
+const std::chrono::milliseconds GuiState::FRAME_INTERVAL(16);
+
+template <typename T>
+GuiState::Slot<T>::Slot() : value(),
+                            isShow(false),
+                            hasSet(false),
+                            hasHide(false),
+                            isHideFirst(false)
+{
+}
+
+template <typename T>
+void GuiState::Slot<T>::set(const T &value, bool show)
+{
+    if (this->hasHide && this->isHideFirst == false)
+    {
+        /* first update after a hide, the hide undid any earlier show request */
+        this->isHideFirst = true;
+        this->isShow = false;
+    }
+    /* a show request survives later plain updates of the same frame */
+    this->isShow = this->isShow || show;
+    this->value = value;
+    this->hasSet = true;
+}
+
+template <typename T>
+void GuiState::Slot<T>::hide()
+{
+    this->hasHide = true;
+    this->isHideFirst = false;
+    this->isShow = false;
+}
+
+template <typename T>
+bool GuiState::Slot<T>::isDirty() const
+{
+    return this->hasSet || this->hasHide;
+}
+
+template <typename T>
+void GuiState::Slot<T>::clear()
+{
+    this->isShow = false;
+    this->hasSet = false;
+    this->hasHide = false;
+    this->isHideFirst = false;
+}
+
+GuiState::Rupiah::Rupiah(unsigned int amount, const std::string &caption) : amount(amount),
+                                                                            caption(caption)
+{
+}
+
+bool GuiState::Rupiah::operator==(const Rupiah &other) const
+{
+    return this->amount == other.amount && this->caption == other.caption;
+}
+
+GuiState::Pan::Pan(unsigned long long pan, const std::string &caption) : pan(pan),
+                                                                         caption(caption)
+{
+}
+
+bool GuiState::Pan::operator==(const Pan &other) const
+{
+    return this->pan == other.pan && this->caption == other.caption;
+}
+
+GuiState::Pending::Pending() : tariff(),
+                               status(),
+                               cardNumber(),
+                               balance(),
+                               message(),
+                               fletCode(),
+                               terminalId(),
+                               version(),
+                               counters(),
+                               counterDirty(0U)
+{
+}
+
+bool GuiState::Pending::isDirty() const
+{
+    return this->tariff.isDirty() ||
+           this->status.isDirty() ||
+           this->cardNumber.isDirty() ||
+           this->balance.isDirty() ||
+           this->message.isDirty() ||
+           this->fletCode.isDirty() ||
+           this->terminalId.isDirty() ||
+           this->version.isDirty() ||
+           this->counterDirty != 0U;
+}
+
+void GuiState::Pending::clear()
+{
+    this->tariff.clear();
+    this->status.clear();
+    this->cardNumber.clear();
+    this->balance.clear();
+    this->message.clear();
+    this->fletCode.clear();
+    this->terminalId.clear();
+    this->version.clear();
+    this->counterDirty = 0U;
+}
+
+GuiState::Applied::Applied() : message(),
+                               isMessageShown(false),
+                               counters(),
+                               counterKnown(0U)
+{
+}
+
+GuiState::GuiState(Gui &gui) : gui(gui),
+                               pending(),
+                               applied(),
+                               isRun(false),
+                               th(),
+                               mtx(),
+                               changed()
+{
+}
+
+GuiState::~GuiState()
+{
+    this->stop();
+}
+
+void GuiState::notify()
+{
+    this->changed.notify_one();
+}
+
+void GuiState::setTariff(unsigned int amount, const std::string &caption, bool show)
+{
+    {
+        std::lock_guard<std::mutex> guard(this->mtx);
+        this->pending.tariff.set(Rupiah(amount, caption), show);
+    }
+    this->notify();
+}
+
+void GuiState::hideTariff()
+{
+    {
+        std::lock_guard<std::mutex> guard(this->mtx);
+        this->pending.tariff.hide();
+    }
+    this->notify();
+}
+
+void GuiState::setStatus(const std::string &text, bool show)
+{
+    {
+        std::lock_guard<std::mutex> guard(this->mtx);
+        this->pending.status.set(text, show);
+    }
+    this->notify();
+}
+
+void GuiState::hideStatus()
+{
+    {
+        std::lock_guard<std::mutex> guard(this->mtx);
+        this->pending.status.hide();
+    }
+    this->notify();
+}
+
+void GuiState::setCardNumber(unsigned long long pan, const std::string &caption, bool show)
+{
+    {
+        std::lock_guard<std::mutex> guard(this->mtx);
+        this->pending.cardNumber.set(Pan(pan, caption), show);
+    }
+    this->notify();
+}
+
+void GuiState::hideCardNumber()
+{
+    {
+        std::lock_guard<std::mutex> guard(this->mtx);
+        this->pending.cardNumber.hide();
+    }
+    this->notify();
+}
+
+void GuiState::hideBalance()
+{
+    {
+        std::lock_guard<std::mutex> guard(this->mtx);
+        this->pending.balance.hide();
+    }
+    this->notify();
+}
+
+void GuiState::showMessage(const ScreenTemplate::Frame &frame)
+{
+    {
+        std::lock_guard<std::mutex> guard(this->mtx);
+        this->pending.message.set(frame, true);
+    }
+    this->notify();
+}
+
+void GuiState::showMessage(const std::array<std::string, ScreenTemplate::LINE_COUNT> &lines)
+{
+    /* free text (boot screens), cut to the frame like a rendered template */
+    ScreenTemplate::Frame frame;
+    for (std::size_t i = 0; i < ScreenTemplate::LINE_COUNT; i++)
+        std::snprintf(frame.lines[i], ScreenTemplate::LINE_SIZE, "%s", lines[i].c_str());
+    this->showMessage(frame);
+}
+
+void GuiState::hideMessage()
+{
+    {
+        std::lock_guard<std::mutex> guard(this->mtx);
+        this->pending.message.hide();
+    }
+    this->notify();
+}
+
+void GuiState::setFletCode(const std::string &text)
+{
+    {
+        std::lock_guard<std::mutex> guard(this->mtx);
+        this->pending.fletCode.set(text, false);
+    }
+    this->notify();
+}
+
+void GuiState::setTerminalId(const std::string &text)
+{
+    {
+        std::lock_guard<std::mutex> guard(this->mtx);
+        this->pending.terminalId.set(text, false);
+    }
+    this->notify();
+}
+
+void GuiState::setVersion(const std::string &text)
+{
+    {
+        std::lock_guard<std::mutex> guard(this->mtx);
+        this->pending.version.set(text, false);
+    }
+    this->notify();
+}
+
+void GuiState::setCounter(Counter counter, unsigned int value)
+{
+    this->pending.counters[counter] = value;
+    this->pending.counterDirty |= (1U << counter);
+}
+
+void GuiState::setCounters(unsigned int tapInRegular,
+                           unsigned int tapInEconomy,
+                           unsigned int tapInFree,
+                           unsigned int tapOut,
+                           unsigned int pending,
+                           unsigned int sent)
+{
+    {
+        std::lock_guard<std::mutex> guard(this->mtx);
+        this->setCounter(COUNTER_TAP_IN_REGULAR, tapInRegular);
+        this->setCounter(COUNTER_TAP_IN_ECONOMY, tapInEconomy);
+        this->setCounter(COUNTER_TAP_IN_FREE, tapInFree);
+        this->setCounter(COUNTER_TAP_OUT, tapOut);
+        this->setCounter(COUNTER_PENDING, pending);
+        this->setCounter(COUNTER_SENT, sent);
+    }
+    this->notify();
+}
+
+void GuiState::apply(const Pending &frame)
+{
+    if (frame.tariff.isDirty())
+    {
+        if (frame.tariff.hasHide && frame.tariff.isHideFirst)
+            this->gui.labelTariff.hide();
+        if (frame.tariff.hasSet)
+            this->gui.labelTariff.setRupiah(frame.tariff.value.amount, frame.tariff.value.caption, frame.tariff.isShow);
+        if (frame.tariff.hasHide && frame.tariff.isHideFirst == false)
+            this->gui.labelTariff.hide();
+    }
+
+    if (frame.status.isDirty())
+    {
+        if (frame.status.hasHide && frame.status.isHideFirst)
+            this->gui.labelStatus.hide();
+        if (frame.status.hasSet)
+            this->gui.labelStatus.setText(frame.status.value, frame.status.isShow);
+        if (frame.status.hasHide && frame.status.isHideFirst == false)
+            this->gui.labelStatus.hide();
+    }
+
+    if (frame.cardNumber.isDirty())
+    {
+        if (frame.cardNumber.hasHide && frame.cardNumber.isHideFirst)
+            this->gui.labelCardNumber.hide();
+        if (frame.cardNumber.hasSet)
+            this->gui.labelCardNumber.setPAN(frame.cardNumber.value.pan, frame.cardNumber.value.caption, frame.cardNumber.isShow);
+        if (frame.cardNumber.hasHide && frame.cardNumber.isHideFirst == false)
+            this->gui.labelCardNumber.hide();
+    }
+
+    if (frame.balance.hasHide)
+        this->gui.labelBalance.hide();
+
+    if (frame.fletCode.hasSet)
+        this->gui.labelFletCode.setText(frame.fletCode.value);
+    if (frame.terminalId.hasSet)
+        this->gui.labelTerminalId.setText(frame.terminalId.value);
+    if (frame.version.hasSet)
+        this->gui.labelVersion.setText(frame.version.value);
+
+    if (frame.message.isDirty())
+    {
+        bool isHidden = frame.message.hasHide && (frame.message.hasSet == false || frame.message.isHideFirst == false);
+        if (isHidden)
+        {
+            if (this->applied.isMessageShown)
+                this->gui.message.hide();
+            this->applied.isMessageShown = false;
+        }
+        else if (this->applied.isMessageShown == false || this->applied.message != frame.message.value)
+        {
+            /* the same screen is already up (e.g. repeated failures), skip the repaint;
+             * otherwise the block goes out whole, Message cannot update one line */
+            const ScreenTemplate::Frame &m = frame.message.value;
+            this->gui.message.show({m.lines[0], m.lines[1], m.lines[2], m.lines[3], m.lines[4]});
+            this->applied.message = m;
+            this->applied.isMessageShown = true;
+        }
+    }
+
+    for (std::size_t i = 0; i < COUNTER_COUNT; i++)
+    {
+        unsigned int bit = (1U << i);
+        if ((frame.counterDirty & bit) == 0U)
+            continue;
+        if ((this->applied.counterKnown & bit) != 0U && this->applied.counters[i] == frame.counters[i])
+            continue;
+        this->applied.counters[i] = frame.counters[i];
+        this->applied.counterKnown |= bit;
+        switch (static_cast<Counter>(i))
+        {
+        case COUNTER_TAP_IN_REGULAR:
+            this->gui.transactionCounter.setTapInRegularCounter(frame.counters[i]);
+            break;
+        case COUNTER_TAP_IN_ECONOMY:
+            this->gui.transactionCounter.setTapInEconomicalCounter(frame.counters[i]);
+            break;
+        case COUNTER_TAP_IN_FREE:
+            this->gui.transactionCounter.setTapInFreeCounter(frame.counters[i]);
+            break;
+        case COUNTER_TAP_OUT:
+            this->gui.transactionCounter.setTapOutCounter(frame.counters[i]);
+            break;
+        case COUNTER_PENDING:
+            this->gui.transactionPendingSummary.setPendingCounter(frame.counters[i]);
+            break;
+        case COUNTER_SENT:
+            this->gui.transactionPendingSummary.setSentCounter(frame.counters[i]);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void GuiState::flush()
+{
+    Pending frame;
+    {
+        std::lock_guard<std::mutex> guard(this->mtx);
+        frame = this->pending;
+        this->pending.clear();
+    }
+    /* widgets are updated without holding the model lock, writers never wait on rendering */
+    this->apply(frame);
+}
+
+void GuiState::routine()
+{
+    std::chrono::steady_clock::time_point lastFrame = std::chrono::steady_clock::now() - FRAME_INTERVAL;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(this->mtx);
+            this->changed.wait(
+                lock,
+                [this]()
+                {
+                    return this->isRun == false || this->pending.isDirty();
+                });
+            if (this->isRun == false)
+                break;
+        }
+
+        /* the first change after idle goes out at once, a burst is merged into the next frame */
+        std::chrono::steady_clock::time_point due = lastFrame + FRAME_INTERVAL;
+        if (std::chrono::steady_clock::now() < due)
+            std::this_thread::sleep_until(due);
+        lastFrame = std::chrono::steady_clock::now();
+        this->flush();
+    }
+    this->flush();
+}
+
+void GuiState::begin()
+{
+    std::lock_guard<std::mutex> guard(this->mtx);
+    if (this->isRun)
+        return;
+    this->isRun = true;
+    this->th.reset(new std::thread(&GuiState::routine, this));
+}
+
+void GuiState::stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(this->mtx);
+        this->isRun = false;
+    }
+    this->changed.notify_all();
+    if (this->th.get())
+    {
+        this->th->join();
+        this->th.reset();
+    }
+}
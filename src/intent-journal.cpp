@@ -0,0 +1,320 @@
+#include <atomic>
+#include <algorithm>
+#include <vector>
+#include <cerrno>
+#include <cstring>
+#include <cstddef>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "intent-journal.hpp"
+#include "lzma.h"
+
+#include "async-log.hpp"
+
+#define INTENT_JOURNAL_MAGIC 0x4A4E5446U /* "FTNJ" */
+#define INTENT_JOURNAL_SIZE (sizeof(Entry) * IntentJournal::CAPACITY)
+
+uint32_t IntentJournal::checksum(const Entry &entry)
+{
+    return lzma_crc32(reinterpret_cast<const uint8_t *>(&entry), offsetof(Entry, crc), 0);
+}
+
+bool IntentJournal::isValid(const Entry &entry)
+{
+    return (entry.magic == INTENT_JOURNAL_MAGIC &&
+            entry.sequence > 0ULL &&
+            entry.crc == IntentJournal::checksum(entry));
+}
+
+void IntentJournal::copy(char *target, std::size_t size, const std::string &source)
+{
+    std::size_t length = std::min(source.length(), size - 1);
+    memcpy(target, source.data(), length);
+    memset(target + length, 0x00, size - length);
+}
+
+IntentJournal::IntentJournal(const std::string &filePath) : filePath(filePath),
+                                                             fd(-1),
+                                                             entries(nullptr),
+                                                             sequence(0ULL),
+                                                             live(),
+                                                             head(0),
+                                                             isRun(false),
+                                                             isDirty(false),
+                                                             th(),
+                                                             mutex(),
+                                                             dirty()
+{
+}
+
+IntentJournal::~IntentJournal()
+{
+    this->close();
+}
+
+bool IntentJournal::open()
+{
+    std::lock_guard<std::mutex> guard(this->mutex);
+    if (this->entries)
+        return true;
+
+    this->fd = ::open(this->filePath.c_str(), O_RDWR | O_CREAT, 0644);
+    if (this->fd < 0)
+    {
+        FTV_LOG_ERROR("open \"%s\" failed: %s\n", this->filePath.c_str(), strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(this->fd, &st) != 0)
+    {
+        FTV_LOG_ERROR("stat \"%s\" failed: %s\n", this->filePath.c_str(), strerror(errno));
+        ::close(this->fd);
+        this->fd = -1;
+        return false;
+    }
+
+    if (static_cast<std::size_t>(st.st_size) != INTENT_JOURNAL_SIZE)
+    {
+        if (st.st_size != 0)
+            FTV_LOG_WARNING("\"%s\" has unexpected size %li, recreate\n", this->filePath.c_str(), static_cast<long>(st.st_size));
+        if (ftruncate(this->fd, 0) != 0 || ftruncate(this->fd, INTENT_JOURNAL_SIZE) != 0)
+        {
+            FTV_LOG_ERROR("resize \"%s\" failed: %s\n", this->filePath.c_str(), strerror(errno));
+            ::close(this->fd);
+            this->fd = -1;
+            return false;
+        }
+    }
+
+    void *addr = mmap(nullptr, INTENT_JOURNAL_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, 0);
+    if (addr == MAP_FAILED)
+    {
+        FTV_LOG_ERROR("mmap \"%s\" failed: %s\n", this->filePath.c_str(), strerror(errno));
+        ::close(this->fd);
+        this->fd = -1;
+        return false;
+    }
+    this->entries = static_cast<Entry *>(addr);
+
+    /* replay the surviving entries in append order, a closing entry drops its intent */
+    std::vector<std::size_t> slots;
+    for (std::size_t slot = 0; slot < IntentJournal::CAPACITY; slot++)
+    {
+        if (IntentJournal::isValid(this->entries[slot]))
+            slots.push_back(slot);
+    }
+    std::sort(slots.begin(),
+              slots.end(),
+              [this](std::size_t a, std::size_t b)
+              {
+                  return this->entries[a].sequence < this->entries[b].sequence;
+              });
+
+    this->sequence = 0ULL;
+    this->live.fill(0ULL);
+    this->head = 0;
+    for (std::size_t slot : slots)
+    {
+        const Entry &entry = this->entries[slot];
+        std::size_t previous = this->findLive(entry.id);
+        if (previous < IntentJournal::CAPACITY)
+            this->live[previous] = 0ULL;
+        if (static_cast<State>(entry.state) != State::DONE)
+            this->live[slot] = entry.id;
+        this->sequence = entry.sequence;
+        this->head = slot;
+    }
+    std::size_t incomplete = IntentJournal::CAPACITY - static_cast<std::size_t>(std::count(this->live.begin(), this->live.end(), 0ULL));
+    if (incomplete > 0)
+        FTV_LOG_WARNING("\"%s\" has %zu incomplete intent(s)\n", this->filePath.c_str(), incomplete);
+
+    this->isRun = true;
+    this->isDirty = false;
+    this->th.reset(new std::thread(&IntentJournal::flush, this));
+    return true;
+}
+
+void IntentJournal::close()
+{
+    {
+        std::lock_guard<std::mutex> guard(this->mutex);
+        this->isRun = false;
+    }
+    this->dirty.notify_one();
+    if (this->th.get())
+    {
+        this->th->join();
+        this->th.reset();
+    }
+
+    std::lock_guard<std::mutex> guard(this->mutex);
+    if (this->entries)
+    {
+        msync(this->entries, INTENT_JOURNAL_SIZE, MS_SYNC);
+        munmap(this->entries, INTENT_JOURNAL_SIZE);
+        this->entries = nullptr;
+    }
+    if (this->fd >= 0)
+    {
+        ::close(this->fd);
+        this->fd = -1;
+    }
+}
+
+void IntentJournal::flush()
+{
+    std::unique_lock<std::mutex> lock(this->mutex);
+    for (;;)
+    {
+        this->dirty.wait(lock,
+                         [this]()
+                         {
+                             return this->isDirty || this->isRun == false;
+                         });
+        if (this->isDirty == false)
+            break;
+
+        /* appends keep going while the pages are written out */
+        this->isDirty = false;
+        lock.unlock();
+        if (msync(this->entries, INTENT_JOURNAL_SIZE, MS_SYNC) != 0)
+            FTV_LOG_ERROR("sync \"%s\" failed: %s\n", this->filePath.c_str(), strerror(errno));
+        lock.lock();
+    }
+}
+
+bool IntentJournal::syncEntry(const Entry &entry)
+{
+    /* the mapping starts on a page, the entry spans one page or two */
+    static const uintptr_t PAGE_SIZE_MASK = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE)) - 1U;
+    const uintptr_t start = reinterpret_cast<uintptr_t>(&entry) & ~PAGE_SIZE_MASK;
+    const uintptr_t end = reinterpret_cast<uintptr_t>(&entry + 1);
+    if (msync(reinterpret_cast<void *>(start), end - start, MS_SYNC) == 0)
+        return true;
+    FTV_LOG_ERROR("sync entry %llu of \"%s\" failed: %s\n", static_cast<unsigned long long>(entry.id), this->filePath.c_str(), strerror(errno));
+    return false;
+}
+
+std::size_t IntentJournal::findLive(uint64_t id) const
+{
+    if (id == 0ULL)
+        return IntentJournal::CAPACITY;
+    return static_cast<std::size_t>(std::find(this->live.begin(), this->live.end(), id) - this->live.begin());
+}
+
+uint64_t IntentJournal::append(State state, uint64_t id, const Intent *intent)
+{
+    if (this->entries == nullptr)
+        return 0ULL;
+
+    /* the newest entry of an open intent is never overwritten, the ring goes around it */
+    const std::size_t previous = this->findLive(id);
+    std::size_t slot = IntentJournal::CAPACITY;
+    for (std::size_t i = 1; i <= IntentJournal::CAPACITY; i++)
+    {
+        std::size_t candidate = (this->head + i) % IntentJournal::CAPACITY;
+        if (this->live[candidate] == 0ULL)
+        {
+            slot = candidate;
+            break;
+        }
+    }
+    if (slot == IntentJournal::CAPACITY)
+    {
+        /* every slot holds an open intent; a DONE may replace its own, its record is committed */
+        if (state != State::DONE || previous == IntentJournal::CAPACITY)
+        {
+            FTV_LOG_ERROR("\"%s\" is full of open intents, %s not journaled\n", this->filePath.c_str(), (state == State::PENDING) ? "intent" : "state");
+            return 0ULL;
+        }
+        slot = previous;
+    }
+
+    uint64_t next = this->sequence + 1ULL;
+    Entry &entry = this->entries[slot];
+
+    entry.crc = 0U;
+    std::atomic_thread_fence(std::memory_order_release);
+    entry.magic = INTENT_JOURNAL_MAGIC;
+    entry.state = static_cast<uint32_t>(state);
+    entry.sequence = next;
+    entry.id = (id == 0ULL) ? next : id;
+    if (intent)
+        entry.intent = *intent;
+    else
+        memset(&entry.intent, 0x00, sizeof(entry.intent));
+    entry.reserved = 0U;
+    std::atomic_thread_fence(std::memory_order_release);
+    entry.crc = IntentJournal::checksum(entry);
+
+    this->sequence = next;
+    this->head = slot;
+    if (previous < IntentJournal::CAPACITY)
+        this->live[previous] = 0ULL;
+    if (state != State::DONE)
+        this->live[slot] = entry.id;
+
+    this->isDirty = true;
+    this->dirty.notify_one();
+    return entry.id;
+}
+
+uint64_t IntentJournal::begin(const Intent &intent)
+{
+    std::lock_guard<std::mutex> guard(this->mutex);
+    uint64_t id = this->append(State::PENDING, 0ULL, &intent);
+    /* only the pages of this entry, the flusher takes the rest */
+    if (id)
+        this->syncEntry(this->entries[this->head]);
+    return id;
+}
+
+bool IntentJournal::deducted(uint64_t id, const Intent &intent)
+{
+    std::lock_guard<std::mutex> guard(this->mutex);
+    if (this->findLive(id) == IntentJournal::CAPACITY)
+        return false;
+    return (this->append(State::DEDUCTED, id, &intent) != 0ULL);
+}
+
+bool IntentJournal::complete(uint64_t id)
+{
+    std::lock_guard<std::mutex> guard(this->mutex);
+    if (this->findLive(id) == IntentJournal::CAPACITY)
+        return false;
+    return (this->append(State::DONE, id, nullptr) != 0ULL);
+}
+
+std::size_t IntentJournal::recover(Replay replay)
+{
+    std::vector<std::pair<uint64_t, Entry>> pending;
+    {
+        std::lock_guard<std::mutex> guard(this->mutex);
+        if (this->entries == nullptr)
+            return 0;
+        for (std::size_t slot = 0; slot < IntentJournal::CAPACITY; slot++)
+        {
+            if (this->live[slot])
+                pending.emplace_back(this->live[slot], this->entries[slot]);
+        }
+    }
+    /* ids are the sequence of the PENDING entry, the oldest intent goes first */
+    std::sort(pending.begin(),
+              pending.end(),
+              [](const std::pair<uint64_t, Entry> &a, const std::pair<uint64_t, Entry> &b)
+              {
+                  return a.first < b.first;
+              });
+
+    /* the replay writes the database, the journal stays usable meanwhile */
+    std::size_t total = 0;
+    for (const std::pair<uint64_t, Entry> &it : pending)
+    {
+        if (replay(static_cast<State>(it.second.state), it.second.intent) && this->complete(it.first))
+            total++;
+    }
+    return total;
+}
@@ -0,0 +1,269 @@
+#include <fstream>
+#include <cstdio>
+#include "latency-stats.hpp"
+#include "duration.hpp"
+#include "epayment/include/card-access.hpp"
+#include "utils/include/nlohmann/json.hpp"
+#include "async-log.hpp"
+
+LatencyHistogram::LatencyHistogram() : count(0ULL),
+                                       maxUs(0U)
+{
+    for (std::size_t i = 0; i < BUCKET_COUNT; i++)
+        this->buckets[i].store(0U, std::memory_order_relaxed);
+}
+
+LatencyHistogram::~LatencyHistogram() {}
+
+std::size_t LatencyHistogram::bucketOf(uint32_t us)
+{
+    if (us < SUB_BUCKET_COUNT)
+        return us;
+
+    std::size_t msb = 31;
+    while ((us >> msb) == 0U)
+        msb--;
+    std::size_t shift = msb - SUB_BUCKET_BITS;
+    return (msb - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT + ((us >> shift) & (SUB_BUCKET_COUNT - 1));
+}
+
+void LatencyHistogram::bucketRange(std::size_t bucket, double &lowerUs, double &widthUs)
+{
+    if (bucket < SUB_BUCKET_COUNT)
+    {
+        lowerUs = static_cast<double>(bucket);
+        widthUs = 1.0;
+        return;
+    }
+
+    std::size_t octave = bucket / SUB_BUCKET_COUNT;
+    std::size_t sub = bucket % SUB_BUCKET_COUNT;
+    widthUs = static_cast<double>(1ULL << (octave - 1));
+    lowerUs = static_cast<double>(SUB_BUCKET_COUNT + sub) * widthUs;
+}
+
+void LatencyHistogram::record(double seconds)
+{
+    double us = seconds * 1000000.0;
+    uint32_t value = (us <= 0.0) ? 0U : (us >= 4294967295.0 ? 0xFFFFFFFFU : static_cast<uint32_t>(us));
+
+    this->buckets[LatencyHistogram::bucketOf(value)].fetch_add(1U, std::memory_order_relaxed);
+    this->count.fetch_add(1ULL, std::memory_order_relaxed);
+
+    uint32_t current = this->maxUs.load(std::memory_order_relaxed);
+    while (value > current && this->maxUs.compare_exchange_weak(current, value, std::memory_order_relaxed) == false)
+    {
+    }
+}
+
+double LatencyHistogram::percentile(const uint32_t *snapshot, uint64_t total, double ratio, double maxUs) const
+{
+    if (total == 0ULL)
+        return 0.0;
+
+    /* rank of the sample, then linear inside the bucket it falls in */
+    double rank = static_cast<double>(total) * ratio;
+    uint64_t seen = 0ULL;
+    for (std::size_t i = 0; i < BUCKET_COUNT; i++)
+    {
+        if (snapshot[i] == 0U)
+            continue;
+        if (static_cast<double>(seen + snapshot[i]) >= rank)
+        {
+            double lowerUs = 0.0;
+            double widthUs = 0.0;
+            LatencyHistogram::bucketRange(i, lowerUs, widthUs);
+            double fraction = (rank - static_cast<double>(seen)) / static_cast<double>(snapshot[i]);
+            double us = lowerUs + widthUs * fraction;
+            return ((us < maxUs) ? us : maxUs) / 1000.0;
+        }
+        seen += snapshot[i];
+    }
+    return maxUs / 1000.0;
+}
+
+LatencyHistogram::Summary LatencyHistogram::summary() const
+{
+    uint32_t snapshot[BUCKET_COUNT];
+    uint64_t total = 0ULL;
+    for (std::size_t i = 0; i < BUCKET_COUNT; i++)
+    {
+        snapshot[i] = this->buckets[i].load(std::memory_order_relaxed);
+        total += snapshot[i];
+    }
+
+    double maxUs = static_cast<double>(this->maxUs.load(std::memory_order_relaxed));
+
+    Summary result;
+    result.count = total;
+    result.p50Ms = this->percentile(snapshot, total, 0.50, maxUs);
+    result.p95Ms = this->percentile(snapshot, total, 0.95, maxUs);
+    result.p99Ms = this->percentile(snapshot, total, 0.99, maxUs);
+    result.maxMs = maxUs / 1000.0;
+    return result;
+}
+
+void LatencyHistogram::reset()
+{
+    for (std::size_t i = 0; i < BUCKET_COUNT; i++)
+        this->buckets[i].store(0U, std::memory_order_relaxed);
+    this->count.store(0ULL, std::memory_order_relaxed);
+    this->maxUs.store(0U, std::memory_order_relaxed);
+}
+
+LatencyStats::LatencyStats() : stageCount(FIXED_STAGE_COUNT),
+                               mutex()
+{
+    for (std::size_t i = 0; i < FIXED_STAGE_COUNT; i++)
+        this->stages[i] = Duration::toString(static_cast<Duration::Stage>(i));
+}
+
+LatencyStats::~LatencyStats() {}
+
+std::size_t LatencyStats::issuerIndex(unsigned int ctype)
+{
+    /* same order as the issuers in Counter */
+    switch (static_cast<Card::cardType_t>(ctype))
+    {
+    case Card::CARD_TYPE_BRI:
+        return 1;
+    case Card::CARD_TYPE_BNI:
+        return 2;
+    case Card::CARD_TYPE_BCA:
+        return 3;
+    case Card::CARD_TYPE_DKI:
+        return 4;
+    default:
+        break;
+    }
+    return 0;
+}
+
+const char *LatencyStats::issuerName(std::size_t issuer)
+{
+    static const char *names[ISSUER_COUNT] = {"emoney", "brizzi", "tapcash", "flazz", "jakcard", "all"};
+    return (issuer < ISSUER_COUNT) ? names[issuer] : "unknown";
+}
+
+std::size_t LatencyStats::stageIndex(Duration::Stage stage)
+{
+    std::size_t index = static_cast<std::size_t>(stage);
+    return (index < FIXED_STAGE_COUNT) ? index : STAGE_COUNT;
+}
+
+std::size_t LatencyStats::findStage(const char *caption)
+{
+    std::size_t total = this->stageCount.load(std::memory_order_acquire);
+    for (std::size_t i = 0; i < total; i++)
+    {
+        if (this->stages[i] == caption)
+            return i;
+    }
+
+    std::lock_guard<std::mutex> guard(this->mutex);
+    total = this->stageCount.load(std::memory_order_relaxed);
+    for (std::size_t i = 0; i < total; i++)
+    {
+        if (this->stages[i] == caption)
+            return i;
+    }
+    if (total >= STAGE_COUNT)
+        return STAGE_COUNT;
+
+    this->stages[total] = caption;
+    this->stageCount.store(total + 1, std::memory_order_release);
+    return total;
+}
+
+void LatencyStats::record(std::size_t stage, unsigned int ctype, double seconds)
+{
+    if (stage >= STAGE_COUNT)
+        return;
+
+    this->histograms[stage][LatencyStats::issuerIndex(ctype)].record(seconds);
+    this->histograms[stage][ISSUER_ALL].record(seconds);
+}
+
+void LatencyStats::record(Duration::Stage stage, unsigned int ctype, double seconds)
+{
+    this->record(LatencyStats::stageIndex(stage), ctype, seconds);
+}
+
+void LatencyStats::record(const char *stage, unsigned int ctype, double seconds)
+{
+    this->record(this->findStage(stage), ctype, seconds);
+}
+
+void LatencyStats::record(const Duration &duration, unsigned int ctype)
+{
+    duration.visit(
+        [this, ctype](Duration::Stage stage, const char *caption, double seconds)
+        {
+            if (stage == Duration::Stage::CUSTOM)
+                this->record(this->findStage(caption), ctype, seconds);
+            else
+                this->record(LatencyStats::stageIndex(stage), ctype, seconds);
+        });
+}
+
+std::size_t LatencyStats::getStageCount() const
+{
+    return this->stageCount.load(std::memory_order_acquire);
+}
+
+const std::string &LatencyStats::getStage(std::size_t stage) const
+{
+    return this->stages[stage];
+}
+
+LatencyHistogram::Summary LatencyStats::summary(std::size_t stage, std::size_t issuer) const
+{
+    return this->histograms[stage][issuer].summary();
+}
+
+bool LatencyStats::dump(const std::string &filePath) const
+{
+    nlohmann::json j = nlohmann::json::object();
+    std::size_t total = this->getStageCount();
+    for (std::size_t i = 0; i < total; i++)
+    {
+        nlohmann::json stage = nlohmann::json::object();
+        for (std::size_t k = 0; k < ISSUER_COUNT; k++)
+        {
+            LatencyHistogram::Summary s = this->summary(i, k);
+            if (s.count == 0ULL)
+                continue;
+            nlohmann::json item = nlohmann::json::object();
+            item["count"] = s.count;
+            item["p50_ms"] = s.p50Ms;
+            item["p95_ms"] = s.p95Ms;
+            item["p99_ms"] = s.p99Ms;
+            item["max_ms"] = s.maxMs;
+            stage[LatencyStats::issuerName(k)] = item;
+        }
+        if (!stage.empty())
+            j[this->stages[i]] = stage;
+    }
+
+    /* write aside then rename, a reader never sees a truncated file */
+    std::string tmpPath = filePath + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::trunc);
+        if (!file.is_open())
+            return false;
+        try
+        {
+            file << j.dump(2);
+        }
+        catch (...)
+        {
+            return false;
+        }
+    }
+    if (std::rename(tmpPath.c_str(), filePath.c_str()) != 0)
+    {
+        FTV_LOG_ERROR("failed to write \"%s\"\n", filePath.c_str());
+        return false;
+    }
+    return true;
+}
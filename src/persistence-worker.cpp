@@ -0,0 +1,250 @@
+#include <algorithm>
+#include "persistence-worker.hpp"
+#include "transaction-store.hpp"
+#include "tscdata/include/transaction-data.hpp"
+
+#include "async-log.hpp"
+
+PersistenceWorker::Entry::Entry(std::unique_ptr<TransactionData> data, Callback onCommitted, const TransactionStore::UploadTag &tag) : data(std::move(data)),
+                                                                                                                                    onCommitted(onCommitted),
+                                                                                                                                    tag(tag),
+                                                                                                                                    enqueuedAt(std::chrono::steady_clock::now())
+{
+}
+
+PersistenceWorker::Stats::Stats() : commits(0ULL),
+                                    records(0ULL),
+                                    maxGroup(0),
+                                    totalLatencyMs(0.0),
+                                    maxLatencyMs(0.0)
+{
+}
+
+PersistenceWorker::PersistenceWorker(TransactionStore &store, std::size_t capacity, std::chrono::milliseconds stallThreshold) : isRun(false),
+                                                                                                                                store(store),
+                                                                                                                                capacity(capacity),
+                                                                                                                                maxBacklog(0),
+                                                                                                                                stallThreshold(stallThreshold),
+                                                                                                                                groupWindow(0),
+                                                                                                                                groupSize(1),
+                                                                                                                                queue(),
+                                                                                                                                stats(),
+                                                                                                                                recycler(),
+                                                                                                                                th(),
+                                                                                                                                mutex(),
+                                                                                                                                notEmpty(),
+                                                                                                                                notFull()
+{
+}
+
+PersistenceWorker::~PersistenceWorker()
+{
+    this->stop();
+}
+
+void PersistenceWorker::routine()
+{
+    std::vector<Entry> batch;
+    std::vector<bool> committed;
+    std::vector<const TransactionData *> records;
+    std::vector<TransactionStore::UploadTag> tags;
+    for (;;)
+    {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->notEmpty.wait(lock,
+                            [this]()
+                            {
+                                return (this->queue.empty() == false || this->isRun == false);
+                            });
+        if (this->queue.empty())
+            /* stopped and fully drained */
+            break;
+
+        if (this->groupSize > 1 && this->groupWindow.count() > 0)
+        {
+            /* collect the burst: until the window expires or the batch is full */
+            std::chrono::steady_clock::time_point deadline = this->queue.front().enqueuedAt + this->groupWindow;
+            this->notEmpty.wait_until(lock,
+                                      deadline,
+                                      [this]()
+                                      {
+                                          return (this->queue.size() >= this->groupSize || this->isRun == false);
+                                      });
+        }
+
+        std::size_t count = std::min(this->queue.size(), this->groupSize);
+        for (std::size_t i = 0; i < count; i++)
+        {
+            batch.emplace_back(std::move(this->queue.front()));
+            this->queue.pop_front();
+        }
+        std::size_t backlog = this->queue.size();
+        lock.unlock();
+        this->notFull.notify_all();
+
+        std::chrono::milliseconds waiting = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - batch.front().enqueuedAt);
+        if (waiting > this->stallThreshold)
+        {
+            FTV_LOG_WARNING("persistence stalled: record waited %lli ms, backlog %zu\n", static_cast<long long>(waiting.count()), backlog);
+        }
+
+        this->commit(batch, committed, records, tags);
+        batch.clear();
+    }
+}
+
+void PersistenceWorker::commit(std::vector<Entry> &batch,
+                               std::vector<bool> &committed,
+                               std::vector<const TransactionData *> &records,
+                               std::vector<TransactionStore::UploadTag> &tags)
+{
+    /* the vectors belong to routine(), their storage is reused batch after batch */
+    if (batch.size() == 1)
+    {
+        committed.assign(1, this->store.insert(*batch.front().data, batch.front().tag));
+    }
+    else
+    {
+        records.clear();
+        tags.clear();
+        for (const Entry &entry : batch)
+        {
+            records.push_back(entry.data.get());
+            tags.push_back(entry.tag);
+        }
+        std::size_t total = this->store.insert(records, tags, committed);
+        FTV_LOG_INFO("group commit %zu/%zu record(s)\n", total, batch.size());
+    }
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> guard(this->mutex);
+        this->stats.commits++;
+        this->stats.records += batch.size();
+        this->stats.maxGroup = std::max(this->stats.maxGroup, batch.size());
+        for (const Entry &entry : batch)
+        {
+            double latencyMs = std::chrono::duration<double, std::milli>(now - entry.enqueuedAt).count();
+            this->stats.totalLatencyMs += latencyMs;
+            this->stats.maxLatencyMs = std::max(this->stats.maxLatencyMs, latencyMs);
+        }
+    }
+
+    for (std::size_t i = 0; i < batch.size(); i++)
+    {
+        if (committed[i] == false)
+        {
+            FTV_LOG_ERROR("failed to insert transaction\n");
+        }
+        if (batch[i].onCommitted)
+        {
+            batch[i].onCommitted(committed[i]);
+        }
+        this->release(std::move(batch[i].data));
+    }
+}
+
+void PersistenceWorker::release(std::unique_ptr<TransactionData> data)
+{
+    if (this->recycler && data.get())
+        this->recycler(std::move(data));
+}
+
+void PersistenceWorker::setGroupCommit(std::chrono::milliseconds window, std::size_t maxRecords)
+{
+    std::lock_guard<std::mutex> guard(this->mutex);
+    this->groupWindow = window;
+    this->groupSize = (maxRecords == 0 ? 1 : maxRecords);
+}
+
+void PersistenceWorker::setRecycler(Recycler recycler)
+{
+    std::lock_guard<std::mutex> guard(this->mutex);
+    this->recycler = recycler;
+}
+
+void PersistenceWorker::begin()
+{
+    std::lock_guard<std::mutex> guard(this->mutex);
+    if (this->th.get())
+        return;
+    this->isRun = true;
+    this->th.reset(new std::thread(&PersistenceWorker::routine, this));
+}
+
+void PersistenceWorker::stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(this->mutex);
+        if (this->th.get() == nullptr)
+            return;
+        this->isRun = false;
+        FTV_LOG_INFO("drain %zu pending record(s)\n", this->queue.size());
+    }
+    this->notEmpty.notify_all();
+    this->notFull.notify_all();
+    this->th->join();
+    this->th.reset();
+}
+
+bool PersistenceWorker::commitInline(std::unique_ptr<TransactionData> data, Callback onCommitted, const TransactionStore::UploadTag &tag)
+{
+    /* the card may already be debited, the record is written on the caller's thread instead of being dropped */
+    std::vector<Entry> batch;
+    std::vector<bool> committed;
+    std::vector<const TransactionData *> records;
+    std::vector<TransactionStore::UploadTag> tags;
+    batch.emplace_back(std::move(data), onCommitted, tag);
+    this->commit(batch, committed, records, tags);
+    return committed.front();
+}
+
+bool PersistenceWorker::push(std::unique_ptr<TransactionData> data, Callback onCommitted, const TransactionStore::UploadTag &tag)
+{
+    std::unique_lock<std::mutex> lock(this->mutex);
+    if (this->isRun == false)
+    {
+        FTV_LOG_WARNING("persistence worker is not running, commit inline\n");
+        lock.unlock();
+        return this->commitInline(std::move(data), onCommitted, tag);
+    }
+    if (this->queue.size() >= this->capacity)
+    {
+        /* never drop a record, hold the card thread until the flash catches up */
+        FTV_LOG_WARNING("persistence queue full (%zu), waiting for flash\n", this->queue.size());
+        this->notFull.wait(lock,
+                           [this]()
+                           {
+                               return (this->queue.size() < this->capacity || this->isRun == false);
+                           });
+        if (this->isRun == false)
+        {
+            lock.unlock();
+            return this->commitInline(std::move(data), onCommitted, tag);
+        }
+    }
+    this->queue.emplace_back(std::move(data), onCommitted, tag);
+    if (this->queue.size() > this->maxBacklog)
+        this->maxBacklog = this->queue.size();
+    lock.unlock();
+    this->notEmpty.notify_one();
+    return true;
+}
+
+std::size_t PersistenceWorker::getBacklog() const
+{
+    std::lock_guard<std::mutex> guard(this->mutex);
+    return this->queue.size();
+}
+
+std::size_t PersistenceWorker::getMaxBacklog() const
+{
+    std::lock_guard<std::mutex> guard(this->mutex);
+    return this->maxBacklog;
+}
+
+PersistenceWorker::Stats PersistenceWorker::getStats() const
+{
+    std::lock_guard<std::mutex> guard(this->mutex);
+    return this->stats;
+}
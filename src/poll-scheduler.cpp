@@ -0,0 +1,213 @@
+#include <ctime>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include "poll-scheduler.hpp"
+#include "async-log.hpp"
+
+#include "utils/include/nlohmann/json.hpp"
+
+/* "HH:MM" to minute of day */
+static int parseMinuteOfDay(const std::string &text)
+{
+    int hour = -1;
+    int minute = -1;
+    char tail = 0;
+    if (sscanf(text.c_str(), "%d:%d%c", &hour, &minute, &tail) != 2 ||
+        hour < 0 || hour > 23 || minute < 0 || minute > 59)
+        throw std::runtime_error("invalid time of day \"" + text + "\"");
+    return hour * 60 + minute;
+}
+
+PollScheduler::Stats::Stats() : samples(0ULL),
+                                totalMs(0.0),
+                                lastMs(0.0),
+                                maxMs(0.0)
+{
+}
+
+double PollScheduler::Stats::getAverageMs() const
+{
+    if (this->samples == 0ULL)
+        return 0.0;
+    return this->totalMs / static_cast<double>(this->samples);
+}
+
+PollScheduler::PollScheduler() : lastMiss(),
+                                 hasLastMiss(false),
+                                 stats()
+{
+}
+
+PollScheduler::~PollScheduler() {}
+
+std::chrono::milliseconds PollScheduler::next(bool isDetected)
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (isDetected)
+    {
+        if (this->hasLastMiss)
+        {
+            std::chrono::duration<double, std::milli> latency = now - this->lastMiss;
+            this->stats.samples++;
+            this->stats.totalMs += latency.count();
+            this->stats.lastMs = latency.count();
+            this->stats.maxMs = std::max(this->stats.maxMs, latency.count());
+        }
+        /* the card stays on the reader for a while, don't measure against it */
+        this->hasLastMiss = false;
+    }
+    else
+    {
+        this->lastMiss = now;
+        this->hasLastMiss = true;
+    }
+    return this->interval(isDetected, now);
+}
+
+std::chrono::milliseconds PollScheduler::held()
+{
+    /* keeps the fast pace for the next card without touching the detection stats */
+    this->hasLastMiss = false;
+    return this->interval(true, std::chrono::steady_clock::now());
+}
+
+const PollScheduler::Stats &PollScheduler::getStats() const
+{
+    return this->stats;
+}
+
+void PollScheduler::resetStats()
+{
+    this->stats = Stats();
+}
+
+FixedPollScheduler::FixedPollScheduler(std::chrono::milliseconds delay) : PollScheduler(),
+                                                                          delay(delay)
+{
+}
+
+FixedPollScheduler::~FixedPollScheduler() {}
+
+std::chrono::milliseconds FixedPollScheduler::interval(bool /* isDetected */, const std::chrono::steady_clock::time_point &/* now */)
+{
+    return this->delay;
+}
+
+AdaptivePollScheduler::AdaptivePollScheduler(std::chrono::milliseconds fast,
+                                             std::chrono::milliseconds slow,
+                                             std::chrono::milliseconds hold) : PollScheduler(),
+                                                                               fast(fast),
+                                                                               slow(std::max(fast, slow)),
+                                                                               hold(hold),
+                                                                               current(fast),
+                                                                               lastActivity(std::chrono::steady_clock::now()),
+                                                                               peakWindows()
+{
+}
+
+AdaptivePollScheduler::~AdaptivePollScheduler() {}
+
+bool AdaptivePollScheduler::load(const std::string &filePath)
+{
+    std::ifstream file(filePath);
+    if (file.is_open() == false)
+    {
+        FTV_LOG_INFO("no %s, default poll intervals without peak windows\n", filePath.c_str());
+        return false;
+    }
+
+    std::chrono::milliseconds fast = this->fast;
+    std::chrono::milliseconds slow = this->slow;
+    std::chrono::milliseconds hold = this->hold;
+    std::vector<std::pair<int, int>> windows;
+    try
+    {
+        nlohmann::json j;
+        file >> j;
+        if (!j.is_object())
+            throw std::runtime_error("not a JSON object");
+
+        fast = std::chrono::milliseconds(j.value("fast_ms", static_cast<long long>(fast.count())));
+        slow = std::chrono::milliseconds(j.value("slow_ms", static_cast<long long>(slow.count())));
+        hold = std::chrono::seconds(j.value("hold_s", static_cast<long long>(std::chrono::duration_cast<std::chrono::seconds>(hold).count())));
+        if (j.contains("peak_windows"))
+        {
+            for (const nlohmann::json &window : j.at("peak_windows"))
+            {
+                windows.emplace_back(parseMinuteOfDay(window.at("start").get<std::string>()),
+                                     parseMinuteOfDay(window.at("end").get<std::string>()));
+            }
+        }
+    }
+    catch (const std::exception &e)
+    {
+        FTV_LOG_ERROR("import \"%s\" failed: %s\n", filePath.c_str(), e.what());
+        return false;
+    }
+
+    if (fast.count() <= 0)
+        fast = std::chrono::milliseconds(1);
+    this->fast = fast;
+    this->slow = std::max(fast, slow);
+    this->hold = hold;
+    this->current = fast;
+    this->peakWindows = windows;
+    FTV_LOG_INFO("poll every %lli-%lli ms, %zu peak window(s)\n", static_cast<long long>(this->fast.count()), static_cast<long long>(this->slow.count()), this->peakWindows.size());
+    return true;
+}
+
+void AdaptivePollScheduler::addPeakWindow(int startMinuteOfDay, int endMinuteOfDay)
+{
+    this->peakWindows.emplace_back(startMinuteOfDay, endMinuteOfDay);
+}
+
+void AdaptivePollScheduler::clearPeakWindows()
+{
+    this->peakWindows.clear();
+}
+
+bool AdaptivePollScheduler::isPeakTime() const
+{
+    if (this->peakWindows.empty())
+        return false;
+
+    std::time_t now = std::time(nullptr);
+    std::tm tmp{};
+    localtime_r(&now, &tmp);
+    int minute = tmp.tm_hour * 60 + tmp.tm_min;
+    for (const std::pair<int, int> &window : this->peakWindows)
+    {
+        if (window.first <= window.second)
+        {
+            if (minute >= window.first && minute < window.second)
+                return true;
+        }
+        else if (minute >= window.first || minute < window.second)
+        {
+            /* window crosses midnight */
+            return true;
+        }
+    }
+    return false;
+}
+
+std::chrono::milliseconds AdaptivePollScheduler::interval(bool isDetected, const std::chrono::steady_clock::time_point &now)
+{
+    if (isDetected)
+    {
+        this->lastActivity = now;
+        this->current = this->fast;
+        return this->current;
+    }
+
+    if (now - this->lastActivity < this->hold || this->isPeakTime())
+    {
+        this->current = this->fast;
+        return this->current;
+    }
+
+    this->current = std::min(this->current * 2, this->slow);
+    return this->current;
+}
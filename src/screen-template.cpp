@@ -0,0 +1,114 @@
+#include <cstdio>
+#include <cstring>
+#include "screen-template.hpp"
+
+ScreenTemplate::Line::Line(const char *text, Field field) : text(text),
+                                                            field(field)
+{
+}
+
+ScreenTemplate::Values::Values() : amount(0U),
+                                   baseAmount(0U),
+                                   balance(0U),
+                                   expire(0),
+                                   error("")
+{
+}
+
+ScreenTemplate::Frame::Frame()
+{
+    this->clear();
+}
+
+void ScreenTemplate::Frame::clear()
+{
+    memset(this->lines, 0x00, sizeof(this->lines));
+}
+
+bool ScreenTemplate::Frame::operator==(const Frame &other) const
+{
+    for (std::size_t i = 0; i < LINE_COUNT; i++)
+    {
+        if (strcmp(this->lines[i], other.lines[i]) != 0)
+            return false;
+    }
+    return true;
+}
+
+bool ScreenTemplate::Frame::operator!=(const Frame &other) const
+{
+    return !(*this == other);
+}
+
+ScreenTemplate::ScreenTemplate(const Line &first, const Line &second, const Line &third, const Line &fourth, const Line &fifth) : lines{{first, second, third, fourth, fifth}}
+{
+}
+
+ScreenTemplate::~ScreenTemplate() {}
+
+std::size_t ScreenTemplate::formatRupiah(char *out, std::size_t size, unsigned int value, const char *pre)
+{
+    /* digits are written from the back with a dot every three of them */
+    char digits[16];
+    std::size_t pos = sizeof(digits) - 1;
+    std::size_t count = 0;
+    digits[pos] = 0x00;
+    do
+    {
+        if (count > 0 && count % 3 == 0)
+            digits[--pos] = '.';
+        digits[--pos] = static_cast<char>('0' + value % 10);
+        value /= 10;
+        count++;
+    } while (value > 0);
+
+    int length = 0;
+    if (pre[0] == 0x00)
+        length = snprintf(out, size, "RP %s", digits + pos);
+    else
+        length = snprintf(out, size, "%s RP %s", pre, digits + pos);
+    return (length < 0) ? 0 : static_cast<std::size_t>(length);
+}
+
+std::size_t ScreenTemplate::formatDate(char *out, std::size_t size, std::time_t time, const char *pre)
+{
+    std::tm tmtmp{};
+    localtime_r(&time, &tmtmp);
+
+    int length = 0;
+    if (pre[0] == 0x00)
+        length = snprintf(out, size, "%02d-%02d-%02d", tmtmp.tm_mday, tmtmp.tm_mon + 1, (tmtmp.tm_year + 1900) % 100);
+    else
+        length = snprintf(out, size, "%s %02d-%02d-%02d", pre, tmtmp.tm_mday, tmtmp.tm_mon + 1, (tmtmp.tm_year + 1900) % 100);
+    return (length < 0) ? 0 : static_cast<std::size_t>(length);
+}
+
+void ScreenTemplate::render(const Values &values, Frame &frame) const
+{
+    for (std::size_t i = 0; i < LINE_COUNT; i++)
+    {
+        const Line &line = this->lines[i];
+        char *out = frame.lines[i];
+        switch (line.field)
+        {
+        case Field::AMOUNT:
+            ScreenTemplate::formatRupiah(out, LINE_SIZE, values.amount, line.text);
+            break;
+        case Field::BASE_AMOUNT:
+            ScreenTemplate::formatRupiah(out, LINE_SIZE, values.baseAmount, line.text);
+            break;
+        case Field::BALANCE:
+            ScreenTemplate::formatRupiah(out, LINE_SIZE, values.balance, line.text);
+            break;
+        case Field::EXPIRE_DATE:
+            ScreenTemplate::formatDate(out, LINE_SIZE, values.expire, line.text);
+            break;
+        case Field::ERROR:
+            snprintf(out, LINE_SIZE, "%s", values.error ? values.error : "");
+            break;
+        default:
+            snprintf(out, LINE_SIZE, "%s", line.text);
+            break;
+        }
+    }
+}
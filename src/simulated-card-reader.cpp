@@ -0,0 +1,372 @@
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include "simulated-card-reader.hpp"
+
+SimulatedCardReader::Latency::Latency(double meanMs, double stddevMs) : meanMs(meanMs),
+                                                                       stddevMs(stddevMs)
+{
+}
+
+SimulatedCardReader::IssuerProfile::IssuerProfile() : bank(),
+                                                      issuer(),
+                                                      mid("0000000000000000"),
+                                                      tid("00000000"),
+                                                      latency(),
+                                                      failureRate()
+{
+    /* rough figures of a contactless reader with the SAM on the same board */
+    this->setLatency(Operation::SELECT, 20.0, 5.0);
+    this->setLatency(Operation::READ_USER_DATA, 30.0, 8.0);
+    this->setLatency(Operation::WRITE_USER_DATA, 60.0, 15.0);
+    this->setLatency(Operation::DEDUCT, 250.0, 60.0);
+    this->setLatency(Operation::GET_BALANCE, 40.0, 10.0);
+    this->setLatency(Operation::PURCHASE_COMMIT, 30.0, 8.0);
+    this->failureRate.fill(0.0);
+}
+
+SimulatedCardReader::IssuerProfile::IssuerProfile(const std::string &bank, const std::string &issuer) : IssuerProfile()
+{
+    this->bank = bank;
+    this->issuer = issuer;
+}
+
+SimulatedCardReader::IssuerProfile &SimulatedCardReader::IssuerProfile::setLatency(Operation op, double meanMs, double stddevMs)
+{
+    this->latency[static_cast<std::size_t>(op)] = Latency(meanMs, stddevMs);
+    return *this;
+}
+
+SimulatedCardReader::IssuerProfile &SimulatedCardReader::IssuerProfile::setFailureRate(Operation op, double rate)
+{
+    this->failureRate[static_cast<std::size_t>(op)] = rate;
+    return *this;
+}
+
+SimulatedCardReader::SimulatedCard::SimulatedCard() : cardNumber(0ULL),
+                                                      type(Card::CARD_TYPE_MANDIRI),
+                                                      balance(0),
+                                                      userData(),
+                                                      interop(0),
+                                                      expireOn(0)
+{
+}
+
+SimulatedCardReader::SimulatedCardReader(unsigned int seed) : profiles(),
+                                                              cards(),
+                                                              presented(nullptr),
+                                                              selected(nullptr),
+                                                              amount(0U),
+                                                              lastBalance(0),
+                                                              lastStatus(STATUS_SUCCESS),
+                                                              transcodeSeq(0ULL),
+                                                              transcode(),
+                                                              timeScale(1.0),
+                                                              rng(seed),
+                                                              mtx()
+{
+    this->profiles[Card::CARD_TYPE_MANDIRI] = IssuerProfile("mandiri", "emoney");
+    this->profiles[Card::CARD_TYPE_BRI] = IssuerProfile("bri", "brizzi");
+    this->profiles[Card::CARD_TYPE_BNI] = IssuerProfile("bni", "tapcash");
+    this->profiles[Card::CARD_TYPE_BCA] = IssuerProfile("bca", "flazz");
+    this->profiles[Card::CARD_TYPE_DKI] = IssuerProfile("dki", "jakcard");
+}
+
+SimulatedCardReader::~SimulatedCardReader() {}
+
+const SimulatedCardReader::IssuerProfile &SimulatedCardReader::findProfile(Card::cardType_t type) const
+{
+    std::map<Card::cardType_t, IssuerProfile>::const_iterator it = this->profiles.find(type);
+    if (it == this->profiles.end())
+        it = this->profiles.find(Card::CARD_TYPE_MANDIRI);
+    return it->second;
+}
+
+bool SimulatedCardReader::simulate(Operation op)
+{
+    std::size_t index = static_cast<std::size_t>(op);
+    double delayMs = 0.0;
+    bool isFailed = false;
+    {
+        std::lock_guard<std::mutex> guard(this->mtx);
+        Card::cardType_t type = this->selected ? this->selected->type : Card::CARD_TYPE_MANDIRI;
+        const IssuerProfile &profile = this->findProfile(type);
+        const Latency &latency = profile.latency[index];
+        if (latency.stddevMs > 0.0)
+        {
+            std::normal_distribution<double> dist(latency.meanMs, latency.stddevMs);
+            delayMs = dist(this->rng);
+        }
+        else
+        {
+            delayMs = latency.meanMs;
+        }
+        if (profile.failureRate[index] > 0.0)
+        {
+            std::uniform_real_distribution<double> dist(0.0, 1.0);
+            isFailed = dist(this->rng) < profile.failureRate[index];
+        }
+        delayMs *= this->timeScale;
+    }
+
+    /* never sleep under the lock, present()/remove() come from another thread */
+    if (delayMs > 0.0)
+        std::this_thread::sleep_for(std::chrono::microseconds(static_cast<long long>(delayMs * 1000.0)));
+    return isFailed == false;
+}
+
+void SimulatedCardReader::setProfile(Card::cardType_t type, const IssuerProfile &profile)
+{
+    std::lock_guard<std::mutex> guard(this->mtx);
+    this->profiles[type] = profile;
+}
+
+SimulatedCardReader::IssuerProfile SimulatedCardReader::getProfile(Card::cardType_t type)
+{
+    /* a copy, the map may change once the lock is released */
+    std::lock_guard<std::mutex> guard(this->mtx);
+    std::map<Card::cardType_t, IssuerProfile>::const_iterator it = this->profiles.find(type);
+    return (it != this->profiles.end()) ? it->second : IssuerProfile();
+}
+
+void SimulatedCardReader::setTimeScale(double scale)
+{
+    std::lock_guard<std::mutex> guard(this->mtx);
+    this->timeScale = (scale < 0.0) ? 0.0 : scale;
+}
+
+void SimulatedCardReader::addCard(unsigned long long cardNumber, Card::cardType_t type, int balance)
+{
+    SimulatedCard card;
+    card.cardNumber = cardNumber;
+    card.type = type;
+    card.balance = balance;
+    this->addCard(card);
+}
+
+void SimulatedCardReader::addCard(const SimulatedCard &card)
+{
+    std::lock_guard<std::mutex> guard(this->mtx);
+    /* cards are never erased, presented/selected point into the map */
+    this->cards[card.cardNumber] = card;
+}
+
+bool SimulatedCardReader::getCard(unsigned long long cardNumber, SimulatedCard &card)
+{
+    std::lock_guard<std::mutex> guard(this->mtx);
+    std::map<unsigned long long, SimulatedCard>::const_iterator it = this->cards.find(cardNumber);
+    if (it == this->cards.end())
+        return false;
+    card = it->second;
+    return true;
+}
+
+std::size_t SimulatedCardReader::getCardCount()
+{
+    std::lock_guard<std::mutex> guard(this->mtx);
+    return this->cards.size();
+}
+
+bool SimulatedCardReader::present(unsigned long long cardNumber)
+{
+    std::lock_guard<std::mutex> guard(this->mtx);
+    std::map<unsigned long long, SimulatedCard>::iterator it = this->cards.find(cardNumber);
+    if (it == this->cards.end())
+        return false;
+    this->presented = &it->second;
+    return true;
+}
+
+void SimulatedCardReader::remove()
+{
+    std::lock_guard<std::mutex> guard(this->mtx);
+    this->presented = nullptr;
+}
+
+std::string SimulatedCardReader::getVersion()
+{
+    return "simulated";
+}
+
+bool SimulatedCardReader::selectAttachedCard()
+{
+    {
+        std::lock_guard<std::mutex> guard(this->mtx);
+        this->selected = this->presented;
+        if (this->selected == nullptr)
+        {
+            this->lastStatus = STATUS_NO_CARD;
+            return false;
+        }
+    }
+    bool result = this->simulate(Operation::SELECT);
+
+    std::lock_guard<std::mutex> guard(this->mtx);
+    if (result == false || this->presented != this->selected)
+    {
+        this->selected = nullptr;
+        this->lastStatus = STATUS_NO_CARD;
+        return false;
+    }
+    this->lastStatus = STATUS_SUCCESS;
+    return true;
+}
+
+unsigned long long SimulatedCardReader::getCardNumber()
+{
+    std::lock_guard<std::mutex> guard(this->mtx);
+    return this->selected ? this->selected->cardNumber : 0ULL;
+}
+
+bool SimulatedCardReader::readUserData(std::array<unsigned char, 64> &userData)
+{
+    bool result = this->simulate(Operation::READ_USER_DATA);
+
+    std::lock_guard<std::mutex> guard(this->mtx);
+    /* pulling the card away mid transaction fails like it does on the hardware */
+    if (result == false || this->selected == nullptr || this->presented != this->selected)
+    {
+        this->lastStatus = STATUS_FAILED;
+        return false;
+    }
+    userData = this->selected->userData;
+    this->lastStatus = STATUS_SUCCESS;
+    return true;
+}
+
+bool SimulatedCardReader::writeUserData(const std::array<unsigned char, 64> &toWrite, const std::array<unsigned char, 64> &userData)
+{
+    bool result = this->simulate(Operation::WRITE_USER_DATA);
+
+    std::lock_guard<std::mutex> guard(this->mtx);
+    if (result == false || this->selected == nullptr || this->presented != this->selected)
+    {
+        this->lastStatus = STATUS_FAILED;
+        return false;
+    }
+    this->selected->userData = toWrite;
+    this->lastStatus = STATUS_SUCCESS;
+    return true;
+}
+
+void SimulatedCardReader::getFreeServiceParam(unsigned short &interop, std::time_t &expireOn)
+{
+    std::lock_guard<std::mutex> guard(this->mtx);
+    interop = this->selected ? this->selected->interop : 0;
+    expireOn = this->selected ? this->selected->expireOn : 0;
+}
+
+std::string SimulatedCardReader::getBank()
+{
+    std::lock_guard<std::mutex> guard(this->mtx);
+    return this->findProfile(this->selected ? this->selected->type : Card::CARD_TYPE_MANDIRI).bank;
+}
+
+std::string SimulatedCardReader::getIssuer()
+{
+    std::lock_guard<std::mutex> guard(this->mtx);
+    return this->findProfile(this->selected ? this->selected->type : Card::CARD_TYPE_MANDIRI).issuer;
+}
+
+Card::cardType_t SimulatedCardReader::getType()
+{
+    std::lock_guard<std::mutex> guard(this->mtx);
+    return this->selected ? this->selected->type : Card::CARD_TYPE_UNKNOWN;
+}
+
+void SimulatedCardReader::setAmount(unsigned int amount)
+{
+    std::lock_guard<std::mutex> guard(this->mtx);
+    this->amount = amount;
+}
+
+bool SimulatedCardReader::deduct()
+{
+    bool result = this->simulate(Operation::DEDUCT);
+
+    std::lock_guard<std::mutex> guard(this->mtx);
+    if (result == false || this->selected == nullptr || this->presented != this->selected)
+    {
+        this->lastStatus = STATUS_FAILED;
+        return false;
+    }
+    if (this->selected->balance < static_cast<int>(this->amount))
+    {
+        this->lastStatus = STATUS_INSUFFICIENT_VALUE;
+        return false;
+    }
+    this->selected->balance -= static_cast<int>(this->amount);
+    this->lastBalance = this->selected->balance;
+
+    char buffer[33];
+    snprintf(buffer, sizeof(buffer), "%016llX%016llX", this->selected->cardNumber, ++this->transcodeSeq);
+    this->transcode = buffer;
+    this->lastStatus = STATUS_SUCCESS;
+    return true;
+}
+
+int SimulatedCardReader::getLastBalance()
+{
+    std::lock_guard<std::mutex> guard(this->mtx);
+    return this->lastBalance;
+}
+
+int SimulatedCardReader::getBalance()
+{
+    bool result = this->simulate(Operation::GET_BALANCE);
+
+    std::lock_guard<std::mutex> guard(this->mtx);
+    if (result == false || this->selected == nullptr || this->presented != this->selected)
+    {
+        this->lastStatus = STATUS_FAILED;
+        return -1;
+    }
+    this->lastBalance = this->selected->balance;
+    this->lastStatus = STATUS_SUCCESS;
+    return this->lastBalance;
+}
+
+bool SimulatedCardReader::purchaseCommit()
+{
+    bool result = this->simulate(Operation::PURCHASE_COMMIT);
+
+    std::lock_guard<std::mutex> guard(this->mtx);
+    this->lastStatus = result ? STATUS_SUCCESS : STATUS_FAILED;
+    return result;
+}
+
+int SimulatedCardReader::getLastStatus()
+{
+    std::lock_guard<std::mutex> guard(this->mtx);
+    return this->lastStatus;
+}
+
+bool SimulatedCardReader::isInsufficientValue()
+{
+    std::lock_guard<std::mutex> guard(this->mtx);
+    return this->lastStatus == STATUS_INSUFFICIENT_VALUE;
+}
+
+std::string SimulatedCardReader::getTranscode()
+{
+    std::lock_guard<std::mutex> guard(this->mtx);
+    return this->transcode;
+}
+
+std::string SimulatedCardReader::getTranscodeUTF8()
+{
+    std::lock_guard<std::mutex> guard(this->mtx);
+    return this->transcode;
+}
+
+std::string SimulatedCardReader::getActiveMID()
+{
+    std::lock_guard<std::mutex> guard(this->mtx);
+    return this->findProfile(this->selected ? this->selected->type : Card::CARD_TYPE_MANDIRI).mid;
+}
+
+std::string SimulatedCardReader::getActiveTID()
+{
+    std::lock_guard<std::mutex> guard(this->mtx);
+    return this->findProfile(this->selected ? this->selected->type : Card::CARD_TYPE_MANDIRI).tid;
+}
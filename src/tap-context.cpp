@@ -0,0 +1,207 @@
+#include "tap-context.hpp"
+#include "card-reader.hpp"
+#include "tscdata/include/transaction-data.hpp"
+
+TapContext::TapContext() : time(0),
+                           issuer(),
+                           bank(),
+                           mid(),
+                           tid(),
+                           uuid(),
+                           intent(0ULL),
+                           identity(),
+                           isIdentityLoaded(false),
+                           isProvisionChanged(false),
+                           origin(),
+                           card(),
+                           unread(),
+                           isUnreadParsed(false),
+                           boundCard(nullptr),
+                           owned(),
+                           ownedCount(),
+                           pool(),
+                           blank(),
+                           poolMtx()
+{
+    this->uuid.reserve(UUIDv7::STRING_LENGTH);
+    for (std::size_t i = 0; i < 2; i++)
+    {
+        this->pool[i].reserve(POOL_SIZE);
+        this->blank[i].reset(new TransactionData(i == 1));
+    }
+}
+
+TapContext::~TapContext() {}
+
+void TapContext::invalidate()
+{
+    /* called from the setup thread, the tap thread reloads at its next reset() */
+    this->isProvisionChanged.store(true, std::memory_order_release);
+}
+
+void TapContext::reset(CardReader &reader, WorkflowManager &workflow)
+{
+    this->time = std::time(nullptr);
+    this->issuer = reader.getIssuer();
+    this->bank = reader.getBank();
+    this->mid = reader.getActiveMID();
+    this->tid = reader.getActiveTID();
+    if (this->isProvisionChanged.exchange(false, std::memory_order_acq_rel))
+    {
+        /* both come from the provision */
+        this->isIdentityLoaded = false;
+        this->isUnreadParsed = false;
+    }
+    if (this->isIdentityLoaded == false)
+    {
+        /* the terminal identity comes from the provision, copied again only after invalidate() */
+        this->identity = workflow.getIdentity();
+        this->isIdentityLoaded = true;
+    }
+    this->identity.setTransactionTime(this->time);
+    this->boundCard = nullptr;
+    this->intent = 0ULL;
+}
+
+void TapContext::bind(const CardData &refUserData)
+{
+    /* the success path stores two transactions from the same card data */
+    if (this->boundCard == &refUserData)
+        return;
+
+    this->card = refUserData;
+    this->card.setIssuer(this->issuer);
+    this->card.setBank(this->bank);
+
+    this->origin = TransactionIdentity();
+    this->origin.setFletCode(refUserData.getFletCode());
+    this->origin.setTerminalId(refUserData.getTerminalId());
+    this->origin.setTransactionTime(refUserData.getEpochTime());
+    this->origin.setTransportationType(refUserData.getTrasportationCode());
+    this->boundCard = &refUserData;
+}
+
+void TapContext::bindUnread(const Provision &provision)
+{
+    if (this->isUnreadParsed == false)
+    {
+        /* the blank card only depends on the provision, parse it once */
+        std::array<unsigned char, 64UL> empty{};
+        this->unread.parse(empty, provision);
+        this->isUnreadParsed = true;
+    }
+    this->card = this->unread;
+    this->card.setIssuer(this->issuer);
+    this->card.setBank(this->bank);
+    this->origin = this->identity;
+    this->boundCard = nullptr;
+}
+
+std::time_t TapContext::getTime() const
+{
+    return this->time;
+}
+
+const std::string &TapContext::getIssuer() const
+{
+    return this->issuer;
+}
+
+const std::string &TapContext::getBank() const
+{
+    return this->bank;
+}
+
+const std::string &TapContext::getMID() const
+{
+    return this->mid;
+}
+
+const std::string &TapContext::getTID() const
+{
+    return this->tid;
+}
+
+const TransactionIdentity &TapContext::getIdentity() const
+{
+    return this->identity;
+}
+
+const TransactionIdentity &TapContext::getOrigin() const
+{
+    return this->origin;
+}
+
+const CardData &TapContext::getCard() const
+{
+    return this->card;
+}
+
+const std::string &TapContext::nextUUID()
+{
+    char text[UUIDv7::STRING_LENGTH + 1];
+    UUIDv7::generate(text);
+    this->uuid.assign(text, UUIDv7::STRING_LENGTH);
+    return this->uuid;
+}
+
+const std::string &TapContext::getUUID() const
+{
+    return this->uuid;
+}
+
+void TapContext::setIntent(uint64_t intent)
+{
+    this->intent = intent;
+}
+
+uint64_t TapContext::takeIntent()
+{
+    uint64_t intent = this->intent;
+    this->intent = 0ULL;
+    return intent;
+}
+
+int TapContext::findOwner(const TransactionData *tsc) const
+{
+    for (int i = 0; i < 2; i++)
+    {
+        for (std::size_t k = 0; k < this->ownedCount[i]; k++)
+        {
+            if (this->owned[i][k] == tsc)
+                return i;
+        }
+    }
+    return -1;
+}
+
+std::unique_ptr<TransactionData> TapContext::acquire(bool isTapIn)
+{
+    const std::size_t direction = isTapIn ? 1 : 0;
+    std::lock_guard<std::mutex> guard(this->poolMtx);
+    if (this->pool[direction].empty() == false)
+    {
+        std::unique_ptr<TransactionData> tsc = std::move(this->pool[direction].back());
+        this->pool[direction].pop_back();
+        return tsc;
+    }
+
+    std::unique_ptr<TransactionData> tsc(new TransactionData(isTapIn));
+    if (this->ownedCount[direction] < POOL_SIZE)
+    {
+        /* only the first POOL_SIZE objects are kept, a deeper backlog allocates and frees as before */
+        this->owned[direction][this->ownedCount[direction]++] = tsc.get();
+    }
+    return tsc;
+}
+
+void TapContext::recycle(std::unique_ptr<TransactionData> tsc)
+{
+    std::lock_guard<std::mutex> guard(this->poolMtx);
+    int direction = this->findOwner(tsc.get());
+    if (direction < 0)
+        return;
+    /* copy-assigned from an empty record: no field of the previous tap survives, the strings keep their storage */
+    *tsc = *this->blank[direction];
+    this->pool[direction].push_back(std::move(tsc));
+}
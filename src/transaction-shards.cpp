@@ -0,0 +1,383 @@
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <vector>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "transaction-shards.hpp"
+#include "transaction-store.hpp"
+#include "counter.hpp"
+#include "sqlite3.h"
+#include "lzma.h"
+
+#include "async-log.hpp"
+#include "utils/include/time.hpp"
+
+/* preset 1 needs about 10 MB to encode and 2 MB to decode, higher presets do not fit the validator */
+#define TRANSACTION_ARCHIVE_PRESET 1
+#define TRANSACTION_ARCHIVE_BUFFER_SIZE (64 * 1024)
+/* a count and its next day, the scratch copies of older archives are dropped first */
+#define TRANSACTION_QUERY_CACHE_SIZE 2
+
+const char *TransactionShards::FILE_NAME = "transaction.db";
+const char *TransactionShards::ARCHIVE_SUFFIX = ".xz";
+
+static std::vector<std::string> listDirectory(const std::string &path)
+{
+    std::vector<std::string> result;
+    DIR *dir = opendir(path.c_str());
+    if (dir == nullptr)
+        return result;
+
+    struct dirent *entry = nullptr;
+    while ((entry = readdir(dir)) != nullptr)
+    {
+        if (entry->d_name[0] != '.')
+            result.push_back(entry->d_name);
+    }
+    closedir(dir);
+    return result;
+}
+
+static bool isFile(const std::string &path)
+{
+    struct stat st;
+    return (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode));
+}
+
+static std::string pragma(sqlite3 *db, const char *sql)
+{
+    std::string result;
+    sqlite3_stmt *stmt = nullptr;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        const unsigned char *text = sqlite3_column_text(stmt, 0);
+        result = text ? reinterpret_cast<const char *>(text) : "";
+    }
+    sqlite3_finalize(stmt);
+    return result;
+}
+
+/* runs an initialized lzma stream from one file into another, synced before returning */
+static bool transcode(lzma_stream &strm, const std::string &source, const std::string &target)
+{
+    FILE *in = fopen(source.c_str(), "rb");
+    if (in == nullptr)
+    {
+        FTV_LOG_ERROR("open \"%s\" failed: %s\n", source.c_str(), strerror(errno));
+        return false;
+    }
+    FILE *out = fopen(target.c_str(), "wb");
+    if (out == nullptr)
+    {
+        FTV_LOG_ERROR("open \"%s\" failed: %s\n", target.c_str(), strerror(errno));
+        fclose(in);
+        return false;
+    }
+
+    std::vector<uint8_t> inBuffer(TRANSACTION_ARCHIVE_BUFFER_SIZE);
+    std::vector<uint8_t> outBuffer(TRANSACTION_ARCHIVE_BUFFER_SIZE);
+    lzma_action action = LZMA_RUN;
+    strm.next_out = outBuffer.data();
+    strm.avail_out = outBuffer.size();
+
+    bool result = false;
+    for (;;)
+    {
+        if (strm.avail_in == 0 && action == LZMA_RUN)
+        {
+            strm.next_in = inBuffer.data();
+            strm.avail_in = fread(inBuffer.data(), 1, inBuffer.size(), in);
+            if (ferror(in))
+            {
+                FTV_LOG_ERROR("read \"%s\" failed\n", source.c_str());
+                break;
+            }
+            if (feof(in))
+                action = LZMA_FINISH;
+        }
+
+        lzma_ret ret = lzma_code(&strm, action);
+        if (strm.avail_out == 0 || ret == LZMA_STREAM_END)
+        {
+            std::size_t size = outBuffer.size() - strm.avail_out;
+            if (fwrite(outBuffer.data(), 1, size, out) != size)
+            {
+                FTV_LOG_ERROR("write \"%s\" failed: %s\n", target.c_str(), strerror(errno));
+                break;
+            }
+            strm.next_out = outBuffer.data();
+            strm.avail_out = outBuffer.size();
+        }
+        if (ret == LZMA_STREAM_END)
+        {
+            result = true;
+            break;
+        }
+        if (ret != LZMA_OK)
+        {
+            FTV_LOG_ERROR("transcode \"%s\" failed: %d\n", source.c_str(), static_cast<int>(ret));
+            break;
+        }
+    }
+
+    fclose(in);
+    if (fflush(out) != 0 || fsync(fileno(out)) != 0)
+        result = false;
+    fclose(out);
+    return result;
+}
+
+bool TransactionShards::compress(const std::string &source, const std::string &target)
+{
+    lzma_stream strm = LZMA_STREAM_INIT;
+    if (lzma_easy_encoder(&strm, TRANSACTION_ARCHIVE_PRESET, LZMA_CHECK_CRC64) != LZMA_OK)
+    {
+        FTV_LOG_ERROR("xz encoder initialization failed\n");
+        return false;
+    }
+    bool result = transcode(strm, source, target);
+    lzma_end(&strm);
+    return result;
+}
+
+bool TransactionShards::decompress(const std::string &source, const std::string &target)
+{
+    lzma_stream strm = LZMA_STREAM_INIT;
+    if (lzma_stream_decoder(&strm, UINT64_MAX, 0) != LZMA_OK)
+    {
+        FTV_LOG_ERROR("xz decoder initialization failed\n");
+        return false;
+    }
+    bool result = transcode(strm, source, target);
+    lzma_end(&strm);
+    return result;
+}
+
+TransactionShards::TransactionShards(const std::string &basePath, const std::string &legacyPath) : basePath(basePath),
+                                                                                                 legacyPath(legacyPath),
+                                                                                                 scratches(),
+                                                                                                 scratchMtx()
+{
+    if (mkdir(this->basePath.c_str(), 0777) != 0 && errno != EEXIST)
+        FTV_LOG_ERROR("create directory \"%s\" failed: %s\n", this->basePath.c_str(), strerror(errno));
+}
+
+TransactionShards::~TransactionShards()
+{
+    for (const Scratch &scratch : this->scratches)
+        unlink(scratch.path.c_str());
+}
+
+bool TransactionShards::openScratch(const Shard &shard, std::string &path) const
+{
+    struct stat st;
+    const std::string archive = shard.path + TransactionShards::ARCHIVE_SUFFIX;
+    if (stat(archive.c_str(), &st) != 0)
+        return false;
+
+    path = shard.path + ".query";
+    std::vector<Scratch>::iterator it = std::find_if(this->scratches.begin(),
+                                                     this->scratches.end(),
+                                                     [&path](const Scratch &scratch)
+                                                     {
+                                                         return scratch.path == path;
+                                                     });
+    if (it != this->scratches.end())
+    {
+        /* still the same archive, the copy is reused and moved to the back */
+        Scratch scratch = *it;
+        this->scratches.erase(it);
+        if (scratch.mtime == st.st_mtime && scratch.size == st.st_size && isFile(path))
+        {
+            this->scratches.push_back(scratch);
+            return true;
+        }
+    }
+    else if (this->scratches.size() >= TRANSACTION_QUERY_CACHE_SIZE)
+    {
+        unlink(this->scratches.front().path.c_str());
+        this->scratches.erase(this->scratches.begin());
+    }
+
+    if (TransactionShards::decompress(archive, path) == false)
+    {
+        unlink(path.c_str());
+        return false;
+    }
+    Scratch scratch;
+    scratch.path = path;
+    scratch.mtime = st.st_mtime;
+    scratch.size = st.st_size;
+    this->scratches.push_back(scratch);
+    return true;
+}
+
+std::string TransactionShards::determinePath(const std::time_t time) const
+{
+    return Counter::determineConfigPath(this->basePath, time) + "/" + TransactionShards::FILE_NAME;
+}
+
+std::vector<TransactionShards::Shard> TransactionShards::list() const
+{
+    std::vector<Shard> result;
+    if (this->legacyPath.empty() == false)
+    {
+        Shard shard;
+        shard.cycle = 0;
+        shard.path = this->legacyPath;
+        shard.isArchived = (isFile(shard.path) == false);
+        if (shard.isArchived == false || isFile(shard.path + TransactionShards::ARCHIVE_SUFFIX))
+            result.push_back(shard);
+    }
+    for (const std::string &year : listDirectory(this->basePath))
+    {
+        std::string yearPath = this->basePath + "/" + year;
+        for (const std::string &month : listDirectory(yearPath))
+        {
+            std::string monthPath = yearPath + "/" + month;
+            for (const std::string &date : listDirectory(monthPath))
+            {
+                std::tm tmp{};
+                if (sscanf(date.c_str(), "%d-%d-%d", &tmp.tm_year, &tmp.tm_mon, &tmp.tm_mday) != 3)
+                    continue;
+                tmp.tm_year -= 1900;
+                tmp.tm_mon -= 1;
+                tmp.tm_isdst = -1;
+
+                Shard shard;
+                shard.cycle = Counter::Cycle(TimeUtils::toEpoch(&tmp)).getCycleTime();
+                shard.path = monthPath + "/" + date + "/" + TransactionShards::FILE_NAME;
+                shard.isArchived = (isFile(shard.path) == false);
+                if (shard.isArchived && isFile(shard.path + TransactionShards::ARCHIVE_SUFFIX) == false)
+                    continue;
+                result.push_back(shard);
+            }
+        }
+    }
+    std::sort(result.begin(),
+              result.end(),
+              [](const Shard &a, const Shard &b)
+              {
+                  return a.cycle < b.cycle;
+              });
+    return result;
+}
+
+bool TransactionShards::isUploaded(const std::string &path)
+{
+    sqlite3 *db = nullptr;
+    if (sqlite3_open_v2(path.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK)
+    {
+        sqlite3_close(db);
+        return false;
+    }
+
+    /* a shard without outbox has unknown upload state and is kept as it is */
+    bool result = false;
+    sqlite3_stmt *stmt = nullptr;
+    if (sqlite3_prepare_v2(db, TransactionStore::NEXT_BATCH_SQL, -1, &stmt, nullptr) == SQLITE_OK)
+    {
+        sqlite3_bind_int(stmt, 1, 1);
+        result = (sqlite3_step(stmt) == SQLITE_DONE);
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+    return result;
+}
+
+bool TransactionShards::archive(const Shard &shard) const
+{
+    if (shard.isArchived)
+        return true;
+
+    /* fold the WAL back first, the archive is the main file alone */
+    sqlite3 *db = nullptr;
+    if (sqlite3_open_v2(shard.path.c_str(), &db, SQLITE_OPEN_READWRITE, nullptr) != SQLITE_OK)
+    {
+        FTV_LOG_ERROR("open \"%s\" failed: %s\n", shard.path.c_str(), db ? sqlite3_errmsg(db) : "out of memory");
+        sqlite3_close(db);
+        return false;
+    }
+    bool isFolded = (pragma(db, "PRAGMA wal_checkpoint(TRUNCATE);") == "0" && pragma(db, "PRAGMA journal_mode=DELETE;") == "delete");
+    sqlite3_close(db);
+    if (isFolded == false)
+    {
+        FTV_LOG_WARNING("\"%s\" is still in use, not archived\n", shard.path.c_str());
+        return false;
+    }
+
+    std::string target = shard.path + TransactionShards::ARCHIVE_SUFFIX;
+    std::string temporary = target + ".tmp";
+    if (TransactionShards::compress(shard.path, temporary) == false || rename(temporary.c_str(), target.c_str()) != 0)
+    {
+        FTV_LOG_ERROR("archive \"%s\" failed\n", shard.path.c_str());
+        unlink(temporary.c_str());
+        return false;
+    }
+    unlink(shard.path.c_str());
+    unlink((shard.path + "-wal").c_str());
+    unlink((shard.path + "-shm").c_str());
+    FTV_LOG_INFO("\"%s\" archived\n", shard.path.c_str());
+    return true;
+}
+
+std::size_t TransactionShards::archiveUploaded(const std::time_t before, const std::string &busyPath) const
+{
+    std::size_t total = 0;
+    for (const Shard &shard : this->list())
+    {
+        if (shard.cycle >= before)
+            break;
+        if (shard.isArchived || shard.path == busyPath || TransactionShards::isUploaded(shard.path) == false)
+            continue;
+        if (this->archive(shard))
+            total++;
+    }
+    return total;
+}
+
+bool TransactionShards::query(const std::time_t from,
+                              const std::time_t to,
+                              std::function<bool(sqlite3 *db, const Shard &shard)> visitor) const
+{
+    bool result = true;
+    for (const Shard &shard : this->list())
+    {
+        if (shard.cycle < from)
+            continue;
+        if (shard.cycle > to)
+            break;
+
+        std::string path = shard.path;
+        std::unique_lock<std::mutex> guard(this->scratchMtx, std::defer_lock);
+        if (shard.isArchived)
+        {
+            /* held until the visitor is done, another query must not drop the copy it reads */
+            guard.lock();
+            if (this->openScratch(shard, path) == false)
+            {
+                result = false;
+                continue;
+            }
+        }
+
+        sqlite3 *db = nullptr;
+        bool isNext = true;
+        if (sqlite3_open_v2(path.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) == SQLITE_OK)
+        {
+            isNext = visitor(db, shard);
+        }
+        else
+        {
+            FTV_LOG_ERROR("open \"%s\" failed: %s\n", path.c_str(), db ? sqlite3_errmsg(db) : "out of memory");
+            result = false;
+        }
+        sqlite3_close(db);
+        if (isNext == false)
+            break;
+    }
+    return result;
+}
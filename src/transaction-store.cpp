@@ -0,0 +1,635 @@
+#include <cstring>
+#include <strings.h>
+#include <algorithm>
+#include "transaction-store.hpp"
+#include "transaction-shards.hpp"
+#include "counter.hpp"
+#include "sqlite3.h"
+#include "tscdata/include/transaction-data.hpp"
+#include "tscdata/include/sqlite3-transaction.hpp"
+
+#include "async-log.hpp"
+
+const char *TransactionStore::OUTBOX_TABLE = "upload_outbox";
+
+const char *TransactionStore::NEXT_BATCH_SQL = "SELECT id, source, source_rowid, counted, ctype, cycle FROM upload_outbox "
+                                               "WHERE id > (SELECT last_id FROM upload_cursor WHERE id = 0) "
+                                               "ORDER BY id LIMIT ?;";
+
+/* never moves back, a late acknowledgement of an older batch is a no-op */
+const char *TransactionStore::ADVANCE_CURSOR_SQL = "UPDATE upload_cursor SET last_id = ?1 WHERE id = 0 AND last_id < ?1;";
+
+const char *TransactionStore::READ_CURSOR_SQL = "SELECT last_id FROM upload_cursor WHERE id = 0;";
+
+/* ?1 cycle, ?2 cursor; served from upload_outbox_cycle alone, the rowid is part of every index entry */
+const char *TransactionStore::COUNT_CYCLE_SQL = "SELECT ctype, COUNT(*), SUM(id > ?2) "
+                                                "FROM upload_outbox INDEXED BY upload_outbox_cycle "
+                                                "WHERE cycle = ?1 AND counted = 1 "
+                                                "GROUP BY ctype;";
+
+TransactionStore::UploadTag::UploadTag() : isCounted(false),
+                                           ctype(0U),
+                                           cycle(0),
+                                           intent()
+{
+}
+
+TransactionStore::UploadTag::UploadTag(unsigned int ctype, std::time_t cycle) : isCounted(true),
+                                                                                ctype(ctype),
+                                                                                cycle(cycle),
+                                                                                intent()
+{
+}
+
+static std::string pragma(sqlite3 *db, const char *sql)
+{
+    std::string result;
+    sqlite3_stmt *stmt = nullptr;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        const unsigned char *text = sqlite3_column_text(stmt, 0);
+        result = text ? reinterpret_cast<const char *>(text) : "";
+    }
+    sqlite3_finalize(stmt);
+    return result;
+}
+
+std::mutex &TransactionStore::writeMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+bool TransactionStore::tune(sqlite3 *db, const std::string &path)
+{
+    /* kept in the file, the library's connection opens it in WAL mode too */
+    if (pragma(db, "PRAGMA journal_mode=WAL;") != "wal")
+        FTV_LOG_WARNING("\"%s\" is not in WAL mode\n", path.c_str());
+    /* a record is acknowledged and counted once committed, the commit has to survive a power cut */
+    TransactionStore::exec(db, "PRAGMA synchronous=FULL;");
+    /* the uploader writes the outbox from its own connection, wait for it instead of failing */
+    sqlite3_busy_timeout(db, 2000);
+
+    /* a fresh connection starts where the library's does, it never sets synchronous */
+    sqlite3 *probe = nullptr;
+    bool isLibraryFull = false;
+    if (sqlite3_open_v2(path.c_str(), &probe, SQLITE_OPEN_READONLY, nullptr) == SQLITE_OK &&
+        TransactionStore::exec(probe, "SELECT COUNT(*) FROM sqlite_master;"))
+        isLibraryFull = TransactionStore::isFullSync(probe);
+    sqlite3_close(probe);
+    if (isLibraryFull == false)
+        FTV_LOG_WARNING("insertLog() does not sync its commits on \"%s\"\n", path.c_str());
+    return (isLibraryFull && TransactionStore::isFullSync(db));
+}
+
+bool TransactionStore::exec(sqlite3 *db, const char *sql)
+{
+    char *err = nullptr;
+    if (sqlite3_exec(db, sql, nullptr, nullptr, &err) != SQLITE_OK)
+    {
+        FTV_LOG_ERROR("\"%s\" failed: %s\n", sql, err ? err : "unknown");
+        sqlite3_free(err);
+        return false;
+    }
+    return true;
+}
+
+TransactionStore::TransactionStore(const TransactionShards &shards) : shards(shards),
+                                                                     filePath(),
+                                                                     shardEnd(0),
+                                                                     db(),
+                                                                     handle(nullptr),
+                                                                     isSynchronous(false),
+                                                                     hasOutbox(false),
+                                                                     sources(),
+                                                                     queued(),
+                                                                     appliedStmt(nullptr),
+                                                                     mutex()
+{
+}
+
+TransactionStore::~TransactionStore()
+{
+    this->close();
+}
+
+bool TransactionStore::open()
+{
+    std::lock_guard<std::mutex> guard(this->mutex);
+    if (this->db.get())
+        return true;
+    return this->openShard(std::time(nullptr));
+}
+
+bool TransactionStore::openShard(const std::time_t time)
+{
+    Counter::Cycle cycle(time);
+    try
+    {
+        this->filePath = this->shards.determinePath(cycle.getCycleTime());
+    }
+    catch (const std::exception &e)
+    {
+        FTV_LOG_ERROR("no shard for %li: %s\n", static_cast<long>(time), e.what());
+        return false;
+    }
+    this->shardEnd = cycle.getNextCycleTime();
+
+    FTV_LOG_INFO("open transaction database \"%s\"\n", this->filePath.c_str());
+    std::lock_guard<std::mutex> writer(TransactionStore::writeMutex());
+    /* opened and tuned before the library's connection, which then finds the file in WAL mode */
+    if (sqlite3_open_v2(this->filePath.c_str(), &this->handle, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr) != SQLITE_OK)
+    {
+        FTV_LOG_ERROR("open transaction database failed: %s\n", this->handle ? sqlite3_errmsg(this->handle) : "out of memory");
+        sqlite3_close(this->handle);
+        this->handle = nullptr;
+        return false;
+    }
+    this->isSynchronous = TransactionStore::tune(this->handle, this->filePath);
+
+    try
+    {
+        this->db.reset(new Sqlite3Transaction(this->filePath));
+        this->db->createLog();
+    }
+    catch (const std::exception &e)
+    {
+        FTV_LOG_ERROR("open transaction database failed: %s\n", e.what());
+        this->closeShard();
+        return false;
+    }
+
+    if (this->prepareOutbox() == false)
+        FTV_LOG_WARNING("upload outbox is not available, records will not be uploaded\n");
+    return true;
+}
+
+bool TransactionStore::hasColumn(sqlite3 *db, const std::string &table, const char *column)
+{
+    std::string sql = "PRAGMA table_info(\"" + table + "\");";
+    sqlite3_stmt *stmt = nullptr;
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+        return false;
+    bool result = false;
+    while (result == false && sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        const char *name = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
+        result = (name != nullptr && strcasecmp(name, column) == 0);
+    }
+    sqlite3_finalize(stmt);
+    return result;
+}
+
+std::vector<std::string> TransactionStore::listSources(sqlite3 *db)
+{
+    /* every table but the store's own is written by the library */
+    std::vector<std::string> tables;
+    sqlite3_stmt *stmt = nullptr;
+    if (sqlite3_prepare_v2(db,
+                           "SELECT name FROM sqlite_master WHERE type = 'table' AND name NOT LIKE 'sqlite_%' "
+                           "AND name NOT IN ('upload_outbox', 'upload_cursor', 'intent_applied') ORDER BY name;",
+                           -1,
+                           &stmt,
+                           nullptr) != SQLITE_OK)
+    {
+        FTV_LOG_ERROR("list tables failed: %s\n", sqlite3_errmsg(db));
+        return tables;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        tables.push_back(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0)));
+    }
+    sqlite3_finalize(stmt);
+    return tables;
+}
+
+bool TransactionStore::catchUpOutbox(sqlite3 *db)
+{
+    /* the card type and cycle of these records are unknown, they are uploaded but not counted */
+    for (const std::string &table : TransactionStore::listSources(db))
+    {
+        std::string sql = "INSERT INTO upload_outbox (source, source_rowid, counted, ctype, cycle) "
+                          "SELECT ?1, rowid, 0, 0, 0 FROM \"" + table + "\" "
+                          "WHERE rowid > IFNULL((SELECT MAX(source_rowid) FROM upload_outbox WHERE source = ?1), 0) ORDER BY rowid;";
+        sqlite3_stmt *stmt = nullptr;
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+        {
+            /* WITHOUT ROWID tables are not written by the library */
+            FTV_LOG_WARNING("%s not queued for upload: %s\n", table.c_str(), sqlite3_errmsg(db));
+            continue;
+        }
+        sqlite3_bind_text(stmt, 1, table.c_str(), static_cast<int>(table.length()), SQLITE_STATIC);
+        int rc = sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+        if (rc != SQLITE_DONE)
+        {
+            FTV_LOG_ERROR("queue %s for upload failed: %s\n", table.c_str(), sqlite3_errmsg(db));
+            return false;
+        }
+        if (sqlite3_changes(db) > 0)
+            FTV_LOG_INFO("%d record(s) of %s without outbox row queued for upload\n", sqlite3_changes(db), table.c_str());
+    }
+    return true;
+}
+
+bool TransactionStore::createOutbox(sqlite3 *db)
+{
+    if (TransactionStore::exec(db, "BEGIN IMMEDIATE;") == false)
+        return false;
+
+    bool result = (TransactionStore::exec(db,
+                                          "CREATE TABLE IF NOT EXISTS upload_outbox ("
+                                          "id INTEGER PRIMARY KEY AUTOINCREMENT, "
+                                          "source TEXT NOT NULL, "
+                                          "source_rowid INTEGER NOT NULL, "
+                                          "counted INTEGER NOT NULL, "
+                                          "ctype INTEGER NOT NULL, "
+                                          "cycle INTEGER NOT NULL);") &&
+                   TransactionStore::exec(db, "CREATE INDEX IF NOT EXISTS upload_outbox_cycle ON upload_outbox (cycle, counted, ctype);") &&
+                   TransactionStore::exec(db, "CREATE INDEX IF NOT EXISTS upload_outbox_source ON upload_outbox (source, source_rowid);") &&
+                   TransactionStore::catchUpOutbox(db) &&
+                   TransactionStore::exec(db, "CREATE TABLE IF NOT EXISTS upload_cursor (id INTEGER PRIMARY KEY CHECK (id = 0), last_id INTEGER NOT NULL);") &&
+                   /* rows below the first id were deleted once sent by the previous outbox */
+                   TransactionStore::exec(db, "INSERT OR IGNORE INTO upload_cursor (id, last_id) SELECT 0, IFNULL(MIN(id) - 1, IFNULL((SELECT seq FROM sqlite_sequence WHERE name = 'upload_outbox'), 0)) FROM upload_outbox;"));
+
+    /* the catch-up and the cursor commit together, a failed catch-up is tried again on the next open */
+    if (TransactionStore::exec(db, result ? "COMMIT;" : "ROLLBACK;") == false)
+    {
+        TransactionStore::exec(db, "ROLLBACK;");
+        return false;
+    }
+    return result;
+}
+
+bool TransactionStore::prepareOutbox()
+{
+    if (TransactionStore::createOutbox(this->handle) == false)
+        return false;
+    this->hasOutbox = true;
+    this->loadSources();
+
+    if (TransactionStore::exec(this->handle, "CREATE TABLE IF NOT EXISTS intent_applied (uuid TEXT PRIMARY KEY) WITHOUT ROWID;") == false ||
+        sqlite3_prepare_v2(this->handle, "INSERT OR IGNORE INTO intent_applied (uuid) VALUES (?);", -1, &this->appliedStmt, nullptr) != SQLITE_OK)
+    {
+        /* records are still stored and uploaded, only a replayed intent may be written twice */
+        FTV_LOG_ERROR("prepare intent insert failed: %s\n", sqlite3_errmsg(this->handle));
+        sqlite3_finalize(this->appliedStmt);
+        this->appliedStmt = nullptr;
+    }
+    return true;
+}
+
+bool TransactionStore::loadSources()
+{
+    /* rows located since the last queue() are not in the outbox yet, keep their marks */
+    std::vector<Source> known;
+    known.swap(this->sources);
+    for (const std::string &table : TransactionStore::listSources(this->handle))
+    {
+        Source source;
+        source.table = table;
+        source.lastRowId = 0;
+        for (const Source &previous : known)
+        {
+            if (previous.table == table)
+                source.lastRowId = previous.lastRowId;
+        }
+        source.lastStmt = nullptr;
+        source.queueStmt = nullptr;
+
+        /* everything up to the last queued row is in the outbox, the catch-up saw to it */
+        std::string last = "SELECT MAX(rowid) FROM \"" + table + "\";";
+        std::string insert = "INSERT INTO upload_outbox (source, source_rowid, counted, ctype, cycle) "
+                             "SELECT ?1, rowid, ?2, ?3, ?4 FROM \"" + table + "\" WHERE rowid > ?5 AND rowid <= ?6 ORDER BY rowid;";
+        sqlite3_stmt *stmt = nullptr;
+        if (sqlite3_prepare_v2(this->handle, "SELECT IFNULL(MAX(source_rowid), 0) FROM upload_outbox WHERE source = ?;", -1, &stmt, nullptr) == SQLITE_OK)
+        {
+            sqlite3_bind_text(stmt, 1, table.c_str(), static_cast<int>(table.length()), SQLITE_STATIC);
+            if (sqlite3_step(stmt) == SQLITE_ROW)
+                source.lastRowId = std::max(source.lastRowId, static_cast<long long>(sqlite3_column_int64(stmt, 0)));
+        }
+        sqlite3_finalize(stmt);
+        if (sqlite3_prepare_v2(this->handle, last.c_str(), -1, &source.lastStmt, nullptr) != SQLITE_OK ||
+            sqlite3_prepare_v2(this->handle, insert.c_str(), -1, &source.queueStmt, nullptr) != SQLITE_OK)
+        {
+            /* WITHOUT ROWID tables are not written by the library */
+            FTV_LOG_WARNING("%s not queued for upload: %s\n", table.c_str(), sqlite3_errmsg(this->handle));
+            sqlite3_finalize(source.lastStmt);
+            sqlite3_finalize(source.queueStmt);
+            continue;
+        }
+        this->sources.push_back(source);
+    }
+    for (Source &previous : known)
+    {
+        sqlite3_finalize(previous.lastStmt);
+        sqlite3_finalize(previous.queueStmt);
+    }
+    return (this->sources.empty() == false);
+}
+
+void TransactionStore::closeSources()
+{
+    for (Source &source : this->sources)
+    {
+        sqlite3_finalize(source.lastStmt);
+        sqlite3_finalize(source.queueStmt);
+    }
+    this->sources.clear();
+}
+
+void TransactionStore::close()
+{
+    std::lock_guard<std::mutex> guard(this->mutex);
+    this->closeShard();
+}
+
+void TransactionStore::closeShard()
+{
+    if (this->appliedStmt)
+    {
+        sqlite3_finalize(this->appliedStmt);
+        this->appliedStmt = nullptr;
+    }
+    this->closeSources();
+    this->queued.clear();
+    this->hasOutbox = false;
+    this->db.reset();
+    if (this->handle)
+        sqlite3_close(this->handle);
+    this->handle = nullptr;
+    this->isSynchronous = false;
+}
+
+bool TransactionStore::rotate()
+{
+    if (this->db.get() && std::time(nullptr) < this->shardEnd)
+        return true;
+
+    /* first insert of a new cycle, or a previous rotation failed */
+    this->closeShard();
+    return this->openShard(std::time(nullptr));
+}
+
+bool TransactionStore::isOpen() const
+{
+    std::lock_guard<std::mutex> guard(this->mutex);
+    return (this->db.get() != nullptr);
+}
+
+bool TransactionStore::isDurable() const
+{
+    std::lock_guard<std::mutex> guard(this->mutex);
+    return this->isSynchronous;
+}
+
+bool TransactionStore::isFullSync(sqlite3 *db)
+{
+    /* FULL (2) or EXTRA (3): a WAL commit is synced before it returns */
+    sqlite3_stmt *stmt = nullptr;
+    bool result = false;
+    if (sqlite3_prepare_v2(db, "PRAGMA synchronous;", -1, &stmt, nullptr) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW)
+        result = (sqlite3_column_int(stmt, 0) >= 2);
+    sqlite3_finalize(stmt);
+    return result;
+}
+
+bool TransactionStore::countShard(sqlite3 *db, const std::time_t cycle, std::vector<UploadCount> &counts)
+{
+    sqlite3_stmt *cursor = nullptr;
+    sqlite3_stmt *stmt = nullptr;
+    if (sqlite3_prepare_v2(db, TransactionStore::READ_CURSOR_SQL, -1, &cursor, nullptr) != SQLITE_OK ||
+        sqlite3_prepare_v2(db, TransactionStore::COUNT_CYCLE_SQL, -1, &stmt, nullptr) != SQLITE_OK)
+    {
+        FTV_LOG_ERROR("prepare upload count failed: %s\n", sqlite3_errmsg(db));
+        sqlite3_finalize(cursor);
+        return false;
+    }
+
+    /* one read snapshot, the uploader may move the cursor meanwhile */
+    TransactionStore::exec(db, "BEGIN;");
+    int rc = sqlite3_step(cursor);
+    if (rc == SQLITE_ROW)
+    {
+        sqlite3_bind_int64(stmt, 1, static_cast<sqlite3_int64>(cycle));
+        sqlite3_bind_int64(stmt, 2, sqlite3_column_int64(cursor, 0));
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+        {
+            const unsigned int ctype = static_cast<unsigned int>(sqlite3_column_int(stmt, 0));
+            const unsigned int pending = static_cast<unsigned int>(sqlite3_column_int64(stmt, 2));
+            const unsigned int sent = static_cast<unsigned int>(sqlite3_column_int64(stmt, 1)) - pending;
+            std::vector<UploadCount>::iterator it = std::find_if(counts.begin(),
+                                                                 counts.end(),
+                                                                 [ctype](const UploadCount &count)
+                                                                 {
+                                                                     return count.ctype == ctype;
+                                                                 });
+            if (it == counts.end())
+                it = counts.insert(counts.end(), UploadCount{ctype, 0U, 0U});
+            it->pending += pending;
+            it->sent += sent;
+        }
+    }
+    TransactionStore::exec(db, "COMMIT;");
+    sqlite3_finalize(cursor);
+    sqlite3_finalize(stmt);
+    return (rc == SQLITE_DONE);
+}
+
+bool TransactionStore::countUploads(const std::time_t cycle, std::vector<UploadCount> &counts) const
+{
+    counts.clear();
+    /* records committed just after midnight sit in the next shard with the cycle of their tap */
+    bool result = true;
+    bool isFound = this->shards.query(cycle,
+                                      Counter::Cycle(cycle).getNextCycleTime(),
+                                      [cycle, &counts, &result](sqlite3 *db, const TransactionShards::Shard &shard)
+                                      {
+                                          (void)shard;
+                                          result = TransactionStore::countShard(db, cycle, counts) && result;
+                                          return true;
+                                      });
+    return (isFound && result);
+}
+
+bool TransactionStore::findIntent(sqlite3 *db, const std::string &uuid)
+{
+    /* shards written before the journal have no intent_applied table */
+    sqlite3_stmt *stmt = nullptr;
+    bool result = false;
+    if (sqlite3_prepare_v2(db, "SELECT 1 FROM intent_applied WHERE uuid = ?;", -1, &stmt, nullptr) == SQLITE_OK)
+    {
+        sqlite3_bind_text(stmt, 1, uuid.c_str(), static_cast<int>(uuid.length()), SQLITE_STATIC);
+        result = (sqlite3_step(stmt) == SQLITE_ROW);
+    }
+    sqlite3_finalize(stmt);
+
+    /* a power cut between the library's commit and the store's leaves the record without
+     * its intent row; it carries the intent UUID, a full scan only runs on recovery */
+    for (const std::string &table : TransactionStore::listSources(db))
+    {
+        if (result)
+            break;
+        if (TransactionStore::hasColumn(db, table, "uuid") == false)
+            continue;
+        std::string sql = "SELECT 1 FROM \"" + table + "\" WHERE uuid = ? LIMIT 1;";
+        stmt = nullptr;
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) == SQLITE_OK)
+        {
+            sqlite3_bind_text(stmt, 1, uuid.c_str(), static_cast<int>(uuid.length()), SQLITE_STATIC);
+            result = (sqlite3_step(stmt) == SQLITE_ROW);
+        }
+        sqlite3_finalize(stmt);
+    }
+    return result;
+}
+
+bool TransactionStore::isApplied(const std::string &intent, const std::time_t since) const
+{
+    /* the record went into the shard of the day it was committed: the day of the tap, the
+     * next one past midnight, or today's when an older intent was replayed by a later start */
+    bool result = false;
+    std::function<bool(sqlite3 *, const TransactionShards::Shard &)> visitor =
+        [&intent, &result](sqlite3 *db, const TransactionShards::Shard &shard)
+        {
+            (void)shard;
+            result = TransactionStore::findIntent(db, intent);
+            return (result == false);
+        };
+    const Counter::Cycle cycle(since);
+    this->shards.query(cycle.getCycleTime(), cycle.getNextCycleTime(), visitor);
+    const std::time_t today = Counter::Cycle(std::time(nullptr)).getCycleTime();
+    if (result == false && today > cycle.getNextCycleTime())
+        this->shards.query(today, today, visitor);
+    return result;
+}
+
+bool TransactionStore::locate(Queued &entry)
+{
+    for (int round = 0; round < 2; round++)
+    {
+        for (std::size_t i = 0; i < this->sources.size(); i++)
+        {
+            Source &source = this->sources[i];
+            long long last = 0;
+            if (sqlite3_step(source.lastStmt) == SQLITE_ROW)
+                last = sqlite3_column_int64(source.lastStmt, 0);
+            sqlite3_reset(source.lastStmt);
+            if (last <= source.lastRowId)
+                continue;
+            entry.source = i;
+            entry.from = source.lastRowId;
+            entry.to = last;
+            source.lastRowId = last;
+            return true;
+        }
+        /* the library may have created a table on this insert */
+        if (round == 0)
+            this->loadSources();
+    }
+    return false;
+}
+
+bool TransactionStore::insertLocked(const TransactionData &tsc, const UploadTag &tag)
+{
+    if (this->db->insertLog(tsc) != 0)
+        return false;
+    if (this->hasOutbox == false)
+        return true;
+
+    Queued entry;
+    entry.tag = &tag;
+    if (this->locate(entry))
+        this->queued.push_back(entry);
+    else
+        /* caught up with on the next open, uncounted */
+        FTV_LOG_WARNING("inserted record not found, not queued for upload\n");
+    return true;
+}
+
+bool TransactionStore::queue()
+{
+    if (this->queued.empty())
+        return true;
+
+    /* the outbox and intent rows of every record inserted since commit together */
+    bool result = TransactionStore::exec(this->handle, "BEGIN IMMEDIATE;");
+    for (const Queued &entry : this->queued)
+    {
+        if (result == false)
+            break;
+        const UploadTag &tag = *entry.tag;
+        if (this->appliedStmt && tag.intent.empty() == false)
+        {
+            sqlite3_bind_text(this->appliedStmt, 1, tag.intent.c_str(), static_cast<int>(tag.intent.length()), SQLITE_STATIC);
+            if (sqlite3_step(this->appliedStmt) != SQLITE_DONE)
+                FTV_LOG_ERROR("mark intent %s applied failed: %s\n", tag.intent.c_str(), sqlite3_errmsg(this->handle));
+            sqlite3_reset(this->appliedStmt);
+            sqlite3_clear_bindings(this->appliedStmt);
+        }
+
+        const Source &source = this->sources[entry.source];
+        sqlite3_bind_text(source.queueStmt, 1, source.table.c_str(), static_cast<int>(source.table.length()), SQLITE_STATIC);
+        sqlite3_bind_int(source.queueStmt, 2, tag.isCounted ? 1 : 0);
+        sqlite3_bind_int(source.queueStmt, 3, static_cast<int>(tag.ctype));
+        sqlite3_bind_int64(source.queueStmt, 4, static_cast<sqlite3_int64>(tag.cycle));
+        sqlite3_bind_int64(source.queueStmt, 5, entry.from);
+        sqlite3_bind_int64(source.queueStmt, 6, entry.to);
+        result = (sqlite3_step(source.queueStmt) == SQLITE_DONE);
+        sqlite3_reset(source.queueStmt);
+        sqlite3_clear_bindings(source.queueStmt);
+    }
+    if (result)
+        result = TransactionStore::exec(this->handle, "COMMIT;");
+    if (result == false)
+    {
+        /* the records themselves are kept, the next open queues them uncounted */
+        FTV_LOG_ERROR("queue %zu record(s) for upload failed: %s\n", this->queued.size(), sqlite3_errmsg(this->handle));
+        TransactionStore::exec(this->handle, "ROLLBACK;");
+    }
+    this->queued.clear();
+    return result;
+}
+
+bool TransactionStore::insert(const TransactionData &tsc, const UploadTag &tag)
+{
+    std::lock_guard<std::mutex> guard(this->mutex);
+    if (this->rotate() == false)
+    {
+        FTV_LOG_ERROR("transaction database is not open\n");
+        return false;
+    }
+
+    std::lock_guard<std::mutex> writer(TransactionStore::writeMutex());
+    bool result = this->insertLocked(tsc, tag);
+    this->queue();
+    return result;
+}
+
+std::size_t TransactionStore::insert(const std::vector<const TransactionData *> &records,
+                                     const std::vector<UploadTag> &tags,
+                                     std::vector<bool> &committed)
+{
+    std::lock_guard<std::mutex> guard(this->mutex);
+    committed.assign(records.size(), false);
+    if (this->rotate() == false)
+    {
+        FTV_LOG_ERROR("transaction database is not open\n");
+        return 0;
+    }
+
+    /* every record commits on its own in the library, only the outbox rows share a transaction */
+    const UploadTag untagged;
+    std::lock_guard<std::mutex> writer(TransactionStore::writeMutex());
+    std::size_t total = 0;
+    for (std::size_t i = 0; i < records.size(); i++)
+    {
+        if (this->insertLocked(*records[i], i < tags.size() ? tags[i] : untagged))
+        {
+            committed[i] = true;
+            total++;
+        }
+    }
+    this->queue();
+    return total;
+}
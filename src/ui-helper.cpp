@@ -1,404 +1,399 @@
 #include <thread>
 #include <algorithm>
+#include <cstdio>
 #include "ui-helper.hpp"
 #include "counter.hpp"
-#include "gui/include/gui.hpp"
+#include "gui-state.hpp"
 
-bool UIHelper::isStateProcessing = false;
+std::atomic<bool> UIHelper::isStateProcessing(false);
+std::atomic<unsigned int> UIHelper::processingSeq(0U);
 std::mutex UIHelper::mtx;
+std::mutex UIHelper::animationMtx;
+std::condition_variable UIHelper::animationChanged;
+std::unique_ptr<std::thread> UIHelper::animationThread;
+bool UIHelper::isAnimationRun(false);
 
-std::string formatRupiah(unsigned int value, const std::string &pre = "")
+void UIHelper::beginAnimation(GuiState &view)
 {
-    std::string number = std::to_string(value);
-    std::string formatted;
+    /* one worker for the controller lifetime, nothing is spawned per tap */
+    std::lock_guard<std::mutex> guard(UIHelper::animationMtx);
+    if (UIHelper::animationThread.get())
+        return;
+    UIHelper::isAnimationRun = true;
+    UIHelper::animationThread.reset(new std::thread(UIHelper::animationRoutine, std::ref(view)));
+}
 
-    int count = 0;
-    for (int i = number.length() - 1; i >= 0; --i)
+void UIHelper::stopAnimation()
+{
+    std::unique_ptr<std::thread> th;
     {
-        formatted.insert(formatted.begin(), number[i]);
-        count++;
-
-        if (count % 3 == 0 && i != 0)
-        {
-            formatted.insert(formatted.begin(), '.');
-        }
+        std::lock_guard<std::mutex> guard(UIHelper::animationMtx);
+        UIHelper::isAnimationRun = false;
+        th.swap(UIHelper::animationThread);
     }
-    if (pre.empty())
-        return "RP " + formatted;
-    return pre + " RP " + formatted;
+    UIHelper::animationChanged.notify_all();
+    if (th.get())
+        th->join();
 }
 
-std::string formatDate(std::time_t time, const std::string &pre = "")
+void UIHelper::reset(GuiState &view, unsigned int amount)
 {
-    char dte[32]{};
-    std::tm tmtmp{};
-
-    localtime_r(&time, &tmtmp);
-    snprintf(dte,
-             sizeof(dte) - 1,
-             "%02d-%02d-%02d",
-             tmtmp.tm_mday,
-             tmtmp.tm_mon + 1,
-             (tmtmp.tm_year + 1900) % 100);
-
-    if (pre.empty())
-        return std::string(dte);
-    return pre + " " + std::string(dte);
+    std::lock_guard<std::mutex> guard(UIHelper::mtx);
+    UIHelper::isStateProcessing = false;
+    view.setTariff(amount, "Tarif");
+    view.hideStatus();
+    view.hideCardNumber();
+    view.hideBalance();
+    view.hideMessage();
 }
 
-void UIHelper::reset(Gui &gui, unsigned int amount)
+void UIHelper::updateCounter(GuiState &view, const Counter *counter)
 {
-    std::lock_guard<std::mutex> guard(UIHelper::mtx);
-    UIHelper::isStateProcessing = false;
-    gui.labelTariff.setRupiah(amount, "Tarif");
-    gui.labelStatus.hide();
-    gui.labelCardNumber.hide();
-    gui.labelBalance.hide();
-    gui.message.hide();
+    if (counter == nullptr)
+        return;
+
+    /* read the counters outside of the view lock */
+    const Counter::Snapshot snapshot = counter->snapshot();
+
+    view.setCounters(snapshot.total.tapInRegular,
+                     snapshot.total.tapInEconomy,
+                     snapshot.total.tapInFreeService,
+                     snapshot.total.tapOut,
+                     snapshot.total.pending,
+                     snapshot.total.sent);
 }
 
-void UIHelper::updateCounter(Gui &gui, const Counter *counter)
+void UIHelper::animationRoutine(GuiState &view)
 {
-    std::lock_guard<std::mutex> guard(UIHelper::mtx);
-    if (counter)
+    static const std::size_t MAX_DOTS = 3;
+    unsigned int seq = 0U;
+    std::size_t dots = 0;
+    bool isAnimating = false;
+
+    for (;;)
     {
-        gui.transactionCounter.setTapInRegularCounter(counter->getTotalTapInRegular());
-        gui.transactionCounter.setTapInEconomicalCounter(counter->getTotalTapInEconomy());
-        gui.transactionCounter.setTapInFreeCounter(counter->getTotalTapInFreeService());
-        gui.transactionCounter.setTapOutCounter(counter->getTotalTapOut());
-        gui.transactionPendingSummary.setPendingCounter(counter->getTotalPending());
-        gui.transactionPendingSummary.setSentCounter(counter->getTotalSent());
+        {
+            /* processingCard raises the flag under animationMtx, the wakeup cannot be lost */
+            std::unique_lock<std::mutex> lock(UIHelper::animationMtx);
+            if (UIHelper::isStateProcessing.load(std::memory_order_acquire) == false)
+                isAnimating = false;
+            UIHelper::animationChanged.wait(
+                lock,
+                []()
+                {
+                    return UIHelper::isAnimationRun == false || UIHelper::isStateProcessing.load(std::memory_order_acquire);
+                });
+            if (UIHelper::isAnimationRun == false)
+                return;
+        }
+
+        unsigned int current = UIHelper::processingSeq.load(std::memory_order_acquire);
+        if (isAnimating == false || current != seq)
+        {
+            /* a new card, processingCard already drew the first frame */
+            isAnimating = true;
+            seq = current;
+            dots = 0;
+        }
+        else
+        {
+            std::lock_guard<std::mutex> guard(UIHelper::mtx);
+            /* a result screen may have landed while sleeping, never draw over it */
+            if (UIHelper::isStateProcessing.load(std::memory_order_relaxed) &&
+                UIHelper::processingSeq.load(std::memory_order_relaxed) == seq)
+            {
+                dots = (dots >= MAX_DOTS) ? 0 : dots + 1;
+                view.setStatus(std::string("Sedang diproses") + std::string(dots, '.'));
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(125));
     }
 }
 
-void UIHelper::processingCard(Gui &gui)
+void UIHelper::processingCard(GuiState &view)
 {
     {
         std::lock_guard<std::mutex> guard(UIHelper::mtx);
-        UIHelper::isStateProcessing = true;
-    }
-    std::thread(
-        [&gui]()
+        UIHelper::processingSeq.fetch_add(1U, std::memory_order_relaxed);
         {
-            std::string message = "Sedang diproses";
-            gui.labelStatus.setText(message, true);
-            for (;;)
-            {
-                {
-                    std::lock_guard<std::mutex> guard(UIHelper::mtx);
-                    if (UIHelper::isStateProcessing == false)
-                    {
-                        break;
-                    }
-                    gui.labelStatus.setText(message);
-                    if (message.length() == 18)
-                        message = "Sedang diproses";
-                    else
-                        message += ".";
-                }
-                std::this_thread::sleep_for(std::chrono::milliseconds(125));
-            }
-        })
-        .detach();
+            std::lock_guard<std::mutex> wake(UIHelper::animationMtx);
+            UIHelper::isStateProcessing.store(true, std::memory_order_release);
+        }
+        view.setStatus("Sedang diproses", true);
+    }
+    UIHelper::animationChanged.notify_one();
 }
 
-void UIHelper::successTapInWithDeduct(Gui &gui, unsigned int amount, unsigned int baseAmount, unsigned int balance, UIHelper::TariffType type, std::time_t exp)
+static const ScreenTemplate &byTariff(UIHelper::TariffType type, const ScreenTemplate &regular, const ScreenTemplate &jaklingko, const ScreenTemplate &free)
 {
-    std::lock_guard<std::mutex> guard(UIHelper::mtx);
-    UIHelper::isStateProcessing = false;
     switch (type)
     {
-    case UIHelper::TariffType::REGULER:
-        gui.message.show(
-            {formatRupiah(baseAmount, "TARIF REGULAR"),
-             "TAP-IN SUKSES",
-             " ",
-             formatRupiah(amount, "TERPOTONG"),
-             formatRupiah(balance, "SALDO ANDA")});
-        break;
     case UIHelper::TariffType::JAKLINGKO:
-        gui.message.show(
-            {formatRupiah(baseAmount, "TARIF REGULAR"),
-             "TAP-IN SUKSES JAKLINGKO",
-             " ",
-             formatRupiah(amount, "TERPOTONG"),
-             formatRupiah(balance, "SALDO ANDA")});
-        break;
+        return jaklingko;
     case UIHelper::TariffType::FREE:
-        gui.message.show(
-            {"TAP-IN SUKSES",
-             formatDate(exp, "BERLAKU s/d"),
-             "LAYANAN GRATIS",
-             "PEMPROV DKI JAKARTA",
-             " "});
-        break;
+        return free;
     default:
-        gui.message.show(
-            {formatRupiah(baseAmount, "TARIF REGULAR"),
-             "TAP-IN SUKSES",
-             " ",
-             formatRupiah(amount, "TERPOTONG"),
-             formatRupiah(balance, "SALDO ANDA")});
         break;
     }
+    return regular;
 }
 
-void UIHelper::successTapOutWithoutDeduct(Gui &gui, unsigned int balance, UIHelper::TariffType type, std::time_t exp)
+void UIHelper::show(GuiState &view, const ScreenTemplate &screen, const ScreenTemplate::Values &values)
 {
+    ScreenTemplate::Frame frame;
+    screen.render(values, frame);
+    view.showMessage(frame);
+}
+
+void UIHelper::successTapInWithDeduct(GuiState &view, unsigned int amount, unsigned int baseAmount, unsigned int balance, UIHelper::TariffType type, std::time_t exp)
+{
+    static const ScreenTemplate regular({"TARIF REGULAR", ScreenTemplate::Field::BASE_AMOUNT},
+                                        "TAP-IN SUKSES",
+                                        " ",
+                                        {"TERPOTONG", ScreenTemplate::Field::AMOUNT},
+                                        {"SALDO ANDA", ScreenTemplate::Field::BALANCE});
+    static const ScreenTemplate jaklingko({"TARIF REGULAR", ScreenTemplate::Field::BASE_AMOUNT},
+                                          "TAP-IN SUKSES JAKLINGKO",
+                                          " ",
+                                          {"TERPOTONG", ScreenTemplate::Field::AMOUNT},
+                                          {"SALDO ANDA", ScreenTemplate::Field::BALANCE});
+    static const ScreenTemplate free("TAP-IN SUKSES",
+                                     {"BERLAKU s/d", ScreenTemplate::Field::EXPIRE_DATE},
+                                     "LAYANAN GRATIS",
+                                     "PEMPROV DKI JAKARTA",
+                                     " ");
+
+    ScreenTemplate::Values values;
+    values.amount = amount;
+    values.baseAmount = baseAmount;
+    values.balance = balance;
+    values.expire = exp;
+
     std::lock_guard<std::mutex> guard(UIHelper::mtx);
     UIHelper::isStateProcessing = false;
-    switch (type)
-    {
-    case UIHelper::TariffType::REGULER:
-        gui.message.show(
-            {"TAP-OUT SUKSES",
-             " ",
-             "TIDAK TERPOTONG",
-             formatRupiah(balance, "SISA SALDO"),
-             " "});
-        break;
-    case UIHelper::TariffType::FREE:
-        gui.message.show(
-            {"TAP-OUT SUKSES",
-             formatDate(exp, "BERLAKU s/d"),
-             "TIDAK TERPOTONG",
-             formatRupiah(balance, "SISA SALDO"),
-             " "});
-        break;
-    case UIHelper::TariffType::JAKLINGKO:
-        gui.message.show(
-            {"TAP-OUT SUKSES",
-             "JAKLINGKO",
-             "TIDAK TERPOTONG",
-             formatRupiah(balance, "SISA SALDO"),
-             " "});
-        break;
-    default:
-        gui.message.show(
-            {"TAP-OUT SUKSES",
-             " ",
-             "TIDAK TERPOTONG",
-             formatRupiah(balance, "SISA SALDO"),
-             " "});
-        break;
-    }
+    UIHelper::show(view, byTariff(type, regular, jaklingko, free), values);
 }
 
-void UIHelper::successTapOutWithDeduct(Gui &gui, unsigned int amount, unsigned int baseAmount, unsigned int balance, UIHelper::TariffType type, std::time_t exp)
+void UIHelper::successTapOutWithoutDeduct(GuiState &view, unsigned int balance, UIHelper::TariffType type, std::time_t exp)
 {
+    static const ScreenTemplate regular("TAP-OUT SUKSES",
+                                        " ",
+                                        "TIDAK TERPOTONG",
+                                        {"SISA SALDO", ScreenTemplate::Field::BALANCE},
+                                        " ");
+    static const ScreenTemplate jaklingko("TAP-OUT SUKSES",
+                                          "JAKLINGKO",
+                                          "TIDAK TERPOTONG",
+                                          {"SISA SALDO", ScreenTemplate::Field::BALANCE},
+                                          " ");
+    static const ScreenTemplate free("TAP-OUT SUKSES",
+                                     {"BERLAKU s/d", ScreenTemplate::Field::EXPIRE_DATE},
+                                     "TIDAK TERPOTONG",
+                                     {"SISA SALDO", ScreenTemplate::Field::BALANCE},
+                                     " ");
+
+    ScreenTemplate::Values values;
+    values.balance = balance;
+    values.expire = exp;
+
     std::lock_guard<std::mutex> guard(UIHelper::mtx);
     UIHelper::isStateProcessing = false;
-    switch (type)
-    {
-    case UIHelper::TariffType::REGULER:
-        gui.message.show(
-            {formatRupiah(baseAmount, "TARIF REGULAR"),
-             "TAP-OUT SUKSES",
-             " ",
-             formatRupiah(amount, "TERPOTONG"),
-             formatRupiah(balance, "SALDO ANDA")});
-        break;
-    case UIHelper::TariffType::JAKLINGKO:
-        gui.message.show(
-            {formatRupiah(baseAmount, "TARIF REGULAR"),
-             "TAP-OUT SUKSES JAKLINGKO",
-             " ",
-             formatRupiah(amount, "TERPOTONG"),
-             formatRupiah(balance, "SALDO ANDA")});
-        break;
-    case UIHelper::TariffType::FREE:
-        gui.message.show(
-            {"TAP-OUT SUKSES",
-             formatDate(exp, "BERLAKU s/d"),
-             "LAYANAN GRATIS",
-             "PEMPROV DKI JAKARTA",
-             " "});
-        break;
-    default:
-        gui.message.show(
-            {formatRupiah(baseAmount, "TARIF REGULAR"),
-             "TAP-OUT SUKSES",
-             " ",
-             formatRupiah(amount, "TERPOTONG"),
-             formatRupiah(balance, "SALDO ANDA")});
-        break;
-    }
+    UIHelper::show(view, byTariff(type, regular, jaklingko, free), values);
 }
 
-void UIHelper::successTapInWithoutDeduct(Gui &gui, unsigned int balance, UIHelper::TariffType type, std::time_t exp)
+void UIHelper::successTapOutWithDeduct(GuiState &view, unsigned int amount, unsigned int baseAmount, unsigned int balance, UIHelper::TariffType type, std::time_t exp)
 {
+    static const ScreenTemplate regular({"TARIF REGULAR", ScreenTemplate::Field::BASE_AMOUNT},
+                                        "TAP-OUT SUKSES",
+                                        " ",
+                                        {"TERPOTONG", ScreenTemplate::Field::AMOUNT},
+                                        {"SALDO ANDA", ScreenTemplate::Field::BALANCE});
+    static const ScreenTemplate jaklingko({"TARIF REGULAR", ScreenTemplate::Field::BASE_AMOUNT},
+                                          "TAP-OUT SUKSES JAKLINGKO",
+                                          " ",
+                                          {"TERPOTONG", ScreenTemplate::Field::AMOUNT},
+                                          {"SALDO ANDA", ScreenTemplate::Field::BALANCE});
+    static const ScreenTemplate free("TAP-OUT SUKSES",
+                                     {"BERLAKU s/d", ScreenTemplate::Field::EXPIRE_DATE},
+                                     "LAYANAN GRATIS",
+                                     "PEMPROV DKI JAKARTA",
+                                     " ");
+
+    ScreenTemplate::Values values;
+    values.amount = amount;
+    values.baseAmount = baseAmount;
+    values.balance = balance;
+    values.expire = exp;
+
     std::lock_guard<std::mutex> guard(UIHelper::mtx);
     UIHelper::isStateProcessing = false;
-    switch (type)
-    {
-    case UIHelper::TariffType::REGULER:
-        gui.message.show(
-            {"TAP-IN SUKSES",
-             " ",
-             "TIDAK TERPOTONG",
-             formatRupiah(balance, "SISA SALDO"),
-             " "});
-        break;
-    case UIHelper::TariffType::FREE:
-        gui.message.show(
-            {"TAP-IN SUKSES",
-             formatDate(exp, "BERLAKU s/d"),
-             "TIDAK TERPOTONG",
-             formatRupiah(balance, "SISA SALDO"),
-             " "});
-        break;
-    case UIHelper::TariffType::JAKLINGKO:
-        gui.message.show(
-            {"TAP-IN SUKSES",
-             "JAKLINGKO",
-             "TIDAK TERPOTONG",
-             formatRupiah(balance, "SISA SALDO"),
-             " "});
-        break;
-    default:
-        gui.message.show(
-            {"TAP-IN SUKSES",
-             " ",
-             "TIDAK TERPOTONG",
-             formatRupiah(balance, "SISA SALDO"),
-             " "});
-        break;
-    }
+    UIHelper::show(view, byTariff(type, regular, jaklingko, free), values);
 }
 
-void UIHelper::successResetTapIn(Gui &gui, unsigned int amount, unsigned int baseAmount, unsigned int balance, UIHelper::TariffType type, std::time_t exp)
+void UIHelper::successTapInWithoutDeduct(GuiState &view, unsigned int balance, UIHelper::TariffType type, std::time_t exp)
 {
+    static const ScreenTemplate regular("TAP-IN SUKSES",
+                                        " ",
+                                        "TIDAK TERPOTONG",
+                                        {"SISA SALDO", ScreenTemplate::Field::BALANCE},
+                                        " ");
+    static const ScreenTemplate jaklingko("TAP-IN SUKSES",
+                                          "JAKLINGKO",
+                                          "TIDAK TERPOTONG",
+                                          {"SISA SALDO", ScreenTemplate::Field::BALANCE},
+                                          " ");
+    static const ScreenTemplate free("TAP-IN SUKSES",
+                                     {"BERLAKU s/d", ScreenTemplate::Field::EXPIRE_DATE},
+                                     "TIDAK TERPOTONG",
+                                     {"SISA SALDO", ScreenTemplate::Field::BALANCE},
+                                     " ");
+
+    ScreenTemplate::Values values;
+    values.balance = balance;
+    values.expire = exp;
+
     std::lock_guard<std::mutex> guard(UIHelper::mtx);
     UIHelper::isStateProcessing = false;
-    switch (type)
-    {
-    case UIHelper::TariffType::REGULER:
-        gui.message.show(
-            {formatRupiah(baseAmount, "TARIF REGULAR"),
-             "RESET + TAP-IN SUKSES",
-             " ",
-             formatRupiah(amount, "TERPOTONG"),
-             formatRupiah(balance, "SALDO ANDA")});
-        break;
-    case UIHelper::TariffType::JAKLINGKO:
-        gui.message.show(
-            {formatRupiah(baseAmount, "TARIF REGULAR"),
-             "RESET + TAP-IN SUKSES JAKLINGKO",
-             " ",
-             formatRupiah(amount, "TERPOTONG"),
-             formatRupiah(balance, "SALDO ANDA")});
-        break;
-    case UIHelper::TariffType::FREE:
-        gui.message.show(
-            {"RESET + TAP-IN SUKSES",
-             formatDate(exp, "BERLAKU s/d"),
-             "LAYANAN GRATIS",
-             "PEMPROV DKI JAKARTA",
-             " "});
-        break;
-    default:
-        gui.message.show(
-            {formatRupiah(baseAmount, "TARIF REGULAR"),
-             "RESET + TAP-IN SUKSES",
-             " ",
-             formatRupiah(amount, "TERPOTONG"),
-             formatRupiah(balance, "SALDO ANDA")});
-        break;
-    }
+    UIHelper::show(view, byTariff(type, regular, jaklingko, free), values);
+}
+
+void UIHelper::successResetTapIn(GuiState &view, unsigned int amount, unsigned int baseAmount, unsigned int balance, UIHelper::TariffType type, std::time_t exp)
+{
+    static const ScreenTemplate regular({"TARIF REGULAR", ScreenTemplate::Field::BASE_AMOUNT},
+                                        "RESET + TAP-IN SUKSES",
+                                        " ",
+                                        {"TERPOTONG", ScreenTemplate::Field::AMOUNT},
+                                        {"SALDO ANDA", ScreenTemplate::Field::BALANCE});
+    static const ScreenTemplate jaklingko({"TARIF REGULAR", ScreenTemplate::Field::BASE_AMOUNT},
+                                          "RESET + TAP-IN SUKSES JAKLINGKO",
+                                          " ",
+                                          {"TERPOTONG", ScreenTemplate::Field::AMOUNT},
+                                          {"SALDO ANDA", ScreenTemplate::Field::BALANCE});
+    static const ScreenTemplate free("RESET + TAP-IN SUKSES",
+                                     {"BERLAKU s/d", ScreenTemplate::Field::EXPIRE_DATE},
+                                     "LAYANAN GRATIS",
+                                     "PEMPROV DKI JAKARTA",
+                                     " ");
+
+    ScreenTemplate::Values values;
+    values.amount = amount;
+    values.baseAmount = baseAmount;
+    values.balance = balance;
+    values.expire = exp;
+
+    std::lock_guard<std::mutex> guard(UIHelper::mtx);
+    UIHelper::isStateProcessing = false;
+    UIHelper::show(view, byTariff(type, regular, jaklingko, free), values);
+}
+
+/* read, write and deduct failures share one screen */
+static const ScreenTemplate &cardProblemScreen()
+{
+    static const ScreenTemplate screen("MASALAH",
+                                       "PADA KARTU",
+                                       " ",
+                                       " ",
+                                       {"", ScreenTemplate::Field::ERROR});
+    return screen;
 }
 
-void UIHelper::failedToReadCard(Gui &gui, const std::string &err)
+void UIHelper::failedToReadCard(GuiState &view, const char *err)
 {
+    ScreenTemplate::Values values;
+    values.error = err;
+
     std::lock_guard<std::mutex> guard(UIHelper::mtx);
     UIHelper::isStateProcessing = false;
-    gui.message.show(
-        {"MASALAH",
-         "PADA KARTU",
-         " ",
-         " ",
-         err});
+    UIHelper::show(view, cardProblemScreen(), values);
 }
 
-void UIHelper::failedToWriteCard(Gui &gui, const std::string &err)
+void UIHelper::failedToWriteCard(GuiState &view, const char *err)
 {
+    ScreenTemplate::Values values;
+    values.error = err;
+
     std::lock_guard<std::mutex> guard(UIHelper::mtx);
     UIHelper::isStateProcessing = false;
-    gui.message.show(
-        {"MASALAH",
-         "PADA KARTU",
-         " ",
-         " ",
-         err});
+    UIHelper::show(view, cardProblemScreen(), values);
 }
 
-void UIHelper::failedToDeductCard(Gui &gui, const std::string &err)
+void UIHelper::failedToDeductCard(GuiState &view, const char *err)
 {
+    ScreenTemplate::Values values;
+    values.error = err;
+
     std::lock_guard<std::mutex> guard(UIHelper::mtx);
     UIHelper::isStateProcessing = false;
-    gui.message.show(
-        {"MASALAH",
-         "PADA KARTU",
-         " ",
-         " ",
-         err});
+    UIHelper::show(view, cardProblemScreen(), values);
 }
 
-void UIHelper::insufficientBalance(Gui &gui, unsigned int balance)
+void UIHelper::insufficientBalance(GuiState &view, unsigned int balance)
 {
+    static const ScreenTemplate screen("SALDO KURANG",
+                                       "SILAHKAN ISI SALDO",
+                                       " ",
+                                       " ",
+                                       "TERIMA KASIH");
+
     std::lock_guard<std::mutex> guard(UIHelper::mtx);
     UIHelper::isStateProcessing = false;
-    gui.message.show(
-        {"SALDO KURANG",
-         "SILAHKAN ISI SALDO",
-         " ",
-         " ",
-         "TERIMA KASIH"});
+    UIHelper::show(view, screen, ScreenTemplate::Values());
 }
 
-void UIHelper::blockingTime(Gui &gui)
+void UIHelper::blockingTime(GuiState &view)
 {
+    static const ScreenTemplate screen("KARTU SUDAH DI",
+                                       "GUNAKAN",
+                                       "SILAHKAN TUNGGU",
+                                       "ATAU NAIK BERIKUTNYA",
+                                       "");
+
     std::lock_guard<std::mutex> guard(UIHelper::mtx);
     UIHelper::isStateProcessing = false;
-    gui.message.show(
-        {"KARTU SUDAH DI",
-         "GUNAKAN",
-         "SILAHKAN TUNGGU",
-         "ATAU NAIK BERIKUTNYA",
-         ""});
+    UIHelper::show(view, screen, ScreenTemplate::Values());
 }
 
-void UIHelper::freeServiceExpired(Gui &gui, std::time_t exp)
+void UIHelper::freeServiceExpired(GuiState &view, std::time_t exp)
 {
+    static const ScreenTemplate screen("KARTU HABIS MASA",
+                                       {"BERLAKU s/d", ScreenTemplate::Field::EXPIRE_DATE},
+                                       " ",
+                                       "LAKUKAN PERPANJANGAN",
+                                       "");
+
+    ScreenTemplate::Values values;
+    values.expire = exp;
+
     std::lock_guard<std::mutex> guard(UIHelper::mtx);
     UIHelper::isStateProcessing = false;
-    gui.message.show(
-        {"KARTU HABIS MASA",
-         formatDate(exp, "BERLAKU s/d"),
-         " ",
-         "LAKUKAN PERPANJANGAN",
-         ""});
+    UIHelper::show(view, screen, values);
 }
 
-void UIHelper::fareNotFound(Gui &gui)
+void UIHelper::fareNotFound(GuiState &view)
 {
+    static const ScreenTemplate screen("TARIF",
+                                       " ",
+                                       "TIDAK",
+                                       "DITEMUKAN",
+                                       "");
+
     std::lock_guard<std::mutex> guard(UIHelper::mtx);
     UIHelper::isStateProcessing = false;
-    gui.message.show(
-        {"TARIF",
-         " ",
-         "TIDAK",
-         "DITEMUKAN",
-         ""});
+    UIHelper::show(view, screen, ScreenTemplate::Values());
 }
 
-void UIHelper::insufficientMinimumBalance(Gui &gui, unsigned int balance)
+void UIHelper::insufficientMinimumBalance(GuiState &view, unsigned int balance)
 {
+    static const ScreenTemplate screen("SALDO MINIMUM KURANG",
+                                       {"SALDO ANDA", ScreenTemplate::Field::BALANCE},
+                                       " ",
+                                       "SILAHKAN ISI SALDO",
+                                       "TERIMA KASIH");
+
+    ScreenTemplate::Values values;
+    values.balance = balance;
+
     std::lock_guard<std::mutex> guard(UIHelper::mtx);
     UIHelper::isStateProcessing = false;
-    gui.message.show(
-        {"SALDO MINIMUM KURANG",
-         formatRupiah(balance, "SALDO ANDA"),
-         " ",
-         "SILAHKAN ISI SALDO",
-         "TERIMA KASIH"});
-}
\ No newline at end of file
+    UIHelper::show(view, screen, values);
+}
@@ -0,0 +1,519 @@
+#include <fstream>
+#include <algorithm>
+#include <map>
+#include <utility>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <curl/curl.h>
+#include "uploader.hpp"
+#include "transaction-store.hpp"
+#include "transaction-shards.hpp"
+#include "counter.hpp"
+#include "sqlite3.h"
+#include "lzma.h"
+
+#include "async-log.hpp"
+#include "utils/include/nlohmann/json.hpp"
+
+/* first retry delay, doubled on every failure up to Config::backoffMax */
+#define UPLOADER_BACKOFF_MIN_S 5
+/* how often an idle uploader looks for shards to archive */
+#define UPLOADER_ARCHIVE_INTERVAL_S 3600
+/* preset 1 encodes with about 10 MB, the default preset needs close to 100 MB */
+#define UPLOADER_XZ_PRESET 1
+
+static std::once_flag curlInitialized;
+
+static int abortOnStop(void *ctx, curl_off_t dlTotal, curl_off_t dlNow, curl_off_t ulTotal, curl_off_t ulNow)
+{
+    (void)dlTotal;
+    (void)dlNow;
+    (void)ulTotal;
+    (void)ulNow;
+    const std::atomic<bool> *isRun = static_cast<const std::atomic<bool> *>(ctx);
+    /* a throttled transfer can last long, do not hold shutdown for it */
+    return isRun->load() ? 0 : 1;
+}
+
+static std::size_t discardResponse(char *data, std::size_t size, std::size_t count, void *ctx)
+{
+    (void)data;
+    (void)ctx;
+    return size * count;
+}
+
+Uploader::Config::Config() : url(),
+                             batchSize(50),
+                             interval(5000),
+                             timeout(15),
+                             backoffMax(300),
+                             maxBytesPerSecond(16384UL),
+                             archiveAfterDays(7U)
+{
+}
+
+bool Uploader::Config::load(const std::string &filePath)
+{
+    std::ifstream file(filePath);
+    if (file.is_open() == false)
+    {
+        FTV_LOG_INFO("no %s, uploader disabled\n", filePath.c_str());
+        return false;
+    }
+
+    try
+    {
+        nlohmann::json j;
+        file >> j;
+        if (!j.is_object())
+            throw std::runtime_error("not a JSON object");
+
+        this->url = j.value("url", std::string());
+        this->batchSize = j.value("batch_size", this->batchSize);
+        this->interval = std::chrono::milliseconds(j.value("interval_ms", static_cast<long long>(this->interval.count())));
+        this->timeout = std::chrono::seconds(j.value("timeout_s", static_cast<long long>(this->timeout.count())));
+        this->backoffMax = std::chrono::seconds(j.value("backoff_max_s", static_cast<long long>(this->backoffMax.count())));
+        this->maxBytesPerSecond = j.value("max_bytes_per_s", this->maxBytesPerSecond);
+        this->archiveAfterDays = j.value("archive_after_days", this->archiveAfterDays);
+    }
+    catch (const std::exception &e)
+    {
+        FTV_LOG_ERROR("import \"%s\" failed: %s\n", filePath.c_str(), e.what());
+        return false;
+    }
+
+    if (this->url.empty())
+    {
+        FTV_LOG_WARNING("no url in %s, uploader disabled\n", filePath.c_str());
+        return false;
+    }
+    if (this->batchSize == 0)
+        this->batchSize = 1;
+    if (this->archiveAfterDays == 0)
+        /* the shard of the current cycle is never archived */
+        this->archiveAfterDays = 1;
+    if (this->backoffMax.count() < UPLOADER_BACKOFF_MIN_S)
+        this->backoffMax = std::chrono::seconds(UPLOADER_BACKOFF_MIN_S);
+    return true;
+}
+
+Uploader::Uploader(const TransactionShards &shards, const Config &config, SentCallback onSent) : isRun(false),
+                                                                                                 shards(shards),
+                                                                                                 config(config),
+                                                                                                 onSent(onSent),
+                                                                                                 db(nullptr),
+                                                                                                 shardPath(),
+                                                                                                 shardCycle(0),
+                                                                                                 outboxStmt(nullptr),
+                                                                                                 sourceStmt(nullptr),
+                                                                                                 sourceTable(),
+                                                                                                 curl(nullptr),
+                                                                                                 headers(nullptr),
+                                                                                                 lastArchive(),
+                                                                                                 th(),
+                                                                                                 mutex(),
+                                                                                                 wake()
+{
+}
+
+Uploader::~Uploader()
+{
+    this->stop();
+}
+
+bool Uploader::openShard(const std::string &path, const std::time_t cycle)
+{
+    if (sqlite3_open_v2(path.c_str(), &this->db, SQLITE_OPEN_READWRITE, nullptr) != SQLITE_OK)
+    {
+        FTV_LOG_ERROR("open %s failed: %s\n", path.c_str(), this->db ? sqlite3_errmsg(this->db) : "out of memory");
+        this->closeDatabase();
+        return false;
+    }
+    /* the persistence worker has priority, wait for its commit instead of failing */
+    sqlite3_busy_timeout(this->db, 2000);
+
+    /* a database written before the outbox (the legacy transaction.db) gets it here, backfilled */
+    std::unique_lock<std::mutex> writer(TransactionStore::writeMutex());
+    const bool hasOutbox = TransactionStore::createOutbox(this->db);
+    writer.unlock();
+    if (hasOutbox == false)
+    {
+        FTV_LOG_ERROR("no upload outbox in %s\n", path.c_str());
+        this->closeDatabase();
+        return false;
+    }
+
+    if (sqlite3_prepare_v2(this->db, TransactionStore::NEXT_BATCH_SQL, -1, &this->outboxStmt, nullptr) != SQLITE_OK)
+    {
+        FTV_LOG_ERROR("prepare outbox select failed: %s\n", sqlite3_errmsg(this->db));
+        this->closeDatabase();
+        return false;
+    }
+    this->shardPath = path;
+    this->shardCycle = cycle;
+    return true;
+}
+
+bool Uploader::hasPending()
+{
+    sqlite3_bind_int(this->outboxStmt, 1, 1);
+    bool result = (sqlite3_step(this->outboxStmt) == SQLITE_ROW);
+    sqlite3_reset(this->outboxStmt);
+    return result;
+}
+
+bool Uploader::openDatabase()
+{
+    if (this->db)
+        return true;
+
+    /* oldest first, records of one shard are acknowledged in id order */
+    std::vector<TransactionShards::Shard> list = this->shards.list();
+    const TransactionShards::Shard *latest = nullptr;
+    for (const TransactionShards::Shard &shard : list)
+    {
+        if (shard.isArchived)
+            continue;
+        latest = &shard;
+        if (this->openShard(shard.path, shard.cycle) == false)
+            continue;
+        if (this->hasPending())
+            return true;
+        this->closeDatabase();
+    }
+    /* everything is uploaded, wait on the newest shard */
+    return (latest != nullptr && this->openShard(latest->path, latest->cycle));
+}
+
+void Uploader::closeDatabase()
+{
+    if (this->sourceStmt)
+        sqlite3_finalize(this->sourceStmt);
+    if (this->outboxStmt)
+        sqlite3_finalize(this->outboxStmt);
+    if (this->db)
+        sqlite3_close(this->db);
+    this->sourceStmt = nullptr;
+    this->outboxStmt = nullptr;
+    this->sourceTable.clear();
+    this->shardPath.clear();
+    this->shardCycle = 0;
+    this->db = nullptr;
+}
+
+bool Uploader::openConnection()
+{
+    if (this->curl)
+        return true;
+
+    std::call_once(curlInitialized,
+                   []()
+                   {
+                       curl_global_init(CURL_GLOBAL_DEFAULT);
+                   });
+
+    CURL *handle = curl_easy_init();
+    if (handle == nullptr)
+    {
+        FTV_LOG_ERROR("curl handle creation failed\n");
+        return false;
+    }
+
+    this->headers = curl_slist_append(this->headers, "Content-Type: application/json");
+    this->headers = curl_slist_append(this->headers, "Content-Encoding: xz");
+
+    /* one handle for the whole run, libcurl keeps the connection alive between batches */
+    curl_easy_setopt(handle, CURLOPT_URL, this->config.url.c_str());
+    curl_easy_setopt(handle, CURLOPT_HTTPHEADER, this->headers);
+    curl_easy_setopt(handle, CURLOPT_POST, 1L);
+    curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(handle, CURLOPT_TIMEOUT, static_cast<long>(this->config.timeout.count()));
+    curl_easy_setopt(handle, CURLOPT_MAX_SEND_SPEED_LARGE, static_cast<curl_off_t>(this->config.maxBytesPerSecond));
+    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, &discardResponse);
+    curl_easy_setopt(handle, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(handle, CURLOPT_XFERINFOFUNCTION, &abortOnStop);
+    curl_easy_setopt(handle, CURLOPT_XFERINFODATA, &this->isRun);
+    this->curl = handle;
+    return true;
+}
+
+void Uploader::closeConnection()
+{
+    if (this->curl)
+        curl_easy_cleanup(static_cast<CURL *>(this->curl));
+    if (this->headers)
+        curl_slist_free_all(this->headers);
+    this->curl = nullptr;
+    this->headers = nullptr;
+}
+
+bool Uploader::appendRecord(const std::string &table, long long rowid, std::string &payload)
+{
+    if (this->sourceStmt == nullptr || this->sourceTable != table)
+    {
+        if (this->sourceStmt)
+            sqlite3_finalize(this->sourceStmt);
+        this->sourceStmt = nullptr;
+        this->sourceTable.clear();
+
+        std::string sql = "SELECT * FROM \"" + table + "\" WHERE rowid = ?;";
+        if (sqlite3_prepare_v2(this->db, sql.c_str(), -1, &this->sourceStmt, nullptr) != SQLITE_OK)
+        {
+            FTV_LOG_ERROR("prepare select on %s failed: %s\n", table.c_str(), sqlite3_errmsg(this->db));
+            this->sourceStmt = nullptr;
+            return false;
+        }
+        this->sourceTable = table;
+    }
+
+    sqlite3_bind_int64(this->sourceStmt, 1, rowid);
+    bool found = (sqlite3_step(this->sourceStmt) == SQLITE_ROW);
+    if (found)
+    {
+        /* columns are sent as the library stored them, the back office maps the names */
+        nlohmann::json row = nlohmann::json::object();
+        const int columns = sqlite3_column_count(this->sourceStmt);
+        for (int i = 0; i < columns; i++)
+        {
+            const char *name = sqlite3_column_name(this->sourceStmt, i);
+            switch (sqlite3_column_type(this->sourceStmt, i))
+            {
+            case SQLITE_INTEGER:
+                row[name] = static_cast<long long>(sqlite3_column_int64(this->sourceStmt, i));
+                break;
+            case SQLITE_FLOAT:
+                row[name] = sqlite3_column_double(this->sourceStmt, i);
+                break;
+            case SQLITE_TEXT:
+                row[name] = std::string(reinterpret_cast<const char *>(sqlite3_column_text(this->sourceStmt, i)),
+                                        static_cast<std::size_t>(sqlite3_column_bytes(this->sourceStmt, i)));
+                break;
+            default:
+                row[name] = nullptr;
+                break;
+            }
+        }
+        payload.append(payload.size() > 1 ? "," : "");
+        payload.append(row.dump());
+    }
+    sqlite3_reset(this->sourceStmt);
+    sqlite3_clear_bindings(this->sourceStmt);
+    return found;
+}
+
+bool Uploader::readBatch(std::vector<Pending> &batch, std::string &payload)
+{
+    batch.clear();
+    payload.assign("[");
+
+    sqlite3_bind_int64(this->outboxStmt, 1, static_cast<sqlite3_int64>(this->config.batchSize));
+    int rc = SQLITE_ROW;
+    while ((rc = sqlite3_step(this->outboxStmt)) == SQLITE_ROW)
+    {
+        Pending pending;
+        pending.id = sqlite3_column_int64(this->outboxStmt, 0);
+        const char *source = reinterpret_cast<const char *>(sqlite3_column_text(this->outboxStmt, 1));
+        long long rowid = sqlite3_column_int64(this->outboxStmt, 2);
+        pending.isCounted = (sqlite3_column_int(this->outboxStmt, 3) != 0);
+        pending.ctype = static_cast<unsigned int>(sqlite3_column_int(this->outboxStmt, 4));
+        pending.cycle = static_cast<std::time_t>(sqlite3_column_int64(this->outboxStmt, 5));
+
+        if (source == nullptr || this->appendRecord(source, rowid, payload) == false)
+        {
+            /* nothing left to send for it, the cursor still moves past it */
+            FTV_LOG_WARNING("outbox %lli: record %lli not found\n", pending.id, rowid);
+            pending.isCounted = false;
+        }
+        batch.push_back(pending);
+    }
+    sqlite3_reset(this->outboxStmt);
+    payload.append("]");
+
+    if (rc != SQLITE_DONE)
+    {
+        FTV_LOG_ERROR("read outbox failed: %s\n", sqlite3_errmsg(this->db));
+        batch.clear();
+        return false;
+    }
+    return true;
+}
+
+bool Uploader::compress(const std::string &payload, std::vector<uint8_t> &body)
+{
+    body.resize(lzma_stream_buffer_bound(payload.size()));
+    std::size_t written = 0;
+    lzma_ret ret = lzma_easy_buffer_encode(UPLOADER_XZ_PRESET,
+                                           LZMA_CHECK_CRC32,
+                                           nullptr,
+                                           reinterpret_cast<const uint8_t *>(payload.data()),
+                                           payload.size(),
+                                           body.data(),
+                                           &written,
+                                           body.size());
+    if (ret != LZMA_OK)
+    {
+        FTV_LOG_ERROR("compress %zu byte(s) failed: %d\n", payload.size(), static_cast<int>(ret));
+        return false;
+    }
+    body.resize(written);
+    return true;
+}
+
+bool Uploader::post(const std::vector<uint8_t> &body)
+{
+    CURL *handle = static_cast<CURL *>(this->curl);
+    curl_easy_setopt(handle, CURLOPT_POSTFIELDS, body.data());
+    curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE_LARGE, static_cast<curl_off_t>(body.size()));
+
+    CURLcode rc = curl_easy_perform(handle);
+    if (rc != CURLE_OK)
+    {
+        FTV_LOG_WARNING("upload failed: %s\n", curl_easy_strerror(rc));
+        return false;
+    }
+
+    long status = 0;
+    curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &status);
+    if (status < 200 || status >= 300)
+    {
+        FTV_LOG_WARNING("upload rejected with HTTP %li\n", status);
+        return false;
+    }
+    return true;
+}
+
+bool Uploader::markSent(long long lastId)
+{
+    sqlite3_stmt *stmt = nullptr;
+    if (sqlite3_prepare_v2(this->db, TransactionStore::ADVANCE_CURSOR_SQL, -1, &stmt, nullptr) != SQLITE_OK)
+    {
+        FTV_LOG_ERROR("prepare cursor update failed: %s\n", sqlite3_errmsg(this->db));
+        return false;
+    }
+    sqlite3_bind_int64(stmt, 1, lastId);
+    std::unique_lock<std::mutex> writer(TransactionStore::writeMutex());
+    bool result = (sqlite3_step(stmt) == SQLITE_DONE);
+    writer.unlock();
+    if (result == false)
+        /* the back office deduplicates by UUID, the batch is simply sent again */
+        FTV_LOG_ERROR("move upload cursor to %lli failed: %s\n", lastId, sqlite3_errmsg(this->db));
+    sqlite3_finalize(stmt);
+    return result;
+}
+
+void Uploader::report(const std::vector<Pending> &batch)
+{
+    if (!this->onSent)
+        return;
+
+    std::map<std::pair<unsigned int, std::time_t>, unsigned int> counts;
+    for (const Pending &pending : batch)
+    {
+        if (pending.isCounted)
+            counts[std::make_pair(pending.ctype, pending.cycle)]++;
+    }
+    for (const std::pair<const std::pair<unsigned int, std::time_t>, unsigned int> &item : counts)
+    {
+        this->onSent(item.first.first, item.first.second, item.second);
+    }
+}
+
+void Uploader::archive()
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (this->lastArchive != std::chrono::steady_clock::time_point() &&
+        now - this->lastArchive < std::chrono::seconds(UPLOADER_ARCHIVE_INTERVAL_S))
+        return;
+    this->lastArchive = now;
+
+    std::time_t before = Counter::Cycle().getCycleTime() - static_cast<std::time_t>(this->config.archiveAfterDays) * 86400;
+    std::size_t total = this->shards.archiveUploaded(before, this->shardPath);
+    if (total > 0)
+        FTV_LOG_INFO("%zu shard(s) archived\n", total);
+}
+
+void Uploader::routine()
+{
+    /* uploads only drain a backlog, they must never delay a tap */
+    setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19);
+
+    std::vector<Pending> batch;
+    std::string payload;
+    std::vector<uint8_t> body;
+    std::chrono::milliseconds delay(0);
+    std::chrono::seconds backoff(0);
+    batch.reserve(this->config.batchSize);
+
+    while (this->isRun)
+    {
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->wake.wait_for(lock,
+                                delay,
+                                [this]()
+                                {
+                                    return (this->isRun == false);
+                                });
+        }
+        if (this->isRun == false)
+            break;
+
+        bool isDone = false;
+        if (this->openDatabase() && this->openConnection() && this->readBatch(batch, payload))
+        {
+            if (batch.empty())
+            {
+                backoff = std::chrono::seconds(0);
+                delay = this->config.interval;
+                if (this->shardCycle != Counter::Cycle().getCycleTime())
+                    /* drained a past shard, look for the next one */
+                    this->closeDatabase();
+                this->archive();
+                continue;
+            }
+            isDone = (this->compress(payload, body) && this->post(body) && this->markSent(batch.back().id));
+        }
+
+        if (isDone)
+        {
+            FTV_LOG_INFO("uploaded %zu record(s), %zu byte(s)\n", batch.size(), body.size());
+            this->report(batch);
+            backoff = std::chrono::seconds(0);
+            /* a full batch means more are waiting, keep draining */
+            delay = (batch.size() < this->config.batchSize) ? this->config.interval : std::chrono::milliseconds(0);
+        }
+        else
+        {
+            backoff = (backoff.count() == 0) ? std::chrono::seconds(UPLOADER_BACKOFF_MIN_S) : std::min(backoff * 2, this->config.backoffMax);
+            delay = backoff;
+            FTV_LOG_WARNING("retry upload in %lli s\n", static_cast<long long>(backoff.count()));
+        }
+    }
+
+    this->closeConnection();
+    this->closeDatabase();
+}
+
+void Uploader::begin()
+{
+    std::lock_guard<std::mutex> guard(this->mutex);
+    if (this->th.get())
+        return;
+    this->isRun = true;
+    this->th.reset(new std::thread(&Uploader::routine, this));
+}
+
+void Uploader::stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(this->mutex);
+        if (this->th.get() == nullptr)
+            return;
+        this->isRun = false;
+    }
+    this->wake.notify_all();
+    this->th->join();
+    this->th.reset();
+}
@@ -0,0 +1,84 @@
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <functional>
+#include "uuid.hpp"
+
+/* (unix_ts_ms << 12) | counter of the last identifier handed out */
+static std::atomic<uint64_t> lastTimestamp(0ULL);
+
+uint64_t UUIDv7::nextTimestamp()
+{
+    uint64_t nowMs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                               std::chrono::system_clock::now().time_since_epoch())
+                                               .count());
+    uint64_t candidate = (nowMs & 0xFFFFFFFFFFFFULL) << 12;
+    uint64_t last = lastTimestamp.load(std::memory_order_relaxed);
+    uint64_t next = 0ULL;
+    do
+    {
+        /* a full counter spills into the millisecond field, order is kept */
+        next = (candidate > last) ? candidate : last + 1ULL;
+    } while (lastTimestamp.compare_exchange_weak(last, next, std::memory_order_relaxed) == false);
+    return next;
+}
+
+uint64_t UUIDv7::random()
+{
+    /* xorshift64* seeded once per thread */
+    static thread_local uint64_t state = 0ULL;
+    if (state == 0ULL)
+    {
+        std::random_device rd;
+        state = (static_cast<uint64_t>(rd()) << 32) ^ static_cast<uint64_t>(rd()) ^
+                static_cast<uint64_t>(std::hash<std::thread::id>()(std::this_thread::get_id())) ^
+                static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+        if (state == 0ULL)
+            state = 0x9E3779B97F4A7C15ULL;
+    }
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1DULL;
+}
+
+static char *hex(char *out, uint64_t value, int digits)
+{
+    static const char table[] = "0123456789abcdef";
+    for (int i = digits - 1; i >= 0; i--)
+    {
+        out[i] = table[value & 0x0FULL];
+        value >>= 4;
+    }
+    return out + digits;
+}
+
+void UUIDv7::format(char (&out)[STRING_LENGTH + 1], uint64_t timestamp, uint64_t random, uint64_t tail)
+{
+    /* ms-ver|counter-variant|rand-rand-rand, the 12-4-4-4-12 layout */
+    char *pos = hex(out, timestamp >> 12, 12);
+    *pos++ = '-';
+    pos = hex(pos, 0x7000ULL | (timestamp & 0x0FFFULL), 4);
+    *pos++ = '-';
+    pos = hex(pos, 0x8000ULL | (tail & 0x3FFFULL), 4);
+    *pos++ = '-';
+    pos = hex(pos, random >> 48, 4);
+    *pos++ = '-';
+    pos = hex(pos, random & 0xFFFFFFFFFFFFULL, 12);
+    *pos = 0x00;
+}
+
+void UUIDv7::generate(char (&out)[STRING_LENGTH + 1])
+{
+    uint64_t ts = UUIDv7::nextTimestamp();
+    uint64_t random = UUIDv7::random();
+    UUIDv7::format(out, ts, random, UUIDv7::random());
+}
+
+std::string UUIDv7::generate()
+{
+    char out[STRING_LENGTH + 1];
+    UUIDv7::generate(out);
+    return std::string(out, STRING_LENGTH);
+}